@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2015 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "dump_stream.h"
+
+#define DUMP_ZBUF_SZ	(256 * 1024)
+
+static int write_all(int fd, const unsigned char *buf, size_t len)
+{
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = write(fd, buf, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		buf += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+/* dump_stream_can_compress - Whether gzip compression is built in */
+int dump_stream_can_compress(void)
+{
+#ifdef WITH_ZLIB
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/* dump_stream_open - Start writing a dump
+ * @ds - stream to set up
+ * @fd - file descriptor of the dump file
+ * @level - zlib compression level 1-9, or 0 to write the dump as is
+ *
+ * Returns 0 on success, -1 with errno set on failure; ENOTSUP if
+ * compression was asked for but is not built in.
+ */
+int dump_stream_open(struct dump_stream *ds, int fd, int level)
+{
+	memset(ds, 0, sizeof(*ds));
+	ds->fd = fd;
+	clock_gettime(CLOCK_MONOTONIC, &ds->start);
+
+	if (level == 0)
+		return 0;
+
+#ifdef WITH_ZLIB
+	{
+		z_stream *zs;
+
+		zs = calloc(1, sizeof(*zs));
+		ds->zbuf = malloc(DUMP_ZBUF_SZ);
+		if (zs == NULL || ds->zbuf == NULL) {
+			free(zs);
+			free(ds->zbuf);
+			ds->zbuf = NULL;
+			errno = ENOMEM;
+			return -1;
+		}
+
+		/* 15 + 16: largest window, gzip header and trailer */
+		if (deflateInit2(zs, level, Z_DEFLATED, 15 + 16, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK) {
+			free(zs);
+			free(ds->zbuf);
+			ds->zbuf = NULL;
+			errno = ENOMEM;
+			return -1;
+		}
+
+		ds->zs = zs;
+		ds->level = level;
+		return 0;
+	}
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+#ifdef WITH_ZLIB
+static int deflate_out(struct dump_stream *ds, int flush)
+{
+	z_stream *zs = ds->zs;
+	size_t len;
+	int rc;
+
+	do {
+		zs->next_out = ds->zbuf;
+		zs->avail_out = DUMP_ZBUF_SZ;
+
+		rc = deflate(zs, flush);
+		if (rc == Z_STREAM_ERROR) {
+			errno = EIO;
+			return -1;
+		}
+
+		len = DUMP_ZBUF_SZ - zs->avail_out;
+		if (write_all(ds->fd, ds->zbuf, len))
+			return -1;
+		ds->out_bytes += len;
+	} while (zs->avail_out == 0);
+
+	return 0;
+}
+#endif
+
+/* dump_stream_write - Append the next part of a dump
+ *
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int dump_stream_write(struct dump_stream *ds, const void *buf, size_t len)
+{
+	ds->in_bytes += len;
+
+#ifdef WITH_ZLIB
+	if (ds->zs) {
+		z_stream *zs = ds->zs;
+
+		zs->next_in = (unsigned char *)buf;
+		zs->avail_in = len;
+		return deflate_out(ds, Z_NO_FLUSH);
+	}
+#endif
+
+	if (write_all(ds->fd, buf, len))
+		return -1;
+	ds->out_bytes += len;
+
+	return 0;
+}
+
+/* dump_stream_close - Finish writing a dump
+ *
+ * Flushes the compressed stream and frees it; the file descriptor is
+ * left open for the caller to sync and close.
+ *
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int dump_stream_close(struct dump_stream *ds)
+{
+	int rc = 0;
+
+#ifdef WITH_ZLIB
+	if (ds->zs) {
+		z_stream *zs = ds->zs;
+
+		zs->next_in = NULL;
+		zs->avail_in = 0;
+		rc = deflate_out(ds, Z_FINISH);
+
+		deflateEnd(zs);
+		free(zs);
+		ds->zs = NULL;
+	}
+#endif
+	free(ds->zbuf);
+	ds->zbuf = NULL;
+
+	return rc;
+}
+
+/* dump_stream_secs - Seconds since the dump was opened */
+double dump_stream_secs(struct dump_stream *ds)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - ds->start.tv_sec) +
+	       (now.tv_nsec - ds->start.tv_nsec) / 1e9;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2015 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef DUMP_STREAM_H
+#define DUMP_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/* Suffix of platform dumps saved gzip compressed */
+#define DUMP_COMPRESS_SUFFIX	".gz"
+
+/*
+ * Writes a platform dump to a file as it is retrieved, optionally gzip
+ * compressing it on the way, so that no copy of the whole dump is ever
+ * held in memory.
+ */
+struct dump_stream {
+	int		fd;
+	int		level;		/* zlib level, 0 = not compressed */
+	void		*zs;		/* z_stream */
+	unsigned char	*zbuf;
+	uint64_t	in_bytes;
+	uint64_t	out_bytes;
+	struct timespec	start;
+};
+
+int	dump_stream_open(struct dump_stream *, int, int);
+int	dump_stream_write(struct dump_stream *, const void *, size_t);
+int	dump_stream_close(struct dump_stream *);
+double	dump_stream_secs(struct dump_stream *);
+int	dump_stream_can_compress(void);
+
+#endif
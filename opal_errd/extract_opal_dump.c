@@ -36,11 +36,14 @@
 #include <syslog.h>
 #include <libgen.h>
 #include "platform.c"
+#include "dump_stream.h"
 
 #define DEFAULT_SYSFS_PATH	"/sys"
 #define DEFAULT_DUMP_PATH	"firmware/opal/dump"
 #define DEFAULT_OUTPUT_DIR	"/var/log/dump"
 #define DUMP_TYPE_LEN		7
+#define DUMP_READ_CHUNK		(256 * 1024)
+#define DEFAULT_COMPRESS_LEVEL	1
 
 /* Retention policy : default maximum dumps of each type */
 #define DEFAULT_MAX_DUMP	4
@@ -48,6 +51,7 @@
 int opt_ack_dump = 1;
 int opt_wait = 0;
 int opt_max_dump = DEFAULT_MAX_DUMP;
+int opt_compress = 0;
 
 char *opt_sysfs = DEFAULT_SYSFS_PATH;
 char *opt_output_dir = DEFAULT_OUTPUT_DIR;
@@ -64,6 +68,9 @@ static void help(const char* argv0)
 	fprintf(stderr, "-m max - maximum number of dumps of a specific type"
 		" to be saved\n");
 	fprintf(stderr, "-w     - wait for a dump\n");
+	if (dump_stream_can_compress())
+		fprintf(stderr, "-z     - gzip compress dumps as they are "
+			"saved\n");
 	fprintf(stderr, "-h     - help (this message)\n");
 }
 
@@ -122,12 +129,13 @@ static void ack_dump(const char* dump_dir_path)
 /**
  * Check for duplicate file
  */
-static void check_dup_dump_file(char *dumpname)
+static void remove_dup_dump_file(char *dumpname, const char *suffix)
 {
 	char dump_path[PATH_MAX];
 	int rc;
 
-	rc = snprintf(dump_path, PATH_MAX, "%s/%s", opt_output_dir, dumpname);
+	rc = snprintf(dump_path, PATH_MAX, "%s/%s%s", opt_output_dir,
+		      dumpname, suffix);
 	if (rc >= PATH_MAX) {
 		syslog(LOG_NOTICE, "Path to dump file (%s) is too big",
 		       dumpname);
@@ -144,6 +152,13 @@ static void check_dup_dump_file(char *dumpname)
 		       dump_path, strerror(errno));
 }
 
+/* The same dump may have been saved before, compressed or not */
+static void check_dup_dump_file(char *dumpname)
+{
+	remove_dup_dump_file(dumpname, "");
+	remove_dup_dump_file(dumpname, DUMP_COMPRESS_SUFFIX);
+}
+
 static int timesort(const struct dirent **file1, const struct dirent **file2)
 {
 	struct stat sbuf1, sbuf2;
@@ -238,65 +253,88 @@ static void remove_dump_files(char *dumpname)
 	free(namelist);
 }
 
+static ssize_t read_dump(int fd, char *buf, size_t len)
+{
+	ssize_t readsz;
+	size_t sz = 0;
+
+	while (sz < len) {
+		readsz = read(fd, buf + sz, len - sz);
+		if (readsz == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (readsz == 0)
+			break;
+
+		sz += readsz;
+	}
+
+	return sz;
+}
+
+/*
+ * The dump is copied DUMP_READ_CHUNK bytes at a time rather than read
+ * into memory as a whole, as dumps can be hundreds of megabytes; the
+ * first chunk is enough to get the file name from the dump header.
+ */
 static int process_dump(const char* dump_dir_path, const char *output_dir)
 {
 	int in_fd = -1;
 	int out_fd = -1;
 	int dir_fd = -1;
+	char in_path[PATH_MAX];
 	char dump_path[PATH_MAX];
 	char final_dump_path[PATH_MAX];
 	char *buf;
-	size_t bufsz;
-	struct stat sbuf;
+	struct dump_stream stream;
 	int ret = -1;
-	ssize_t sz = 0;
 	ssize_t readsz = 0;
 	char outfname[DUMP_MAX_FNAME_LEN];
+	const char *suffix = opt_compress ? DUMP_COMPRESS_SUFFIX : "";
 	uint16_t prefix_size;
+	double secs;
 	int rc;
 
-	rc = snprintf(dump_path, sizeof(dump_path), "%s/dump", dump_dir_path);
-	if (rc < 0 || rc >= sizeof(dump_path)) {
+	memset(&stream, 0, sizeof(stream));
+
+	rc = snprintf(in_path, sizeof(in_path), "%s/dump", dump_dir_path);
+	if (rc < 0 || rc >= sizeof(in_path)) {
 		syslog(LOG_ERR, "%s:%d - Unable to format %s\n",
 				__func__, __LINE__, dump_dir_path);
 		return -1;
 	}
 
-	if (stat(dump_path,&sbuf) == -1)
-		return -1;
-
-	bufsz = sbuf.st_size;
-	buf = malloc(bufsz);
+	buf = malloc(DUMP_READ_CHUNK);
 	if (!buf) {
 		syslog(LOG_ERR, "Failed to allocate memory for dump\n");
 		return -1;
 	}
 
-	in_fd = open(dump_path, O_RDONLY);
+	in_fd = open(in_path, O_RDONLY);
 
 	if (in_fd == -1) {
 		syslog(LOG_ERR, "Failed to open platform dump: %s (%d:%s)\n",
-		       dump_path, errno, strerror(errno));
+		       in_path, errno, strerror(errno));
 		goto err;
 	}
 
-	do {
-		readsz = read(in_fd, buf+sz, bufsz-sz);
-		if (readsz == -1) {
-			syslog(LOG_ERR, "Failed to read platform dump: %s "
-			       "(%d:%s)\n",
-			       dump_path, errno, strerror(errno));
-			goto err;
-		}
-
-		sz += readsz;
-	} while(sz != bufsz);
+	readsz = read_dump(in_fd, buf, DUMP_READ_CHUNK);
+	if (readsz == -1) {
+		syslog(LOG_ERR, "Failed to read platform dump: %s "
+		       "(%d:%s)\n",
+		       in_path, errno, strerror(errno));
+		goto err;
+	}
 
-	dump_get_file_name(buf, bufsz, outfname,
+	dump_get_file_name(buf, readsz, outfname,
 			   DUMP_MAX_FNAME_LEN, &prefix_size);
 
-	snprintf(dump_path, sizeof(dump_path), "%s/%s.tmp", output_dir, outfname);
-	snprintf(final_dump_path, sizeof(dump_path), "%s/%s", output_dir, outfname);
+	snprintf(final_dump_path, sizeof(final_dump_path), "%s/%s%s",
+		 output_dir, outfname, suffix);
+	snprintf(dump_path, sizeof(dump_path), "%s/%s%s.tmp",
+		 output_dir, outfname, suffix);
 
 	remove_dump_files(outfname);
 
@@ -308,8 +346,32 @@ static int process_dump(const char* dump_dir_path, const char *output_dir)
 		goto err;
 	}
 
-	sz = write(out_fd, buf, bufsz);
-	if (sz != bufsz) {
+	if (dump_stream_open(&stream, out_fd, opt_compress)) {
+		syslog(LOG_ERR, "Failed to set up platform dump compression: "
+		       "%s (%d:%s)\n", dump_path, errno, strerror(errno));
+		unlink(dump_path);
+		goto err;
+	}
+
+	while (readsz > 0) {
+		if (dump_stream_write(&stream, buf, readsz)) {
+			syslog(LOG_ERR, "Failed to write platform dump: %s "
+			       "(%d:%s)\n", dump_path, errno, strerror(errno));
+			unlink(dump_path);
+			goto err;
+		}
+
+		readsz = read_dump(in_fd, buf, DUMP_READ_CHUNK);
+		if (readsz == -1) {
+			syslog(LOG_ERR, "Failed to read platform dump: %s "
+			       "(%d:%s)\n",
+			       in_path, errno, strerror(errno));
+			unlink(dump_path);
+			goto err;
+		}
+	}
+
+	if (dump_stream_close(&stream)) {
 		syslog(LOG_ERR, "Failed to write platform dump: %s (%d:%s)\n",
 		       dump_path, errno, strerror(errno));
 		unlink(dump_path);
@@ -345,11 +407,23 @@ static int process_dump(const char* dump_dir_path, const char *output_dir)
 		       " (%d:%s)\n", output_dir, errno, strerror(errno));
 	}
 
-	syslog(LOG_NOTICE, "New platform dump available. File: %s/%s\n",
-	       output_dir, outfname);
+	if (opt_compress) {
+		secs = dump_stream_secs(&stream);
+		syslog(LOG_NOTICE, "Platform dump %s: %llu bytes compressed "
+		       "to %llu (%.1f%%) at %.1f MB/s\n", outfname,
+		       (unsigned long long)stream.in_bytes,
+		       (unsigned long long)stream.out_bytes,
+		       stream.in_bytes ?
+		       100.0 * stream.out_bytes / stream.in_bytes : 0,
+		       secs > 0 ? stream.in_bytes / secs / (1024 * 1024) : 0);
+	}
+
+	syslog(LOG_NOTICE, "New platform dump available. File: %s/%s%s\n",
+	       output_dir, outfname, suffix);
 
 	ret = 0;
 err:
+	dump_stream_close(&stream);
 	if (in_fd != -1)
 		close(in_fd);
 	if (out_fd != -1)
@@ -449,7 +523,7 @@ int main(int argc, char *argv[])
 	openlog("OPAL_DUMP", LOG_CONS | LOG_PID | LOG_NDELAY | LOG_PERROR,
 		LOG_LOCAL1);
 
-	while ((opt = getopt(argc, argv, "As:o:m:wh")) != -1) {
+	while ((opt = getopt(argc, argv, "As:o:m:whz")) != -1) {
 		switch (opt) {
 		case 'A':
 			opt_ack_dump = 0;
@@ -472,6 +546,15 @@ int main(int argc, char *argv[])
 		case 'w':
 			opt_wait = 1;
 			break;
+		case 'z':
+			if (!dump_stream_can_compress()) {
+				syslog(LOG_ERR, "Built without zlib, -z is "
+				       "not supported\n");
+				closelog();
+				exit(EXIT_FAILURE);
+			}
+			opt_compress = DEFAULT_COMPRESS_LEVEL;
+			break;
 		case 'h':
 			help(argv[0]);
 			closelog();
@@ -27,6 +27,7 @@
  *   4. Parsing required fields from log and write to syslog
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -49,6 +50,7 @@
 #include <time.h>
 #include <libudev.h>
 #include <sys/wait.h>
+#include <sys/sendfile.h>
 
 #include "opal-elog-parse/opal-elog.h"
 #include "opal-elog-parse/opal-event-data.h"
@@ -573,11 +575,106 @@ static int ack_elog(const char *elog_path)
 	return 0;
 }
 
-static int process_elog(const char *elog_path, const char *output)
+/*
+ * Ways of copying a log from sysfs to the output file, best first.  Not
+ * every kernel can copy_file_range() or sendfile() from a sysfs binary
+ * attribute; once one fails that way the next one is used from then on.
+ * One that copies nothing is only given up on for the current log.
+ */
+enum {
+	ELOG_COPY_FILE_RANGE,
+	ELOG_COPY_SENDFILE,
+	ELOG_COPY_READ_WRITE,
+};
+
+static int elog_copy_method = ELOG_COPY_FILE_RANGE;
+
+/* Bounce buffer for ELOG_COPY_READ_WRITE, big enough for any log */
+static char elog_copy_buf[OPAL_ERROR_LOG_MAX];
+
+static ssize_t copy_elog_buffered(int in_fd, int out_fd, off_t *off,
+				  size_t len)
+{
+	ssize_t readsz;
+	ssize_t sz;
+	ssize_t written = 0;
+
+	if (len > sizeof(elog_copy_buf))
+		len = sizeof(elog_copy_buf);
+
+	readsz = pread(in_fd, elog_copy_buf, len, *off);
+	if (readsz <= 0)
+		return readsz;
+
+	while (written < readsz) {
+		sz = write(out_fd, elog_copy_buf + written, readsz - written);
+		if (sz == -1)
+			return -1;
+		written += sz;
+	}
+
+	*off += readsz;
+	return readsz;
+}
+
+/* Copy len bytes of a log, returns the number of bytes copied or -1 */
+static ssize_t copy_elog(int in_fd, int out_fd, size_t len)
+{
+	int method = elog_copy_method;
+	off_t off = 0;
+	ssize_t sz;
+
+	while (off < len) {
+		switch (method) {
+		case ELOG_COPY_FILE_RANGE:
+			sz = copy_file_range(in_fd, &off, out_fd, NULL,
+					     len - off, 0);
+			break;
+		case ELOG_COPY_SENDFILE:
+			sz = sendfile(out_fd, in_fd, &off, len - off);
+			break;
+		default:
+			sz = copy_elog_buffered(in_fd, out_fd, &off, len - off);
+			break;
+		}
+
+		if (sz == -1 && method != ELOG_COPY_READ_WRITE &&
+		    (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+		     errno == EOPNOTSUPP)) {
+			method++;
+			if (elog_copy_method < method)
+				elog_copy_method = method;
+			continue;
+		}
+
+		if (sz == -1)
+			return -1;
+
+		/*
+		 * Nothing copied does not mean the end of the log when the
+		 * file cannot be copied in the kernel; only a read tells
+		 * that sysfs had less than it said.
+		 */
+		if (sz == 0) {
+			if (method == ELOG_COPY_READ_WRITE)
+				break;
+			method++;
+		}
+	}
+
+	return off;
+}
+
+/*
+ * Save a log to the output directory.  The data is not synced here: on
+ * success the output file is left open in *r_out_fd for
+ * commit_elog_batch() to sync it.
+ */
+static int process_elog(const char *elog_path, const char *output,
+			int *r_out_fd)
 {
 	int in_fd = -1;
 	int out_fd = -1;
-	int dir_fd = -1;
 	char elog_raw_path[PATH_MAX];
 	char *name;
 	size_t bufsz;
@@ -586,8 +683,8 @@ static int process_elog(const char *elog_path, const char *output)
 	ssize_t sz = 0;
 	ssize_t readsz = 0;
 	int rc;
-	char *output_dir = NULL;
-	char *buf = NULL;
+	char hdr[ELOG_MIN_READ_OFFSET];
+	size_t hdrsz;
 	char output_file[PATH_MAX];
 	int elog_type;
 
@@ -602,11 +699,6 @@ static int process_elog(const char *elog_path, const char *output)
 		goto err;
 
 	bufsz = sbuf.st_size;
-	buf = malloc(bufsz);
-	if (!buf) {
-		syslog(LOG_ERR, "Failed to allocate memory\n");
-		goto err;
-	}
 
 	in_fd = open(elog_raw_path, O_RDONLY);
 	if (in_fd == -1) {
@@ -615,18 +707,22 @@ static int process_elog(const char *elog_path, const char *output)
 		goto err;
 	}
 
-	do {
-		readsz = read(in_fd, buf+sz, bufsz-sz);
+	/* Only the header is needed here, the rest is copied as it is */
+	hdrsz = bufsz < sizeof(hdr) ? bufsz : sizeof(hdr);
+	while (sz < hdrsz) {
+		readsz = pread(in_fd, hdr + sz, hdrsz - sz, sz);
 		if (readsz == -1) {
 			syslog(LOG_ERR, "Failed to read elog: %s (%d:%s)\n",
 			       elog_raw_path, errno, strerror(errno));
 			goto err;
 		}
+		if (readsz == 0)
+			break;
 
 		sz += readsz;
-	} while(sz != bufsz);
+	}
 
-	if (parse_log(buf, bufsz, &elog_type)) {
+	if (parse_log(hdr, sz, &elog_type)) {
 		goto err;
 	}
 
@@ -650,49 +746,132 @@ static int process_elog(const char *elog_path, const char *output)
 		goto err;
 	}
 
-	sz = write(out_fd, buf, bufsz);
-	if (sz != bufsz) {
+	sz = copy_elog(in_fd, out_fd, bufsz);
+	if (sz == -1) {
 		syslog(LOG_ERR, "Failed to write elog output file: %s (%d:%s)\n",
 		       output_file, errno, strerror(errno));
+		unlink(output_file);
 		goto err;
 	}
-
-	rc = fsync(out_fd);
-	if (rc == -1) {
-		syslog(LOG_ERR, "Failed to sync elog output file: %s (%d:%s)\n",
-		       output_file, errno, strerror(errno));
-		goto err;
-	}
-
-	output_dir = strdup(output);
-	if (!output_dir)
+	if (sz != bufsz) {
+		syslog(LOG_ERR, "Short copy of elog to output file: %s (%zd of "
+		       "%zu bytes)\n", output_file, sz, bufsz);
+		unlink(output_file);
 		goto err;
-
-	dir_fd = open(dirname(output_dir), O_RDONLY|O_DIRECTORY);
-	if (dir_fd == -1) {
-		syslog(LOG_ERR, "Failed to open platform elog directory: %s"
-		       " (%d:%s)\n", output_dir, errno, strerror(errno));
-	} else {
-		rc = fsync(dir_fd);
-		if (rc == -1)
-			syslog(LOG_ERR, "Failed to sync platform elog "
-			       "directory: %s (%d:%s)\n",
-			       output_dir, errno, strerror(errno));
 	}
 
+	*r_out_fd = out_fd;
+	out_fd = -1;
 	ret = 0;
 err:
 	if (in_fd != -1)
 		close(in_fd);
 	if (out_fd != -1)
 		close(out_fd);
-	if (dir_fd != -1)
-		close(dir_fd);
-	free(output_dir);
-	free(buf);
 	return ret;
 }
 
+/*
+ * The logs read in one pass are acked together: when firmware sends a
+ * burst of them, the output directory is synced once for the lot
+ * rather than once per log.  No log is acked before its copy, and the
+ * directory entry for it, are on disk.
+ */
+#define ELOG_BATCH_SIZE		64
+
+struct elog_batch {
+	const char	*elog_dir;
+	const char	*output_dir;
+	int		count;
+	struct {
+		int	out_fd;	/* -1 if the log could not be saved */
+		char	name[NAME_MAX + 1];
+	} logs[ELOG_BATCH_SIZE];
+};
+
+static void init_elog_batch(struct elog_batch *batch, const char *elog_dir,
+			    const char *output_dir)
+{
+	batch->elog_dir = elog_dir;
+	batch->output_dir = output_dir;
+	batch->count = 0;
+}
+
+/* Sync the logs of the batch to disk, then ack them */
+static void commit_elog_batch(struct elog_batch *batch)
+{
+	char elog_path[PATH_MAX];
+	struct timespec start, end;
+	int dir_fd;
+	int synced = 0;
+	int i;
+
+	if (!batch->count)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < batch->count; i++) {
+		if (batch->logs[i].out_fd == -1)
+			continue;
+
+		if (fsync(batch->logs[i].out_fd) == -1)
+			syslog(LOG_ERR, "Failed to sync elog output file for"
+			       " %s (%d:%s)\n", batch->logs[i].name,
+			       errno, strerror(errno));
+		close(batch->logs[i].out_fd);
+		synced++;
+	}
+
+	if (synced) {
+		dir_fd = open(batch->output_dir, O_RDONLY|O_DIRECTORY);
+		if (dir_fd == -1) {
+			syslog(LOG_ERR, "Failed to open platform elog directory:"
+			       " %s (%d:%s)\n", batch->output_dir, errno,
+			       strerror(errno));
+		} else {
+			if (fsync(dir_fd) == -1)
+				syslog(LOG_ERR, "Failed to sync platform elog "
+				       "directory: %s (%d:%s)\n",
+				       batch->output_dir, errno, strerror(errno));
+			close(dir_fd);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	syslog(LOG_DEBUG, "Synced %d of %d elogs in %ld us\n", synced,
+	       batch->count, (long)(end.tv_sec - start.tv_sec) * 1000000 +
+	       (end.tv_nsec - start.tv_nsec) / 1000);
+
+	for (i = 0; i < batch->count; i++) {
+		snprintf(elog_path, sizeof(elog_path), "%s/%s",
+			 batch->elog_dir, batch->logs[i].name);
+		ack_elog(elog_path);
+	}
+
+	batch->count = 0;
+}
+
+/* Save a log, it is acked when the batch is committed */
+static int read_elog(struct elog_batch *batch, const char *elog_path)
+{
+	int out_fd = -1;
+	int rc;
+
+	if (batch->count == ELOG_BATCH_SIZE)
+		commit_elog_batch(batch);
+
+	rc = process_elog(elog_path, batch->output_dir, &out_fd);
+
+	batch->logs[batch->count].out_fd = out_fd;
+	strncpy(batch->logs[batch->count].name, strrchr(elog_path, '/') + 1,
+		NAME_MAX);
+	batch->logs[batch->count].name[NAME_MAX] = '\0';
+	batch->count++;
+
+	return rc;
+}
+
 /* Read logs from opal sysfs interface */
 static int find_and_read_elog_events(const char *elog_dir, const char *output_path)
 {
@@ -700,6 +879,7 @@ static int find_and_read_elog_events(const char *elog_dir, const char *output_pa
 	struct dirent **namelist;
 	struct dirent *dirent;
 	char elog_path[PATH_MAX];
+	struct elog_batch batch;
 	int is_dir = 0;
 	struct stat sbuf;
 	int retval = 0;
@@ -710,6 +890,8 @@ static int find_and_read_elog_events(const char *elog_dir, const char *output_pa
 	if (n < 0)
 		return -1;
 
+	init_elog_batch(&batch, elog_dir, output_path);
+
 	for (i = 0; i < n; i++) {
 		dirent = namelist[i];
 
@@ -746,22 +928,165 @@ static int find_and_read_elog_events(const char *elog_dir, const char *output_pa
 		}
 
 		if (is_dir) {
-			rc = process_elog(elog_path, output_path);
+			rc = read_elog(&batch, elog_path);
 			if (rc != 0 && retval == 0)
 				retval = -1;
 			if (rc == 0 && retval >= 0)
 				retval++;
-			ack_elog(elog_path);
 		}
 
 		free(namelist[i]);
 	}
 
 	free(namelist);
+	commit_elog_batch(&batch);
 
 	return retval;
 }
 
+/*
+ * udev tells us the id of every log OPAL adds, so there is no need to
+ * scan the whole elog directory after each wakeup.  The ids are queued
+ * here until the next pass of the main loop; a full scan is only done
+ * at startup, every ELOG_RESCAN_INTERVAL seconds in case an event was
+ * lost, and whenever the queue or an event stream overflowed.
+ */
+#define ELOG_QUEUE_SIZE		64
+#define ELOG_RESCAN_INTERVAL	60 /* In seconds */
+
+struct elog_queue {
+	int	count;
+	bool	rescan;
+	char	names[ELOG_QUEUE_SIZE][ELOG_STR_SIZE];
+};
+
+static void queue_elog(struct elog_queue *queue, const char *name)
+{
+	int i;
+
+	if (name[0] == '\0' || name[0] == '.' ||
+	    strlen(name) >= ELOG_STR_SIZE) {
+		/* Not an elog id we know how to handle, look for ourselves */
+		queue->rescan = true;
+		return;
+	}
+
+	for (i = 0; i < queue->count; i++)
+		if (!strcmp(queue->names[i], name))
+			return;
+
+	if (queue->count == ELOG_QUEUE_SIZE) {
+		queue->rescan = true;
+		return;
+	}
+
+	strcpy(queue->names[queue->count++], name);
+}
+
+/* Read the logs named in the queue, the ones already gone are skipped */
+static int read_queued_elog_events(const char *elog_dir,
+				   struct elog_queue *queue,
+				   const char *output_path)
+{
+	char elog_path[PATH_MAX];
+	struct elog_batch batch;
+	struct stat sbuf;
+	int retval = 0;
+	int rc;
+	int i;
+
+	init_elog_batch(&batch, elog_dir, output_path);
+
+	for (i = 0; i < queue->count; i++) {
+		rc = snprintf(elog_path, sizeof(elog_path), "%s/%s",
+			      elog_dir, queue->names[i]);
+		if (rc < 0 || rc >= sizeof(elog_path)) {
+			syslog(LOG_ERR, "%s:%d - Unable to format %s\n",
+			       __func__, __LINE__, queue->names[i]);
+			continue;
+		}
+
+		if (stat(elog_path, &sbuf) == -1 || !S_ISDIR(sbuf.st_mode))
+			continue;
+
+		rc = read_elog(&batch, elog_path);
+		if (rc != 0 && retval == 0)
+			retval = -1;
+		if (rc == 0 && retval >= 0)
+			retval++;
+	}
+
+	commit_elog_batch(&batch);
+	queue->count = 0;
+
+	return retval;
+}
+
+/* Queue the elogs named in a buffer of inotify events */
+static void parse_inotify_events(const char *buf, ssize_t len,
+				 struct elog_queue *queue)
+{
+	const struct inotify_event *event;
+	const char *p;
+
+	for (p = buf; p + sizeof(*event) <= buf + len;
+	     p += sizeof(*event) + event->len) {
+		event = (const struct inotify_event *)p;
+
+		if (event->mask & IN_Q_OVERFLOW) {
+			queue->rescan = true;
+			continue;
+		}
+
+		/*
+		 * The watch is on the opal directory: the elog directory
+		 * showing up means any log in it is new to us.
+		 */
+		if (event->len && !strcmp(event->name, "elog"))
+			queue->rescan = true;
+	}
+}
+
+/* Queue the elog a udev event is about */
+static void parse_udev_event(struct udev_device *udev_dev,
+			     struct elog_queue *queue)
+{
+	const char *subsystem;
+	const char *action;
+	const char *devpath;
+
+	if (!udev_dev) {
+		/* Could be lost events (ENOBUFS), so make sure */
+		queue->rescan = true;
+		return;
+	}
+
+	subsystem = udev_device_get_subsystem(udev_dev);
+	action = udev_device_get_action(udev_dev);
+	devpath = udev_device_get_devpath(udev_dev);
+
+	/* dumps are looked for by check_platform_dump() on each pass */
+	if (!subsystem || strcmp(subsystem, "elog"))
+		return;
+	if (action && strcmp(action, "add"))
+		return;
+
+	if (devpath && strrchr(devpath, '/'))
+		queue_elog(queue, strrchr(devpath, '/') + 1);
+	else
+		queue->rescan = true;
+}
+
+static time_t monotonic_seconds(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return time(NULL);
+
+	return ts.tv_sec;
+}
+
 static char *validate_extract_opal_dump(const char *cmd)
 {
 	char *extract_opal_dump_cmd = NULL;
@@ -877,10 +1202,12 @@ int main(int argc, char *argv[])
 	struct udev_device *udev_dev = NULL;
 	struct pollfd fds[2];
 	fds[INOTIFY_FD].fd = -1;
-	char inotifybuf[sizeof(struct inotify_event) + NAME_MAX + 1];
+	char inotifybuf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
 
-	const char *devpath;
-	char elog_str_name[ELOG_STR_SIZE];
+	struct elog_queue elog_queue = { .rescan = true };
+	time_t last_rescan = 0;
 	struct sigaction siga;
 
 	int opt_daemon = 1;
@@ -1073,7 +1400,16 @@ int main(int argc, char *argv[])
 	/* Read error/event log until we get termination signal */
 	while (!terminate) {
 		rotate_srvc_logs = rotate_info_logs = false;
-		find_and_read_elog_events(elog_path, opt_output_dir);
+		if (elog_queue.rescan ||
+		    monotonic_seconds() - last_rescan >= ELOG_RESCAN_INTERVAL) {
+			elog_queue.rescan = false;
+			elog_queue.count = 0;
+			last_rescan = monotonic_seconds();
+			find_and_read_elog_events(elog_path, opt_output_dir);
+		} else {
+			read_queued_elog_events(elog_path, &elog_queue,
+						opt_output_dir);
+		}
 
 		if (rotate_srvc_logs) {
 			rotate_logs(opt_output_dir, max_serviceable_logs,
@@ -1091,29 +1427,25 @@ int main(int argc, char *argv[])
 		if (!opt_watch) {
 			terminate = 1;
 		} else {
-			/* We don't care about the content of the inotify
-			 * event, we'll just scan the directory anyway
+			/* Only the logs the events name are read next time
+			 * round, see struct elog_queue
 			 */
 			rc = poll(fds, sizeof(fds)/sizeof(struct pollfd), POLL_TIMEOUT);
 			if (rc > 0 && fds[INOTIFY_FD].revents) {
-				if (read(fds[INOTIFY_FD].fd, inotifybuf, sizeof(inotifybuf)) == -1) {
+				len = read(fds[INOTIFY_FD].fd, inotifybuf, sizeof(inotifybuf));
+				if (len == -1) {
 					syslog(LOG_WARNING, "Can not read platform log directory:"
 					       " (%d:%s)\n", errno, strerror(errno));
 					goto exit;
 				}
+				parse_inotify_events(inotifybuf, len, &elog_queue);
 			}
 
 			if (rc > 0 && fds[UDEV_FD].revents) {
 				udev_dev = udev_monitor_receive_device(udev_mon);
-				devpath = udev_device_get_devpath(udev_dev);
-				if (devpath && strrchr(devpath, '/')) {
-					strncpy(elog_str_name, strrchr(devpath, '/'), ELOG_STR_SIZE);
-					elog_str_name[sizeof(elog_str_name) - 1] = '\0';
-				}
-				udev_device_unref(udev_dev);
-				/* The id of the elog should be in elog_str_name
-				 * Perhaps more can be done with the udev information
-				 */
+				parse_udev_event(udev_dev, &elog_queue);
+				if (udev_dev)
+					udev_device_unref(udev_dev);
 			}
 		}
 		rc = 0;
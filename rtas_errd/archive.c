@@ -0,0 +1,374 @@
+/**
+ * @file archive.c
+ * @brief Append RTAS events to the binary event archive
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/stat.h>
+#include <librtasevent.h>
+#include "rtas_errd.h"
+#include "archive.h"
+#include "config.h"
+
+/*
+ * See archive.h for the archive format.  Only the segment events are
+ * currently appended to is kept open; the other segments are only ever
+ * touched again to remove them.
+ */
+static char archive_dir[sizeof(d_cfg.archive_path)];
+static int archive_data_fd = -1;
+static int archive_idx_fd = -1;
+
+static unsigned int first_seg;	/**< oldest segment kept */
+static unsigned int cur_seg;	/**< segment being appended to */
+
+static struct rtas_archive_idx_hdr cur_hdr;
+static uint64_t cur_data_size;
+static uint32_t cur_recs;
+
+static uint32_t last_seq;	/**< of the last event archived */
+static uint64_t last_time;
+
+static void
+archive_close_segment(void)
+{
+	if (archive_data_fd >= 0)
+		close(archive_data_fd);
+	if (archive_idx_fd >= 0)
+		close(archive_idx_fd);
+
+	archive_data_fd = -1;
+	archive_idx_fd = -1;
+}
+
+/**
+ * read_last_rec
+ * @brief Read the last index record of a segment
+ *
+ * @param fd index file of the segment
+ * @param recs number of records in it
+ * @param rec buffer for the record, converted to host byte order
+ * @return 0 on success, -1 if there is no such record
+ */
+static int
+read_last_rec(int fd, uint32_t recs, struct rtas_archive_rec *rec)
+{
+	off_t off = sizeof(struct rtas_archive_idx_hdr) +
+		    (off_t)(recs - 1) * sizeof(*rec);
+
+	if (recs == 0 || pread(fd, rec, sizeof(*rec), off) != sizeof(*rec))
+		return -1;
+
+	rec->seq_num = be32toh(rec->seq_num);
+	rec->time = be64toh(rec->time);
+	rec->offset = be64toh(rec->offset);
+	rec->len = be32toh(rec->len);
+	return 0;
+}
+
+/**
+ * archive_open_segment
+ * @brief Open a segment to append events to
+ *
+ * An existing segment is checked for records that were only partly
+ * written when rtas_errd (or the system) went down: the index is cut
+ * back to the last record whose event data is complete, and the data
+ * file to the end of that event.
+ *
+ * @param seg segment number
+ * @param create start the segment afresh
+ * @return 0 on success, -1 on failure
+ */
+static int
+archive_open_segment(unsigned int seg, int create)
+{
+	char path[PATH_MAX];
+	struct stat sbuf;
+	struct rtas_archive_rec rec;
+	int flags = O_RDWR | O_CREAT | (create ? O_TRUNC : 0);
+
+	snprintf(path, sizeof(path), RTAS_ARCHIVE_DATA_FMT, archive_dir, seg);
+	archive_data_fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (archive_data_fd < 0)
+		goto error;
+
+	snprintf(path, sizeof(path), RTAS_ARCHIVE_IDX_FMT, archive_dir, seg);
+	archive_idx_fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (archive_idx_fd < 0 || fstat(archive_idx_fd, &sbuf))
+		goto error;
+
+	cur_seg = seg;
+	cur_recs = 0;
+	cur_data_size = 0;
+
+	if (sbuf.st_size < sizeof(cur_hdr) ||
+	    pread(archive_idx_fd, &cur_hdr, sizeof(cur_hdr), 0) !=
+							sizeof(cur_hdr) ||
+	    memcmp(cur_hdr.magic, RTAS_ARCHIVE_MAGIC, sizeof(cur_hdr.magic)) ||
+	    be32toh(cur_hdr.version) != RTAS_ARCHIVE_VERSION) {
+		/* New, or not worth salvaging; start the segment over */
+		memset(&cur_hdr, 0, sizeof(cur_hdr));
+		memcpy(cur_hdr.magic, RTAS_ARCHIVE_MAGIC,
+		       sizeof(cur_hdr.magic));
+		cur_hdr.version = htobe32(RTAS_ARCHIVE_VERSION);
+
+		if (ftruncate(archive_data_fd, 0) ||
+		    ftruncate(archive_idx_fd, 0) ||
+		    pwrite(archive_idx_fd, &cur_hdr, sizeof(cur_hdr), 0) !=
+							sizeof(cur_hdr))
+			goto error;
+
+		return 0;
+	}
+
+	cur_recs = (sbuf.st_size - sizeof(cur_hdr)) / sizeof(rec);
+
+	if (fstat(archive_data_fd, &sbuf))
+		goto error;
+
+	while (read_last_rec(archive_idx_fd, cur_recs, &rec) == 0) {
+		if (rec.offset + rec.len <= sbuf.st_size) {
+			cur_data_size = rec.offset + rec.len;
+			last_seq = rec.seq_num;
+			last_time = rec.time;
+			break;
+		}
+		cur_recs--;
+	}
+
+	if (ftruncate(archive_idx_fd, sizeof(cur_hdr) +
+				      (off_t)cur_recs * sizeof(rec)) ||
+	    ftruncate(archive_data_fd, cur_data_size))
+		goto error;
+
+	return 0;
+
+error:
+	log_msg(NULL, "Could not open %s, %s.  RTAS events will not be "
+		"archived", path, strerror(errno));
+	archive_close_segment();
+	return -1;
+}
+
+/**
+ * archive_rotate
+ * @brief Start a new segment, removing the oldest ones past the limit
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int
+archive_rotate(void)
+{
+	char path[PATH_MAX];
+
+	archive_close_segment();
+
+	while (cur_seg + 1 - first_seg >= d_cfg.archive_segments) {
+		snprintf(path, sizeof(path), RTAS_ARCHIVE_IDX_FMT,
+			 archive_dir, first_seg);
+		unlink(path);
+		snprintf(path, sizeof(path), RTAS_ARCHIVE_DATA_FMT,
+			 archive_dir, first_seg);
+		unlink(path);
+		first_seg++;
+	}
+
+	dbg("Starting event archive segment %u", cur_seg + 1);
+	return archive_open_segment(cur_seg + 1, 1);
+}
+
+/**
+ * archive_open
+ * @brief Open the event archive in EventArchivePath
+ *
+ * Called once the config file has been read.  EventArchivePath is only
+ * looked at here, so changes to it take effect when rtas_errd is
+ * restarted.
+ */
+void
+archive_open(void)
+{
+	struct rtas_archive_rec rec;
+	struct dirent *de;
+	unsigned int seg, idx_min = 0, idx_max = 0;
+	char suffix[8];
+	DIR *dir;
+	int fd;
+
+	if (d_cfg.archive_segments == 0)
+		return;
+
+	snprintf(archive_dir, sizeof(archive_dir), "%s",
+		 d_cfg.archive_path);
+	if (mkdir(archive_dir, S_IRWXU | S_IRGRP | S_IXGRP) &&
+	    errno != EEXIST) {
+		log_msg(NULL, "Could not create %s, %s.  RTAS events will "
+			"not be archived", archive_dir, strerror(errno));
+		return;
+	}
+
+	dir = opendir(archive_dir);
+	if (dir == NULL) {
+		log_msg(NULL, "Could not open %s, %s.  RTAS events will "
+			"not be archived", archive_dir, strerror(errno));
+		return;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		if (sscanf(de->d_name, "events.%u.%7s", &seg, suffix) != 2 ||
+		    strcmp(suffix, "idx") || seg == 0)
+			continue;
+
+		if (idx_min == 0 || seg < idx_min)
+			idx_min = seg;
+		if (seg > idx_max)
+			idx_max = seg;
+	}
+	closedir(dir);
+
+	if (idx_max == 0) {
+		first_seg = 1;
+		archive_open_segment(1, 1);
+		return;
+	}
+
+	first_seg = idx_min;
+	if (archive_open_segment(idx_max, 0))
+		return;
+
+	/* A segment that was just started; take the last event from the
+	 * segment before it */
+	if (cur_recs == 0 && idx_max > idx_min) {
+		char path[PATH_MAX];
+		struct stat sbuf;
+
+		snprintf(path, sizeof(path), RTAS_ARCHIVE_IDX_FMT,
+			 archive_dir, idx_max - 1);
+		fd = open(path, O_RDONLY);
+		if (fd >= 0 && !fstat(fd, &sbuf) &&
+		    sbuf.st_size > sizeof(cur_hdr) &&
+		    !read_last_rec(fd, (sbuf.st_size - sizeof(cur_hdr)) /
+				       sizeof(rec), &rec)) {
+			last_seq = rec.seq_num;
+			last_time = rec.time;
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+
+	dbg("Event archive %s has segments %u to %u, last event %u",
+	    archive_dir, first_seg, cur_seg, last_seq);
+}
+
+/**
+ * archive_close
+ * @brief Close the event archive
+ */
+void
+archive_close(void)
+{
+	archive_close_segment();
+}
+
+/**
+ * archive_last_seq
+ * @brief Retrieve the number of the last event in the archive
+ *
+ * @return RTAS event number, 0 if the archive is empty or not in use
+ */
+int
+archive_last_seq(void)
+{
+	return archive_idx_fd < 0 ? 0 : last_seq;
+}
+
+/**
+ * archive_event
+ * @brief Append an RTAS event to the event archive
+ *
+ * A failure to archive an event is logged but otherwise ignored; the
+ * platform log remains the record of the event.
+ *
+ * @param event the event, as written to the platform log
+ */
+void
+archive_event(struct event *event)
+{
+	struct rtas_archive_rec rec;
+	uint64_t now = time(NULL);
+	uint8_t type = event->rtas_hdr->type;
+	int len = event->length;
+
+	/* EventArchiveSegments may have been set to 0 since */
+	if (archive_idx_fd < 0 || d_cfg.archive_segments == 0)
+		return;
+
+	/* Same as print_rtas_event() */
+	if (len == 0)
+		len = 32;
+
+	if (cur_recs && (cur_data_size + len >
+				(uint64_t)d_cfg.archive_segment_size * 1024 ||
+			 (uint32_t)event->seq_num < last_seq ||
+			 now < last_time)) {
+		if (archive_rotate())
+			return;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.seq_num = htobe32(event->seq_num);
+	rec.type = type;
+	rec.severity = event->rtas_hdr->severity;
+	rec.time = htobe64(now);
+	rec.offset = htobe64(cur_data_size);
+	rec.len = htobe32(len);
+
+	if (pwrite(archive_data_fd, event->event_buf, len, cur_data_size)
+									!= len ||
+	    pwrite(archive_idx_fd, &rec, sizeof(rec), sizeof(cur_hdr) +
+				(off_t)cur_recs * sizeof(rec)) != sizeof(rec))
+		goto error;
+
+	if (!RTAS_ARCHIVE_HAS_TYPE(&cur_hdr, type)) {
+		cur_hdr.types[type / 8] |= 1 << (type % 8);
+		if (pwrite(archive_idx_fd, &cur_hdr, sizeof(cur_hdr), 0) !=
+							sizeof(cur_hdr))
+			goto error;
+	}
+
+	cur_data_size += len;
+	cur_recs++;
+	last_seq = event->seq_num;
+	last_time = now;
+	return;
+
+error:
+	log_msg(NULL, "Could not archive RTAS event %d in %s, %s",
+		event->seq_num, archive_dir, strerror(errno));
+}
@@ -0,0 +1,79 @@
+/**
+ * @file archive.h
+ * @brief Binary RTAS event archive format
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <stdint.h>
+
+/*
+ * Every RTAS event written to the platform log is also appended to the
+ * event archive in EventArchivePath, so that events can be looked up
+ * without parsing the platform log hexdumps (see rtas_archive(8)).
+ *
+ * The archive is a series of numbered segments.  Segment n is made of
+ * two files: events.<n> holds the raw event data, one event after the
+ * other, and events.<n>.idx an index of fixed size records, one for
+ * each event, behind a struct rtas_archive_idx_hdr.  The event data is
+ * always written before its index record, so that an index record only
+ * ever refers to data that is on disk.
+ *
+ * Within a segment the index records are in increasing seq_num and
+ * time order; an event that would break that order starts a new
+ * segment, so that each segment can be binary searched.  A new segment
+ * is also started once a segment holds EventArchiveSegmentSize kbytes
+ * of event data, and the oldest segments are removed so that no more
+ * than EventArchiveSegments are kept.
+ *
+ * All fields are big endian.
+ */
+#define RTAS_ARCHIVE_MAGIC	"RTASARCH"
+#define RTAS_ARCHIVE_VERSION	1
+
+#define RTAS_ARCHIVE_DATA_FMT	"%s/events.%08u"
+#define RTAS_ARCHIVE_IDX_FMT	"%s/events.%08u.idx"
+
+struct rtas_archive_idx_hdr {
+	char		magic[8];	/**< RTAS_ARCHIVE_MAGIC, no NUL */
+	uint32_t	version;	/**< RTAS_ARCHIVE_VERSION */
+	uint32_t	reserved;
+	uint8_t		types[32];	/**< bitmap of the RTAS event types */
+};
+
+struct rtas_archive_rec {
+	uint32_t	seq_num;	/**< RTAS event number */
+	uint8_t		type;		/**< RTAS header type */
+	uint8_t		severity;	/**< RTAS header severity */
+	uint16_t	reserved;
+	uint64_t	time;		/**< secs since the Epoch when logged */
+	uint64_t	offset;		/**< of the event in the data file */
+	uint32_t	len;		/**< length of the event data */
+	uint32_t	reserved2;
+};
+
+/**
+ * @def RTAS_ARCHIVE_HAS_TYPE
+ * @brief Whether the segment of an index header has events of a type
+ */
+#define RTAS_ARCHIVE_HAS_TYPE(hdr, type) \
+	((hdr)->types[(type) / 8] & (1 << ((type) % 8)))
+
+#endif /* _ARCHIVE_H */
@@ -264,6 +264,31 @@ get_config_num(char *start, char *end, int *val, int *line_no)
 	return start;
 }
 
+/**
+ * get_config_count
+ * @brief Retrieve a numeric config value that may be zero
+ *
+ * Same as get_config_num(), except that 0 is allowed.
+ */
+static char *
+get_config_count(char *start, char *end, int *val, int *line_no)
+{
+	char	tok[1024];
+
+	/* The first token should be '=' */
+	start = get_token(start, end, tok, line_no);
+	if ((start == NULL) || (tok[0] != '='))
+		return NULL;
+
+	/* Next token should be the value */
+	start = get_token(start, end, tok, line_no);
+	if (start != NULL)
+		*val = ((int)strtol(tok, NULL, 10) > 0 ?
+				(int)strtol(tok, NULL, 10) : 0);
+
+	return start;
+}
+
 /**
  * get_restart_policy_value
  * @brief Retrieve Auto Restart Policy value
@@ -592,6 +617,270 @@ parse_config_entries(char *buf, char *buf_end, int update_sysconfig)
 			d_cfg.log_msg("Configuring Platform Dump Path to "
 				      "\"%s\"", d_cfg.platform_dump_path);
 
+		/* PlatformDumpChunkSize */
+		} else if (strcmp(tok, "PlatformDumpChunkSize") == 0) {
+			cur = get_config_num(cur, buf_end,
+					     &d_cfg.platform_dump_chunk,
+					     &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"PlatformDumpChunkSize\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+
+			/* rtas_platform_dump() needs at least a page */
+			if (d_cfg.platform_dump_chunk < 4)
+				d_cfg.platform_dump_chunk = 4;
+
+			d_cfg.log_msg("Configuring Platform Dump Chunk Size "
+				      "to %d kbytes",
+				      d_cfg.platform_dump_chunk);
+
+		/* PlatformDumpCompress */
+		} else if (strcmp(tok, "PlatformDumpCompress") == 0) {
+			cur = get_config_count(cur, buf_end,
+					       &d_cfg.platform_dump_compress,
+					       &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"PlatformDumpCompress\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+
+			if (d_cfg.platform_dump_compress > 9)
+				d_cfg.platform_dump_compress = 9;
+
+			d_cfg.log_msg("Configuring Platform Dump Compress "
+				      "to level %d",
+				      d_cfg.platform_dump_compress);
+
+		/* ServicelogBatchSize */
+		} else if (strcmp(tok, "ServicelogBatchSize") == 0) {
+			cur = get_config_num(cur, buf_end,
+					     &d_cfg.sl_batch_size, &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"ServicelogBatchSize\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Servicelog Batch "
+					      "Size to %d",
+					      d_cfg.sl_batch_size);
+			}
+
+		/* ServicelogBatchTimeout */
+		} else if (strcmp(tok, "ServicelogBatchTimeout") == 0) {
+			cur = get_config_num(cur, buf_end,
+					     &d_cfg.sl_batch_timeout,
+					     &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"ServicelogBatchTimeout\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Servicelog Batch "
+					      "Timeout to %d msecs",
+					      d_cfg.sl_batch_timeout);
+			}
+
+		/* ServicelogFlushSeverity */
+		} else if (strcmp(tok, "ServicelogFlushSeverity") == 0) {
+			cur = get_config_num(cur, buf_end,
+					     &d_cfg.sl_flush_severity,
+					     &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"ServicelogFlushSeverity\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Servicelog Flush "
+					      "Severity to %d",
+					      d_cfg.sl_flush_severity);
+			}
+
+		/* HotplugCoalesceWindow */
+		} else if (strcmp(tok, "HotplugCoalesceWindow") == 0) {
+			cur = get_config_num(cur, buf_end,
+					     &d_cfg.hp_coalesce_window,
+					     &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"HotplugCoalesceWindow\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Hotplug Coalesce "
+					      "Window to %d msecs",
+					      d_cfg.hp_coalesce_window);
+			}
+
+		/* HotplugCoalesceMax */
+		} else if (strcmp(tok, "HotplugCoalesceMax") == 0) {
+			cur = get_config_num(cur, buf_end,
+					     &d_cfg.hp_coalesce_max,
+					     &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"HotplugCoalesceMax\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Hotplug Coalesce "
+					      "Max to %d events",
+					      d_cfg.hp_coalesce_max);
+			}
+
+		/* EventDedupWindow */
+		} else if (strcmp(tok, "EventDedupWindow") == 0) {
+			cur = get_config_count(cur, buf_end,
+					       &d_cfg.dedup_window, &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"EventDedupWindow\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Event Dedup "
+					      "Window to %d secs",
+					      d_cfg.dedup_window);
+			}
+
+		/* EventDedupHexdumps */
+		} else if (strcmp(tok, "EventDedupHexdumps") == 0) {
+			cur = get_config_count(cur, buf_end,
+					       &d_cfg.dedup_hexdumps,
+					       &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"EventDedupHexdumps\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Event Dedup "
+					      "Hexdumps to %d",
+					      d_cfg.dedup_hexdumps);
+			}
+
+		/* EventRecoverySource */
+		} else if (strcmp(tok, "EventRecoverySource") == 0) {
+			char source[1024];
+
+			cur = get_config_string(cur, buf_end, source,
+						&line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"EventRecoverySource\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+
+			if (strcmp(source, "syslog") == 0) {
+				d_cfg.recovery_source = RE_CFG_RECOVER_SYSLOG;
+			} else if (strcmp(source, "journal") == 0) {
+				d_cfg.recovery_source = RE_CFG_RECOVER_JOURNAL;
+			} else {
+				d_cfg.log_msg("Invalid parameter (%s) "
+					      "specified for the "
+					      "EventRecoverySource (line %d) "
+					      "in config file (%s), expecting "
+					      "syslog or journal", source,
+					      line_no, config_file);
+				rc = -1;
+				break;
+			}
+
+			d_cfg.log_msg("Configuring Event Recovery Source to "
+				      "\"%s\"", source);
+
+		/* EventArchivePath */
+		} else if (strcmp(tok, "EventArchivePath") == 0) {
+			cur = get_config_string(cur, buf_end,
+						d_cfg.archive_path, &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"EventArchivePath\", line %d",
+					      line_no);
+				rc = -1;
+				break;
+			}
+
+			d_cfg.log_msg("Configuring Event Archive Path to "
+				      "\"%s\"", d_cfg.archive_path);
+
+		/* EventArchiveSegmentSize */
+		} else if (strcmp(tok, "EventArchiveSegmentSize") == 0) {
+			cur = get_config_num(cur, buf_end,
+					     &d_cfg.archive_segment_size,
+					     &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"EventArchiveSegmentSize\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+
+			/* Room for at least one event of the largest size */
+			if (d_cfg.archive_segment_size < 4)
+				d_cfg.archive_segment_size = 4;
+
+			d_cfg.log_msg("Configuring Event Archive Segment Size "
+				      "to %d kbytes",
+				      d_cfg.archive_segment_size);
+
+		/* EventArchiveSegments */
+		} else if (strcmp(tok, "EventArchiveSegments") == 0) {
+			cur = get_config_count(cur, buf_end,
+					       &d_cfg.archive_segments,
+					       &line_no);
+			if (cur == NULL) {
+				d_cfg.log_msg("Parsing error for "
+					      "configuration file entry "
+					      "\"EventArchiveSegments\", "
+					      "line %d", line_no);
+				rc = -1;
+				break;
+			}
+			else {
+				d_cfg.log_msg("Configuring Event Archive "
+					      "Segments to %d",
+					      d_cfg.archive_segments);
+			}
+
 		/* AutoRestartPolicy */
 		} else if (strcmp(tok, "AutoRestartPolicy") == 0) {
 			cur = config_restart_policy(cur, buf_end, &line_no,
@@ -626,9 +915,27 @@ init_d_cfg(void (*log_msg)(char *, ...))
 	
 	strcpy(d_cfg.scanlog_dump_path, "/var/log/");
 	strcpy(d_cfg.platform_dump_path, "/var/log/dump/");
+	d_cfg.platform_dump_chunk = 64;
+	d_cfg.platform_dump_compress = 0;
 
 	d_cfg.restart_policy = -1;
 
+	d_cfg.sl_batch_size = 16;
+	d_cfg.sl_batch_timeout = 250;
+	d_cfg.sl_flush_severity = 4;	/* SL_SEV_WARNING */
+
+	d_cfg.hp_coalesce_window = 100;
+	d_cfg.hp_coalesce_max = 256;
+
+	d_cfg.dedup_window = 60;
+	d_cfg.dedup_hexdumps = 5;
+
+	d_cfg.recovery_source = RE_CFG_RECOVER_SYSLOG;
+
+	strcpy(d_cfg.archive_path, "/var/log/platform.archive");
+	d_cfg.archive_segment_size = 4096;
+	d_cfg.archive_segments = 16;
+
 	d_cfg.log_msg = log_msg;
 };
 
@@ -34,12 +34,26 @@ struct ppc64_diag_config {
 	int			min_entitled_capacity;
 	char			scanlog_dump_path[512];
 	char			platform_dump_path[512];
+	int			platform_dump_chunk;	/* kbytes */
+	int			platform_dump_compress;	/* zlib level */
 	int			restart_policy;
+	int			sl_batch_size;
+	int			sl_batch_timeout;	/* msecs */
+	int			sl_flush_severity;
+	int			hp_coalesce_window;	/* msecs */
+	int			hp_coalesce_max;
+	int			dedup_window;	/* secs, 0 = off */
+	int			dedup_hexdumps;
+	int			recovery_source;
+	char			archive_path[512];
+	int			archive_segment_size;	/* kbytes */
+	int			archive_segments;	/* 0 = off */
 	void			(*log_msg)(char *, ...);
 };
 
-#define RE_CFG_RECEIVED_SIGHUP	0x00000001
-#define RE_CFG_RECFG_SAFE	0x00000002
+/* values for recovery_source */
+#define RE_CFG_RECOVER_SYSLOG	0
+#define RE_CFG_RECOVER_JOURNAL	1
 
 extern struct ppc64_diag_config d_cfg;
 
@@ -29,6 +29,7 @@
 #include <stdint.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #include "platform.h"
 
@@ -38,6 +39,8 @@ static struct option long_options[] = {
 	{"context",	required_argument, NULL, 'c'},
 	{"from",	required_argument, NULL, 'f'},
 	{"to",		required_argument, NULL, 't'},
+	{"batch",	no_argument,       NULL, 'b'},
+	{"dt-root",	required_argument, NULL, 'r'},
 	{"help",	no_argument,       NULL, 'h'},
 	{0,0,0,0}
 };
@@ -72,15 +75,22 @@ static struct option long_options[] = {
 #define DRC_TYPE_LEN		16
 #define DRC_NAME_LEN		256   /* Worst case length to expect */
 
+/* Where the device tree is read from, see --dt-root */
+static char *dt_root = "/proc/device-tree";
+static char cpus_dir[PATH_MAX];
+
 /*
  * Association between older and newer 'drc info' structions
  * used to drive search routines.
  */
 struct drc_info_search_config {
 	char *drc_type;		/* device kind sought e.g. "MEM" "PHB" "CPU" */
-	char *v1_tree_address;
-	char *v1_tree_name_address;
-	char *v2_tree_address;
+	char *v1_prop;		/* properties, relative to dt_root */
+	char *v1_name_prop;
+	char *v2_prop;
+	char v1_tree_address[PATH_MAX];
+	char v1_tree_name_address[PATH_MAX];
+	char v2_tree_address[PATH_MAX];
 };
 
 /*
@@ -88,9 +98,9 @@ struct drc_info_search_config {
  */
 static struct drc_info_search_config mem_to_name = {
 	"MEM",
-	"/proc/device-tree/ibm,drc-indexes",
-	"/proc/device-tree/ibm,drc-names",
-	"/proc/device-tree/ibm,drc-info",
+	"ibm,drc-indexes",
+	"ibm,drc-names",
+	"ibm,drc-info",
 };
 
 /*
@@ -98,9 +108,9 @@ static struct drc_info_search_config mem_to_name = {
  */
 static struct drc_info_search_config cpu_to_name = {
 	"CPU",
-	"/proc/device-tree/cpus/ibm,drc-indexes",
-	"/proc/device-tree/cpus/ibm,drc-names",
-	"/proc/device-tree/cpus/ibm,drc-info",
+	"cpus/ibm,drc-indexes",
+	"cpus/ibm,drc-names",
+	"cpus/ibm,drc-info",
 };
 
 /*
@@ -122,14 +132,44 @@ int cpu_drcname_to_drcindex(char *, uint32_t *);
 static void
 print_usage(char *command) {
 	printf ("Usage: %s --context <x> --from <y> --to <z> <value>\n"
-		"\t--context: currently, <x> must be cpu\n"
+		"       %s --batch [--context <x>] [--from <y>] [--to <z>]\n"
+		"\t--context: <x> is cpu, or mem (from drc-index to drc-name)\n"
 		"\t--from and --to: allowed values for <y> and <z>:\n"
 		"\t\tinterrupt-server\n\t\tdrc-index\n\t\tdrc-name\n"
 		"\tif <value> is a drc-index or interrupt-server, it can be\n"
 		"\tspecified in decimal, hex (with a leading 0x), or octal\n"
 		"\t(with a leading 0); if it is a drc-name, it should be\n"
-		"\tspecified as a string in double quotes\n\n",
-		command);
+		"\tspecified as a string in double quotes\n"
+		"\t--batch: read one query per line from stdin, as\n"
+		"\t\t[--context <x>] [--from <y>] [--to <z>] <value>\n"
+		"\t\twith the flags given on the command line as defaults,\n"
+		"\t\tand write one line of answer per query\n"
+		"\t--dt-root: read the device tree from the given directory\n"
+		"\t\tinstead of /proc/device-tree\n\n",
+		command, command);
+}
+
+/**
+ * set_dt_root
+ * @brief Build the paths of the properties read under a device tree root
+ */
+static void
+set_dt_root(char *root)
+{
+	struct drc_info_search_config *sr[] = { &mem_to_name, &cpu_to_name };
+	int i;
+
+	dt_root = root;
+	snprintf(cpus_dir, sizeof(cpus_dir), "%s/cpus", root);
+
+	for (i = 0; i < 2; i++) {
+		snprintf(sr[i]->v1_tree_address, PATH_MAX, "%s/%s", root,
+			 sr[i]->v1_prop);
+		snprintf(sr[i]->v1_tree_name_address, PATH_MAX, "%s/%s", root,
+			 sr[i]->v1_name_prop);
+		snprintf(sr[i]->v2_tree_address, PATH_MAX, "%s/%s", root,
+			 sr[i]->v2_prop);
+	}
 }
 
 static int
@@ -506,28 +546,631 @@ cpu_drcname_to_drcindex(char *drc_name, uint32_t *drc_idx)
 }
 
 
+/*
+ * Batch mode (--batch) answers many queries in one run.  Each query above
+ * re-reads the properties it needs and walks them from the start, which
+ * is fine for one query, but not for the hundreds a script translating
+ * every CPU or LMB of a partition makes.  Instead, the drc tables and the
+ * CPU nodes are read once, on the first query that needs them, into
+ * arrays sorted for bsearch().
+ */
+struct drc_entry {
+	uint32_t	drc_index;
+	char		*drc_name;
+};
+
+struct drc_table {
+	int			loaded;
+	int			n;
+	int			size;
+	struct drc_entry	*by_index;
+	struct drc_entry	**by_name;
+};
+
+struct cpu_node {
+	uint32_t	drc_index;
+	uint32_t	*servers;
+	int		nservers;
+};
+
+struct server_entry {
+	uint32_t	server;
+	struct cpu_node	*cpu;
+};
+
+static struct drc_table cpu_drcs, mem_drcs;
+
+static int cpus_loaded;
+static struct cpu_node *cpu_nodes;
+static int ncpu_nodes;
+static struct server_entry *servers;
+static int nservers;
+
+/**
+ * read_prop
+ * @brief Read a whole device tree property
+ *
+ * @param path property file
+ * @param len set to the length of the property
+ * @return malloc'ed property value, NULL on failure
+ */
+static char *
+read_prop(const char *path, int *len)
+{
+	struct stat sbuf;
+	char *buf;
+	int fd, rc;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &sbuf) < 0 || (buf = malloc(sbuf.st_size + 1)) == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	*len = 0;
+	while (*len < sbuf.st_size) {
+		rc = read(fd, buf + *len, sbuf.st_size - *len);
+		if (rc <= 0)
+			break;
+		*len += rc;
+	}
+	close(fd);
+
+	/* so that a truncated string property still ends */
+	buf[*len] = '\0';
+	return buf;
+}
+
+static uint32_t
+prop_u32(const char *p)
+{
+	uint32_t val;
+
+	memcpy(&val, p, 4);
+	return be32toh(val);
+}
+
+static int
+add_drc(struct drc_table *t, uint32_t drc_index, const char *name_fmt,
+	const char *prefix, int suffix)
+{
+	struct drc_entry *e;
+	char name[DRC_NAME_LEN];
+
+	if (t->n == t->size) {
+		e = realloc(t->by_index, (t->size ? 2 * t->size : 64) *
+			    sizeof(*e));
+		if (!e)
+			return -1;
+		t->by_index = e;
+		t->size = t->size ? 2 * t->size : 64;
+	}
+
+	snprintf(name, sizeof(name), name_fmt, prefix, suffix);
+	e = &t->by_index[t->n];
+	e->drc_index = drc_index;
+	e->drc_name = strdup(name);
+	if (!e->drc_name)
+		return -1;
+
+	t->n++;
+	return 0;
+}
+
+/**
+ * load_drc_info_table
+ * @brief Expand the entries of an ibm,drc-info property of one drc-type
+ *
+ * Names are made up as search_drcindex_to_drcname() makes them up.
+ */
+static int
+load_drc_info_table(struct drc_info_search_config *sr, struct drc_table *t,
+		    char *buf, int len)
+{
+	char *p = buf + 4, *end = buf + len, *type, *prefix;
+	uint32_t i, j, num, start, suffix, count, incr;
+
+	if (len < 4)
+		return -1;
+
+	num = prop_u32(buf);
+	for (i = 0; i < num; i++) {
+		type = p;
+		p += strnlen(p, end - p) + 1;
+		prefix = p;
+		p += strnlen(p, end - p) + 1;
+
+		/* index start, name suffix start, count, increment, domain */
+		if (p + 5 * 4 > end)
+			return -1;
+		start = prop_u32(p);
+		suffix = prop_u32(p + 4);
+		count = prop_u32(p + 8);
+		incr = prop_u32(p + 12);
+		p += 5 * 4;
+
+		if (strcmp(type, sr->drc_type))
+			continue;
+
+		for (j = 0; j < count; j++)
+			if (add_drc(t, start + j * incr, "%s%d", prefix,
+				    suffix + j * incr))
+				return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * load_drc_v1_table
+ * @brief Pair up the ibm,drc-indexes and ibm,drc-names properties
+ */
+static int
+load_drc_v1_table(struct drc_info_search_config *sr, struct drc_table *t)
+{
+	char *indexes, *names, *p, *end;
+	int ilen, nlen, i, rc = -1;
+
+	indexes = read_prop(sr->v1_tree_address, &ilen);
+	names = read_prop(sr->v1_tree_name_address, &nlen);
+	if (!indexes || !names || ilen < 4 || nlen < 4) {
+		fprintf(stderr, "Error: property %s not found\n",
+			indexes ? sr->v1_tree_name_address :
+				  sr->v1_tree_address);
+		goto out;
+	}
+
+	p = names + 4;
+	end = names + nlen;
+	for (i = 1; i * 4 + 4 <= ilen && p < end; i++) {
+		if (add_drc(t, prop_u32(indexes + i * 4), "%s", p, 0))
+			goto out;
+		p += strnlen(p, end - p) + 1;
+	}
+	rc = 0;
+
+out:
+	free(indexes);
+	free(names);
+	return rc;
+}
+
+static int
+cmp_drc_index(const void *a, const void *b)
+{
+	const struct drc_entry *ea = a, *eb = b;
+
+	return ea->drc_index < eb->drc_index ? -1 :
+	       ea->drc_index > eb->drc_index;
+}
+
+static int
+cmp_drc_name(const void *a, const void *b)
+{
+	return strcmp((*(struct drc_entry * const *)a)->drc_name,
+		      (*(struct drc_entry * const *)b)->drc_name);
+}
+
+/**
+ * load_drc_table
+ * @brief Read the drc table of a drc-type once, for batch queries
+ *
+ * @return 0 on success, -1 if the table could not be read
+ */
+static int
+load_drc_table(struct drc_info_search_config *sr, struct drc_table *t)
+{
+	char *buf;
+	int len, i, rc;
+
+	if (t->loaded)
+		return t->loaded > 0 ? 0 : -1;
+
+	buf = read_prop(sr->v2_tree_address, &len);
+	if (buf) {
+		rc = load_drc_info_table(sr, t, buf, len);
+		free(buf);
+	} else {
+		rc = load_drc_v1_table(sr, t);
+	}
+
+	if (!rc && t->n) {
+		t->by_name = malloc(t->n * sizeof(*t->by_name));
+		if (!t->by_name)
+			rc = -1;
+	}
+
+	if (rc) {
+		t->loaded = -1;
+		return -1;
+	}
+
+	qsort(t->by_index, t->n, sizeof(*t->by_index), cmp_drc_index);
+	for (i = 0; i < t->n; i++)
+		t->by_name[i] = &t->by_index[i];
+	qsort(t->by_name, t->n, sizeof(*t->by_name), cmp_drc_name);
+
+	t->loaded = 1;
+	return 0;
+}
+
+static int
+cmp_cpu_node(const void *a, const void *b)
+{
+	const struct cpu_node *ca = a, *cb = b;
+
+	return ca->drc_index < cb->drc_index ? -1 :
+	       ca->drc_index > cb->drc_index;
+}
+
+static int
+cmp_server(const void *a, const void *b)
+{
+	const struct server_entry *sa = a, *sb = b;
+
+	return sa->server < sb->server ? -1 : sa->server > sb->server;
+}
+
+/**
+ * load_cpu_nodes
+ * @brief Read the drc-index and interrupt servers of every CPU node once
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int
+load_cpu_nodes(void)
+{
+	struct cpu_node *cpu;
+	struct dirent *entry;
+	char path[PATH_MAX], *drc, *intservs;
+	int dlen, slen, i, j;
+	DIR *dir;
+
+	if (cpus_loaded)
+		return cpus_loaded > 0 ? 0 : -1;
+	cpus_loaded = -1;
+
+	dir = opendir(cpus_dir);
+	if (!dir) {
+		fprintf(stderr, "Error opening %s:\n%s\n", cpus_dir,
+			strerror(errno));
+		return -1;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "PowerPC,POWER", 13))
+			continue;
+
+		drc = intservs = NULL;
+		if (snprintf(path, sizeof(path), "%s/%s/ibm,my-drc-index",
+			     cpus_dir, entry->d_name) < sizeof(path))
+			drc = read_prop(path, &dlen);
+		if (snprintf(path, sizeof(path), "%s/%s/"
+			     "ibm,ppc-interrupt-server#s", cpus_dir,
+			     entry->d_name) < sizeof(path))
+			intservs = read_prop(path, &slen);
+
+		if (!drc || !intservs || dlen < 4) {
+			free(drc);
+			free(intservs);
+			continue;
+		}
+
+		cpu = realloc(cpu_nodes, (ncpu_nodes + 1) * sizeof(*cpu));
+		if (!cpu) {
+			free(drc);
+			free(intservs);
+			closedir(dir);
+			return -1;
+		}
+		cpu_nodes = cpu;
+		cpu = &cpu_nodes[ncpu_nodes++];
+
+		cpu->drc_index = prop_u32(drc);
+		cpu->nservers = slen / 4;
+		cpu->servers = (uint32_t *)intservs;
+		for (i = 0; i < cpu->nservers; i++)
+			cpu->servers[i] = prop_u32(intservs + i * 4);
+		nservers += cpu->nservers;
+		free(drc);
+	}
+	closedir(dir);
+
+	qsort(cpu_nodes, ncpu_nodes, sizeof(*cpu_nodes), cmp_cpu_node);
+
+	servers = malloc((nservers ? nservers : 1) * sizeof(*servers));
+	if (!servers)
+		return -1;
+	for (i = 0, j = 0; i < ncpu_nodes; i++) {
+		int k;
+
+		for (k = 0; k < cpu_nodes[i].nservers; k++) {
+			servers[j].server = cpu_nodes[i].servers[k];
+			servers[j++].cpu = &cpu_nodes[i];
+		}
+	}
+	qsort(servers, nservers, sizeof(*servers), cmp_server);
+
+	cpus_loaded = 1;
+	return 0;
+}
+
+static struct drc_entry *
+find_drc_index(struct drc_table *t, uint32_t drc_index)
+{
+	struct drc_entry key = { .drc_index = drc_index };
+
+	return bsearch(&key, t->by_index, t->n, sizeof(*t->by_index),
+		       cmp_drc_index);
+}
+
+static struct drc_entry *
+find_drc_name(struct drc_table *t, char *drc_name)
+{
+	struct drc_entry key = { .drc_name = drc_name }, *kp = &key, **e;
+
+	e = bsearch(&kp, t->by_name, t->n, sizeof(*t->by_name), cmp_drc_name);
+	return e ? *e : NULL;
+}
+
+static struct cpu_node *
+find_cpu_node(uint32_t drc_index)
+{
+	struct cpu_node key = { .drc_index = drc_index };
+
+	return bsearch(&key, cpu_nodes, ncpu_nodes, sizeof(*cpu_nodes),
+		       cmp_cpu_node);
+}
+
+static struct cpu_node *
+find_cpu_server(uint32_t server)
+{
+	struct server_entry key = { .server = server }, *e;
+
+	e = bsearch(&key, servers, nservers, sizeof(*servers), cmp_server);
+	return e ? e->cpu : NULL;
+}
+
+/**
+ * batch_query
+ * @brief Answer one query from the in-memory tables
+ *
+ * Prints one line, empty if the query could not be answered.
+ *
+ * @return 0 on success, or the exit status of the equivalent single query
+ */
+static int
+batch_query(char *context, char *from, char *to, char *value)
+{
+	struct drc_entry *drc = NULL;
+	struct cpu_node *cpu = NULL;
+	uint32_t drcindex, interruptserver;
+	int i, rc = 0;
+
+	if (!strcmp(context, "mem")) {
+		if (strcmp(from, "drc-index") || strcmp(to, "drc-name")) {
+			fprintf(stderr, "invalid --to flag: %s\n", to);
+			rc = 3;
+			goto out;
+		}
+
+		drcindex = strtoul(value, NULL, 0);
+		if (!load_drc_table(&mem_to_name, &mem_drcs))
+			drc = find_drc_index(&mem_drcs, drcindex);
+		if (!drc) {
+			fprintf(stderr, "could not find the drc-name "
+				"corresponding to drc-index 0x%08x\n",
+				drcindex);
+			rc = 4;
+			goto out;
+		}
+		printf("%s", drc->drc_name);
+		goto out;
+	}
+
+	if (strcmp(context, "cpu")) {
+		fprintf(stderr, "invalid --context flag: %s\n", context);
+		rc = 1;
+		goto out;
+	}
+
+	if (strcmp(to, "interrupt-server") && strcmp(to, "drc-index") &&
+	    strcmp(to, "drc-name")) {
+		fprintf(stderr, "invalid --to flag: %s\n", to);
+		rc = 3;
+		goto out;
+	}
+
+	/* First get to the drc-index */
+	if (!strcmp(from, "interrupt-server")) {
+		interruptserver = strtol(value, NULL, 0);
+		if (!load_cpu_nodes())
+			cpu = find_cpu_server(interruptserver);
+		if (!cpu) {
+			fprintf(stderr, "could not find the drc-index "
+				"corresponding to interrupt-server 0x%08x\n",
+				interruptserver);
+			rc = 4;
+			goto out;
+		}
+		drcindex = cpu->drc_index;
+	} else if (!strcmp(from, "drc-index")) {
+		drcindex = strtol(value, NULL, 0);
+	} else if (!strcmp(from, "drc-name")) {
+		if (!load_drc_table(&cpu_to_name, &cpu_drcs))
+			drc = find_drc_name(&cpu_drcs, value);
+		if (!drc) {
+			fprintf(stderr, "could not find the drc-index "
+				"corresponding to drc-name %s\n", value);
+			rc = 4;
+			goto out;
+		}
+		drcindex = drc->drc_index;
+	} else {
+		fprintf(stderr, "invalid --from flag: %s\n", from);
+		rc = 2;
+		goto out;
+	}
+
+	if (!strcmp(from, to)) {
+		fprintf(stderr, "invalid --to flag: %s\n", to);
+		rc = 3;
+	} else if (!strcmp(to, "drc-index")) {
+		printf("0x%08x", drcindex);
+	} else if (!strcmp(to, "drc-name")) {
+		drc = NULL;
+		if (!load_drc_table(&cpu_to_name, &cpu_drcs))
+			drc = find_drc_index(&cpu_drcs, drcindex);
+		if (!drc) {
+			fprintf(stderr, "could not find the drc-name "
+				"corresponding to drc-index 0x%08x\n",
+				drcindex);
+			rc = 4;
+			goto out;
+		}
+		printf("%s", drc->drc_name);
+	} else {
+		if (!cpu && !load_cpu_nodes())
+			cpu = find_cpu_node(drcindex);
+		if (!cpu || !cpu->nservers) {
+			fprintf(stderr, "could not find the interrupt-server "
+				"corresponding to drc-index 0x%08x\n",
+				drcindex);
+			rc = 4;
+			goto out;
+		}
+		/* All of the servers, on the one line */
+		for (i = 0; i < cpu->nservers; i++)
+			printf("%s0x%08x", i ? " " : "", cpu->servers[i]);
+	}
+
+out:
+	printf("\n");
+	return rc;
+}
+
+/* Split the next word off a query line */
+static char *
+next_word(char **line)
+{
+	char *word;
+
+	*line += strspn(*line, " \t");
+	word = *line;
+	*line += strcspn(*line, " \t");
+	if (**line != '\0')
+		*(*line)++ = '\0';
+
+	return *word ? word : NULL;
+}
+
+/**
+ * run_batch
+ * @brief Answer the queries read from stdin, one per line
+ *
+ * Lines are "[--context <x>] [--from <y>] [--to <z>] <value>", the
+ * short flags are accepted as well, and flags left out default to the
+ * ones given on the command line.  The value is the rest of the line,
+ * optionally in double quotes, so that drc-names can hold spaces.
+ * Output is flushed after every answer, for callers that write a query
+ * and wait for its answer.
+ *
+ * @return 0 if every query was answered, or the exit status of the last
+ *	one that was not
+ */
+static int
+run_batch(char *context, char *from, char *to)
+{
+	char line[DRC_NAME_LEN + 128], *p, *word, *arg, *value;
+	char *q_context, *q_from, *q_to;
+	int len, rc, status = 0;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		len = strcspn(line, "\n");
+		line[len] = '\0';
+
+		p = line;
+		q_context = context;
+		q_from = from;
+		q_to = to;
+		rc = 0;
+
+		for (;;) {
+			p += strspn(p, " \t");
+			if (*p != '-')
+				break;
+
+			word = next_word(&p);
+			arg = next_word(&p);
+			if (!arg) {
+				fprintf(stderr, "%s needs a value\n", word);
+				rc = 1;
+				break;
+			}
+
+			if (!strcmp(word, "--context") || !strcmp(word, "-c"))
+				q_context = arg;
+			else if (!strcmp(word, "--from") || !strcmp(word, "-f"))
+				q_from = arg;
+			else if (!strcmp(word, "--to") || !strcmp(word, "-t"))
+				q_to = arg;
+			else {
+				fprintf(stderr, "invalid flag: %s\n", word);
+				rc = 1;
+				break;
+			}
+		}
+
+		/* The value, without trailing blanks and quotes */
+		value = p;
+		len = strlen(value);
+		while (len && (value[len - 1] == ' ' || value[len - 1] == '\t'))
+			value[--len] = '\0';
+		if (len >= 2 && value[0] == '"' && value[len - 1] == '"') {
+			value[len - 1] = '\0';
+			value++;
+		}
+
+		if (!rc && !q_context) {
+			fprintf(stderr, "--context not specified\n");
+			rc = 1;
+		} else if (!rc && !q_from) {
+			fprintf(stderr, "--from not specified\n");
+			rc = 2;
+		} else if (!rc && !q_to) {
+			fprintf(stderr, "--to not specified\n");
+			rc = 3;
+		}
+
+		if (rc)
+			printf("\n");
+		else
+			rc = batch_query(q_context, q_from, q_to, value);
+
+		if (rc)
+			status = rc;
+		fflush(stdout);
+	}
+
+	return status;
+}
+
 int
 main(int argc, char *argv[]) {
 	int option_index, rc, i;
-	int platform = 0;
+	int platform = 0, batch = 0;
 	char *context=NULL, *from=NULL, *to=NULL;
 	uint32_t interruptserver, drcindex;
 	unsigned long drc_tmp_idx;
 	uint32_t intservs_array[MAX_IRQ_SERVERS_PER_CPU];
 	char drcname[DRC_NAME_LEN];
 
-	platform = get_platform();
-	switch (platform) {
-	case PLATFORM_UNKNOWN:
-	case PLATFORM_POWERNV:
-		fprintf(stderr, "%s: is not supported on the %s platform\n",
-				argv[0], __power_platform_name(platform));
-		return -1;
-	}
-
 	for (;;) {
 		option_index = 0;
-		rc = getopt_long(argc, argv, "hc:f:t:", long_options,
+		rc = getopt_long(argc, argv, "hbc:f:r:t:", long_options,
 				&option_index);
 
 		if (rc == -1)
@@ -545,6 +1188,12 @@ main(int argc, char *argv[]) {
 		case 't':	/* to */
 			to = optarg;
 			break;
+		case 'b':	/* batch */
+			batch = 1;
+			break;
+		case 'r':	/* dt-root */
+			dt_root = optarg;
+			break;
 		case '?':
 			print_usage(argv[0]);
 			return -1;
@@ -555,6 +1204,23 @@ main(int argc, char *argv[]) {
 		}
 	}
 
+	/* Another device tree than the running one can be read anywhere */
+	if (!strcmp(dt_root, "/proc/device-tree")) {
+		platform = get_platform();
+		switch (platform) {
+		case PLATFORM_UNKNOWN:
+		case PLATFORM_POWERNV:
+			fprintf(stderr, "%s: is not supported on the %s "
+				"platform\n", argv[0],
+				__power_platform_name(platform));
+			return -1;
+		}
+	}
+	set_dt_root(dt_root);
+
+	if (batch)
+		return run_batch(context, from, to);
+
 	if (!context) {
 		fprintf(stderr, "--context not specified\n");
 		return 1;
@@ -737,12 +1403,15 @@ cpu_interruptserver_to_drcindex(uint32_t int_serv, uint32_t *drc_idx) {
 	uint32_t temp;
 	int rc;
 
-	dir = opendir("/proc/device-tree/cpus");
+	dir = opendir(cpus_dir);
+	if (!dir)
+		return 0;
 
 	while (!found && (entry = readdir(dir)) != NULL) {
 		if (!strncmp(entry->d_name, "PowerPC,POWER", 13)) {
-			rc = snprintf(buffer, 1024, "/proc/device-tree/cpus/%s/ibm"
-						",ppc-interrupt-server#s", entry->d_name);
+			rc = snprintf(buffer, 1024, "%s/%s/ibm"
+						",ppc-interrupt-server#s", cpus_dir,
+						entry->d_name);
 			if (rc < 0 || rc >= 1024) {
 				fprintf(stderr, "%s:%d - Unable to format %s\n",
 						__func__, __LINE__, entry->d_name);
@@ -758,8 +1427,9 @@ cpu_interruptserver_to_drcindex(uint32_t int_serv, uint32_t *drc_idx) {
 			while (read_uint32(fd, &temp) == 0) {
 				if (temp == int_serv) {
 					close(fd);
-					rc = snprintf(buffer, 1024, "/proc/device-tree/cpus/%s/"
-							"ibm,my-drc-index", entry->d_name);
+					rc = snprintf(buffer, 1024, "%s/%s/"
+							"ibm,my-drc-index", cpus_dir,
+							entry->d_name);
 					if (rc < 0 || rc >= 1024) {
 						fprintf(stderr, "%s:%d - Unable to format %s\n",
 								__func__, __LINE__, entry->d_name);
@@ -799,14 +1469,14 @@ cpu_drcindex_to_interruptserver(uint32_t drc_idx, uint32_t *int_servs,
 	uint32_t temp;
 	int rc;
 
-	dir = opendir("/proc/device-tree/cpus");
+	dir = opendir(cpus_dir);
 	if (!dir)
 		return 0;
 
 	while (!found && (entry = readdir(dir)) != NULL) {
 		if (!strncmp(entry->d_name, "PowerPC,POWER", 13)) {
-			rc = snprintf(buffer, 1024, "/proc/device-tree/cpus/%s/ibm,my-drc-index",
-					entry->d_name);
+			rc = snprintf(buffer, 1024, "%s/%s/ibm,my-drc-index",
+					cpus_dir, entry->d_name);
 			if (rc < 0 || rc >= 1024) {
 				fprintf(stderr, "%s:%d - Unable to format %s\n",
 						__func__, __LINE__, entry->d_name);
@@ -822,9 +1492,9 @@ cpu_drcindex_to_interruptserver(uint32_t drc_idx, uint32_t *int_servs,
 
 			while (read_uint32(drc_fd, &temp) == 0) {
 				if (temp == drc_idx) {
-					rc = snprintf(buffer, 1024, "/proc/device-tree/cpus/%s/"
+					rc = snprintf(buffer, 1024, "%s/%s/"
 							"ibm,ppc-interrupt-server#s",
-							entry->d_name);
+							cpus_dir, entry->d_name);
 					if (rc < 0 || rc >= 1024) {
 						fprintf(stderr, "%s:%d - Unable to format %s\n",
 								__func__, __LINE__, entry->d_name);
@@ -843,7 +1513,7 @@ cpu_drcindex_to_interruptserver(uint32_t drc_idx, uint32_t *int_servs,
 					}
 					while (found < array_elements &&
 						(read(intr_fd, &temp, 4)) == 4)
-							int_servs[found++] = temp;
+							int_servs[found++] = be32toh(temp);
 					close(intr_fd);
 					break;
 				}
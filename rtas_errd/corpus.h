@@ -0,0 +1,50 @@
+/**
+ * @file corpus.h
+ * @brief Binary RTAS event corpus format
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _CORPUS_H
+#define _CORPUS_H
+
+#include <stdint.h>
+
+/*
+ * A corpus holds any number of RTAS events for rtas_errd to replay
+ * (the DEBUG -C option), so that long runs of events are not slowed
+ * down by parsing an ascii test file for every one of them.
+ *
+ * The file starts with a struct rtas_corpus_hdr, followed by the
+ * events, each one a struct rtas_corpus_rec followed by rec.len bytes
+ * of raw RTAS event data.  All header fields are big endian.
+ */
+#define RTAS_CORPUS_MAGIC	"RTASCORP"
+#define RTAS_CORPUS_VERSION	1
+
+struct rtas_corpus_hdr {
+	char		magic[8];	/**< RTAS_CORPUS_MAGIC, no NUL */
+	uint32_t	version;	/**< RTAS_CORPUS_VERSION */
+	uint32_t	count;		/**< number of events */
+};
+
+struct rtas_corpus_rec {
+	uint32_t	seq_num;	/**< RTAS event number */
+	uint32_t	len;		/**< length of the event data */
+};
+
+#endif /* _CORPUS_H */
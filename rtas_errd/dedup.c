@@ -0,0 +1,461 @@
+/**
+ * @file dedup.c
+ * @brief Collapse storms of identical RTAS events
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <librtasevent.h>
+#include "rtas_errd.h"
+
+/*
+ * A failing component can report the same recovered or predictive
+ * error hundreds of times.  The first occurrence of an event is
+ * handled as usual; repeats of it within EventDedupWindow seconds only
+ * have their hexdump written to the platform log, for the first
+ * EventDedupHexdumps of them, and are neither analyzed nor logged to
+ * servicelog.  When the window closes the number of occurrences is
+ * logged to servicelog as an informational entry of its own.
+ *
+ * Events are considered identical when their signature matches: the
+ * severity, the primary SRC and the callout location codes for v6
+ * events, or the severity and the event data less its time stamp for
+ * earlier events, whose refcode only comes out of the analysis.
+ *
+ * The repeats seen so far are saved in the spool, so that a crash
+ * within the window does not lose them.  The next start restores them
+ * with a new window; the repeats it replays from the spool are not
+ * counted twice.
+ */
+
+/**
+ * @struct dedup_entry
+ * @brief An event signature seen within the dedup window
+ */
+struct dedup_entry {
+	uint64_t	sig;		/**< event signature hash */
+	int		first_seq;	/**< event handled in full */
+	int		first_repeat;	/**< first repeat */
+	int		last_seq;	/**< last repeat */
+	int		count;		/**< occurrences, including the first */
+	uint64_t	sl_key;		/**< servicelog key of first_seq */
+	char		refcode[DEDUP_REFCODE_LEN]; /**< of first_seq */
+	struct timespec	expires;	/**< end of the dedup window */
+	int		rec;		/**< spool record, -1 if none */
+	int		restored_seq;	/**< last repeat counted by the last
+					     run, 0 if none */
+};
+
+static struct dedup_entry dedup_table[DEDUP_MAX];
+static int dedup_count = 0;
+
+/* Pre-v6 extended log time stamp: date and time, 8 bytes at offset 12 */
+#define PRE_V6_TIME_OFFSET	12
+#define PRE_V6_TIME_LEN		8
+
+#define FNV_OFFSET	0xcbf29ce484222325ULL
+#define FNV_PRIME	0x100000001b3ULL
+
+static uint64_t
+fnv_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/**
+ * dedup_signature
+ * @brief Compute the signature of an event
+ *
+ * @param event RTAS event
+ * @param sig buffer for the signature
+ * @return 0 on success, !0 if the event has no usable signature
+ */
+static int
+dedup_signature(struct event *event, uint64_t *sig)
+{
+	struct rtas_src_scn *src;
+	struct rtas_fru_scn *fru;
+	uint64_t hash = FNV_OFFSET;
+	int sev = event->rtas_hdr->severity;
+
+	hash = fnv_hash(hash, &sev, sizeof(sev));
+
+	if (event->rtas_hdr->version == 6) {
+		src = event_scn(event, RTAS_PSRC_SCN);
+		if (src == NULL)
+			return -1;
+
+		hash = fnv_hash(hash, src->primary_refcode,
+				strnlen(src->primary_refcode,
+					sizeof(src->primary_refcode)));
+
+		for (fru = src->fru_scns; fru != NULL; fru = fru->next)
+			hash = fnv_hash(hash, fru->loc_code,
+					strnlen(fru->loc_code,
+						sizeof(fru->loc_code)) + 1);
+	} else {
+		if (event->length < PRE_V6_TIME_OFFSET + PRE_V6_TIME_LEN)
+			return -1;
+
+		hash = fnv_hash(hash, event->event_buf, PRE_V6_TIME_OFFSET);
+		hash = fnv_hash(hash, event->event_buf + PRE_V6_TIME_OFFSET +
+				PRE_V6_TIME_LEN, event->length -
+				PRE_V6_TIME_OFFSET - PRE_V6_TIME_LEN);
+	}
+
+	*sig = hash;
+	return 0;
+}
+
+static int
+dedup_expired(struct dedup_entry *entry, struct timespec *now)
+{
+	return now->tv_sec > entry->expires.tv_sec ||
+	       (now->tv_sec == entry->expires.tv_sec &&
+		now->tv_nsec >= entry->expires.tv_nsec);
+}
+
+/**
+ * dedup_save
+ * @brief Save the repeats of an event to the spool
+ *
+ * @param entry the event's entry in dedup_table
+ */
+static void
+dedup_save(struct dedup_entry *entry)
+{
+	struct spool_repeat repeat;
+
+	memset(&repeat, 0, sizeof(repeat));
+	repeat.sig = entry->sig;
+	repeat.sl_key = entry->sl_key;
+	repeat.first_seq = entry->first_seq;
+	repeat.last_seq = entry->last_seq;
+	repeat.count = entry->count;
+	memcpy(repeat.refcode, entry->refcode, sizeof(repeat.refcode));
+
+	entry->rec = spool_save_repeat(entry->rec, &repeat);
+}
+
+/**
+ * dedup_window_start
+ * @brief Start the dedup window of an entry
+ */
+static void
+dedup_window_start(struct dedup_entry *entry)
+{
+	clock_gettime(CLOCK_MONOTONIC, &entry->expires);
+	entry->expires.tv_sec += d_cfg.dedup_window;
+}
+
+/**
+ * dedup_close
+ * @brief Record the number of occurrences of an event and forget it
+ *
+ * @param i index of the entry in dedup_table
+ */
+static void
+dedup_close(int i)
+{
+	struct dedup_entry *entry = &dedup_table[i];
+
+	if (entry->count > 1) {
+		/* The first occurrence may still be queued for servicelog */
+		if (entry->sl_key == 0)
+			log_event_flush();
+
+		log_msg(NULL, "RTAS event %d occurred %d times, repeats up to "
+			"RTAS event %d were not logged to servicelog",
+			entry->first_seq, entry->count, entry->last_seq);
+		platform_log_write("RTAS event %d occurred %d times, last as "
+				   "RTAS event %d\n", entry->first_seq,
+				   entry->count, entry->last_seq);
+
+		if (entry->sl_key != 0)
+			log_event_occurrences(entry->sl_key, entry->refcode,
+					      entry->count, entry->first_seq,
+					      entry->last_seq);
+	}
+
+	spool_drop_repeat(entry->rec);
+	dedup_table[i] = dedup_table[--dedup_count];
+}
+
+/**
+ * dedup_expire
+ * @brief Close the entries whose dedup window has ended
+ */
+static void
+dedup_expire(void)
+{
+	struct timespec now;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (i = dedup_count - 1; i >= 0; i--)
+		if (dedup_expired(&dedup_table[i], &now))
+			dedup_close(i);
+}
+
+/**
+ * dedup_event
+ * @brief Check whether an event repeats one seen within the window
+ *
+ * Only recovered and predictive errors are deduplicated.
+ *
+ * @param event RTAS event
+ * @return 0 if the event is to be handled in full, otherwise the
+ *	   number of times it has been repeated so far
+ */
+int
+dedup_event(struct event *event)
+{
+	struct rtas_event_exthdr *exthdr;
+	struct dedup_entry *entry;
+	uint64_t sig;
+	int i, oldest;
+
+	if (d_cfg.dedup_window == 0)
+		return 0;
+
+	dedup_expire();
+
+	switch (event->rtas_hdr->type) {
+	    case RTAS_HDR_TYPE_EPOW:
+	    case RTAS_HDR_TYPE_DUMP_NOTIFICATION:
+	    case RTAS_HDR_TYPE_PRRN:
+	    case RTAS_HDR_TYPE_HOTPLUG:
+		return 0;
+	}
+
+	exthdr = event_scn(event, RTAS_EVENT_EXT_HDR);
+	if (exthdr == NULL || !(exthdr->recoverable || exthdr->predictive))
+		return 0;
+
+	if (dedup_signature(event, &sig))
+		return 0;
+
+	for (i = 0; i < dedup_count; i++) {
+		entry = &dedup_table[i];
+		if (entry->sig != sig)
+			continue;
+
+		/* Replayed from the spool, and counted by the last run */
+		if (event->seq_num <= entry->restored_seq) {
+			if (event->seq_num == entry->first_seq)
+				return 0;
+			return entry->count - 1;
+		}
+
+		if (entry->count == 1)
+			entry->first_repeat = event->seq_num;
+		entry->last_seq = event->seq_num;
+		dbg("RTAS event %d repeats RTAS event %d", event->seq_num,
+		    entry->first_seq);
+		entry->count++;
+		dedup_save(entry);
+		return entry->count - 1;
+	}
+
+	/* Make room by closing the entry whose window ends first */
+	if (dedup_count == DEDUP_MAX) {
+		oldest = 0;
+		for (i = 1; i < dedup_count; i++) {
+			struct timespec *a = &dedup_table[i].expires;
+			struct timespec *b = &dedup_table[oldest].expires;
+
+			if (a->tv_sec < b->tv_sec ||
+			    (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec))
+				oldest = i;
+		}
+		dedup_close(oldest);
+	}
+
+	entry = &dedup_table[dedup_count++];
+	memset(entry, 0, sizeof(*entry));
+	entry->sig = sig;
+	entry->first_seq = entry->last_seq = event->seq_num;
+	entry->count = 1;
+	entry->rec = -1;
+	dedup_window_start(entry);
+
+	return 0;
+}
+
+/**
+ * dedup_logged
+ * @brief Note the servicelog key of an event
+ *
+ * Called once an event has been logged to servicelog, so the number
+ * of occurrences logged when its dedup window closes can refer to it.
+ *
+ * @param seq_num RTAS event number
+ * @param key servicelog key
+ * @param refcode refcode of the servicelog entry, may be NULL
+ */
+void
+dedup_logged(int seq_num, uint64_t key, const char *refcode)
+{
+	struct dedup_entry *entry;
+	int i;
+
+	for (i = 0; i < dedup_count; i++) {
+		entry = &dedup_table[i];
+		if (entry->first_seq != seq_num)
+			continue;
+
+		entry->sl_key = key;
+		if (refcode != NULL) {
+			strncpy(entry->refcode, refcode,
+				sizeof(entry->refcode) - 1);
+			entry->refcode[sizeof(entry->refcode) - 1] = '\0';
+		}
+
+		/* The restored repeats must refer to the entry */
+		if (entry->rec >= 0)
+			dedup_save(entry);
+		return;
+	}
+}
+
+/**
+ * dedup_deadline
+ * @brief Retrieve the time at which the next dedup window ends
+ *
+ * Only windows with repeats to record are considered.
+ *
+ * @param deadline buffer for the CLOCK_MONOTONIC deadline
+ * @return 1 if a window with repeats is open, 0 otherwise
+ */
+int
+dedup_deadline(struct timespec *deadline)
+{
+	int i, rc = 0;
+
+	for (i = 0; i < dedup_count; i++) {
+		struct timespec *e = &dedup_table[i].expires;
+
+		if (dedup_table[i].count < 2)
+			continue;
+
+		if (!rc || e->tv_sec < deadline->tv_sec ||
+		    (e->tv_sec == deadline->tv_sec &&
+		     e->tv_nsec < deadline->tv_nsec))
+			*deadline = *e;
+		rc = 1;
+	}
+
+	return rc;
+}
+
+/**
+ * dedup_pending
+ * @brief Retrieve the first repeat that is not recorded yet
+ *
+ * Repeats are only recorded when their dedup window closes.  Those
+ * that could not be saved to the spool keep the spool slots of the
+ * repeats until then (see checkpoint_flushed()).
+ *
+ * @param seq_num buffer for the RTAS event number
+ * @return 1 if a window with unsaved repeats is open, 0 otherwise
+ */
+int
+dedup_pending(int *seq_num)
+{
+	int i, rc = 0;
+
+	for (i = 0; i < dedup_count; i++) {
+		if (dedup_table[i].count < 2 || dedup_table[i].rec >= 0)
+			continue;
+
+		if (!rc || dedup_table[i].first_repeat < *seq_num)
+			*seq_num = dedup_table[i].first_repeat;
+		rc = 1;
+	}
+
+	return rc;
+}
+
+/**
+ * dedup_restore
+ * @brief Reopen the dedup windows the last run saved to the spool
+ *
+ * Called before the spool is replayed.  The windows are given their
+ * full length again.
+ */
+void
+dedup_restore(void)
+{
+	struct spool_repeat repeat;
+	struct dedup_entry *entry;
+	int i = 0;
+
+	while (dedup_count < DEDUP_MAX &&
+	       (i = spool_next_repeat(i, &repeat)) >= 0) {
+		entry = &dedup_table[dedup_count++];
+		memset(entry, 0, sizeof(*entry));
+		entry->sig = repeat.sig;
+		entry->sl_key = repeat.sl_key;
+		entry->first_seq = repeat.first_seq;
+		entry->first_repeat = entry->last_seq = repeat.last_seq;
+		entry->restored_seq = repeat.last_seq;
+		entry->count = repeat.count;
+		memcpy(entry->refcode, repeat.refcode, sizeof(entry->refcode));
+		entry->refcode[sizeof(entry->refcode) - 1] = '\0';
+		entry->rec = i++;
+		dedup_window_start(entry);
+
+		dbg("Restored %d occurrences of RTAS event %d, up to RTAS "
+		    "event %d", entry->count, entry->first_seq,
+		    entry->last_seq);
+	}
+
+	/* Deduplication was turned off since */
+	if (d_cfg.dedup_window == 0)
+		dedup_flush(1);
+}
+
+/**
+ * dedup_flush
+ * @brief Close expired dedup windows, or all of them
+ *
+ * @param all 1 to close every window (at exit), 0 for expired ones
+ */
+void
+dedup_flush(int all)
+{
+	if (!all) {
+		dedup_expire();
+		return;
+	}
+
+	while (dedup_count)
+		dedup_close(dedup_count - 1);
+}
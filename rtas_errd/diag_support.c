@@ -24,6 +24,7 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <ctype.h>
 #include <librtas.h>
 #include <sys/types.h>
@@ -35,38 +36,35 @@
 
 char target_status[80];
 
+/**
+ * @struct vpd_cache_entry
+ * @brief One lsvpd record, hashed by its location code (YL)
+ */
+struct vpd_cache_entry {
+	struct diag_vpd		vpd;
+	struct vpd_cache_entry	*next;	/**< next entry in the hash chain */
+};
+
+/*
+ * The VPD of every FRU, keyed by location code, so that callout lookups
+ * don't have to run and parse lsvpd each time.  The cache is built from
+ * a single lsvpd run at startup and rebuilt on the next lookup after a
+ * hotplug or PRRN event has changed the configuration.
+ */
+static struct vpd_cache_entry	**vpd_cache;
+static unsigned int		vpd_cache_buckets;
+static int			vpd_cache_valid;
+
+/**
+ * free_diag_vpd
+ * @brief Forget the VPD looked up for an event
+ *
+ * The VPD strings belong to the VPD cache, so there is nothing to free.
+ */
 void
 free_diag_vpd(struct event *event)
 {
-	if (event->diag_vpd.ds != NULL) {
-		free(event->diag_vpd.ds);
-		event->diag_vpd.ds = NULL;
-	}
-
-	if (event->diag_vpd.yl != NULL) {
-		free(event->diag_vpd.yl);
-		event->diag_vpd.yl = NULL;
-	}
-
-	if (event->diag_vpd.fn != NULL) {
-		free(event->diag_vpd.fn);
-		event->diag_vpd.fn = NULL;
-	}
-
-	if (event->diag_vpd.sn != NULL) {
-		free(event->diag_vpd.sn);
-		event->diag_vpd.sn = NULL;
-	}
-
-	if (event->diag_vpd.se != NULL) {
-		free(event->diag_vpd.se);
-		event->diag_vpd.se = NULL;
-	}
-
-	if (event->diag_vpd.tm != NULL) {
-		free(event->diag_vpd.tm);
-		event->diag_vpd.tm = NULL;
-	}
+	memset(&event->diag_vpd, 0, sizeof(event->diag_vpd));
 }
 
 /*
@@ -110,133 +108,269 @@ lsvpd_term(FILE *fp, pid_t *cpid)
         return rc;
 }
 
+static void
+free_vpd_entry(struct vpd_cache_entry *entry)
+{
+	free(entry->vpd.ds);
+	free(entry->vpd.yl);
+	free(entry->vpd.fn);
+	free(entry->vpd.sn);
+	free(entry->vpd.se);
+	free(entry->vpd.tm);
+	free(entry);
+}
+
+/**
+ * vpd_cache_free
+ * @brief Release every entry of the VPD cache
+ */
+void
+vpd_cache_free(void)
+{
+	struct vpd_cache_entry *entry, *next;
+	unsigned int i;
+
+	for (i = 0; i < vpd_cache_buckets; i++) {
+		for (entry = vpd_cache[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			free_vpd_entry(entry);
+		}
+	}
+
+	free(vpd_cache);
+	vpd_cache = NULL;
+	vpd_cache_buckets = 0;
+	vpd_cache_valid = 0;
+}
+
+/**
+ * vpd_cache_invalidate
+ * @brief Mark the VPD cache out of date
+ *
+ * Called after events that add, remove or move FRUs.  The cache is
+ * rebuilt by the next lookup rather than right away, so a burst of
+ * such events only costs one lsvpd run.
+ */
+void
+vpd_cache_invalidate(void)
+{
+	if (vpd_cache_valid)
+		dbg("VPD cache invalidated");
+
+	vpd_cache_valid = 0;
+}
+
+static unsigned int
+vpd_hash(const char *loc)
+{
+	unsigned int hash = 5381;
+
+	while (*loc)
+		hash = (hash * 33) ^ (unsigned char)*loc++;
+
+	return hash;
+}
+
+static struct vpd_cache_entry *
+vpd_cache_find(const char *loc)
+{
+	struct vpd_cache_entry *entry;
+
+	if (vpd_cache_buckets == 0)
+		return NULL;
+
+	entry = vpd_cache[vpd_hash(loc) & (vpd_cache_buckets - 1)];
+	for (; entry != NULL; entry = entry->next) {
+		if (!strcmp(entry->vpd.yl, loc))
+			return entry;
+	}
 
+	return NULL;
+}
 
 /*
- * Read the next lsvpd keyword, value pair
+ * Save one lsvpd keyword value in the record being read
  */
 static int
-lsvpd_read(struct event *event, FILE *fp)
+lsvpd_save(char **field, const char *line)
 {
-	int rc = 1;
-	char line[512];
+	free(*field);
+	*field = strdup(&line[4]);
+
+	return *field == NULL;
+}
 
-	dbg("start lsvpd_read");
+/*
+ * Read the next lsvpd record.  Records are separated by "*FC" lines;
+ * the keywords before the first one describe the system and have no
+ * location code.  Returns NULL at the end of the lsvpd output.
+ */
+static struct vpd_cache_entry *
+lsvpd_read(FILE *fp)
+{
+	struct vpd_cache_entry *entry;
+	char line[512];
+	int err = 0, found = 0;
 
-	if (!fp)
-		return rc;
+	entry = calloc(1, sizeof(*entry));
+	if (entry == NULL)
+		return NULL;
 
-	/* clear all residual data */
-	free_diag_vpd(event);
+	while (!err && fgets(line, sizeof(line), fp)) {
+		found = 1;
 
-	while (fgets(line, sizeof(line), fp)) {
 		if (line[strlen(line) - 1] == '\n')
 			line[strlen(line) - 1] = '\0';
 
-		if (! strncmp(line, "*DS", 3)) {
-			event->diag_vpd.ds = malloc(strlen (line) + 1);
-			if (event->diag_vpd.ds == NULL)
-				return rc;
+		if (! strncmp(line, "*DS", 3))
+			err = lsvpd_save(&entry->vpd.ds, line);
+		else if (! strncmp(line, "*YL", 3))
+			err = lsvpd_save(&entry->vpd.yl, line);
+		else if (! strncmp(line, "*FN", 3))
+			err = lsvpd_save(&entry->vpd.fn, line);
+		else if (! strncmp(line, "*SN", 3))
+			err = lsvpd_save(&entry->vpd.sn, line);
+		else if (! strncmp(line, "*SE", 3))
+			err = lsvpd_save(&entry->vpd.se, line);
+		else if (! strncmp(line, "*TM", 3))
+			err = lsvpd_save(&entry->vpd.tm, line);
+		else if (! strncmp(line, "*FC", 3))
+			/* start of next record */
+			return entry;
+	}
 
-			strcpy(event->diag_vpd.ds, &line[4]);
-			dbg("found DS: \"%s\"", event->diag_vpd.ds);
-		}
+	if (err || !found) {
+		free_vpd_entry(entry);
+		return NULL;
+	}
 
-		if (! strncmp(line, "*YL", 3)) {
-			event->diag_vpd.yl = malloc(strlen (line) + 1);
-			if (event->diag_vpd.yl == NULL)
-				return rc;
+	/* last record */
+	return entry;
+}
 
-			strcpy(event->diag_vpd.yl, &line[4]);
-			dbg("found YL: \"%s\"", event->diag_vpd.yl);
-		}
+/**
+ * vpd_cache_build
+ * @brief Read all VPD records from a single lsvpd run into the cache
+ *
+ * @return 0 on success, !0 on failure
+ */
+static int
+vpd_cache_build(void)
+{
+	struct vpd_cache_entry *entry, *records = NULL;
+	struct timespec start, end;
+	FILE *fp = NULL;
+	pid_t cpid;                       /* child pid */
+	unsigned int n = 0, b;
+	int rc;
 
-		if (! strncmp(line, "*FN", 3)) {
-			event->diag_vpd.fn = malloc(strlen (line) + 1);
-			if (event->diag_vpd.fn == NULL)
-				return rc;
+	dbg("start vpd_cache_build");
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
-			strcpy(event->diag_vpd.fn, &line[4]);
-			dbg("found FN: \"%s\"", event->diag_vpd.fn);
-		}
+	vpd_cache_free();
 
-		if (! strncmp(line, "*SN", 3)) {
-			event->diag_vpd.sn = malloc(strlen (line) + 1);
-			if (event->diag_vpd.sn == NULL)
-				return rc;
+	if (lsvpd_init(&fp, &cpid) != 0)
+		return 1;
 
-			strcpy(event->diag_vpd.sn, &line[4]);
-			dbg("found SN: \"%s\"", event->diag_vpd.sn);
+	while ((entry = lsvpd_read(fp)) != NULL) {
+		if (entry->vpd.yl == NULL) {
+			free_vpd_entry(entry);
+			continue;
 		}
 
-		if (! strncmp(line, "*SE", 3)) {
-			event->diag_vpd.se = malloc(strlen (line) + 1);
-			if (event->diag_vpd.se == NULL)
-				return rc;
+		entry->next = records;
+		records = entry;
+		n++;
+	}
 
-			strcpy(event->diag_vpd.se, &line[4]);
-			dbg("found SE: \"%s\"", event->diag_vpd.se);
-		}
+	rc = lsvpd_term(fp, &cpid);
 
-		if (! strncmp(line, "*TM", 3)) {
-			event->diag_vpd.tm = malloc(strlen (line) + 1);
-			if (event->diag_vpd.tm == NULL)
-				return rc;
+	/* Size the table for chains of one or two entries */
+	for (b = 64; b < n; b <<= 1)
+		;
 
-			strcpy(event->diag_vpd.tm, &line[4]);
-			dbg("found TM: \"%s\"", event->diag_vpd.tm);
-		}
+	vpd_cache = calloc(b, sizeof(*vpd_cache));
+	if (vpd_cache == NULL) {
+		log_msg(NULL, "Could not allocate the VPD cache, %s",
+			strerror(errno));
+		rc = 1;
+	}
 
-		if (! strncmp(line, "*FC", 3)) {
-			/* start of next record */
-			dbg("found FC - start next record");
-			return 0;
+	/*
+	 * The list is in reverse lsvpd order, so inserting at the head of
+	 * the chains leaves the first record for a location code in front,
+	 * which is the one the linear lsvpd search used to find.
+	 */
+	while ((entry = records) != NULL) {
+		records = entry->next;
+
+		if (rc) {
+			free_vpd_entry(entry);
+			continue;
 		}
+
+		entry->next = vpd_cache[vpd_hash(entry->vpd.yl) & (b - 1)];
+		vpd_cache[vpd_hash(entry->vpd.yl) & (b - 1)] = entry;
+	}
+
+	if (rc) {
+		vpd_cache_free();
+		dbg("end vpd_cache_build, failure");
+		return 1;
 	}
 
-	dbg("end lsvpd_read");
-	return 1;
+	vpd_cache_buckets = b;
+	vpd_cache_valid = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dbg("end vpd_cache_build, %u records in %ld msecs", n,
+	    (end.tv_sec - start.tv_sec) * 1000 +
+	    (end.tv_nsec - start.tv_nsec) / 1000000);
+
+	return 0;
 }
 
+/**
+ * vpd_cache_init
+ * @brief Build the VPD cache at startup
+ */
+void
+vpd_cache_init(void)
+{
+	if (vpd_cache_build())
+		dbg("Could not build the VPD cache, lookups will retry");
+}
 
+/**
+ * get_diag_vpd
+ * @brief Look up the VPD of the FRU at a location code
+ *
+ * On success the event's diag_vpd points at the cached record.
+ *
+ * @return 0 on success, !0 if the location code is not in the VPD
+ */
 int
 get_diag_vpd(struct event *event, char *phyloc)
 {
-	int rc = 0;
-	FILE *fp = NULL;
-	pid_t cpid;                       /* child pid */
+	struct vpd_cache_entry *entry;
 
 	dbg("start get_diag_vpd");
 
-	if (event->diag_vpd.yl != NULL)
-		free_diag_vpd(event);
-
-	/* sigchld_handler() messes up pclose(). */
-	restore_sigchld_default();
+	free_diag_vpd(event);
 
-	if (lsvpd_init(&fp, &cpid) != 0) {
-		setup_sigchld_handler();
+	if (!vpd_cache_valid && vpd_cache_build())
 		return 1;
-	}
 
-	while (event->diag_vpd.yl == NULL ||
-	       strcmp(event->diag_vpd.yl, phyloc)) {
-		if (lsvpd_read(event, fp)) {
-			dbg("end get_diag_vpd, failure");
-			rc = lsvpd_term(fp, &cpid);
-			setup_sigchld_handler();
-			return 1;
-		}
+	entry = vpd_cache_find(phyloc);
+	if (entry == NULL) {
+		dbg("end get_diag_vpd, failure");
+		return 1;
 	}
-	rc = lsvpd_term(fp, &cpid);
-	if (rc)
-		dbg("end get_diag_vpd, pclose failure");
-	else
-		dbg("end get_diag_vpd, success");
 
-	setup_sigchld_handler();
+	event->diag_vpd = entry->vpd;
+	dbg("end get_diag_vpd, success");
 
-	return rc;
+	return 0;
 }
 
 char *
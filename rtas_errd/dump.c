@@ -295,6 +295,9 @@ check_platform_dump(struct event *event)
 	struct statvfs vfs;
 	uint64_t dump_tag;
 	uint64_t dump_size;
+	struct timespec start, end;
+	struct stat sbuf;
+	double	secs;
 	char	filename[DUMP_MAX_FNAME_LEN + 20], *pos;
 	char	*pathname = NULL;
 	FILE	*f;
@@ -303,7 +306,7 @@ check_platform_dump(struct event *event)
 	char 	tmp_sys_arg[60];		/* tmp sys_args		*/
 	pid_t	cpid;                           /* child pid            */
 
-	dump_scn = rtas_get_dump_scn(event->rtas_event);
+	dump_scn = event_scn(event, RTAS_DUMP_SCN);
 	if (dump_scn == NULL)
 		return;
 
@@ -332,7 +335,11 @@ check_platform_dump(struct event *event)
 	dump_size <<= 32;
 	dump_size |= dump_scn->size_lo;
 
-	/* Check if there is sufficient space in the file system to store the dump */
+	/*
+	 * Check if there is sufficient space in the file system to store
+	 * the dump; how well a dump compresses is not known up front, so
+	 * the full size is needed even if it is to be compressed.
+	 */
 	if (vfs.f_bavail * vfs.f_frsize < dump_size) {
 		syslog(LOG_ERR, "Insufficient space in %s to store platform dump for dump ID: "
 				"0x%016lX (required: %lu bytes, available: %lu bytes)",
@@ -348,26 +355,21 @@ check_platform_dump(struct event *event)
 	system_args[0] = EXTRACT_PLATDUMP_CMD;
 	system_args[1] = tmp_sys_arg;
 
-	/* sigchld_handler() messes up pclose(). */
-	restore_sigchld_default();
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	f = spopen(system_args, &cpid);
 	if (f == NULL) {
 		log_msg(event, "Failed to open pipe to %s.",
 			EXTRACT_PLATDUMP_CMD);
-		setup_sigchld_handler();
 		return;
 	}
 	if (!fgets(filename, DUMP_MAX_FNAME_LEN + 20, f)) {
 		dbg("Failed to collect filename info");
 		spclose(f, cpid);
-		setup_sigchld_handler();
 		return;
 	}
 	rc = spclose(f, cpid);
 
-	setup_sigchld_handler();
-
 	if (rc) {
 		dbg("%s failed to extract the dump", EXTRACT_PLATDUMP_CMD);
 		return;
@@ -380,7 +382,7 @@ check_platform_dump(struct event *event)
 	event->flags |= RE_PLATDUMP_AVAIL;
 
 	/* Update the raw and parsed events with the dump path and length */
-	update_os_id_scn(event->rtas_event, filename);
+	update_os_id_scn(event_rtas(event), filename);
 	memcpy(dump_scn->os_id, filename, DUMP_MAX_FNAME_LEN);
 	bytes = strlen(filename);
 	if ((bytes % 4) > 0)
@@ -392,6 +394,17 @@ check_platform_dump(struct event *event)
 		dbg("%s: Failed to allocate memory", __func__);
 		return;
 	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (stat(pathname, &sbuf) == 0 && secs > 0)
+		log_msg(event, "Platform dump %s: %llu bytes retrieved in "
+			"%.3f seconds (%.1f MB/s), saved as %llu bytes "
+			"(%.1f%%)", filename, (unsigned long long)dump_size,
+			secs, dump_size / secs / (1024 * 1024),
+			(unsigned long long)sbuf.st_size, dump_size ?
+			100.0 * sbuf.st_size / dump_size : 0);
 	platform_log_write("Platform Dump Notification\n");
 	platform_log_write("    Dump Location: %s\n", pathname);
 	free(pathname);
@@ -69,7 +69,7 @@ check_eeh(struct event *event)
 		return;
 	}
 
-	src = rtas_get_src_scn(event->rtas_event);
+	src = event_scn(event, RTAS_PSRC_SCN);
 	if (src == NULL) {
 		log_msg(event, "Could not retrieve SRC section to check for "
 			"an EEH event, skipping");
@@ -96,7 +96,7 @@ check_eeh(struct event *event)
 	 */
 	platform_log_write("EEH Event Notification\n");
 
-	privhdr = rtas_get_priv_hdr_scn(event->rtas_event);
+	privhdr = event_scn(event, RTAS_PRIV_HDR_SCN);
 	if (privhdr == NULL) {
 		log_msg(event, "Could not retrieve the RTAS Event information "
 			"to report EEH failure date/time");
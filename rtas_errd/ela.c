@@ -40,6 +40,7 @@
 
 #include "rtas_errd.h"
 #include "ela_msg.h"
+#include "symptom.h"
 
 /* Function prototypes */
 static int analyze_io_bus_error(struct event *, int, int);
@@ -575,7 +576,7 @@ process_pre_v6(struct event *event)
                 event->loc_codes = NULL;
         }
 
-	exthdr = rtas_get_event_exthdr_scn(event->rtas_event);
+	exthdr = event_scn(event, RTAS_EVENT_EXT_HDR);
 	if (exthdr == NULL) {
 		log_msg(event, "Could not retrieve extended event data");
 		return 0;
@@ -2481,148 +2482,17 @@ process_v3_logs(struct event *event, int error_type)
  * 	displayed in lieu of encoding a SRN.
  *
  */
-#define NCPUSYMPTOMS	 9
-#define NMEMSYMPTOMS	17
-#define NIOSYMPTOMS	17
-#define NSPSYMPTOMS	33
-#define NSPSYMPTOMS_ADDITIONAL	9
 int
 convert_symptom(struct event *event, int format_type, int predictive,
 		char **msg)
 {
+	const struct symptom_table *t;
 	int seqn;
 	int sbits;
-	int signature;
 	int msg_index;
 	int error_type;
 
-	/* Look up tables for sequence number to reason code messages. */
-	int cpu_log_sig[NCPUSYMPTOMS] = {0x00, 0x80, 0x40, 0x20, 0x10,
-					0x08, 0x04, 0x02, 0x01};
-	char *cpu_log[NCPUSYMPTOMS][2]= {
-		{ MSGCPUALLZERO, DEFER_MSGALLZERO},
-		{ MSGCPUB12b0, DEFER_MSGCPUB12b0},
-		{ MSGCPUB12b1, DEFER_MSGCPUB12b1},
-		{ MSGCPUB12b2, DEFER_MSGCPUB12b2},
-		{ MSGCPUB12b3, DEFER_MSGCPUB12b3},
-		{ MSGCPUB12b4, DEFER_MSGCPUB12b4},
-		{ MSGCPUB12b5, DEFER_MSGCPUB12b5},
-		{ MSGCPUB12b6, DEFER_MSGCPUB12b6},
-		{ MSGCPUB12b7, DEFER_MSGCPUB12b7}
-	};
-
-	int mem_log_sig[NMEMSYMPTOMS] = {0x0000, 0x8000, 0x4000, 0x2000, 0x1000,
-					 0x0800, 0x0400, 0x0200, 0x0100,
-					 0x0080, 0x0040, 0x0020, 0x0010,
-					 0x0008, 0x0004, 0x0002, 0x0001};
-	char *mem_log[NMEMSYMPTOMS][2] = {
-		{ MSGMEMALLZERO, DEFER_MSGALLZERO},
-		{ MSGMEMB12b0, DEFER_MSGMEMB12b0},
-		{ MSGMEMB12b1, DEFER_MSGMEMB12b1},
-		{ MSGMEMB12b2, DEFER_MSGMEMB12b2},
-		{ MSGMEMB12b3, DEFER_MSGMEMB12b3},
-		{ MSGMEMB12b4, DEFER_MSGMEMB12b4},
-		{ MSGMEMB12b5, DEFER_MSGMEMB12b5},
-		{ MSGMEMB12b6, DEFER_MSGMEMB12b6},
-		{ MSGMEMB12b7, DEFER_MSGMEMB12b7},
-		{ MSGMEMB13b0, DEFER_MSGMEMB13b0},
-		{ MSGMEMB13b1, DEFER_MSGMEMB13b1},
-		{ MSGMEMB13b2, DEFER_MSGMEMB13b2},
-		{ MSGMEMB13b3, DEFER_MSGMEMB13b3},
-		{ MSGMEMB13b4, DEFER_MSGMEMB13b4},
-		{ MSGRESERVED, DEFER_MSGRESERVED},
-		{ MSGMEMB13b6, DEFER_MSGMEMB13b6},
-		{ MSGMEMB13b7, DEFER_MSGMEMB13b7},
-	};
-
-	/* I/O Byte 13, bits 0-2 are describtions */
-	/* that are masked off the symptom bits. */
-	int io_log_sig[NIOSYMPTOMS] = {0x0000, 0x8000, 0x4000, 0x2000, 0x1000,
-				       0x0800, 0x0400, 0x0410, 0x0200, 0x0210,
-				       0x0100, 0x0110, 0x0010,
-				       0x0008, 0x0004, 0x0002, 0x0001};
-	char * io_log[NIOSYMPTOMS][3] = {
-		{ MSGIOALLZERO, DEFER_MSGALLZERO},
-		{ MSGIOB12b0, DEFER_MSGIOB12b0},
-		{ MSGIOB12b1, DEFER_MSGIOB12b1},
-		{ MSGIOB12b2, DEFER_MSGIOB12b2},
-		{ MSGIOB12b3, DEFER_MSGIOB12b3},
-		{ MSGIOB12b4, DEFER_MSGIOB12b4},
-		{ MSGIOB12b5, DEFER_MSGIOB12b5},
-		{ MSGIOB12b5B13b3, DEFER_MSGIOB12b5B13b3},
-		{ MSGIOB12b6, DEFER_MSGIOB12b6},
-		{ MSGIOB12b6B13b3, DEFER_MSGIOB12b6B13b3},
-		{ MSGIOB12b7, DEFER_MSGIOB12b7},
-		{ MSGIOB12b7B13b3, DEFER_MSGIOB12b7B13b3},
-		{ MSGIOB13b3, DEFER_MSGIOB13b3},
-		{ MSGIOB13b4, DEFER_MSGIOB13b4},
-		{ MSGIOB13b5, DEFER_MSGIOB13b5},
-		{ MSGIOB13b6, DEFER_MSGIOB13b6},
-		{ MSGIOB13b7, DEFER_MSGIOB13b7},
-	};
-
-	int sp_log_sig[NSPSYMPTOMS] = { 0x00000000,
-		0x80000000, 0x40000000, 0x20000000, 0x10000000,
-		0x08000000, 0x04000000, 0x02000000, 0x01000000,
-		0x00800000, 0x00400000, 0x00200000, 0x00100000,
-		0x00080000, 0x00040000, 0x00020000, 0x00010000,
-		0x00008000, 0x00004000, 0x00002000, 0x00001000,
-		0x00000800, 0x00000400, 0x00000200, 0x00000100,
-		0x00000080, 0x00000040, 0x00000020, 0x00000010,
-		0x00000008, 0x00000004, 0x00000002, 0x00000001};
-	char *sp_log[NSPSYMPTOMS][2] = {
-		{ MSGSPALLZERO, DEFER_MSGALLZERO},
-		{ MSGSPB16b0, DEFER_MSGSPB16b0},
-		{ MSGSPB16b1, DEFER_MSGSPB16b1},
-		{ MSGSPB16b2, DEFER_MSGSPB16b2},
-		{ MSGSPB16b3, DEFER_MSGSPB16b3},
-		{ MSGSPB16b4, DEFER_MSGSPB16b4},
-		{ MSGSPB16b5, DEFER_MSGSPB16b5},
-		{ MSGSPB16b6, DEFER_MSGSPB16b6},
-		{ MSGSPB16b7, DEFER_MSGSPB16b7},
-		{ MSGSPB17b0, DEFER_MSGSPB17b0},
-		{ MSGSPB17b1, DEFER_MSGSPB17b1},
-		{ MSGSPB17b2, DEFER_MSGSPB17b2},
-		{ MSGSPB17b3, DEFER_MSGSPB17b3},
-		{ MSGSPB17b4, DEFER_MSGSPB17b4},
-		{ MSGSPB17b5, DEFER_MSGSPB17b5},
-		{ MSGRESERVED,DEFER_MSGRESERVED},
-		{ MSGRESERVED,DEFER_MSGRESERVED},
-		{ MSGSPB18b0, DEFER_MSGSPB18b0},
-		{ MSGSPB18b1, DEFER_MSGSPB18b1},
-		{ MSGSPB18b2, DEFER_MSGSPB18b2},
-		{ MSGSPB18b3, DEFER_MSGSPB18b3},
-		{ MSGSPB18b4, DEFER_MSGSPB18b4},
-		{ MSGRESERVED,DEFER_MSGRESERVED},
-		{ MSGSPB18b6, DEFER_MSGSPB18b6},
-		{ MSGSPB18b7, DEFER_MSGSPB18b7},
-		{ MSGSPB19b0, DEFER_MSGSPB19b0},
-		{ MSGSPB19b1, DEFER_MSGSPB19b1},
-		{ MSGRESERVED, DEFER_MSGRESERVED},
-		{ MSGRESERVED, DEFER_MSGRESERVED},
-		{ MSGSPB19b4, DEFER_MSGSPB19b4},
-		{ MSGSPB19b5, DEFER_MSGSPB19b5},
-		{ MSGSPB19b6, DEFER_MSGSPB19b6},
-		{ MSGRESERVED, DEFER_MSGRESERVED},
-	};
-
-	int sp_log_additional_sig[NSPSYMPTOMS_ADDITIONAL] = {0x00,
-						0x80, 0x40, 0x20, 0x10,
-						0x08, 0x04, 0x02, 0x01};
-	char *sp_log_additional[NSPSYMPTOMS_ADDITIONAL][2] = {
-		{ MSGSPALLZERO, DEFER_MSGALLZERO},
-		{ MSGSPB28b0, DEFER_MSGSPB28b0},
-		{ MSGSPB28b1, DEFER_MSGSPB28b1},
-		{ MSGSPB28b2, DEFER_MSGSPB28b2},
-		{ MSGSPB28b3, DEFER_MSGSPB28b3},
-		{ MSGSPB28b4, DEFER_MSGSPB28b4},
-		{ MSGSPB28b5, DEFER_MSGSPB28b5},
-		{ MSGSPB28b6, DEFER_MSGSPB28b6},
-		{ MSGSPB28b7, DEFER_MSGSPB28b7},
-	};
-
 	*msg = NULL;
-	seqn = 1;
 	msg_index = 0;
 
 	if (predictive)
@@ -2631,30 +2501,17 @@ convert_symptom(struct event *event, int format_type, int predictive,
 	switch (format_type) {
 		case RTAS_EXTHDR_FMT_CPU:
 			sbits = event->event_buf[I_BYTE12];
-			while (seqn < NCPUSYMPTOMS) {
-				signature = cpu_log_sig[seqn];
-				if ((sbits & signature) == signature)
-					break;
-				seqn++;
-			}
-			if (seqn == NCPUSYMPTOMS)
-				seqn = 0;
-			*msg = cpu_log[seqn][msg_index];
+			t = &symptom_tables[SYMPTOM_CPU];
+			seqn = symptom_seqn(SYMPTOM_CPU, sbits);
+			*msg = (char *)t->msgs[seqn][msg_index];
 			break;
 
 		case RTAS_EXTHDR_FMT_MEMORY:
 			sbits = (event->event_buf[I_BYTE12] << 8) |
 				 event->event_buf[I_BYTE13];
-
-			while (seqn < NMEMSYMPTOMS) {
-				signature = mem_log_sig[seqn];
-				if ((sbits & signature) == signature)
-					break;
-				seqn++;
-			}
-			if (seqn == NMEMSYMPTOMS)
-				seqn = 0;
-			*msg = mem_log[seqn][msg_index];
+			t = &symptom_tables[SYMPTOM_MEM];
+			seqn = symptom_seqn(SYMPTOM_MEM, sbits);
+			*msg = (char *)t->msgs[seqn][msg_index];
 			break;
 
 		case RTAS_EXTHDR_FMT_IO:
@@ -2668,16 +2525,9 @@ convert_symptom(struct event *event, int format_type, int predictive,
 			sbits = (event->event_buf[I_BYTE12] << 8) |
 				 event->event_buf[I_BYTE13];
 			sbits &= 0x0FF1F;
-
-			while (seqn < NIOSYMPTOMS) {
-				signature = io_log_sig[seqn];
-				if ((sbits & signature) == signature)
-					break;
-				seqn++;
-			}
-			if (seqn == NIOSYMPTOMS)
-				seqn = 0;
-			*msg = io_log[seqn][msg_index];
+			t = &symptom_tables[SYMPTOM_IO];
+			seqn = symptom_seqn(SYMPTOM_IO, sbits);
+			*msg = (char *)t->msgs[seqn][msg_index];
 			break;
 
 		case RTAS_EXTHDR_FMT_IBM_SP:
@@ -2686,45 +2536,22 @@ convert_symptom(struct event *event, int format_type, int predictive,
 				(event->event_buf[I_BYTE18] << 8 ) |
 				event->event_buf[I_BYTE19]);
 			if (sbits) {
-				while (seqn < NSPSYMPTOMS) {
-					signature = sp_log_sig[seqn];
-					if ((sbits & signature) == signature)
-						break;
-					seqn++;
-				}
-				if (seqn >= NSPSYMPTOMS)
-					seqn = 0;
-				*msg = sp_log[seqn][msg_index];
-				break;
-			} else {
-				/* use additional symptom bits */
-				sbits = event->event_buf[I_BYTE28];
-				if (!sbits) {
-					seqn = 0;
-					*msg =
-					    sp_log_additional[seqn][msg_index];
-				} else {
-				  while ((seqn < NSPSYMPTOMS_ADDITIONAL)) {
-					signature = sp_log_additional_sig[seqn];
-					if ((sbits & signature) == signature)
-						break;
-					seqn++;
-				  }
-
-				  if (seqn >= NSPSYMPTOMS_ADDITIONAL) {
-					seqn = 0;
-					*msg =
-					    sp_log_additional[seqn][msg_index];
-				  } else {
-					*msg =
-					    sp_log_additional[seqn][msg_index];
-					seqn += (NSPSYMPTOMS - 1);
-					/* after original symptom bits */
-				  }
-				}
+				t = &symptom_tables[SYMPTOM_SP];
+				seqn = symptom_seqn(SYMPTOM_SP, sbits);
+				*msg = (char *)t->msgs[seqn][msg_index];
 				break;
 			}
 
+			/* use additional symptom bits */
+			sbits = event->event_buf[I_BYTE28];
+			t = &symptom_tables[SYMPTOM_SP_ADDITIONAL];
+			seqn = symptom_seqn(SYMPTOM_SP_ADDITIONAL, sbits);
+			*msg = (char *)t->msgs[seqn][msg_index];
+			if (seqn)
+				/* after original symptom bits */
+				seqn += symptom_tables[SYMPTOM_SP].nsigs - 1;
+			break;
+
 		default:
 			/*
 			 * Should not get here unless the format is
@@ -27,6 +27,8 @@
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
 #include <librtas.h>
 #include <librtasevent.h>
 #include "rtas_errd.h"
@@ -52,18 +54,69 @@
 static int time_remaining = 0;
 
 /**
- * epow_timer_handler
- * @brief Routine to handle SIGALRM timer interrupts.
+ * @var epow_timer_fd
+ * @brief timerfd that expires every EPOW_TIMER_INTERVAL seconds while
+ * a system shutdown is pending
+ */
+int epow_timer_fd = -1;
+
+#define EPOW_TIMER_INTERVAL	5	/* secs */
+
+/**
+ * epow_timer_init
+ * @brief Create the EPOW timer, for the event loop to poll
+ *
+ * @return 0 on success, -1 on failure
+ */
+int
+epow_timer_init(void)
+{
+	epow_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				       TFD_NONBLOCK | TFD_CLOEXEC);
+	if (epow_timer_fd == -1) {
+		log_msg(NULL, "Could not create the timer for certain EPOW "
+			"events, %s", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * epow_timer_set
+ * @brief Start or stop the EPOW interval timer
  *
- * @param sig unused
- * @param siginfo unused
- * @param context unused
+ * @param secs interval in seconds, 0 to stop the timer
+ */
+static void
+epow_timer_set(int secs)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_interval.tv_sec = secs;
+	its.it_value = its.it_interval;
+
+	if (timerfd_settime(epow_timer_fd, 0, &its, NULL))
+		log_msg(NULL, "Could not set the EPOW timer, %s",
+			strerror(errno));
+}
+
+/**
+ * epow_timer_expired
+ * @brief Handle the expiry of the EPOW timer
+ *
+ * Called from the event loop whenever epow_timer_fd is readable.
  */
 void
-epow_timer_handler(int sig, siginfo_t siginfo, void *context)
+epow_timer_expired(void)
 {
+	uint64_t expirations;
 	int rc, state;
-	struct itimerval tv;
+
+	if (read(epow_timer_fd, &expirations, sizeof(expirations)) !=
+	    sizeof(expirations))
+		return;
 
 	if (time_remaining <= 0) {
 		/*
@@ -71,10 +124,7 @@ epow_timer_handler(int sig, siginfo_t siginfo, void *context)
 		 * The EPOW_PROGRAM should have already shut the 
 		 * system down by this point.
 		 */
-		tv.it_interval.tv_sec = 0;
-		tv.it_interval.tv_usec = 0;
-		tv.it_value = tv.it_interval;
-		rc = setitimer(ITIMER_REAL, &tv, NULL);
+		epow_timer_set(0);
 		return;
 	}
 
@@ -84,10 +134,7 @@ epow_timer_handler(int sig, siginfo_t siginfo, void *context)
 		 * Problem resolved; disable the interval timer and
 		 * update the epow status file.
 		 */
-		tv.it_interval.tv_sec = 0;
-		tv.it_interval.tv_usec = 0;
-		tv.it_value = tv.it_interval;
-		rc = setitimer(ITIMER_REAL, &tv, NULL);
+		epow_timer_set(0);
 
 		if (state == RTAS_EPOW_ACTION_RESET)
 			update_epow_status_file(0);
@@ -105,12 +152,25 @@ epow_timer_handler(int sig, siginfo_t siginfo, void *context)
 	 * still exists. If the problem is worse, the system will 
 	 * probably shut down within 20 seconds.  We shouldn't 
 	 * overwrite the status so that if a worse problem exists, 
-	 * it can be handled appropriately.
+	 * it can be handled appropriately.  The timer may have expired
+	 * more than once if an event took long to handle.
 	 */
-	time_remaining -= 5;
+	time_remaining -= EPOW_TIMER_INTERVAL * expirations;
 	return;
 }
 
+/**
+ * epow_timer_close
+ * @brief Stop and close the EPOW timer
+ */
+void
+epow_timer_close(void)
+{
+	if (epow_timer_fd != -1)
+		close(epow_timer_fd);
+	epow_timer_fd = -1;
+}
+
 static void
 log_epow(struct event *event, char *fmt, ...)
 {
@@ -160,7 +220,6 @@ parse_epow(struct event *event)
 {
 	struct rtas_event_hdr *rtas_hdr = event->rtas_hdr;
 	struct rtas_epow_scn *epow;
-	struct itimerval tv;
 	char	*event_type;
 	int	rc, state;
 
@@ -190,7 +249,7 @@ parse_epow(struct event *event)
 		}
         }
 
-	epow = rtas_get_epow_scn(event->rtas_event);
+	epow = event_scn(event, RTAS_EPOW_SCN);
 	if (epow == NULL) {
 		log_msg(event, "Could not retrieve EPOW section to handle "
 			"incoming EPOW event, skipping");
@@ -233,10 +292,7 @@ parse_epow(struct event *event)
 			/* Set up an interval timer to update the epow 
 			 * status file every 5 seconds.
 			 */
-			tv.it_interval.tv_sec = 5;
-			tv.it_interval.tv_usec = 0;
-			tv.it_value = tv.it_interval;
-			rc = setitimer(ITIMER_REAL, &tv, NULL);
+			epow_timer_set(EPOW_TIMER_INTERVAL);
 		}
 
 		time_remaining = 600;	/* in seconds */
@@ -381,6 +437,29 @@ parse_epow(struct event *event)
 	return 0;
 }
 
+/**
+ * epow_done
+ * @brief Completion of EPOW_PROGRAM
+ *
+ * @param status wait status of EPOW_PROGRAM, -1 if it could not be run
+ * @param arg set to 1 if EPOW_PROGRAM could not be run
+ */
+static void
+epow_done(int status, void *arg)
+{
+	if (status == -1) {
+		log_msg(NULL, "%s could not be run, could not handle an "
+			"incoming EPOW event", EPOW_PROGRAM);
+		*(int *)arg = 1;
+		return;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		log_msg(NULL, "%s failed to handle an EPOW event, exit "
+			"status %d", EPOW_PROGRAM, WIFEXITED(status) ?
+			WEXITSTATUS(status) : -1);
+}
+
 /**
  * check_epow
  * @brief Check an RTAS event for EPOW data.
@@ -395,14 +474,14 @@ parse_epow(struct event *event)
 int
 check_epow(struct event *event)
 {
-	pid_t	child;
+	static int spawn_failed;
 	char	*childargs[2];
 	int	current_status;
 
 	/*
 	 * Dissect the EPOW extended error information;
 	 * if the error is serious enough to warrant further action,
-	 * fork and exec the script to handle it
+	 * run the script to handle it, without waiting for it
 	 */
 	current_status = parse_epow(event);
 	update_epow_status_file(current_status);
@@ -410,21 +489,17 @@ check_epow(struct event *event)
 	if (current_status > 0) {
 		childargs[0] = EPOW_PROGRAM_NOPATH;
 		childargs[1] = NULL;
-		child = fork();
-		if (child == -1) {
-			log_msg(event, "Fork error, %s cannot be run to handle"
-				"an incoming EPOW event, %s", EPOW_PROGRAM,
-				strerror(errno));
-		}
-		else if (child == 0) {
-			/* child process */
-			execv(EPOW_PROGRAM, childargs);
-
-			/* shouldn't get here */
-			log_msg(event, "Could not exec %s, %s.  Could not "
-				"handle an incoming EPOW event", EPOW_PROGRAM,
-				strerror(errno));
-			exit(1);
+
+		/* epow_done() is called right away if the spawn fails */
+		spawn_failed = 0;
+		if (helper_run(HELPER_POWERFAIL, "epow", EPOW_PROGRAM,
+			       childargs, epow_done, &spawn_failed) == 0 &&
+		    !spawn_failed && event->read_time) {
+			/* How long it took to act on the EPOW event */
+			stats_stage(STATS_EPOW_ACTION, event->read_time);
+			dbg("Started %s %llu usecs after reading the EPOW "
+			    "event", EPOW_PROGRAM, (unsigned long long)
+			    (stats_now() - event->read_time));
 		}
 	}
 
@@ -30,26 +30,69 @@
 #include <errno.h>
 #include <dirent.h>
 #include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 #include <librtas.h>
 #include <sys/stat.h>
 
 #include "rtas_errd.h"
 #include "platform.h"
+#include "dump_stream.h"
 
 #define DUMP_HDR_PREFIX_OFFSET	0x16	/* prefix size in dump header */
 #define DUMP_HDR_FNAME_OFFSET	0x18	/* suggested filename in dump header */
 #define DUMP_MAX_FNAME_LEN	40
 #define TOKEN_PLATDUMP_MAXSIZE	32
-#define DUMP_BUF_SZ		4096
+#define DUMP_CHUNK_MIN		4096
 
 int flag_v = 0;
 
+/**
+ * @var chunk_size
+ * @brief Bytes to retrieve from firmware per rtas_platform_dump() call
+ *
+ * Set from PlatformDumpChunkSize in the config file, or with -b.
+ */
+static uint64_t chunk_size = 0;
+
+/**
+ * @var compress_level
+ * @brief zlib level to compress dumps with, 0 to save them as they are
+ *
+ * Set from PlatformDumpCompress in the config file, or with -z.
+ */
+static int compress_level = 0;
+
 static struct option long_options[] = {
+	{"bufsize",		required_argument,	NULL, 'b'},
 	{"help",		no_argument,		NULL, 'h'},
+	{"output",		required_argument,	NULL, 'o'},
 	{"verbose",		no_argument,		NULL, 'v'},
+	{"compress",		required_argument,	NULL, 'z'},
 	{0,0,0,0}
 };
 
+/*
+ * The dump is retrieved into two buffers in turn: while firmware fills
+ * one of them, the writer thread copies the other one to the dump file.
+ */
+struct dump_chunk {
+	char		*data;
+	uint64_t	bytes;
+	int		full;		/**< waiting to be written */
+};
+
+struct dump_writer {
+	pthread_t		thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct dump_chunk	chunk[2];
+	int			out;
+	struct dump_stream	stream;
+	int			done;	/**< no more chunks will be queued */
+	int			error;	/**< errno of a failed write */
+};
+
 /**
  * msg
  * @brief Print message if verbose flag is set
@@ -80,9 +123,15 @@ msg(char *fmt, ...)
  */
 static void
 print_usage(const char *name) {
-	printf("Usage: %s [-h] [-v] <dump_tag>\n"
+	printf("Usage: %s [-h] [-v] [-b <kbytes>] [-o <dir>] [-z <level>] "
+		"<dump_tag>\n"
 		"\t-h: print this help message\n"
 		"\t-v: verbose output\n"
+		"\t-b: kbytes to retrieve from firmware at a time\n"
+		"\t-o: directory to save the dump to, instead of the\n"
+		"\t    PlatformDumpPath of the config file\n"
+		"\t-z: gzip compress the dump at level 1-9, 0 to not\n"
+		"\t    compress it\n"
 		"\t<dump_tag>: the tag of the dump(s) to extract, in hex\n",
 		name);
 	return;
@@ -204,6 +253,78 @@ remove_old_dumpfiles(char *dumpname, int prefix_size)
 	closedir(dir);
 }
 
+/**
+ * get_dump_chunk
+ * @brief Retrieve the next chunk of a platform dump from firmware
+ *
+ * The buffer for the call comes out of the small librtas RMO area, so
+ * if chunk_size turns out to be too large for it the call is retried
+ * with smaller chunks, down to DUMP_CHUNK_MIN.
+ *
+ * @return the rtas_platform_dump() return code
+ */
+static int
+get_dump_chunk(uint64_t dump_tag, uint64_t seq, char *buf,
+	       uint64_t *seq_next, uint64_t *bytes)
+{
+	int librtas_rc;
+
+	while (1) {
+		msg("Calling rtas_platform_dump, seq 0x%016LX", seq);
+		librtas_rc = rtas_platform_dump(dump_tag, seq, buf, chunk_size,
+						seq_next, bytes);
+		if ((librtas_rc != RTAS_NO_MEM && librtas_rc != RTAS_NO_LOWMEM)
+		    || chunk_size <= DUMP_CHUNK_MIN)
+			return librtas_rc;
+
+		chunk_size /= 2;
+		if (chunk_size < DUMP_CHUNK_MIN)
+			chunk_size = DUMP_CHUNK_MIN;
+		msg("Retrying with %llu byte chunks",
+		    (unsigned long long)chunk_size);
+	}
+}
+
+/**
+ * dump_writer_main
+ * @brief Write the retrieved chunks of a dump out in order
+ */
+static void *
+dump_writer_main(void *arg)
+{
+	struct dump_writer *w = arg;
+	struct dump_chunk *chunk;
+	int i = 0, rc;
+
+	while (1) {
+		chunk = &w->chunk[i];
+
+		pthread_mutex_lock(&w->lock);
+		while (!chunk->full && !w->done)
+			pthread_cond_wait(&w->cond, &w->lock);
+		pthread_mutex_unlock(&w->lock);
+
+		if (!chunk->full)
+			break;
+
+		rc = dump_stream_write(&w->stream, chunk->data, chunk->bytes);
+
+		pthread_mutex_lock(&w->lock);
+		if (rc)
+			w->error = errno;
+		chunk->full = 0;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+
+		if (rc)
+			break;
+
+		i ^= 1;
+	}
+
+	return NULL;
+}
+
 /**
  * extract_platform_dump
  * @brief Extract a platform dump with a given tag to the filesystem
@@ -216,26 +337,39 @@ extract_platform_dump(uint64_t dump_tag)
 {
 	uint64_t seq=0, seq_next, bytes;
 	uint16_t prefix_size = 7;
-	char	*dump_buf = NULL;
 	char	filename[DUMP_MAX_FNAME_LEN + 1];
 	char	pathname[PATH_MAX];
 	char	dump_err[RTAS_ERROR_LOG_MAX];
 	char	dumpid[5] = "";
-	int	out=-1, rc, librtas_rc, dump_complete=0, ret=0;
+	struct dump_writer writer;
+	struct dump_chunk *chunk;
+	struct timespec start, end;
+	double	secs;
+	int	rc, librtas_rc, dump_complete=0, ret=0, writing=0, i;
+	int	compressed = compress_level;
 
 	msg("Dump tag: 0x%016LX", dump_tag);
 
-	dump_buf = malloc(DUMP_BUF_SZ);
-	if (dump_buf == NULL) {
-		msg("Could not allocate buffer to retrieve dump: %s",
-			strerror(errno));
-		ret = 1;
-		goto platdump_error_out;
+	memset(&writer, 0, sizeof(writer));
+	writer.out = -1;
+	pthread_mutex_init(&writer.lock, NULL);
+	pthread_cond_init(&writer.cond, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < 2; i++) {
+		writer.chunk[i].data = malloc(chunk_size);
+		if (writer.chunk[i].data == NULL) {
+			msg("Could not allocate buffer to retrieve dump: %s",
+				strerror(errno));
+			ret = 1;
+			goto platdump_error_out;
+		}
 	}
 
-	msg("Calling rtas_platform_dump, seq 0x%016LX", seq);
-	librtas_rc = rtas_platform_dump(dump_tag, 0, dump_buf, DUMP_BUF_SZ,
-					&seq_next, &bytes);
+	chunk = &writer.chunk[0];
+	librtas_rc = get_dump_chunk(dump_tag, 0, chunk->data, &seq_next,
+				    &bytes);
 	if (librtas_rc == 0) {
 		dump_complete = 1;
 	}
@@ -261,12 +395,13 @@ extract_platform_dump(uint64_t dump_tag)
 	 * from the dump header 
 	 */
 	if (bytes >= DUMP_HDR_PREFIX_OFFSET + sizeof(uint16_t)) {
-		prefix_size = *(uint16_t *)(dump_buf + DUMP_HDR_PREFIX_OFFSET);
+		prefix_size = *(uint16_t *)(chunk->data +
+					    DUMP_HDR_PREFIX_OFFSET);
 		prefix_size = be16toh(prefix_size);
 	}
 
 	if (bytes >= DUMP_HDR_FNAME_OFFSET + DUMP_MAX_FNAME_LEN) {
-		strncpy(filename, dump_buf + DUMP_HDR_FNAME_OFFSET,
+		strncpy(filename, chunk->data + DUMP_HDR_FNAME_OFFSET,
 			DUMP_MAX_FNAME_LEN);
 	}
 	else {
@@ -277,6 +412,17 @@ extract_platform_dump(uint64_t dump_tag)
 	filename[DUMP_MAX_FNAME_LEN - 1] = '\0';
 	msg("Suggested filename: %s, prefix size: %d", filename, prefix_size);
 
+	/* rtas_errd records the file name in the event, which limits it */
+	if (compress_level &&
+	    strlen(filename) + strlen(DUMP_COMPRESS_SUFFIX) >=
+	    DUMP_MAX_FNAME_LEN) {
+		msg("Dump file name %s is too long to add %s, the dump "
+		    "will not be compressed", filename, DUMP_COMPRESS_SUFFIX);
+		compressed = 0;
+	}
+	if (compressed)
+		strcat(filename, DUMP_COMPRESS_SUFFIX);
+
 	/* Create the platform dump directory if necessary */
 	if (mkdir(d_cfg.platform_dump_path,
 		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) < 0) {
@@ -295,32 +441,57 @@ extract_platform_dump(uint64_t dump_tag)
 	strcpy(pathname, d_cfg.platform_dump_path);
 	strcat(pathname, filename);
 	msg("Dump path/filename: %s", pathname);
-	out = creat(pathname, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (out <= 0) {
+	writer.out = creat(pathname, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (writer.out <= 0) {
 		msg("Could not open %s for writing: %s.\nThe platform dump "
 			"could not be retrieved", pathname, strerror(errno));
+		writer.out = -1;
 		ret = 1;
 		goto platdump_error_out;
 	}
 
-	rc = write(out, dump_buf, (size_t)bytes);
-	if (rc < 0) {
-		msg("Could not write to %s: %s.\nThe platform dump "
-			"could not be retrieved", pathname, strerror(errno));
+	if (dump_stream_open(&writer.stream, writer.out, compressed)) {
+		msg("Could not set up compression of %s: %s.\nThe platform "
+			"dump could not be retrieved", pathname,
+			strerror(errno));
+		ret = 1;
+		goto platdump_error_out;
+	}
+
+	chunk->bytes = bytes;
+	chunk->full = 1;
+
+	if (pthread_create(&writer.thread, NULL, dump_writer_main, &writer)) {
+		msg("Could not start the dump writer thread.\nThe platform "
+			"dump could not be retrieved");
 		ret = 1;
 		goto platdump_error_out;
 	}
+	writing = 1;
 
+	i = 0;
 	while (dump_complete == 0) {
-		msg("Calling rtas_platform_dump, seq 0x%016LX", seq);
-		librtas_rc = rtas_platform_dump(dump_tag, seq, dump_buf,
-						DUMP_BUF_SZ, &seq_next, &bytes);
+		i ^= 1;
+		chunk = &writer.chunk[i];
+
+		/* Wait for the writer to be done with this buffer */
+		pthread_mutex_lock(&writer.lock);
+		while (chunk->full && !writer.error)
+			pthread_cond_wait(&writer.cond, &writer.lock);
+		rc = writer.error;
+		pthread_mutex_unlock(&writer.lock);
+
+		if (rc)
+			break;
+
+		librtas_rc = get_dump_chunk(dump_tag, seq, chunk->data,
+					    &seq_next, &bytes);
 		if (librtas_rc < 0) {
 			handle_platform_dump_error(librtas_rc, dump_err, 1024);
 			msg("%s\nThe platform dump could not be "
 				"retrieved from firmware", dump_err);
 			ret = 1;
-			goto platdump_error_out;
+			break;
 		}
 		if (librtas_rc == 0) {
 			dump_complete = 1;
@@ -328,15 +499,36 @@ extract_platform_dump(uint64_t dump_tag)
 
 		seq = seq_next;
 
-		rc = write(out, dump_buf, (size_t)bytes);
-		if (rc < 0) {
-			msg("Could not write to %s: %s\nThe platform "
-				"dump could not be retrieved", pathname,
-				strerror(errno));
-			ret = 1;
-			goto platdump_error_out;
-		}
+		pthread_mutex_lock(&writer.lock);
+		chunk->bytes = bytes;
+		chunk->full = 1;
+		pthread_cond_broadcast(&writer.cond);
+		pthread_mutex_unlock(&writer.lock);
+	}
+
+	/* Let the writer finish the queued chunks */
+	pthread_mutex_lock(&writer.lock);
+	writer.done = 1;
+	pthread_cond_broadcast(&writer.cond);
+	pthread_mutex_unlock(&writer.lock);
+	pthread_join(writer.thread, NULL);
+	writing = 0;
+
+	if (!writer.error && dump_stream_close(&writer.stream))
+		writer.error = errno;
+
+	if (writer.error) {
+		msg("Could not write to %s: %s\nThe platform "
+			"dump could not be retrieved", pathname,
+			strerror(writer.error));
+		/* Don't leave a partial dump filling up the directory */
+		if (unlink(pathname) < 0)
+			msg("Could not remove %s: %s", pathname,
+			    strerror(errno));
+		ret = 1;
 	}
+	if (ret)
+		goto platdump_error_out;
 
 	/* 
 	 * Got the dump; signal the platform that it is okay for
@@ -351,14 +543,38 @@ extract_platform_dump(uint64_t dump_tag)
 			"delete its copy of a platform dump", dump_err);
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "Extracted %llu bytes to %s in %.3f seconds, "
+		"%.1f MB/s", (unsigned long long)writer.stream.in_bytes,
+		pathname, secs,
+		secs > 0 ? writer.stream.in_bytes / secs / (1024 * 1024) : 0);
+	if (compressed)
+		fprintf(stderr, ", compressed to %llu bytes (%.1f%%)",
+			(unsigned long long)writer.stream.out_bytes,
+			writer.stream.in_bytes ? 100.0 *
+			writer.stream.out_bytes / writer.stream.in_bytes : 0);
+	fprintf(stderr, "\n");
+
 	/* rtas_errd depends on this line being printed */
 	printf("%s\n", filename);
 
 platdump_error_out:
-	if (out != -1)
-		close(out);
-	if (dump_buf != NULL)
-		free(dump_buf);
+	if (writing) {
+		pthread_mutex_lock(&writer.lock);
+		writer.done = 1;
+		pthread_cond_broadcast(&writer.cond);
+		pthread_mutex_unlock(&writer.lock);
+		pthread_join(writer.thread, NULL);
+	}
+	dump_stream_close(&writer.stream);
+	if (writer.out != -1)
+		close(writer.out);
+	for (i = 0; i < 2; i++)
+		free(writer.chunk[i].data);
+	pthread_mutex_destroy(&writer.lock);
+	pthread_cond_destroy(&writer.cond);
 
 	return ret;
 }
@@ -367,8 +583,12 @@ int
 main(int argc, char *argv[])
 {
 	int option_index, rc, fail=0;
-	int platform = 0;
 	uint64_t dump_tag;
+	char *output_dir = NULL;
+	long kbytes = 0;
+	int level = -1;
+#ifndef FAKE_PLATDUMP
+	int platform = 0;
 
 	platform = get_platform();
 	switch (platform) {
@@ -378,16 +598,37 @@ main(int argc, char *argv[])
 				argv[0], __power_platform_name(platform));
 		return -1;
 	}
+#endif
 
 	for (;;) {
 		option_index = 0;
-		rc = getopt_long(argc, argv, "hv", long_options,
+		rc = getopt_long(argc, argv, "b:ho:vz:", long_options,
 				&option_index);
 
 		if (rc == -1)
 			break;
 
 		switch (rc) {
+		case 'b':
+			kbytes = strtol(optarg, NULL, 10);
+			if (kbytes < DUMP_CHUNK_MIN / 1024) {
+				fprintf(stderr, "Invalid buffer size %s, it "
+					"must be at least %d kbytes\n",
+					optarg, DUMP_CHUNK_MIN / 1024);
+				return -1;
+			}
+			break;
+		case 'o':
+			output_dir = optarg;
+			break;
+		case 'z':
+			level = strtol(optarg, NULL, 10);
+			if (level < 0 || level > 9) {
+				fprintf(stderr, "Invalid compression level %s"
+					"\n", optarg);
+				return -1;
+			}
+			break;
 		case 'h':
 			print_usage(argv[0]);
 			return 0;
@@ -413,6 +654,30 @@ main(int argc, char *argv[])
 			return -2;
 		}
 
+		if (output_dir != NULL) {
+			if (strlen(output_dir) + 2 >
+			    sizeof(d_cfg.platform_dump_path)) {
+				fprintf(stderr, "Output directory %s is too "
+					"long\n", output_dir);
+				return -1;
+			}
+
+			strcpy(d_cfg.platform_dump_path, output_dir);
+			if (output_dir[strlen(output_dir) - 1] != '/')
+				strcat(d_cfg.platform_dump_path, "/");
+		}
+
+		if (kbytes == 0)
+			kbytes = d_cfg.platform_dump_chunk;
+		chunk_size = (uint64_t)kbytes * 1024;
+
+		compress_level = level >= 0 ? level : d_cfg.platform_dump_compress;
+		if (compress_level && !dump_stream_can_compress()) {
+			msg("extract_platdump was built without zlib, the "
+			    "dump will not be compressed");
+			compress_level = 0;
+		}
+
 		while (optind < argc) {
 			dump_tag = strtoll(argv[optind++], NULL, 16);
 			fail += extract_platform_dump(dump_tag);
@@ -19,6 +19,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -29,10 +30,16 @@
 #include <string.h>
 #include <ctype.h>
 #include <libgen.h>
+#include <endian.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <pthread.h>
 #include "rtas_errd.h"
+#include "hexdump.h"
+#include "corpus.h"
 
 char *platform_log = "/var/log/platform";
 int platform_log_fd = -1;
@@ -74,6 +81,15 @@ char *rtas_errd_log0 = "/var/log/rtas_errd.log0";
 static int rtas_errd_log_fd = -1;
 #define RTAS_ERRD_LOGSZ		25000
 
+/**
+ * @var rtas_errd_log_lock
+ * @brief Serializes writes (and rotation) of rtas_errd_log between the
+ * event reader thread and the handler.  Recursive since log rotation
+ * logs its own failures.
+ */
+static pthread_mutex_t rtas_errd_log_lock =
+				PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
 /* 
  * @var epow_status_file 
  * @brief File used to communicate the current state of an epow event
@@ -126,6 +142,24 @@ int	scenario_count = 0;
  */
 int	testing_finished = 0;
 
+/**
+ * @var corpus_file
+ * @brief binary event corpus specified with the -C option
+ */
+/**
+ * @var corpus_rate
+ * @brief events per second to replay corpus_file at, 0 for no limit
+ */
+char	*corpus_file = NULL;
+int	corpus_rate = 0;
+
+static char	*corpus_map = NULL;
+static size_t	corpus_size = 0;
+static size_t	corpus_pos = 0;
+static uint32_t	corpus_count = 0;
+static uint32_t	corpus_index = 0;
+static struct timespec corpus_start;
+
 /**
  * event_dump
  * @brief Dump an RTAS event
@@ -138,7 +172,7 @@ void
 event_dump(struct event *event)
 {
 	int i;
-	char *bufp = (char *)event->rtas_hdr;
+	char *bufp = event->event_buf;
 	int len = event->length;
 
 	/* Print 16 bytes/line in hex, with a space after every 4 bytes */
@@ -243,6 +277,186 @@ setup_rtas_event_scenario(void)
 
 	return 0;
 }
+
+/**
+ * setup_rtas_event_corpus
+ * @brief Map a binary event corpus to replay
+ *
+ * See corpus.h for the format of the corpus.
+ *
+ * @return 0 on success, !0 otherwise
+ */
+static int
+setup_rtas_event_corpus(void)
+{
+	struct rtas_corpus_hdr hdr;
+	struct stat sbuf;
+	int fd;
+
+	if (corpus_file == NULL)
+		return 0;
+
+	fd = open(corpus_file, O_RDONLY);
+	if (fd == -1) {
+		log_msg(NULL, "Could not open corpus file %s, %s",
+			corpus_file, strerror(errno));
+		return -1;
+	}
+
+	if ((fstat(fd, &sbuf)) < 0) {
+		log_msg(NULL, "Could not get status of corpus file %s, %s",
+			corpus_file, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if (sbuf.st_size < sizeof(hdr)) {
+		log_msg(NULL, "Invalid corpus file %s", corpus_file);
+		close(fd);
+		return -1;
+	}
+
+	corpus_map = mmap(0, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (corpus_map == MAP_FAILED) {
+		log_msg(NULL, "Cannot map corpus file %s, %s", corpus_file,
+			strerror(errno));
+		corpus_map = NULL;
+		return -1;
+	}
+
+	corpus_size = sbuf.st_size;
+
+	memcpy(&hdr, corpus_map, sizeof(hdr));
+	if (memcmp(hdr.magic, RTAS_CORPUS_MAGIC, sizeof(hdr.magic)) ||
+	    be32toh(hdr.version) != RTAS_CORPUS_VERSION ||
+	    be32toh(hdr.count) == 0) {
+		log_msg(NULL, "Invalid corpus file %s", corpus_file);
+		munmap(corpus_map, corpus_size);
+		corpus_map = NULL;
+		return -1;
+	}
+
+	corpus_count = be32toh(hdr.count);
+	corpus_pos = sizeof(hdr);
+	dbg("Replaying %u RTAS events from %s", corpus_count, corpus_file);
+
+	proc_error_log1 = corpus_file;
+	proc_error_log2 = NULL;
+
+	return 0;
+}
+
+/**
+ * corpus_due
+ * @brief Retrieve the time at which the next corpus event is due
+ *
+ * @param due buffer for the CLOCK_MONOTONIC time
+ * @return 1 if the event has to wait for corpus_rate, 0 otherwise
+ */
+static int
+corpus_due(struct timespec *due)
+{
+	uint64_t nsecs;
+
+	if (corpus_index == 0 && corpus_start.tv_sec == 0 &&
+	    corpus_start.tv_nsec == 0)
+		clock_gettime(CLOCK_MONOTONIC, &corpus_start);
+
+	if (!corpus_rate)
+		return 0;
+
+	nsecs = (uint64_t)corpus_index * 1000000000 / corpus_rate;
+	due->tv_sec = corpus_start.tv_sec + nsecs / 1000000000;
+	due->tv_nsec = corpus_start.tv_nsec + nsecs % 1000000000;
+	if (due->tv_nsec >= 1000000000) {
+		due->tv_sec++;
+		due->tv_nsec -= 1000000000;
+	}
+
+	return 1;
+}
+
+/**
+ * read_corpus_event
+ * @brief Read the next event from the corpus being replayed
+ *
+ * When a replay rate is set the event is not returned before its turn.
+ *
+ * @param buf buffer to read RTAS event in to.
+ * @param buflen length of buffer parameter
+ * @return number of bytes read.
+ */
+static int
+read_corpus_event(char *buf, int buflen)
+{
+	struct rtas_corpus_rec rec;
+	struct timespec due;
+	int seq_num, len;
+
+	if (corpus_pos + sizeof(rec) > corpus_size)
+		goto invalid;
+
+	memcpy(&rec, corpus_map + corpus_pos, sizeof(rec));
+	seq_num = be32toh(rec.seq_num);
+	len = be32toh(rec.len);
+	if (len + sizeof(int) > buflen ||
+	    corpus_pos + sizeof(rec) + len > corpus_size)
+		goto invalid;
+
+	if (corpus_due(&due))
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due,
+				       NULL) == EINTR);
+
+	memcpy(buf, &seq_num, sizeof(int));
+	memcpy(buf + sizeof(int), corpus_map + corpus_pos + sizeof(rec), len);
+	corpus_pos += sizeof(rec) + len;
+
+	if (++corpus_index == corpus_count)
+		testing_finished = 1;
+
+	return len + sizeof(int);
+
+invalid:
+	log_msg(NULL, "Invalid event %u in corpus file %s", corpus_index,
+		corpus_file);
+	testing_finished = 1;
+	return -1;
+}
+
+/**
+ * corpus_report
+ * @brief Log the rate at which the corpus was replayed
+ *
+ * Called once the replayed events have all been handled, along with
+ * the event handling statistics for the per-event latencies.
+ */
+void
+corpus_report(void)
+{
+	struct timespec now;
+	uint64_t usecs;
+
+	if (corpus_map == NULL || corpus_index == 0)
+		return;
+
+	/* Whatever is still queued is part of handling the corpus */
+	hotplug_flush();
+	log_event_flush();
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usecs = (now.tv_sec - corpus_start.tv_sec) * 1000000 +
+		(now.tv_nsec - corpus_start.tv_nsec) / 1000;
+	if (usecs == 0)
+		usecs = 1;
+
+	log_msg(NULL, "Replayed %u RTAS events from %s in %llu.%06llu "
+		"seconds, %llu events/sec", corpus_index, corpus_file,
+		(unsigned long long)(usecs / 1000000),
+		(unsigned long long)(usecs % 1000000),
+		(unsigned long long)corpus_index * 1000000 / usecs);
+	stats_log();
+}
 #endif /* DEBUG */
 
 /** 
@@ -278,6 +492,10 @@ init_files(void)
 	rc = setup_rtas_event_scenario();
 	if (rc)
 		return rc;
+
+	rc = setup_rtas_event_corpus();
+	if (rc)
+		return rc;
 #endif
 	proc_error_log_fd = open(proc_error_log1, O_RDONLY);
 	if (proc_error_log_fd < 0)
@@ -309,7 +527,8 @@ init_files(void)
 	}
 
 	/* Next, open /var/log/platform */
-	platform_log_fd = open(platform_log, O_RDWR | O_SYNC | O_CREAT,
+	platform_log_fd = open(platform_log,
+			       O_RDWR | O_SYNC | O_CREAT | O_APPEND,
 			       S_IRUSR | S_IWUSR | S_IRGRP /*0640*/);
 	if (platform_log_fd < 0) {
 		log_msg(NULL, "Could not open log file %s, %s\nThe daemon "
@@ -341,6 +560,8 @@ close_files(void)
 		free(scenario_buf);
 	if (scenario_files != NULL)
 		free(scenario_files);
+	if (corpus_map != NULL)
+		munmap(corpus_map, corpus_size);
 #endif
 	if (rtas_errd_log_fd)
 		close(rtas_errd_log_fd);
@@ -352,6 +573,56 @@ close_files(void)
 		close(epow_status_fd);
 }
 
+/**
+ * wait_proc_error_log
+ * @brief Wait until an RTAS event can be read, or the reader must stop
+ *
+ * The kernel error log is polled together with stop_fd, so that the
+ * reader thread does not have to be cancelled while it waits.
+ *
+ * @param stop_fd fd that becomes readable when the reader must stop
+ * @return 0 if read_proc_error_log() can be called, 1 to stop
+ */
+int
+wait_proc_error_log(int stop_fd)
+{
+	struct pollfd fds[2];
+	int timeout = -1;
+
+	fds[0].fd = proc_error_log_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = stop_fd;
+	fds[1].events = POLLIN;
+
+#ifdef DEBUG
+	if (corpus_map != NULL) {
+		struct timespec due, now;
+
+		/* Only the replay rate has to be waited for */
+		fds[0].fd = -1;
+		timeout = 0;
+		if (corpus_due(&due)) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			timeout = (due.tv_sec - now.tv_sec) * 1000 +
+				  (due.tv_nsec - now.tv_nsec) / 1000000;
+			if (timeout < 0)
+				timeout = 0;
+		}
+	}
+#endif
+
+	/* read() reports a log that could not be opened */
+	if (fds[0].fd < 0 && timeout == -1)
+		return 0;
+
+	while (poll(fds, 2, timeout) == -1) {
+		if (errno != EINTR)
+			return 0;
+	}
+
+	return fds[1].revents ? 1 : 0;
+}
+
 /** 
  * read_proc_error_log
  * @brief Read data from proc_error_log
@@ -370,6 +641,9 @@ read_proc_error_log(char *buf, int buflen)
 	int len = 0;
 
 #ifdef DEBUG
+	if (corpus_map != NULL)
+		return read_corpus_event(buf, buflen);
+
 	/* If we are reading in a test file with an ascii RTAS event,
 	 * we need to convert it to binary.  proc_error_log2 should
 	 * only be NULL when a debug proc_error_log file is specified
@@ -706,9 +980,11 @@ cfg_log(char *fmt, ...)
 {
 	va_list ap;
 
+	pthread_mutex_lock(&rtas_errd_log_lock);
 	va_start(ap, fmt);
 	_log_msg(NULL, fmt, ap);
 	va_end(ap);
+	pthread_mutex_unlock(&rtas_errd_log_lock);
 }
 
 /**
@@ -724,9 +1000,11 @@ log_msg(struct event *event, char *fmt, ...)
 {
 	va_list ap;
 
+	pthread_mutex_lock(&rtas_errd_log_lock);
 	va_start(ap, fmt);
 	_log_msg(event, fmt, ap);
 	va_end(ap);
+	pthread_mutex_unlock(&rtas_errd_log_lock);
 }
 
 /**
@@ -767,16 +1045,22 @@ _dbg(const char *fmt, ...)
  * @brief Print an RTAS event to the platform log
  * 
  * Prints the binary hexdump of an RTAS event to the PLATFORM_LOG file.
+ * The begin line, optional scanlog line, hexdump and end line are
+ * written with a single writev() so the event always lands in the
+ * (O_APPEND) platform log in one piece.
  * 
  * @param event pointer to the struct event to print
- * @return 0 on success, !0 on failure
+ * @return number of bytes written on success, <= 0 on failure
  */
 int
 print_rtas_event(struct event *event)
 {
-	char	*out_buf;
-	int	len, buf_size, offset;
-	int	i, rc, nlines;
+	static char	*out_buf = NULL;
+	static int	out_buf_size = 0;
+	char	begin[64], end[64], *scanlog_line = NULL;
+	struct iovec iov[4];
+	int	len, buf_size, iovcnt = 0, total = 0;
+	int	rc;
 
 	/* Determine the length of the log */
 	len = event->length;
@@ -788,76 +1072,66 @@ print_rtas_event(struct event *event)
 	if (len == 0)
 		len = 32;
 
-	/* We need to allocate a buffer big enough to hold all the data
-	 * from the RTAS event plus the additional strings printed
-	 * before and after the RTAS event (roughly 0x40 in length)
-	 * _and_ the strings printed in front of every line (roughly 0x10
-	 * in length).  
-	 *
-	 * We calculate the number of lines needed to print the RTAS event, 
-	 * mulitply that by the space for the strings then add in the 
-	 * beginning/end strings.  For a little extra padding we double the 
-	 * len value also.
-	 *
-	 * size = (len * 2) + (number of lines * 0x10) + (2 * 0x40)
+	/* The hexdump buffer is kept around between events and only
+	 * grows if an event needs more space than any previous one.
 	 */
-	nlines = len / 0x10;
-	if (len % 0x10)
-		nlines++;
-	buf_size = (len * 2) + (nlines * 0x10) + (2 * 0x40);
-	/* event_dump(event); */
-
-	out_buf = calloc(1, buf_size);
-	if (out_buf == NULL) {
-		log_msg(NULL, "Could not allocate buffer to print RTAS event "
-			"%d, %s.  The event will not copied to %s",
-			event->seq_num, strerror(errno),
-			platform_log);
-		return -1;
+	buf_size = RTAS_HEXDUMP_SIZE(len);
+	if (buf_size > out_buf_size) {
+		char *new_buf = realloc(out_buf, buf_size);
+
+		if (new_buf == NULL) {
+			log_msg(NULL, "Could not allocate buffer to print "
+				"RTAS event %d, %s.  The event will not copied "
+				"to %s", event->seq_num, strerror(errno),
+				platform_log);
+			return -1;
+		}
+		out_buf = new_buf;
+		out_buf_size = buf_size;
 	}
 
-	offset = sprintf(out_buf,
-			 "RTAS: %d -------- RTAS event begin --------\n",
-			 event->seq_num);
+	iov[iovcnt].iov_base = begin;
+	iov[iovcnt].iov_len = sprintf(begin,
+			"RTAS: %d -------- RTAS event begin --------\n",
+			event->seq_num);
+	total += iov[iovcnt++].iov_len;
 
 	if (event->flags & RE_SCANLOG_AVAIL) {
-		offset += sprintf(out_buf + offset, "RTAS: %s\n", scanlog);
+		rc = asprintf(&scanlog_line, "RTAS: %s\n", scanlog);
+		if (rc < 0) {
+			scanlog_line = NULL;
+		} else {
+			iov[iovcnt].iov_base = scanlog_line;
+			iov[iovcnt].iov_len = rc;
+			total += iov[iovcnt++].iov_len;
+		}
 		free(scanlog);
 		scanlog = NULL;
 	}
 
-	/* Print 16 bytes/line in hex, with a space after every 4 bytes */
-	for (i = 0; i < len; i++) {
-		if ((i % 16) == 0)
-			offset += sprintf(out_buf + offset, "RTAS %d:", i/16);
-
-		if ((i % 4) == 0)
-			offset += sprintf(out_buf + offset, " ");
-
-		offset += sprintf(out_buf + offset, "%02x",
-				  event->event_buf[i]);
-
-		if ((i % 16) == 15)
-			offset += sprintf(out_buf + offset, "\n");
-	}
-	if ((i % 16) != 0)
-		offset += sprintf(out_buf + offset, "\n");
+	iov[iovcnt].iov_base = out_buf;
+	iov[iovcnt].iov_len = rtas_hexdump(out_buf, event->event_buf, len);
+	total += iov[iovcnt++].iov_len;
 
-	offset += sprintf(out_buf + offset,
-			  "RTAS: %d -------- RTAS event end ----------\n",
-			  event->seq_num);
+	iov[iovcnt].iov_base = end;
+	iov[iovcnt].iov_len = sprintf(end,
+			"RTAS: %d -------- RTAS event end ----------\n",
+			event->seq_num);
+	total += iov[iovcnt++].iov_len;
 
 	dbg("Writing RTAS event %d to %s", event->seq_num, platform_log);
-	lseek(platform_log_fd, 0, SEEK_END);
-	rc = write(platform_log_fd, out_buf, offset);
-	if (rc != offset) {
+	rc = writev(platform_log_fd, iov, iovcnt);
+	if (rc != total) {
 		log_msg(NULL, "Writing RTAS event %d to %s failed."
 			"expected to write %d, only wrote %d. %s",
-			event->seq_num, platform_log, offset, rc,
+			event->seq_num, platform_log, total, rc,
 			strerror(errno));
+	} else {
+		archive_event(event);
 	}
 
-	free(out_buf);
+	if (scanlog_line)
+		free(scanlog_line);
 	return rc;
 }
 
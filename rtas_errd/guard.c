@@ -23,45 +23,62 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <stdint.h>
 #include <string.h>
-#include <sys/stat.h>
 #include <sys/wait.h>
-#include <dirent.h>
-#include "utils.h"
 #include "rtas_errd.h"
 
-#define DRMGR_PROGRAM		"/usr/sbin/drmgr"
 #define DRMGR_PROGRAM_NOPATH	"drmgr"
-#define CONVERT_DT_PROPS_PROGRAM "/usr/sbin/convert_dt_node_props"
 
 #define RTAS_V6_TYPE_RESOURCE_DEALLOC	0xE3
 
 enum resource_dealloc_type {CPU_GUARD, SP_CPU_GUARD, MEM_PAGE, MEM_LMB};
 enum event_type {CPUTYPE, MEMTYPE};
 
+/**
+ * dealloc_done
+ * @brief Completion of a drmgr run for a deallocation request
+ *
+ * @param status wait status of drmgr, -1 if it could not be run
+ * @param arg unused
+ */
+static void
+dealloc_done(int status, void *arg)
+{
+	if (status == -1)
+		return;
+
+	/* A CPU or an LMB may be gone now */
+	topology_invalidate();
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		log_msg(NULL, "%s failed to deallocate resources in response "
+			"to a predictive failure, exit status %d",
+			drmgr_program, WIFEXITED(status) ?
+			WEXITSTATUS(status) : -1);
+}
+
 /**
  * run_drmgr
- * @brief build correct options followed by fork and exec drmgr
+ * @brief build correct options and have drmgr run
+ *
+ * drmgr is not waited for; the requests for CPUs, and those for
+ * memory, are carried out in the order they are made (see helper.c).
  *
  * @param resource type to deallocate.
  * @param specific drc_name to be de-allocted.
  * @param either quatity or capacity to be deallocated.
- * @param wait do we do a waitpid?
  */
 void
 run_drmgr(enum resource_dealloc_type resource_type, char *drc_name,
-	  unsigned int value, int wait)
+	  unsigned int value)
 {
-	pid_t child;
-	int status;
 	char capacity[6], quant_str[5];
 	char *drmgr_args[] = {DRMGR_PROGRAM_NOPATH, "-r", "-c", NULL,
 			NULL, NULL, NULL, NULL, NULL};
 
-	dbg("in run_drmgr command: %d %s %d %d", resource_type, drc_name,
-	     value, wait);
+	dbg("in run_drmgr command: %d %s %d", resource_type, drc_name,
+	     value);
 
 	if (resource_type == CPU_GUARD) {
 		drmgr_args[3] = "cpu";
@@ -86,6 +103,7 @@ run_drmgr(enum resource_dealloc_type resource_type, char *drc_name,
 		log_msg(NULL, "We should not reach this code path "
 			"error in handling of MEM_PAGE");
 		/* place holder for future expansion */
+		return;
 	}
 	else if (resource_type == MEM_LMB) {
 		drmgr_args[3] = "mem";
@@ -103,100 +121,33 @@ run_drmgr(enum resource_dealloc_type resource_type, char *drc_name,
 		return;
 #endif
 
-	child = fork();
-	if (child == -1) {
-		log_msg(NULL, "%s cannot be run to handle a predictive CPU "
-			"failure, %s", DRMGR_PROGRAM, strerror(errno));
-		return;
-	}
-	else if (child == 0) {
-		/* child process */
-		execv(DRMGR_PROGRAM, drmgr_args);
-
-		/* shouldn't get here */
-		log_msg(NULL, "Could not exec %s to in response to a "
-			"predictive CPU failure, %s", DRMGR_PROGRAM,
-			strerror(errno));
-		exit(1);
-	}
-
-	if (wait) {
-		child = waitpid(child, &status, 0);
-	}
+	helper_run(HELPER_DRMGR, drmgr_args[3], drmgr_program, drmgr_args,
+		   dealloc_done, NULL);
 }
 
 /**
  * can_delete_lmb
- * @brief Counts the number of lmb's and returns an appropriate value
+ * @brief Check that an LMB is not the last one online
  *
- * This function returns true or false. It counts the lmb's in the system
- * and returns true if there is more than one lmb in the system. Which allows
- * us to call the appropriate delete function.
  * @return true if deletion can occur or false if it is the last lmb.
  */
 static int
 can_delete_lmb(void)
 {
-	DIR *dir;
-	struct dirent *entry;
-	int ret_val, fd, ctr=0;
-	char buffer[1024], state[7];
-	int rc;
-
-	ret_val = 0; /* default state is false, unless count is positive */
-
-	dir = opendir("/sys/devices/system/memory");
-	if (!dir)
-		return 0;
-
-	while ((entry = readdir(dir)) != NULL) {
-
-		/* ignore memory@0 situation */
-		if (!strncmp(entry->d_name, "memory@0", 8))
-				continue;
-
-		if (!strncmp(entry->d_name, "memory", 6)) {
-
-			rc = snprintf(buffer, 1024, "/sys/devices/system/memory/%s/"
-					"state", entry->d_name);
-			if (rc < 0 || rc >= 1024) {
-				log_msg(NULL, "%s:%d - Unable to format %s\n",
-						__func__, __LINE__, entry->d_name);
-				continue;
-			}
-
-			if ((fd = open(buffer, O_RDONLY)) < 0 ) {
-				log_msg(NULL, "Could not open %s, %s",
-					buffer, strerror(errno));
-				continue;
-			}
-			if ((read(fd, state, 6)) == 6) {
-				if(!strncmp(state, "online", 6))
-					ctr++;
-				/* make sure its not the last lmb */
-				if (ctr >= 2) {
-					ret_val = 1;
-					close(fd);
-					break;
-				}
-			}
-			close(fd);
-		}
-	}
-
-	closedir(dir);
-	return ret_val;
+	return topology_online_lmbs() >= 2;
 }
 
 /**
  * retrieve_drc_name
- * @brief retrieve the drc-name of a cpu
- * 
- * Retrieves a string containing the drc-name of the CPU specified by the ID 
- * passed as a parameter.  Returns 1 on success, 0 on failure.
+ * @brief retrieve the drc-name of a cpu or an lmb
+ *
+ * Retrieves a string containing the drc-name of the CPU or LMB specified
+ * by the ID passed as a parameter, from the topology index.  Returns 1
+ * on success, 0 on failure.
  *
+ * @param type CPUTYPE or MEMTYPE
  * @param event rtas event pointer
- * @param id interrupt server number of the cpu
+ * @param id interrupt server number of the cpu, drc-index of the lmb
  * @param buffer storeage for drc-name
  * @param bufsize size of buffer
  * @return 1 on success, 0 on failure
@@ -205,94 +156,30 @@ static int
 retrieve_drc_name(enum event_type type, struct event *event, unsigned int id,
 		      char *buffer, size_t bufsize)
 {
-	struct stat sbuf;
-	int rc, ret=1;
-	FILE *fp;
-	uint8_t status;
-	char *system_args[9] = {NULL,}; /* execv arguments      	*/
-	char tmp_sys_arg[100];		/* tmp sys_arg for snprintf	*/
-	pid_t cpid;                     /* child pid            	*/
-
-	if (stat(CONVERT_DT_PROPS_PROGRAM, &sbuf) < 0) {
-		log_msg(event, "The command \"%s\" does not exist, %s",
-			CONVERT_DT_PROPS_PROGRAM, strerror(errno));
-		return 0;
-	}
+	int len;
 
-	system_args[0] = CONVERT_DT_PROPS_PROGRAM;
-	system_args[1] = "--context";
-	if (type == CPUTYPE) {
-		system_args[2] = "cpu";
-		system_args[3] = "--from";
-		system_args[4] = "interrupt-server";
-		system_args[5] = "--to";
-		system_args[6] = "drc-name";
-		snprintf(tmp_sys_arg, 100, "%u", id);
-		system_args[7] = tmp_sys_arg;
-	} else { /* event type is mem */
-		system_args[2] = "mem";
-		system_args[3] = "--from";
-		system_args[4] = "drc-index";
-		system_args[5] = "--to";
-		system_args[6] = "drc-name";
-		snprintf(tmp_sys_arg, 100, "0x%08x", id);
-		system_args[7] = tmp_sys_arg;
-	}
+	if (type == CPUTYPE)
+		len = topology_cpu_drc_name(id, buffer, bufsize);
+	else
+		len = topology_mem_drc_name(id, buffer, bufsize);
 
-	/* Note :
-	 *        rtas_errd sets up child signal handler
-	 * (setup_sigchld_handler()) which cleanup child process when it
-	 * exited. This caused pclose() to return non-zero value always
-	 * (No child process ). Resulted this function to return 0
-	 * (failure) always. To overcome this issue we will restore
-	 * SIGCHLD handler to default action before doing popen() and
-	 * setup again after completing pclose().
-	 */
-	restore_sigchld_default();
-
-	fp = spopen(system_args, &cpid);
-	if (fp == NULL) {
-		if (type == CPUTYPE) {
-			log_msg(event, "Cannot obtain the drc-name for the "
-				"CPU with ID %u; Could not run %s. %s", id,
-				CONVERT_DT_PROPS_PROGRAM, strerror(errno));
-		}
-		else {
-			log_msg(event, "Cannot obtain the drc-name for the "
-				"Memory with ID %u; Could not run %s. %s", id,
-				CONVERT_DT_PROPS_PROGRAM, strerror(errno));
-		}
-		setup_sigchld_handler();
+	if (len < 0) {
+		log_msg(event, "Cannot obtain the drc-name for the %s with "
+			"ID %u; it is not in the device tree",
+			(type == CPUTYPE) ? "CPU" : "MEMORY", id);
 		return 0;
-	} /* fp == NULL */
+	}
 
-	rc = fread(buffer, 1, bufsize, fp);
-	if (rc == bufsize) {
+	if ((size_t)len >= bufsize) {
 		log_msg(event, "Cannot obtain the drc-name for the "
 			       "%s with ID %u; Buffer overflow in "
 			       "retrieve_drc_name",
 				(type == CPUTYPE) ? "CPU" : "MEMORY",
 				id);
-		buffer[bufsize-1] = '\0';
-		ret = 0;
-	} else if (rc > 0) {
-		buffer[rc-1] = '\0';	/* overwrite the newline at the end */
-	} else
-		buffer[0] = '\0';
-
-	status = spclose(fp, cpid);
-
-	setup_sigchld_handler();
-
-	if (status != 0) {
-		log_msg(event, "Cannot obtain the drc-name for the "
-			       "%s with ID %u; %s returned %d",
-				(type == CPUTYPE) ? "CPU" : "MEMORY",
-				id, CONVERT_DT_PROPS_PROGRAM, rc);
-		ret = 0;
+		return 0;
 	}
 
-	return ret;
+	return 1;
 }
 
 /**
@@ -343,8 +230,8 @@ parse_lparcfg(char *param) {
  * @brief Parse RTAS event for CPU guard information.
  *
  * Parses error information to determine if it represents a predictive CPU
- * failure, which should cause a CPU Guard operation.  DRMGR_PROGRAM is
- * forked to actually remove the CPU from the system.
+ * failure, which should cause a CPU Guard operation.  drmgr is
+ * run to actually remove the CPU from the system.
  *
  * @param event rtas event
  * @param cpu id to locate drc_name
@@ -380,7 +267,7 @@ guard_cpu(struct event *event, int cpu_id)
 		return;
 	}
 
-	run_drmgr(CPU_GUARD, drc_name, 0, 0);
+	run_drmgr(CPU_GUARD, drc_name, 0);
 	log_msg(event, "The following CPU has been offlined due to the "
 		"reporting of a predictive CPU failure: logical ID "
 		"%d, drc-name %s", cpu_id, drc_name);
@@ -400,8 +287,8 @@ guard_cpu(struct event *event, int cpu_id)
  * @brief Parse RTAS event for SP_CPU guard information.
  *
  * Parses error information to determine if it represents a predictive SPCPU
- * failure, which should cause a SPCPU Guard operation. DRMGR_PROGRAM is
- * forked to actually remove the virtual cpu from the system.
+ * failure, which should cause a SPCPU Guard operation. drmgr is
+ * run to actually remove the virtual cpu from the system.
  *
  * @param event rtas event
  * @param entitiled shared processor loss.
@@ -435,7 +322,7 @@ guard_spcpu(struct event *event, int ent_loss)
 	if ((ent_cap - ent_loss) < (n_cpus * min_ent_cap)) {
 		/* need to deallocate virtual CPUs */
 		quant = (ent_cap - ent_loss)/10;
-		run_drmgr(CPU_GUARD, NULL, quant, 1);
+		run_drmgr(CPU_GUARD, NULL, quant);
 
 		log_msg(event, "A request was received to deallocate "
 			"entitled capacity due to a predictive CPU "
@@ -454,7 +341,7 @@ guard_spcpu(struct event *event, int ent_loss)
 			"virtual CPUs", quant);
 		}
 
-	run_drmgr(SP_CPU_GUARD, NULL, ent_loss, 0);
+	run_drmgr(SP_CPU_GUARD, NULL, ent_loss);
 	log_msg(event, "Entitled capacity in the amount of %d has been "
 		"offlined due to the reporting of a predictive CPU "
 		"failure", ent_loss);
@@ -496,7 +383,7 @@ guard_mempage( struct event *event, uint64_t memory_address)
  *
  * parses error information to determine the lmb that requires
  * guarding operation. At this time only MEMLMB operations may
- * be guarded. DRMGR_PROGRAM is forked to actually remove
+ * be guarded. drmgr is run to actually remove
  * the LMB from the system.
  *
  * @param event rtas event
@@ -523,7 +410,7 @@ guard_memlmb(struct event *event, unsigned int drc_index)
 		return;
 	}
 
-	run_drmgr(MEM_LMB, drc_name, 0,0);
+	run_drmgr(MEM_LMB, drc_name, 0);
 	log_msg(event, "The following LMB has been offlined due to the "
 		       "reporting of a predictive memory failure:"
 			"0x%08x, drc-name %s", drc_index, drc_name);
@@ -545,8 +432,8 @@ guard_memlmb(struct event *event, unsigned int drc_index)
  * @brief Parse RTAS event for CPU guard information.
  *
  * Parses error information to determine if it represents a predictive CPU
- * failure, which should cause a CPU Guard operation.  DRMGR_PROGRAM is
- * forked to actually remove the CPU from the system.
+ * failure, which should cause a CPU Guard operation.  drmgr is
+ * run to actually remove the CPU from the system.
  *
  * @param event rtas event
  */
@@ -572,9 +459,9 @@ handle_resource_dealloc(struct event *event)
 	    rtas_hdr->version < 6) {
 
 		/* Check extended error information */
-		exthdr = rtas_get_event_exthdr_scn(event->rtas_event);
+		exthdr = event_scn(event, RTAS_EVENT_EXT_HDR);
 
-		cpu = rtas_get_cpu_scn(event->rtas_event);
+		cpu = event_scn(event, RTAS_CPU_SCN);
 
 		if (cpu == NULL) {
 			log_msg(event, "Could not retrieve CPU section to "
@@ -591,7 +478,7 @@ handle_resource_dealloc(struct event *event)
 
 	if (rtas_hdr->version >= 6) {
 		if (rtas_hdr->type == RTAS_V6_TYPE_RESOURCE_DEALLOC) {
-			lri = rtas_get_lri_scn(event->rtas_event);
+			lri = event_scn(event, RTAS_LRI_SCN);
 			if (lri == NULL) {
 				log_msg(event, "Could not retrieve a Logical "
 					"Resource Identification section from "
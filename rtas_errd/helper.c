@@ -0,0 +1,437 @@
+/**
+ * @file helper.c
+ * @brief Supervisor for the helper programs rtas_errd runs
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "rtas_errd.h"
+
+/*
+ * Helpers such as drmgr can take minutes to run, e.g. to remove a CPU
+ * or an LMB, so rtas_errd does not wait for them while handling an
+ * event.  helper_run() starts the helper with posix_spawn() and returns
+ * straight away; the helper's exit is picked up from SIGCHLD by the
+ * event loop, which calls helper_reap() to run the completion callback
+ * of the request.
+ *
+ * Requests are kept in one list, in the order they were made.  A
+ * request is only started once fewer than max_running helpers of its
+ * type are running, and once no earlier request of its type for the
+ * same resource, running or not, is left.  Operations on a resource are
+ * therefore carried out in the order of the events that asked for them.
+ * The resource "*" stands for all resources of a helper type.
+ *
+ * Once rtas_errd is told to terminate, helper_stop() keeps any further
+ * request from being started: a CPU or LMB removal can take minutes,
+ * and should not be begun while the system shuts down.
+ */
+
+#define HELPER_DRAIN_TIMEOUT	30	/* secs */
+
+struct helper {
+	int		type;		/**< HELPER_* */
+	char		resource[16];	/**< ordering key */
+	char		*path;
+	char		**argv;
+	pid_t		pid;		/**< 0 until started */
+	uint64_t	start;		/**< stats_now() when started */
+	helper_done_t	done;
+	void		*arg;
+	struct helper	*next;
+};
+
+static const struct {
+	const char	*name;
+	int		max_running;	/**< 0 for no limit */
+} helper_types[HELPER_TYPE_MAX] = {
+	[HELPER_DRMGR]		= { "drmgr", 1 },
+	[HELPER_POWERFAIL]	= { "rc.powerfail", 0 },
+};
+
+static struct helper *helpers = NULL;
+static int helpers_stopped = 0;
+
+/**
+ * @var drmgr_program
+ * @brief drmgr to run for hotplug, PRRN and deallocation requests
+ */
+char *drmgr_program = "/usr/sbin/drmgr";
+
+extern char **environ;
+
+static void
+helper_free(struct helper *h)
+{
+	int i;
+
+	for (i = 0; h->argv[i] != NULL; i++)
+		free(h->argv[i]);
+	free(h->argv);
+	free(h->path);
+	free(h);
+}
+
+static int
+resource_conflict(struct helper *a, struct helper *b)
+{
+	return a->type == b->type &&
+	       (!strcmp(a->resource, b->resource) ||
+		!strcmp(a->resource, "*") || !strcmp(b->resource, "*"));
+}
+
+/**
+ * helper_spawn
+ * @brief Start the program of a request
+ *
+ * The child starts with no signals blocked and SIGPIPE at its default
+ * action, whatever the event loop has blocked or ignored.
+ *
+ * @return 0 on success, an errno value on failure
+ */
+static int
+helper_spawn(struct helper *h)
+{
+	posix_spawnattr_t attr;
+	sigset_t set;
+	int rc;
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+					POSIX_SPAWN_SETSIGDEF);
+	sigemptyset(&set);
+	posix_spawnattr_setsigmask(&attr, &set);
+	sigaddset(&set, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &set);
+
+	rc = posix_spawn(&h->pid, h->path, NULL, &attr, h->argv, environ);
+	posix_spawnattr_destroy(&attr);
+	if (rc) {
+		h->pid = 0;
+		return rc;
+	}
+
+	h->start = stats_now();
+	dbg("Started %s (pid %d) for %s", h->path, h->pid, h->resource);
+	return 0;
+}
+
+/**
+ * helper_complete
+ * @brief Remove a request from the list and run its completion
+ *
+ * @param h the request
+ * @param status wait status of the helper, -1 if it could not be run
+ */
+static void
+helper_complete(struct helper *h, int status)
+{
+	struct helper **pp;
+
+	for (pp = &helpers; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == h) {
+			*pp = h->next;
+			break;
+		}
+	}
+
+	if (h->pid) {
+		if (h->type == HELPER_DRMGR)
+			stats_stage(STATS_DRMGR, h->start);
+		dbg("%s (pid %d) for %s exited with %d after %llu usecs",
+		    h->path, h->pid, h->resource, WIFEXITED(status) ?
+		    WEXITSTATUS(status) : -1,
+		    (unsigned long long)(stats_now() - h->start));
+	}
+
+	if (h->done)
+		h->done(status, h->arg);
+
+	helper_free(h);
+}
+
+/**
+ * helper_start_queued
+ * @brief Start every queued request that is allowed to run
+ */
+static void
+helper_start_queued(void)
+{
+	struct helper *h, *prev, *next;
+	int running[HELPER_TYPE_MAX] = { 0, };
+	int max, rc, blocked;
+
+	if (helpers_stopped)
+		return;
+
+	for (h = helpers; h != NULL; h = next) {
+		next = h->next;
+		max = helper_types[h->type].max_running;
+
+		if (h->pid) {
+			running[h->type]++;
+			continue;
+		}
+
+		if (max && running[h->type] >= max)
+			continue;
+
+		/* Wait for earlier requests on the same resource */
+		blocked = 0;
+		for (prev = helpers; prev != h; prev = prev->next) {
+			if (resource_conflict(prev, h)) {
+				blocked = 1;
+				break;
+			}
+		}
+		if (blocked)
+			continue;
+
+		rc = helper_spawn(h);
+		if (rc) {
+			log_msg(NULL, "Could not run %s, %s", h->path,
+				strerror(rc));
+			/* h is off the list now, carry on with the next */
+			helper_complete(h, -1);
+			continue;
+		}
+
+		running[h->type]++;
+	}
+}
+
+/**
+ * helper_run
+ * @brief Run a helper program without waiting for it
+ *
+ * @param type HELPER_* type, for the concurrency limit
+ * @param resource what the helper operates on, e.g. "cpu" or "mem"
+ * @param path program to run
+ * @param argv NULL terminated argument list, copied
+ * @param done called once the helper exited, or could not be run; may
+ *	be NULL, must not call helper_run()
+ * @param arg passed to done
+ * @return 0 if the request was queued or started, -1 on failure, in
+ *	which case done is not called
+ */
+int
+helper_run(int type, const char *resource, const char *path,
+	   char *const argv[], helper_done_t done, void *arg)
+{
+	struct helper *h, **pp;
+	int i, argc;
+
+	for (argc = 0; argv[argc] != NULL; argc++)
+		;
+
+	h = calloc(1, sizeof(*h));
+	if (h == NULL)
+		goto nomem;
+
+	h->argv = calloc(argc + 1, sizeof(char *));
+	h->path = strdup(path);
+	if (h->argv == NULL || h->path == NULL)
+		goto nomem_free;
+
+	for (i = 0; i < argc; i++) {
+		h->argv[i] = strdup(argv[i]);
+		if (h->argv[i] == NULL)
+			goto nomem_free;
+	}
+
+	h->type = type;
+	snprintf(h->resource, sizeof(h->resource), "%s", resource);
+	h->done = done;
+	h->arg = arg;
+
+	for (pp = &helpers; *pp != NULL; pp = &(*pp)->next)
+		;
+	*pp = h;
+
+	helper_start_queued();
+	return 0;
+
+nomem_free:
+	if (h->argv)
+		helper_free(h);
+	else
+		free(h);
+nomem:
+	log_msg(NULL, "Could not run %s, %s", path, strerror(ENOMEM));
+	return -1;
+}
+
+static void
+helper_exited(pid_t pid, int status)
+{
+	struct helper *h;
+
+	for (h = helpers; h != NULL; h = h->next) {
+		if (h->pid == pid) {
+			helper_complete(h, status);
+			return;
+		}
+	}
+
+	/* Not one of ours, e.g. a child that failed to exec */
+	dbg("Reaped child %d, exit status %d", pid,
+	    WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+/**
+ * helper_reap
+ * @brief Complete the helpers that have exited
+ *
+ * Called by the event loop on SIGCHLD.  Any other exited child is
+ * reaped as well; every child rtas_errd waits for itself has been
+ * reaped by the time the event loop gets here.
+ */
+void
+helper_reap(void)
+{
+	pid_t pid;
+	int status;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		helper_exited(pid, status);
+
+	helper_start_queued();
+}
+
+/**
+ * helper_stop
+ * @brief Start no more requests
+ *
+ * Called when rtas_errd receives SIGTERM or SIGINT.
+ */
+void
+helper_stop(void)
+{
+	helpers_stopped = 1;
+}
+
+/**
+ * helper_stopped
+ * @brief Check whether helper_stop() was called
+ *
+ * @return 1 if requests are no longer started, 0 otherwise
+ */
+int
+helper_stopped(void)
+{
+	return helpers_stopped;
+}
+
+/**
+ * helper_drain_stopped
+ * @brief Drop the requests not started yet, and give the running
+ * helpers HELPER_DRAIN_TIMEOUT seconds to complete
+ */
+static void
+helper_drain_stopped(void)
+{
+	struct timespec delay = { 0, 100000000 };	/* 100 msecs */
+	struct helper *h, *next;
+	uint64_t deadline;
+	pid_t pid;
+	int status;
+
+	for (h = helpers; h != NULL; h = next) {
+		next = h->next;
+		if (h->pid)
+			continue;
+
+		log_msg(NULL, "rtas_errd is exiting, %s was not run for %s",
+			h->path, h->resource);
+		helper_complete(h, -1);
+	}
+
+	deadline = stats_now() + HELPER_DRAIN_TIMEOUT * 1000000ULL;
+	while (helpers != NULL && stats_now() < deadline) {
+		dbg("Waiting for %s (pid %d) for %s", helpers->path,
+		    helpers->pid, helpers->resource);
+
+		pid = waitpid(-1, &status, WNOHANG);
+		if (pid > 0) {
+			helper_exited(pid, status);
+			continue;
+		}
+
+		/* No children left, nothing can complete any more */
+		if (pid == -1 && errno != EINTR)
+			break;
+
+		nanosleep(&delay, NULL);
+	}
+
+	for (h = helpers; h != NULL; h = next) {
+		next = h->next;
+		log_msg(NULL, "rtas_errd is exiting, not waiting for %s "
+			"(pid %d) for %s to complete", h->path, h->pid,
+			h->resource);
+		helper_complete(h, -1);
+	}
+}
+
+/**
+ * helper_drain
+ * @brief Wait for all requests to complete
+ *
+ * Used when rtas_errd exits, so that no requested operation is lost.
+ * After helper_stop(), only the helpers already running are waited
+ * for, and for no more than HELPER_DRAIN_TIMEOUT seconds.
+ */
+void
+helper_drain(void)
+{
+	struct helper *h;
+	pid_t pid;
+	int status;
+
+	if (helpers_stopped) {
+		helper_drain_stopped();
+		return;
+	}
+
+	while (helpers != NULL) {
+		dbg("Waiting for %s (pid %d) for %s", helpers->path,
+		    helpers->pid, helpers->resource);
+
+		pid = waitpid(-1, &status, 0);
+		if (pid > 0) {
+			helper_exited(pid, status);
+			helper_start_queued();
+			continue;
+		}
+
+		if (errno == EINTR)
+			continue;
+
+		/* No children left, nothing can complete any more */
+		while ((h = helpers) != NULL)
+			helper_complete(h, -1);
+	}
+}
@@ -0,0 +1,93 @@
+/**
+ * @file hexdump.c
+ * @brief Hexdump encoder for RTAS events written to the platform log
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "hexdump.h"
+
+static const char hex_nibble[16] = "0123456789abcdef";
+
+/**
+ * put_line_no
+ * @brief Write the "RTAS <line>:" prefix of a hexdump line
+ *
+ * @param out buffer to write to
+ * @param line_no line number
+ * @return number of bytes written
+ */
+static int
+put_line_no(char *out, unsigned int line_no)
+{
+	char	digits[10];
+	int	n = 0, len = 0;
+
+	do {
+		digits[n++] = '0' + (line_no % 10);
+		line_no /= 10;
+	} while (line_no);
+
+	out[len++] = 'R';
+	out[len++] = 'T';
+	out[len++] = 'A';
+	out[len++] = 'S';
+	out[len++] = ' ';
+	while (n)
+		out[len++] = digits[--n];
+	out[len++] = ':';
+
+	return len;
+}
+
+/**
+ * rtas_hexdump
+ * @brief Encode a buffer in the platform log hexdump format
+ *
+ * Prints 16 bytes per line in hex, with a space before every 4 bytes,
+ * each line prefixed with "RTAS <line number>:".  This is the same text
+ * print_rtas_event() has always produced with one "%02x" per byte, and
+ * that update_rtas_msgs() and the -f/-s test files parse.
+ *
+ * @param out buffer of at least RTAS_HEXDUMP_SIZE(len) bytes
+ * @param data data to encode
+ * @param len length of data
+ * @return number of bytes written to out (not NUL terminated)
+ */
+int
+rtas_hexdump(char *out, const char *data, int len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	char	*o = out;
+	int	i, j, line_len;
+
+	for (i = 0; i < len; i += 16) {
+		o += put_line_no(o, i / 16);
+
+		line_len = (len - i < 16) ? len - i : 16;
+		for (j = 0; j < line_len; j++) {
+			if ((j % 4) == 0)
+				*o++ = ' ';
+			*o++ = hex_nibble[p[i + j] >> 4];
+			*o++ = hex_nibble[p[i + j] & 0xf];
+		}
+
+		*o++ = '\n';
+	}
+
+	return o - out;
+}
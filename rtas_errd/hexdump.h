@@ -0,0 +1,40 @@
+/**
+ * @file hexdump.h
+ * @brief Header for the platform log hexdump encoder
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _HEXDUMP_H
+#define _HEXDUMP_H
+
+/**
+ * @def RTAS_HEXDUMP_LINE_MAX
+ * @brief Longest hexdump line: "RTAS <10 digits>:", four " xxxxxxxx"
+ * groups and a newline.
+ */
+#define RTAS_HEXDUMP_LINE_MAX	(16 + (4 * 9) + 1)
+
+/**
+ * @def RTAS_HEXDUMP_SIZE
+ * @brief Buffer size needed to hexdump len bytes
+ */
+#define RTAS_HEXDUMP_SIZE(len)	((((len) + 15) / 16) * RTAS_HEXDUMP_LINE_MAX)
+
+int rtas_hexdump(char *, const char *, int);
+
+#endif /* _HEXDUMP_H */
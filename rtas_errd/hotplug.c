@@ -22,29 +22,313 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/wait.h>
 
 #include <librtas.h>
 #include "rtas_errd.h"
 
-#define DRMGR_PROGRAM           "/usr/sbin/drmgr"
 #define DRMGR_PROGRAM_NOPATH    "drmgr"
 
+/**
+ * @struct hotplug_batch
+ * @brief Memory hotplug events waiting to be handed to drmgr together
+ *
+ * The HMC adds or removes memory one LMB at a time, so resizing a
+ * partition produces long runs of single LMB hotplug events.  Rather
+ * than run drmgr for each of them, consecutive events with the same
+ * action for adjacent drc indexes are handed to drmgr as one indexed
+ * count request, and consecutive count events are added up.
+ */
+struct hotplug_batch {
+	int		events;		/**< number of events merged */
+	int		action;		/**< RTAS_HP_ACTION_* */
+	int		identifier;	/**< RTAS_HP_ID_DRC_INDEX or _COUNT */
+	uint32_t	drc_index;	/**< lowest drc index of the run */
+	uint32_t	count;		/**< number of LMBs */
+	int		first_seq;	/**< first RTAS event merged */
+	int		last_seq;	/**< last RTAS event merged */
+	struct timespec	deadline;	/**< when to run drmgr if idle */
+};
+
+static struct hotplug_batch hp_batch;
+
+/**
+ * @struct drmgr_run
+ * @brief A drmgr run queued to the helper and not completed yet
+ */
+struct drmgr_run {
+	int			first_seq;	/**< first RTAS event it is for */
+	struct drmgr_run	*next;
+};
+
+static struct drmgr_run *drmgr_runs = NULL;
+
+/**
+ * drmgr_done
+ * @brief Completion of a drmgr run for a hotplug event
+ *
+ * The run stops holding back the checkpoint, unless drmgr was not run
+ * because rtas_errd is exiting: its events are then replayed from the
+ * spool by the next start.
+ *
+ * @param status wait status of drmgr, -1 if it could not be run
+ * @param arg the struct drmgr_run of the run, may be NULL
+ */
+static void
+drmgr_done(int status, void *arg)
+{
+	struct drmgr_run *run = arg, **pp;
+
+	if (run != NULL && !(status == -1 && helper_stopped())) {
+		for (pp = &drmgr_runs; *pp != NULL; pp = &(*pp)->next) {
+			if (*pp == run) {
+				*pp = run->next;
+				break;
+			}
+		}
+		free(run);
+	}
+
+	if (status == -1)
+		return;
+
+	stats_count(STATS_DRMGR_RUNS);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		log_msg(NULL, "%s failed to handle a hotplug event, exit "
+			"status %d", drmgr_program, WIFEXITED(status) ?
+			WEXITSTATUS(status) : -1);
+
+	/* The set of FRUs changed, re-read the VPD on the next lookup */
+	vpd_cache_invalidate();
+	topology_invalidate();
+}
+
+/**
+ * run_drmgr
+ * @brief Have drmgr run for a hotplug event
+ *
+ * drmgr is not waited for; the runs for a resource type are carried
+ * out in the order they were requested (see helper.c).  Until the run
+ * completes, hotplug_pending() reports its first event.
+ *
+ * @param drmgr_args NULL terminated drmgr argument list, the resource
+ *	type is drmgr_args[2]
+ * @param first_seq first RTAS event the run is for
+ */
+static void
+run_drmgr(char **drmgr_args, int first_seq)
+{
+	struct drmgr_run *run;
+
+#ifdef DEBUG
+	if(no_drmgr)
+		return;
+#endif
+	/* invoke drmgr */
+	dbg("Invoke drmgr command\n");
+
+	run = malloc(sizeof(*run));
+	if (run != NULL) {
+		run->first_seq = first_seq;
+		run->next = drmgr_runs;
+		drmgr_runs = run;
+	}
+
+	if (helper_run(HELPER_DRMGR, drmgr_args[2], drmgr_program, drmgr_args,
+		       drmgr_done, run) && run != NULL) {
+		drmgr_runs = run->next;
+		free(run);
+	}
+}
+
+/**
+ * hotplug_flush
+ * @brief Run drmgr for the memory hotplug events merged so far
+ */
+void
+hotplug_flush(void)
+{
+	char *drmgr_args[] = { DRMGR_PROGRAM_NOPATH, "-c", "mem", NULL, NULL,
+			NULL, NULL, NULL, NULL};
+	char drc_index[11];
+	char count[11];
+	char cmd[128];
+	int i = 3, len;
+
+	if (hp_batch.events == 0)
+		return;
+
+	drmgr_args[i++] = (hp_batch.action == RTAS_HP_ACTION_ADD) ? "-a" : "-r";
+
+	snprintf(count, sizeof(count), "%u", hp_batch.count);
+	snprintf(drc_index, sizeof(drc_index), "%#x", hp_batch.drc_index);
+
+	if (hp_batch.identifier == RTAS_HP_ID_DRC_COUNT ||
+	    hp_batch.count > 1) {
+		drmgr_args[i++] = "-q";
+		drmgr_args[i++] = count;
+	}
+
+	if (hp_batch.identifier == RTAS_HP_ID_DRC_INDEX) {
+		drmgr_args[i++] = "-s";
+		drmgr_args[i++] = drc_index;
+	}
+
+	for (i = 0, len = 0; drmgr_args[i] != NULL; i++)
+		len += snprintf(cmd + len, sizeof(cmd) - len, "%s%s",
+				i ? " " : "", drmgr_args[i]);
+
+	if (hp_batch.events > 1)
+		log_msg(NULL, "Merged %d hotplug events (RTAS events %d to %d) "
+			"into one drmgr run: %s", hp_batch.events,
+			hp_batch.first_seq, hp_batch.last_seq, cmd);
+
+	dbg("run: %s\n", cmd);
+
+	hp_batch.events = 0;
+	run_drmgr(drmgr_args, hp_batch.first_seq);
+}
+
+/**
+ * hotplug_deadline
+ * @brief Retrieve the time by which merged events must be handled
+ *
+ * @param deadline buffer for the CLOCK_MONOTONIC deadline
+ * @return 1 if events are waiting, 0 otherwise
+ */
+int
+hotplug_deadline(struct timespec *deadline)
+{
+	if (hp_batch.events == 0)
+		return 0;
+
+	*deadline = hp_batch.deadline;
+	return 1;
+}
+
+/**
+ * hotplug_pending
+ * @brief Retrieve the first event whose drmgr run has not completed
+ *
+ * Covers the events merged into the current batch and those of the
+ * drmgr runs queued to the helper or running.
+ *
+ * @param seq_num buffer for the RTAS event number
+ * @return 1 if events are waiting, 0 otherwise
+ */
+int
+hotplug_pending(int *seq_num)
+{
+	struct drmgr_run *run;
+	int rc = 0;
+
+	if (hp_batch.events) {
+		*seq_num = hp_batch.first_seq;
+		rc = 1;
+	}
+
+	for (run = drmgr_runs; run != NULL; run = run->next) {
+		if (!rc || run->first_seq < *seq_num)
+			*seq_num = run->first_seq;
+		rc = 1;
+	}
+
+	return rc;
+}
+
+/**
+ * hotplug_merge
+ * @brief Try to add a memory hotplug event to the current batch
+ *
+ * @return 1 if the event was merged, 0 otherwise
+ */
+static int
+hotplug_merge(struct rtas_hotplug_scn *hotplug)
+{
+	if (hp_batch.events == 0 ||
+	    hp_batch.events >= d_cfg.hp_coalesce_max ||
+	    hp_batch.action != hotplug->action ||
+	    hp_batch.identifier != hotplug->identifier)
+		return 0;
+
+	if (hotplug->identifier == RTAS_HP_ID_DRC_COUNT) {
+		hp_batch.count += hotplug->u1.count;
+	} else if (hotplug->u1.drc_index ==
+		   hp_batch.drc_index + hp_batch.count) {
+		hp_batch.count++;
+	} else if (hotplug->u1.drc_index + 1 == hp_batch.drc_index) {
+		hp_batch.drc_index--;
+		hp_batch.count++;
+	} else {
+		return 0;
+	}
+
+	hp_batch.events++;
+	return 1;
+}
+
+/**
+ * hotplug_coalesce
+ * @brief Queue a memory hotplug event to be merged with the next ones
+ *
+ * drmgr is run once the batch cannot take the next event, once no
+ * hotplug event arrived for HotplugCoalesceWindow milliseconds, or
+ * when any other type of event is handled.
+ *
+ * @param re RTAS event
+ * @param hotplug hotplug section of the event
+ */
+static void
+hotplug_coalesce(struct event *re, struct rtas_hotplug_scn *hotplug)
+{
+	int window = d_cfg.hp_coalesce_window;
+
+	if (!hotplug_merge(hotplug)) {
+		hotplug_flush();
+
+		hp_batch.events = 1;
+		hp_batch.action = hotplug->action;
+		hp_batch.identifier = hotplug->identifier;
+		if (hotplug->identifier == RTAS_HP_ID_DRC_COUNT) {
+			hp_batch.drc_index = 0;
+			hp_batch.count = hotplug->u1.count;
+		} else {
+			hp_batch.drc_index = hotplug->u1.drc_index;
+			hp_batch.count = 1;
+		}
+		hp_batch.first_seq = re->seq_num;
+	}
+
+	hp_batch.last_seq = re->seq_num;
+
+	clock_gettime(CLOCK_MONOTONIC, &hp_batch.deadline);
+	hp_batch.deadline.tv_sec += window / 1000;
+	hp_batch.deadline.tv_nsec += (window % 1000) * 1000000;
+	if (hp_batch.deadline.tv_nsec >= 1000000000) {
+		hp_batch.deadline.tv_sec++;
+		hp_batch.deadline.tv_nsec -= 1000000000;
+	}
+
+	if (hp_batch.events >= d_cfg.hp_coalesce_max)
+		hotplug_flush();
+}
+
 void handle_hotplug_event(struct event *re)
 {
         struct rtas_event_hdr *rtas_hdr = re->rtas_hdr;
         struct rtas_hotplug_scn *hotplug;
-        pid_t child;
-        int status;
         char drc_index[11];
-	char count[4];
+	char count[11];
         char *drmgr_args[] = { DRMGR_PROGRAM_NOPATH, "-c", NULL, NULL, NULL,
                         NULL, NULL, "-d4", "-V", NULL};
 
         /* Retrieve Hotplug section */
         if (rtas_hdr->version >= 6) {
-	        hotplug = rtas_get_hotplug_scn(re->rtas_event);
+	        hotplug = event_scn(re, RTAS_HP_SCN);
 
                 /* Build drmgr argument list */
                 dbg("Build drmgr command\n");
@@ -89,7 +373,7 @@ void handle_hotplug_event(struct event *re)
                                 break;
 			case RTAS_HP_ID_DRC_COUNT:
 				drmgr_args[4] = "-q";
-				snprintf(count, 4, "%u", hotplug->u1.count);
+				snprintf(count, sizeof(count), "%u", hotplug->u1.count);
 				drmgr_args[5] = count;
 				break;
                         default:
@@ -98,34 +382,19 @@ void handle_hotplug_event(struct event *re)
                                 return;
                 }
 
+		if (hotplug->type == RTAS_HP_TYPE_MEMORY &&
+		    d_cfg.hp_coalesce_max > 1) {
+			hotplug_coalesce(re, hotplug);
+			return;
+		}
+
+		/* Keep drmgr runs in the order of the events */
+		hotplug_flush();
+
                 dbg("run: %s %s %s %s %s %s %s\n", drmgr_args[0],
                         drmgr_args[1], drmgr_args[2], drmgr_args[3],
                         drmgr_args[4], drmgr_args[5], drmgr_args[6]);
 
-#ifdef DEBUG
-		if(no_drmgr)
-			return;
-#endif
-                /* invoke drmgr */
-                dbg("Invoke drmgr command\n");
-
-                child = fork();
-                if (child == -1) {
-                        log_msg(NULL, "%s cannot be run to handle a hotplug event, %s",
-                                DRMGR_PROGRAM, strerror(errno));
-                        return;
-                } else if (child == 0) {
-                        /* child process */
-                        execv(DRMGR_PROGRAM, drmgr_args);
-
-                        /* shouldn't get here */
-                        log_msg(NULL, "Couldn not exec %s in response to hotplug event, %s",
-                                DRMGR_PROGRAM, strerror(errno));
-                        exit(1);
-                }
-
-                child = waitpid(child, &status, 0);
-
-                dbg("drmgr call exited with %d\n", WEXITSTATUS(status));
+		run_drmgr(drmgr_args, re->seq_num);
         }
 }
@@ -0,0 +1,292 @@
+/**
+ * @file journal.c
+ * @brief Recover missed RTAS events from the systemd journal
+ *
+ * This is the journal equivalent of the syslog search in update.c, for
+ * systems where the kernel messages only end up in the journal.  Only
+ * kernel transport entries are looked at, and the search starts at the
+ * journal cursor saved at the end of the previous search.
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <systemd/sd-journal.h>
+#include "rtas_errd.h"
+
+#define RTAS_START	"RTAS event begin"
+#define RTAS_END	"RTAS event end"
+
+#define MESSAGE_FIELD	"MESSAGE="
+
+/**
+ * get_message
+ * @brief Retrieve the text of the current journal entry
+ *
+ * @param j journal
+ * @param msg buffer to copy the NUL terminated message to
+ * @param msglen size of msg
+ * @return 0 on success, !0 on failure
+ */
+static int
+get_message(sd_journal *j, char *msg, size_t msglen)
+{
+	const void	*data;
+	size_t		len;
+
+	if (sd_journal_get_data(j, "MESSAGE", &data, &len) < 0)
+		return -1;
+
+	/* data is "MESSAGE=<text>", and is not NUL terminated */
+	len -= strlen(MESSAGE_FIELD);
+	if (len >= msglen)
+		len = msglen - 1;
+	memcpy(msg, (char *)data + strlen(MESSAGE_FIELD), len);
+	msg[len] = '\0';
+
+	return 0;
+}
+
+/**
+ * get_rtas_start_no
+ * @brief Retrieve the event number of an "RTAS event begin" message
+ *
+ * @param msg journal message
+ * @return event number, or -1 if msg is not the start of an event
+ */
+static int
+get_rtas_start_no(char *msg)
+{
+	char	*p;
+
+	if (strstr(msg, RTAS_START) == NULL)
+		return -1;
+
+	p = strstr(msg, "RTAS: ");
+	if (p == NULL)
+		return -1;
+
+	return strtoul(p + strlen("RTAS: "), NULL, 10);
+}
+
+/**
+ * hex_val
+ * @brief Convert a hex digit to its value
+ */
+static int
+hex_val(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * decode_rtas_line
+ * @brief Decode one "RTAS <n>: xxxxxxxx ..." line of an event
+ *
+ * @param msg journal message
+ * @param buf event buffer to append the decoded bytes to
+ * @param len reference to the number of bytes in buf
+ */
+static void
+decode_rtas_line(char *msg, char *buf, int *len)
+{
+	char	*p;
+	int	hi, lo;
+
+	p = strstr(msg, "RTAS ");
+	if (p == NULL)
+		return;
+
+	p = strchr(p, ':');
+	if (p == NULL)
+		return;
+
+	for (p++; *p != '\0'; p++) {
+		if (*p == ' ')
+			continue;
+
+		hi = hex_val(p[0]);
+		lo = hex_val(p[1]);
+		if (hi < 0 || lo < 0 || *len >= RTAS_ERROR_LOG_MAX)
+			return;
+
+		buf[(*len)++] = (hi << 4) | lo;
+		p++;
+	}
+}
+
+/**
+ * position_journal
+ * @brief Position the journal before the first entry to search
+ *
+ * With a saved cursor the search continues right after it.  Otherwise
+ * go backwards from the end of the journal until an event that has
+ * already been handled is found.
+ *
+ * @param j journal
+ * @param last_rtas_no last RTAS event handled by rtas_errd
+ * @return 0 on success, !0 on failure
+ */
+static int
+position_journal(sd_journal *j, int last_rtas_no)
+{
+	char	cursor[512];
+	char	msg[RTAS_ERROR_LOG_MAX];
+	int	rc, seq;
+
+	if (read_checkpoint_cursor(cursor, sizeof(cursor)) == 0 &&
+	    sd_journal_seek_cursor(j, cursor) >= 0) {
+		/* Step on to the cursor entry itself, which has already
+		 * been searched; if it is gone, the next entry is the
+		 * first one to look at.
+		 */
+		rc = sd_journal_next(j);
+		if (rc > 0 && sd_journal_test_cursor(j, cursor) <= 0)
+			rc = sd_journal_previous(j);
+
+		dbg("Resuming journal search at saved cursor");
+		return rc < 0 ? rc : 0;
+	}
+
+	dbg("Searching the journal backwards from the end");
+	rc = sd_journal_seek_tail(j);
+	if (rc < 0)
+		return rc;
+
+	while ((rc = sd_journal_previous(j)) > 0) {
+		if (get_message(j, msg, sizeof(msg)))
+			continue;
+
+		seq = get_rtas_start_no(msg);
+		if (seq >= 0 && seq <= last_rtas_no)
+			return 0;
+	}
+
+	if (rc < 0)
+		return rc;
+
+	/* Reached the start of the journal */
+	return sd_journal_seek_head(j);
+}
+
+/**
+ * journal_update_rtas_msgs
+ * @brief Handle RTAS events in the journal that rtas_errd missed
+ *
+ * Events are rebuilt from the kernel's "RTAS event begin", hexdump
+ * and "RTAS event end" messages, and then handled like events found
+ * in syslog.
+ *
+ * @param last_rtas_no last RTAS event handled by rtas_errd
+ * @return last RTAS event handled after the search
+ */
+int
+journal_update_rtas_msgs(int last_rtas_no)
+{
+	sd_journal	*j;
+	struct event	*event;
+	char		msg[RTAS_ERROR_LOG_MAX];
+	char		*cursor = NULL;
+	int		in_event = 0, len = 0, seq;
+	int		rc;
+
+	event = malloc(sizeof(*event));
+	if (event == NULL) {
+		log_msg(NULL, "Could not allocate memory to recover RTAS "
+			"events from the journal, %s", strerror(errno));
+		return last_rtas_no;
+	}
+
+#ifdef DEBUG
+	if (journal_file != NULL) {
+		const char *files[] = { journal_file, NULL };
+
+		rc = sd_journal_open_files(&j, files, 0);
+	} else
+#endif
+		rc = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY |
+				     SD_JOURNAL_SYSTEM);
+	if (rc < 0) {
+		log_msg(NULL, "Could not open the journal to update RTAS "
+			"events, %s", strerror(-rc));
+		free(event);
+		return last_rtas_no;
+	}
+
+	rc = sd_journal_add_match(j, "_TRANSPORT=kernel", 0);
+	if (rc >= 0)
+		rc = position_journal(j, last_rtas_no);
+	if (rc < 0) {
+		log_msg(NULL, "Could not search the journal to update RTAS "
+			"events, %s", strerror(-rc));
+		goto out;
+	}
+
+	while ((rc = sd_journal_next(j)) > 0) {
+		if (get_message(j, msg, sizeof(msg)))
+			continue;
+
+		seq = get_rtas_start_no(msg);
+		if (seq >= 0) {
+			/* Only rebuild events we have not handled yet */
+			in_event = seq > last_rtas_no;
+			if (in_event) {
+				memset(event, 0, sizeof(*event));
+				event->seq_num = seq;
+				len = 0;
+			}
+			continue;
+		}
+
+		if (in_event && strstr(msg, RTAS_END) != NULL) {
+			in_event = 0;
+			if (handle_recovered_event(event) == 0)
+				last_rtas_no = event->seq_num;
+		} else if (in_event) {
+			decode_rtas_line(msg, event->event_buf, &len);
+			continue;
+		}
+
+		/*
+		 * Remember where we are whenever we are not in the
+		 * middle of an event, so an event that is only partly
+		 * in the journal yet is searched again next time.
+		 */
+		free(cursor);
+		cursor = NULL;
+		if (sd_journal_get_cursor(j, &cursor) < 0)
+			cursor = NULL;
+	}
+
+	if (cursor != NULL)
+		update_checkpoint_cursor(cursor);
+
+out:
+	free(cursor);
+	sd_journal_close(j);
+	free(event);
+	return last_rtas_no;
+}
@@ -28,13 +28,14 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <dirent.h>
 #include <time.h>
 #include <librtas.h>
 #include "rtas_errd.h"
 
 struct pmap_struct {
-	struct pmap_struct	*next;
+	struct pmap_struct	*next;	/**< next entry in the hash chain */
 	/* The fields below are stored in host endian */
 	uint32_t		phandle;
 	uint32_t		drc_index;
@@ -49,8 +50,24 @@ struct drconf_cell {
 	uint32_t	flags;
 };
 
-static struct pmap_struct *plist;
+/*
+ * Map of phandles (and of LMB drc-indexes, which PRRN reports in place
+ * of phandles) to device tree nodes.  It is built from the device tree
+ * by the first PRRN event and kept from then on; later events only
+ * revisit the nodes they touch.
+ */
+static struct pmap_struct **pmap;
+static unsigned int pmap_bits;
+static unsigned int pmap_entries;
+static int pmap_rescanned;
+
+/* Shared name of every LMB entry, there can be hundreds of thousands */
+static char lmb_name[] = "LMB";
 static int prrn_log_fd;
+static int ofdt_fd = -1;
+static char *ofdt_cmd;		/* update_property command being built */
+static size_t ofdt_cmd_size;
+static unsigned int prrn_nodes, prrn_updates;
 static char prrn_filename[128];
 
 #define OFDT_BASE	"/proc/device-tree"
@@ -104,51 +121,138 @@ uint32_t get_drc_index(const char *path)
 	return be32toh(drc_index);
 }
 
+static unsigned int pmap_hash(uint32_t phandle)
+{
+	return (phandle * 0x9e3779b1U) >> (32 - pmap_bits);
+}
+
+/**
+ * pmap_grow
+ * @brief Double the number of hash buckets
+ *
+ * @returns 0 on success, !0 otherwise
+ */
+static int pmap_grow(void)
+{
+	struct pmap_struct **old = pmap, *pm;
+	unsigned int i, old_size = pmap ? 1U << pmap_bits : 0;
+	unsigned int bits = pmap ? pmap_bits + 1 : 10;
+
+	pmap = calloc(1U << bits, sizeof(*pmap));
+	if (!pmap) {
+		pmap = old;
+		return -1;
+	}
+
+	pmap_bits = bits;
+	for (i = 0; i < old_size; i++) {
+		while ((pm = old[i]) != NULL) {
+			old[i] = pm->next;
+			pm->next = pmap[pmap_hash(pm->phandle)];
+			pmap[pmap_hash(pm->phandle)] = pm;
+		}
+	}
+
+	free(old);
+	return 0;
+}
+
 /**
  * add_phandle_to_list
  *
- * @param name
+ * New entries go in front of any older entry with the same phandle.
+ *
+ * @param name node path, or lmb_name for an LMB
  * @param phandle
+ * @param drc_index
  */
 static void add_phandle_to_list(char *name, uint32_t phandle,
 				uint32_t drc_index)
 {
 	struct pmap_struct *pm;
 
+	if ((!pmap || pmap_entries >= (1U << pmap_bits)) && pmap_grow())
+		return;
+
 	pm = calloc(1, sizeof(struct pmap_struct));
 	if (!pm)
 		return;
 
-	pm->name = malloc(strlen(name) + 1);
-	if (!pm->name) {
-		free(pm);
-		return;
+	if (name == lmb_name) {
+		pm->name = lmb_name;
+	} else {
+		pm->name = strdup(name);
+		if (!pm->name) {
+			free(pm);
+			return;
+		}
 	}
 
-	sprintf(pm->name, "%s", name);
-
 	pm->phandle = phandle;
 	pm->drc_index = drc_index;
-	pm->next = plist;
-	plist = pm;
+	pm->next = pmap[pmap_hash(phandle)];
+	pmap[pmap_hash(phandle)] = pm;
+	pmap_entries++;
+}
+
+static void free_pms(struct pmap_struct *pm)
+{
+	if (pm->name != lmb_name)
+		free(pm->name);
+	free(pm);
 }
 
 /**
- * phandle_to_name
+ * find_pms
  *
- * @param ph
- * @returns
+ * @param phandle
+ * @returns the map entry for phandle, NULL if there is none
  */
-static struct pmap_struct *phandle_to_pms(uint32_t phandle)
+static struct pmap_struct *find_pms(uint32_t phandle)
 {
-	struct pmap_struct *pms = plist;
+	struct pmap_struct *pms;
 
+	if (!pmap)
+		return NULL;
+
+	pms = pmap[pmap_hash(phandle)];
 	while (pms && pms->phandle != phandle)
 		pms = pms->next;
 
 	return pms;
 }
 
+/**
+ * pms_current
+ * @brief Check that a map entry still matches the device tree
+ *
+ * Nodes come and go with DLPAR operations between PRRN events, so
+ * check that the node is still there with the same phandle.
+ *
+ * @param pms
+ * @returns 1 if the entry is current, 0 otherwise
+ */
+static int pms_current(struct pmap_struct *pms)
+{
+	char path[PATH_MAX];
+	uint32_t phandle;
+	FILE *fd;
+	int rc;
+
+	if (pms->name == lmb_name)
+		return 1;
+
+	snprintf(path, sizeof(path), "%s%s/ibm,phandle", OFDT_BASE, pms->name);
+	fd = fopen(path, "r");
+	if (!fd)
+		return 0;
+
+	rc = fread(&phandle, sizeof(phandle), 1, fd);
+	fclose(fd);
+
+	return rc == 1 && be32toh(phandle) == pms->phandle;
+}
+
 /**
  * add_std_phandles
  *
@@ -255,8 +359,12 @@ static int add_drconf_phandles()
 	mem = (struct drconf_cell *)&membuf[1];
 
 	for (i = 0; i < entries; i++) {
+		uint32_t drc_index = be32toh(mem->drc_index);
+		struct pmap_struct *pms = find_pms(drc_index);
+
 		/* See comment above about rtas reporting drc_indexes. */
-		add_phandle_to_list("LMB", be32toh(mem->drc_index), be32toh(mem->drc_index));
+		if (!pms || pms->name != lmb_name)
+			add_phandle_to_list(lmb_name, drc_index, drc_index);
 		mem++; /* trust your compiler */
 	}
 
@@ -271,25 +379,35 @@ static int add_drconf_phandles()
 static void free_phandles()
 {
 	struct pmap_struct *pm;
+	unsigned int i;
 
-	while (plist) {
-		pm = plist;
-		plist = plist->next;
-
-		free(pm->name);
-		free(pm);
+	for (i = 0; pmap && i < (1U << pmap_bits); i++) {
+		while ((pm = pmap[i]) != NULL) {
+			pmap[i] = pm->next;
+			free_pms(pm);
+		}
 	}
+
+	free(pmap);
+	pmap = NULL;
+	pmap_bits = 0;
+	pmap_entries = 0;
 }
 
 /**
  * add_phandles
  *
+ * Build the phandle map from the device tree, if it is not built yet.
+ *
  * @returns
  */
 static int add_phandles()
 {
 	int rc;
 
+	if (pmap)
+		return 0;
+
 	rc = add_std_phandles(OFDT_BASE, NULL);
 	if (rc) {
 		free_phandles();
@@ -297,10 +415,110 @@ static int add_phandles()
 	}
 
 	rc = add_drconf_phandles();
-	if (rc)
+	if (rc) {
 		free_phandles();
+		return rc;
+	}
 
-	return rc;
+	dbg("Built phandle map of %u nodes", pmap_entries);
+	return 0;
+}
+
+/**
+ * phandle_to_pms
+ *
+ * A phandle that is not in the map, or whose node has changed, makes
+ * the map be rebuilt from the device tree, at most once per PRRN event.
+ *
+ * @param phandle
+ * @returns the map entry for phandle, NULL if there is none
+ */
+static struct pmap_struct *phandle_to_pms(uint32_t phandle)
+{
+	struct pmap_struct *pms = find_pms(phandle);
+
+	if (pms && pms_current(pms))
+		return pms;
+
+	if (pmap_rescanned)
+		return NULL;
+
+	dbg("phandle %08x %s, rescanning the device tree", phandle,
+	    pms ? "has changed" : "not found");
+	free_phandles();
+	pmap_rescanned = 1;
+	if (add_phandles())
+		return NULL;
+
+	return find_pms(phandle);
+}
+
+/**
+ * ofdt_open
+ *
+ * The ofdt file is kept open for the whole PRRN event, every write
+ * to it is a separate command.
+ *
+ * @returns 0 on success, errno otherwise
+ */
+static int ofdt_open(void)
+{
+	if (ofdt_fd >= 0)
+		return 0;
+
+	ofdt_fd = open(OFDTPATH, O_WRONLY);
+	if (ofdt_fd < 0) {
+		dbg("Failed to open %s: %s", OFDTPATH, strerror(errno));
+		return errno;
+	}
+
+	return 0;
+}
+
+/**
+ * ofdt_close
+ *
+ * Close the ofdt file and release the command buffer at the end of
+ * a PRRN event; ibm,dynamic-memory updates can make it quite large.
+ */
+static void ofdt_close(void)
+{
+	if (ofdt_fd >= 0)
+		close(ofdt_fd);
+	ofdt_fd = -1;
+
+	free(ofdt_cmd);
+	ofdt_cmd = NULL;
+	ofdt_cmd_size = 0;
+}
+
+/**
+ * ofdt_cmd_reserve
+ *
+ * Make sure the command buffer can hold at least len bytes, keeping
+ * its contents.
+ *
+ * @param len
+ * @returns 0 on success, !0 otherwise
+ */
+static int ofdt_cmd_reserve(size_t len)
+{
+	size_t size = ofdt_cmd_size ? ofdt_cmd_size : 4096;
+	char *newcmd;
+
+	if (len <= ofdt_cmd_size)
+		return 0;
+
+	while (size < len)
+		size *= 2;
+
+	newcmd = realloc(ofdt_cmd, size);
+	if (!newcmd)
+		return -1;
+
+	ofdt_cmd = newcmd;
+	ofdt_cmd_size = size;
+	return 0;
 }
 
 /**
@@ -308,28 +526,33 @@ static int add_phandles()
  *
  * @param cmd
  * @param len
- * @returns 0 on success, !0 otherwise
+ * @returns number of bytes written on success, errno if the ofdt
+ *	    file cannot be opened
  */
 static int do_update(char *cmd, int len)
 {
 	int rc;
-	int i, fd;
+	int i;
 
-	fd = open(OFDTPATH, O_WRONLY);
-	if (fd < 0) {
-		dbg("Failed to open %s: %s", OFDTPATH, strerror(errno));
-		rc = errno;
+	rc = ofdt_open();
+	if (rc)
 		return rc;
-	}
 
-	if ((rc = write(fd, cmd, len)) != len)
+	if ((rc = write(ofdt_fd, cmd, len)) != len)
 		dbg("Error writing to ofdt file! rc %d errno %d", rc, errno);
+	else
+		prrn_updates++;
 
-	close(fd);
+	if (!debug)
+		return rc;
 
 	/* The reamining code only formats the cmd buffer to make it
-	 * human readable when printed via dbg().
+	 * human readable when printed via dbg(), which does not print
+	 * more than RTAS_ERROR_LOG_MAX bytes anyway.
 	 */
+	if (len > RTAS_ERROR_LOG_MAX)
+		len = RTAS_ERROR_LOG_MAX;
+
 	for (i = 0; i < len; i++) {
 		if (!isprint(cmd[i]))
 			cmd[i] = '.';
@@ -345,15 +568,13 @@ static int do_update(char *cmd, int len)
 /**
  * update_properties
  *
- * @param phandle
+ * @param pms
  * @returns 0 on success, !0 otherwise
  */
-static int update_properties(uint32_t phandle)
+static int update_properties(struct pmap_struct *pms)
 {
 	int rc;
 	char cmd[1024];
-	char *longcmd = NULL;
-	char *newcmd;
 	int cmdlen = 0;
 	int proplen = 0;
 	unsigned int wa[1024];
@@ -364,7 +585,8 @@ static int update_properties(uint32_t phandle)
 	char *pname;
 	unsigned int i;
 	int more = 0;
-	struct pmap_struct *pms = phandle_to_pms(phandle);
+	int new_lmbs = 0;
+	uint32_t phandle = pms->phandle;
 
 	/*
 	 * First call to the udpate-properties call, expects the following :
@@ -447,33 +669,26 @@ static int update_properties(uint32_t phandle)
 				/* See if we have a partially completed
 				 * command
 				 */
-				if (longcmd) {
-					newcmd = malloc(cmdlen + vd);
-					if (!newcmd) {
-						free(longcmd);
+				if (cmdlen) {
+					if (ofdt_cmd_reserve(cmdlen + vd))
 						return -1;
-					}
-
-					memcpy(newcmd, longcmd, cmdlen);
-					free(longcmd);
-					longcmd = newcmd;
 				} else {
-					longcmd = malloc(vd+128);
-					if (!longcmd)
+					if (ofdt_cmd_reserve(vd + strlen(pname)
+							     + 64))
 						return -1;
 
 					/* Build the command with a length
 					 * of six zeros
 					 */
-					lenpos = sprintf(longcmd,
+					lenpos = sprintf(ofdt_cmd,
 							 "update_property %u "
 							 "%s ", phandle,
 							 pname);
-					strcat(longcmd, "000000 ");
-					cmdlen = strlen(longcmd);
+					strcat(ofdt_cmd, "000000 ");
+					cmdlen = strlen(ofdt_cmd);
 				}
 
-				memcpy(longcmd + cmdlen, op, vd);
+				memcpy(ofdt_cmd + cmdlen, op, vd);
 				cmdlen += vd;
 				proplen += vd;
 
@@ -482,12 +697,24 @@ static int update_properties(uint32_t phandle)
 					 * value  and do a hideous fixup of
 					 * the new trailing null
 					 */
-					sprintf(longcmd+lenpos,"%06d",proplen);
-					longcmd[lenpos+6] = ' ';
+					sprintf(ofdt_cmd+lenpos,"%06d",proplen);
+					ofdt_cmd[lenpos+6] = ' ';
+
+					/* Keep the phandle map in step */
+					if (!strcmp(pname, "ibm,my-drc-index") &&
+					    proplen == sizeof(uint32_t)) {
+						uint32_t drc_index;
+
+						memcpy(&drc_index, ofdt_cmd +
+						       cmdlen - proplen,
+						       sizeof(drc_index));
+						pms->drc_index = be32toh(drc_index);
+					} else if (!strcmp(pname,
+							   "ibm,dynamic-memory")) {
+						new_lmbs = 1;
+					}
 
-					do_update(longcmd, cmdlen);
-					free(longcmd);
-					longcmd = NULL;
+					do_update(ofdt_cmd, cmdlen);
 					cmdlen = 0;
 					proplen = 0;
 				}
@@ -497,6 +724,10 @@ static int update_properties(uint32_t phandle)
 		}
 	} while (rc == 1);
 
+	/* Pick up any LMBs the new property added */
+	if (new_lmbs)
+		add_drconf_phandles();
+
 	return 0;
 }
 
@@ -522,7 +753,7 @@ static void do_node_update(struct pmap_struct *pms, const char *type)
 	}
 
 	dbg("Updating property for %s (%08x)", pms->name, pms->phandle);
-	update_properties(pms->phandle);
+	update_properties(pms);
 }
 
 /**
@@ -546,6 +777,8 @@ static void update_nodes(unsigned int *op, unsigned int n)
 		if (!pms)
 			continue;
 
+		prrn_nodes++;
+
 		if (!strcmp(pms->name, "LMB")) {
 			len = sprintf(buf, "mem %x\n", pms->drc_index);
 			write_prrn_log(buf, len);
@@ -563,11 +796,17 @@ static void update_nodes(unsigned int *op, unsigned int n)
  */
 static void devtree_update(uint scope)
 {
+	struct timespec start, end;
 	int rc;
 	unsigned int wa[1024];
 	unsigned int *op;
 
 	dbg("Updating device_tree");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	prrn_nodes = prrn_updates = 0;
+
+	/* A map built just now needs no rescan for this event */
+	pmap_rescanned = (pmap == NULL);
 	if (add_phandles())
 		return;
 
@@ -613,13 +852,43 @@ static void devtree_update(uint scope)
 		}
 	} while (rc == 1);
 
-	free_phandles();
+	ofdt_close();
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	log_msg(NULL, "PRRN scope %u: updated %u device tree nodes with %u "
+		"ofdt commands in %ld msecs", scope, prrn_nodes,
+		prrn_updates, (end.tv_sec - start.tv_sec) * 1000 +
+		(end.tv_nsec - start.tv_nsec) / 1000000);
 	dbg("Finished devtree update");
 }
 
+/**
+ * prrn_done
+ * @brief Completion of the drmgr PRRN handler
+ *
+ * @param status wait status of drmgr, -1 if it could not be run
+ * @param arg the PRRN log file drmgr was given
+ */
+static void prrn_done(int status, void *arg)
+{
+	char *filename = arg;
+
+	if (status == -1)
+		unlink(filename);
+	else if (!WIFEXITED(status) || WEXITSTATUS(status))
+		dbg("drmgr PRRN handler failed for %s", filename);
+
+	/* drmgr may have added or removed CPUs and LMBs */
+	if (status != -1)
+		topology_invalidate();
+
+	free(filename);
+}
+
 void handle_prrn_event(struct event *re)
 {
-	pid_t pid;
+	char *args[] = { drmgr_program, "-P", prrn_filename, NULL };
+	char *filename;
 	uint scope = re->rtas_hdr->ext_log_length;
 
 	open_prrn_log();
@@ -629,23 +898,25 @@ void handle_prrn_event(struct event *re)
 	devtree_update(scope);
 	close_prrn_log();
 
-	/* Kick off script to do required hotplug add/remove */
-	pid = fork();
-	if (pid == -1) {
+	/* FRUs may have moved, re-read the VPD on the next lookup */
+	vpd_cache_invalidate();
+	topology_invalidate();
+
+	/*
+	 * Kick off script to do required hotplug add/remove.  It affects
+	 * any resource, so it runs once every earlier drmgr run is done.
+	 */
+	filename = strdup(prrn_filename);
+	if (filename == NULL) {
 		unlink(prrn_filename);
 		dbg("Could not exec drmgr PRRN handler.\n");
 		return;
 	}
 
-	if (pid == 0) { /* Child */
-		dbg("Executing drmgr prrn handler.\n");
-		execl("/usr/sbin/drmgr", "/usr/sbin/drmgr", "-P", prrn_filename,
-		      NULL);
+	dbg("Executing drmgr prrn handler.\n");
+	if (helper_run(HELPER_DRMGR, "*", drmgr_program, args, prrn_done,
+		       filename)) {
 		unlink(prrn_filename);
-		/* Should not get here */
-		dbg("Failed PRRN Hotplug exec: %s", strerror(errno));
-		exit(0);
+		free(filename);
 	}
-
-	/* Nothing to do for the parent, just return */
 }
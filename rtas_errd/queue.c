@@ -0,0 +1,372 @@
+/**
+ * @file queue.c
+ * @brief Bounded queue of RTAS events between the reader and handler
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "rtas_errd.h"
+
+/*
+ * Handling an RTAS event can take a long time (forking drmgr or
+ * extract_platdump, servicelog inserts, ...).  To keep the kernel
+ * error log drained while that happens, a reader thread copies events
+ * out of /proc into a ring of struct event buffers and the main thread
+ * handles them from there.
+ *
+ * There is exactly one producer (the reader thread) and one consumer
+ * (read_rtas_events()), so the ring is a plain FIFO and events are
+ * handled in the order the kernel handed them to us, i.e. in seq_num
+ * order.  Only the slot indexes and counters are protected by the
+ * lock; the event data in a slot is owned by whichever side currently
+ * holds it.
+ *
+ * The reader signals event_queue_fd, an eventfd, whenever it queues an
+ * event or stops, so that the main thread can wait for events in its
+ * epoll loop together with signals and timers.
+ *
+ * Every event is saved in the spool (see spool.c) before it is queued,
+ * and only released from there once it has been handled.
+ */
+
+/**
+ * @struct event_slot
+ * @brief one entry in the event ring
+ */
+struct event_slot {
+	struct event	event;
+	int		len;	/**< bytes returned by read_proc_error_log */
+	int		spool_slot; /**< -1 if the event was not spooled */
+};
+
+static struct event_slot *ring = NULL;
+static int ring_head = 0;	/* next slot to be handled */
+static int ring_tail = 0;	/* next slot to be filled */
+static int ring_done = 0;	/* reader has stopped */
+static int ring_error = 0;	/* reader stopped because of an error */
+static int ring_stop = 0;	/* reader has been asked to stop */
+
+static struct event_queue_stats qstats;
+
+static pthread_t reader_thread;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_not_full = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @var event_queue_fd
+ * @brief eventfd that becomes readable when events have been queued
+ */
+int event_queue_fd = -1;
+
+/* eventfd that tells the reader to stop waiting for the kernel */
+static int reader_stop_fd = -1;
+
+static void
+event_queue_notify(void)
+{
+	uint64_t one = 1;
+
+	if (write(event_queue_fd, &one, sizeof(one)) != sizeof(one))
+		dbg("Could not signal the event queue, %s", strerror(errno));
+}
+
+/**
+ * event_reader
+ * @brief Reader thread, drains the kernel error log into the ring
+ *
+ * @param arg unused
+ * @return NULL
+ */
+static void *
+event_reader(void *arg)
+{
+	struct event_slot *slot;
+	int retries = 0;
+	int len;
+
+	while (1) {
+		pthread_mutex_lock(&ring_lock);
+		if (qstats.depth == RTAS_EVENT_QUEUE_SZ) {
+			qstats.full_waits++;
+			dbg("Event queue is full, waiting for the handler");
+		}
+		while (qstats.depth == RTAS_EVENT_QUEUE_SZ && !ring_stop)
+			pthread_cond_wait(&ring_not_full, &ring_lock);
+		if (ring_stop)
+			break;
+		slot = &ring[ring_tail];
+		pthread_mutex_unlock(&ring_lock);
+
+		/*
+		 * The slot at ring_tail is not visible to the handler
+		 * until it is queued below, so it can be filled without
+		 * holding the lock.
+		 *
+		 * Passing a reference to the event to the read routine
+		 * is correct, see rtas_errd.h for details.
+		 */
+		memset(slot, 0, sizeof(*slot));
+		if (wait_proc_error_log(reader_stop_fd)) {
+			pthread_mutex_lock(&ring_lock);
+			break;
+		}
+		len = read_proc_error_log((char *)&slot->event,
+					  RTAS_ERROR_LOG_MAX);
+		if (len <= 0) {
+			stats_count(STATS_READ_RETRIES);
+			retries++;
+			if (retries >= 3) {
+				log_msg(NULL, "Could not read error log file");
+				pthread_mutex_lock(&ring_lock);
+				ring_error = 1;
+				break;
+			}
+			continue;
+		}
+
+		retries = 0;
+		slot->len = len;
+		slot->event.read_time = stats_now();
+		slot->spool_slot = spool_commit(&slot->event, len);
+
+		pthread_mutex_lock(&ring_lock);
+		ring_tail = (ring_tail + 1) % RTAS_EVENT_QUEUE_SZ;
+		qstats.depth++;
+		qstats.enqueued++;
+		if (qstats.depth > qstats.high_water)
+			qstats.high_water = qstats.depth;
+		event_queue_notify();
+
+#ifdef DEBUG
+		/*
+		 * If we are reading fake rtas events from test files
+		 * stop once the last one has been queued
+		 */
+		if (testing_finished)
+			break;
+#endif
+		pthread_mutex_unlock(&ring_lock);
+	}
+
+	/* ring_lock is held here */
+	ring_done = 1;
+	event_queue_notify();
+	pthread_mutex_unlock(&ring_lock);
+
+	return NULL;
+}
+
+static void
+event_queue_close_fds(void)
+{
+	if (event_queue_fd != -1)
+		close(event_queue_fd);
+	if (reader_stop_fd != -1)
+		close(reader_stop_fd);
+	event_queue_fd = reader_stop_fd = -1;
+}
+
+/**
+ * event_queue_start
+ * @brief Allocate the event ring and start the reader thread
+ *
+ * All signals are blocked in the reader thread, they are all handled
+ * by the main thread.
+ *
+ * @return 0 on success, !0 on failure
+ */
+int
+event_queue_start(void)
+{
+	sigset_t all, old;
+	int rc;
+
+	event_queue_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	reader_stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (event_queue_fd == -1 || reader_stop_fd == -1) {
+		log_msg(NULL, "Could not create the RTAS event queue eventfd, "
+			"%s", strerror(errno));
+		event_queue_close_fds();
+		return -1;
+	}
+
+	ring = calloc(RTAS_EVENT_QUEUE_SZ, sizeof(*ring));
+	if (ring == NULL) {
+		log_msg(NULL, "Could not allocate the RTAS event queue, %s",
+			strerror(errno));
+		event_queue_close_fds();
+		return -1;
+	}
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	rc = pthread_create(&reader_thread, NULL, event_reader, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (rc) {
+		log_msg(NULL, "Could not start the RTAS event reader thread, "
+			"%s", strerror(rc));
+		free(ring);
+		ring = NULL;
+		event_queue_close_fds();
+		return -1;
+	}
+
+	dbg("RTAS event queue started with %d slots", RTAS_EVENT_QUEUE_SZ);
+	return 0;
+}
+
+/**
+ * event_queue_get
+ * @brief Retrieve the next RTAS event read from the kernel
+ *
+ * Does not wait; poll event_queue_fd for more events to arrive.  The
+ * returned event stays in the ring, and is owned by the caller, until
+ * it is handed back with event_queue_put().
+ *
+ * @param event returns a pointer to the event
+ * @param len returns the number of bytes read for the event
+ * @return 0 on success, EAGAIN if the queue is empty, or ENODATA once
+ *	the reader has stopped and the queue has been drained
+ */
+int
+event_queue_get(struct event **event, int *len)
+{
+	struct event_slot *slot = NULL;
+	uint64_t count;
+	int rc;
+
+	/* Clear the eventfd first so that no later notification is lost */
+	if (read(event_queue_fd, &count, sizeof(count)) < 0 &&
+	    errno != EAGAIN)
+		dbg("Could not read the event queue eventfd, %s",
+		    strerror(errno));
+
+	pthread_mutex_lock(&ring_lock);
+	rc = ring_done ? ENODATA : EAGAIN;
+	if (qstats.depth > 0) {
+		slot = &ring[ring_head];
+		dbg("Event queue depth %u (high water %u)",
+		    qstats.depth, qstats.high_water);
+	}
+	pthread_mutex_unlock(&ring_lock);
+
+	if (slot == NULL)
+		return rc;
+
+	*event = &slot->event;
+	*len = slot->len;
+	return 0;
+}
+
+/**
+ * event_queue_put
+ * @brief Release the event returned by the last event_queue_get()
+ *
+ * @param handled 0 to leave the event in the spool, for the next start
+ *	of rtas_errd to handle
+ */
+void
+event_queue_put(int handled)
+{
+	if (handled)
+		spool_release(ring[ring_head].spool_slot);
+
+	pthread_mutex_lock(&ring_lock);
+	ring_head = (ring_head + 1) % RTAS_EVENT_QUEUE_SZ;
+	qstats.depth--;
+	qstats.dequeued++;
+	pthread_cond_signal(&ring_not_full);
+	pthread_mutex_unlock(&ring_lock);
+}
+
+/**
+ * event_queue_error
+ * @brief Check if the reader stopped because of a read failure
+ *
+ * @return 1 if the reader failed, 0 otherwise
+ */
+int
+event_queue_error(void)
+{
+	int rc;
+
+	pthread_mutex_lock(&ring_lock);
+	rc = ring_error;
+	pthread_mutex_unlock(&ring_lock);
+
+	return rc;
+}
+
+/**
+ * event_queue_get_stats
+ * @brief Take a consistent snapshot of the event queue counters
+ *
+ * @param stats buffer to copy the counters to
+ */
+void
+event_queue_get_stats(struct event_queue_stats *stats)
+{
+	pthread_mutex_lock(&ring_lock);
+	memcpy(stats, &qstats, sizeof(*stats));
+	pthread_mutex_unlock(&ring_lock);
+}
+
+/**
+ * event_queue_stop
+ * @brief Stop the reader thread and free the event ring
+ *
+ * The reader may be waiting for the kernel error log, so it is woken
+ * up through reader_stop_fd as well as asked to stop.
+ */
+void
+event_queue_stop(void)
+{
+	struct event_queue_stats stats;
+	uint64_t one = 1;
+
+	if (ring == NULL)
+		return;
+
+	pthread_mutex_lock(&ring_lock);
+	ring_stop = 1;
+	pthread_cond_signal(&ring_not_full);
+	pthread_mutex_unlock(&ring_lock);
+
+	if (write(reader_stop_fd, &one, sizeof(one)) != sizeof(one))
+		dbg("Could not stop the event reader, %s", strerror(errno));
+	pthread_join(reader_thread, NULL);
+
+	event_queue_get_stats(&stats);
+	dbg("RTAS event queue: %lu events queued, %lu handled, high water "
+	    "%u of %d slots, reader waited %lu times on a full queue",
+	    stats.enqueued, stats.dequeued, stats.high_water,
+	    RTAS_EVENT_QUEUE_SZ, stats.full_waits);
+
+	free(ring);
+	ring = NULL;
+	event_queue_close_fds();
+}
@@ -0,0 +1,474 @@
+/**
+ * @file rtas_archive.c
+ * @brief Search the binary RTAS event archive
+ *
+ * Looks up the RTAS events that rtas_errd archived (see archive.h) by
+ * event number, time or type, and prints either a summary line for each
+ * of them or the platform log text of the events.
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "config.h"
+#include "hexdump.h"
+
+/**
+ * @struct segment
+ * @brief An archive segment, with its index mapped
+ */
+struct segment {
+	unsigned int			num;
+	uint32_t			recs;
+	struct rtas_archive_idx_hdr	*hdr;
+	struct rtas_archive_rec		*rec;	/**< hdr + 1 */
+	size_t				map_size;
+};
+
+/**
+ * @struct query
+ * @brief The events to look for; every field is a closed range
+ */
+struct query {
+	uint32_t	seq_lo, seq_hi;
+	uint64_t	time_lo, time_hi;
+	int		type;		/**< -1 for any type */
+};
+
+static char *archive_dir;
+static struct segment *segments;
+static int nsegments;
+static int flag_v = 0;
+
+/**
+ * msg
+ * @brief Print messages while the config file is parsed, with -v
+ */
+static void
+msg(char *fmt, ...)
+{
+	va_list ap;
+
+	if (flag_v) {
+		va_start(ap, fmt);
+		vfprintf(stderr, fmt, ap);
+		va_end(ap);
+		fprintf(stderr, "\n");
+	}
+}
+
+static void
+print_usage(const char *name)
+{
+	printf("Usage: %s [-h] [-v] [-x] [-d <dir>] [-n <seq>[-<seq>]] "
+		"[-s <time>] [-e <time>] [-t <type>]\n"
+		"\t-h: print this help message\n"
+		"\t-v: verbose output\n"
+		"\t-x: print the events as they are in the platform log\n"
+		"\t-d: archive directory, instead of the EventArchivePath\n"
+		"\t    of the config file\n"
+		"\t-n: RTAS event number, or range of them\n"
+		"\t-s: events archived at or after this time\n"
+		"\t-e: events archived at or before this time\n"
+		"\t-t: RTAS event type, in hex\n"
+		"\t<time> is \"YYYY-MM-DD HH:MM:SS\" in local time, or "
+		"seconds\n\tsince the Epoch\n", name);
+}
+
+static int
+cmp_segment(const void *a, const void *b)
+{
+	const struct segment *sa = a, *sb = b;
+
+	return sa->num < sb->num ? -1 : sa->num > sb->num;
+}
+
+/**
+ * load_segments
+ * @brief Map the index of every segment in the archive
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int
+load_segments(void)
+{
+	char path[PATH_MAX], suffix[8];
+	struct segment *seg;
+	struct dirent *de;
+	struct stat sbuf;
+	unsigned int num;
+	DIR *dir;
+	int fd, max = 0;
+
+	dir = opendir(archive_dir);
+	if (dir == NULL) {
+		fprintf(stderr, "Could not open %s, %s\n", archive_dir,
+			strerror(errno));
+		return -1;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		if (sscanf(de->d_name, "events.%u.%7s", &num, suffix) != 2 ||
+		    strcmp(suffix, "idx"))
+			continue;
+
+		snprintf(path, sizeof(path), RTAS_ARCHIVE_IDX_FMT, archive_dir,
+			 num);
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			/* Removed by rtas_errd since */
+			continue;
+		}
+
+		if (fstat(fd, &sbuf) ||
+		    sbuf.st_size < sizeof(struct rtas_archive_idx_hdr)) {
+			close(fd);
+			continue;
+		}
+
+		if (nsegments == max) {
+			max = max ? max * 2 : 16;
+			segments = realloc(segments, max * sizeof(*segments));
+			if (segments == NULL) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+
+		seg = &segments[nsegments];
+		seg->num = num;
+		seg->map_size = sbuf.st_size;
+		seg->hdr = mmap(NULL, seg->map_size, PROT_READ, MAP_SHARED,
+				fd, 0);
+		close(fd);
+		if (seg->hdr == MAP_FAILED)
+			continue;
+
+		if (memcmp(seg->hdr->magic, RTAS_ARCHIVE_MAGIC,
+			   sizeof(seg->hdr->magic)) ||
+		    be32toh(seg->hdr->version) != RTAS_ARCHIVE_VERSION) {
+			fprintf(stderr, "Skipping %s, not an event archive "
+				"index\n", path);
+			munmap(seg->hdr, seg->map_size);
+			continue;
+		}
+
+		seg->rec = (struct rtas_archive_rec *)(seg->hdr + 1);
+		seg->recs = (sbuf.st_size - sizeof(*seg->hdr)) /
+			    sizeof(*seg->rec);
+		nsegments++;
+	}
+	closedir(dir);
+
+	qsort(segments, nsegments, sizeof(*segments), cmp_segment);
+	return 0;
+}
+
+/**
+ * seq_lower_bound
+ * @brief Find the first record of a segment with a seq_num >= seq
+ */
+static uint32_t
+seq_lower_bound(struct segment *seg, uint32_t seq)
+{
+	uint32_t lo = 0, hi = seg->recs, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (be32toh(seg->rec[mid].seq_num) < seq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/**
+ * time_lower_bound
+ * @brief Find the first record of a segment with a time >= t
+ */
+static uint32_t
+time_lower_bound(struct segment *seg, uint64_t t)
+{
+	uint32_t lo = 0, hi = seg->recs, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (be64toh(seg->rec[mid].time) < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/**
+ * print_event
+ * @brief Print an archived event
+ *
+ * @param seg segment the event is in
+ * @param rec index record of the event
+ * @param hexdump print the platform log text of the event, rather than
+ *	  a summary line
+ * @return 0 on success, -1 on failure
+ */
+static int
+print_event(struct segment *seg, struct rtas_archive_rec *rec, int hexdump)
+{
+	static int data_fd = -1;
+	static unsigned int data_seg;
+	char path[PATH_MAX], date[32];
+	char *data, *out;
+	uint32_t seq = be32toh(rec->seq_num), len = be32toh(rec->len);
+	time_t t = be64toh(rec->time);
+	struct tm tm;
+	int rc = -1;
+
+	if (!hexdump) {
+		localtime_r(&t, &tm);
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+		printf("%-10u %s  type 0x%02x  severity %u  %u bytes\n", seq,
+		       date, rec->type, rec->severity, len);
+		return 0;
+	}
+
+	if (data_fd < 0 || data_seg != seg->num) {
+		if (data_fd >= 0)
+			close(data_fd);
+
+		snprintf(path, sizeof(path), RTAS_ARCHIVE_DATA_FMT,
+			 archive_dir, seg->num);
+		data_fd = open(path, O_RDONLY);
+		if (data_fd < 0) {
+			fprintf(stderr, "Could not open %s, %s\n", path,
+				strerror(errno));
+			return -1;
+		}
+		data_seg = seg->num;
+	}
+
+	/* Sized from the record, the event can be of any length */
+	data = malloc(len);
+	out = malloc(RTAS_HEXDUMP_SIZE((size_t)len));
+	if (data == NULL || out == NULL) {
+		fprintf(stderr, "Could not print RTAS event %u, %s\n", seq,
+			strerror(ENOMEM));
+		goto out;
+	}
+
+	if (pread(data_fd, data, len, be64toh(rec->offset)) != len) {
+		fprintf(stderr, "Could not read RTAS event %u from segment "
+			"%u\n", seq, seg->num);
+		goto out;
+	}
+
+	printf("RTAS: %u -------- RTAS event begin --------\n", seq);
+	fwrite(out, 1, rtas_hexdump(out, data, len), stdout);
+	printf("RTAS: %u -------- RTAS event end ----------\n", seq);
+	rc = 0;
+
+out:
+	free(data);
+	free(out);
+	return rc;
+}
+
+/**
+ * run_query
+ * @brief Print every archived event that matches a query
+ *
+ * Segments whose range of event numbers and times does not overlap the
+ * query, or that hold no event of the type, are skipped without looking
+ * at their records.  Within a segment, the first candidate event is
+ * found with a binary search on both the event number and the time.
+ *
+ * @return number of events found, -1 on failure
+ */
+static int
+run_query(struct query *q, int hexdump)
+{
+	struct segment *seg;
+	struct rtas_archive_rec *rec;
+	uint32_t i, j;
+	int s, found = 0;
+
+	for (s = 0; s < nsegments; s++) {
+		seg = &segments[s];
+		if (seg->recs == 0)
+			continue;
+
+		if (be32toh(seg->rec[0].seq_num) > q->seq_hi ||
+		    be32toh(seg->rec[seg->recs - 1].seq_num) < q->seq_lo ||
+		    be64toh(seg->rec[0].time) > q->time_hi ||
+		    be64toh(seg->rec[seg->recs - 1].time) < q->time_lo)
+			continue;
+
+		if (q->type >= 0 && !RTAS_ARCHIVE_HAS_TYPE(seg->hdr, q->type))
+			continue;
+
+		i = seq_lower_bound(seg, q->seq_lo);
+		j = time_lower_bound(seg, q->time_lo);
+		if (j > i)
+			i = j;
+
+		for (; i < seg->recs; i++) {
+			rec = &seg->rec[i];
+			if (be32toh(rec->seq_num) > q->seq_hi ||
+			    be64toh(rec->time) > q->time_hi)
+				break;
+
+			if (q->type >= 0 && rec->type != q->type)
+				continue;
+
+			if (print_event(seg, rec, hexdump))
+				return -1;
+			found++;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * parse_time
+ * @brief Parse a -s or -e time
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int
+parse_time(const char *str, uint64_t *t)
+{
+	struct tm tm;
+	char *end;
+
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
+	if (end != NULL && *end == '\0') {
+		tm.tm_isdst = -1;
+		*t = mktime(&tm);
+		return 0;
+	}
+
+	*t = strtoull(str, &end, 10);
+	return (end == str || *end != '\0') ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct query q = { 0, UINT32_MAX, 0, UINT64_MAX, -1 };
+	int c, hexdump = 0, found;
+	char *end;
+
+	while ((c = getopt(argc, argv, "d:e:hn:s:t:vx")) != -1) {
+		switch (c) {
+		case 'd':
+			archive_dir = optarg;
+			break;
+		case 'e':
+			if (parse_time(optarg, &q.time_hi)) {
+				fprintf(stderr, "Invalid time %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'n':
+			q.seq_lo = strtoul(optarg, &end, 10);
+			q.seq_hi = q.seq_lo;
+			if (*end == '-')
+				q.seq_hi = strtoul(end + 1, &end, 10);
+			if (end == optarg || *end != '\0') {
+				fprintf(stderr, "Invalid event number %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			if (parse_time(optarg, &q.time_lo)) {
+				fprintf(stderr, "Invalid time %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 't':
+			q.type = strtol(optarg, &end, 16);
+			if (end == optarg || *end != '\0' || q.type < 0 ||
+			    q.type > 0xff) {
+				fprintf(stderr, "Invalid event type %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'v':
+			flag_v = 1;
+			break;
+		case 'x':
+			hexdump = 1;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return 0;
+		default:
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind < argc) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (archive_dir == NULL) {
+		if (diag_cfg(0, &msg)) {
+			fprintf(stderr, "Could not parse configuration file "
+				"%s\n", config_file);
+			return 1;
+		}
+		archive_dir = d_cfg.archive_path;
+	}
+
+	if (load_segments())
+		return 1;
+
+	found = run_query(&q, hexdump);
+	if (found < 0)
+		return 1;
+
+	if (flag_v)
+		fprintf(stderr, "%d events found in %d segments of %s\n",
+			found, nsegments, archive_dir);
+
+	return found ? 0 : 2;
+}
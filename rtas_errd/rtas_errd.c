@@ -29,6 +29,7 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
 #include <librtas.h>
 #include <limits.h>
 
@@ -47,6 +48,7 @@ int debug = 0;
  * @brief specifies if the '--nodrmgr' flag was specified
  */
 int no_drmgr = 0;
+int spool_crash = 0;
 /**
  * @var db_dir
  * @brief Specify an alternate path for the servicelog files
@@ -119,16 +121,17 @@ daemonize_error:
 }
 
 /**
- * handle_rtas_event
- * @brief Main routine for processing RTAS events.
+ * dispatch_rtas_event
+ * @brief Run an RTAS event through each stage of its handling
  *
  * @param event RTAS event structure to be handled
  */
-int
-handle_rtas_event(struct event *event)
+static int
+dispatch_rtas_event(struct event *event)
 {
-	int rc = 0;
+	int rc = 0, repeat;
 	struct rtas_event_exthdr *exthdr;
+	uint64_t start;
 
 	dbg("Handling RTAS event %d", event->seq_num);
 
@@ -139,10 +142,28 @@ handle_rtas_event(struct event *event)
 	 * the log will be updated with the path to the dump
 	 */
 	dbg("Entering check_platform_dump()");
+	start = stats_now();
 	check_platform_dump(event);
+	stats_stage(STATS_DUMP, start);
 
-	/* write the event to the platform file */
-	rc = print_rtas_event(event);
+	/*
+	 * Repeats of an event seen within the dedup window are not
+	 * analyzed or logged to servicelog, and only the first few of
+	 * them are written to the platform log.
+	 */
+	repeat = dedup_event(event);
+	if (repeat)
+		stats_count(STATS_DEDUP_REPEATS);
+	if (repeat > d_cfg.dedup_hexdumps) {
+		dbg("Not writing repeat %d of the event to %s", repeat,
+		    platform_log);
+		rc = 1;
+	} else {
+		/* write the event to the platform file */
+		start = stats_now();
+		rc = print_rtas_event(event);
+		stats_stage(STATS_PRINT, start);
+	}
 	if (rc <= 0) {
 		log_msg(event, "Could not write RTAS event %d to log file %s",
 			event->seq_num, platform_log);
@@ -152,16 +173,25 @@ handle_rtas_event(struct event *event)
 		return -1;
 	}
 
+	/* Hotplug requests must be run before anything that follows them */
+	if (event->rtas_hdr->type != RTAS_HDR_TYPE_HOTPLUG)
+		hotplug_flush();
+
 	switch (event->rtas_hdr->type) {
 	    case RTAS_HDR_TYPE_CACHE_PARITY:
 	    case RTAS_HDR_TYPE_RESOURCE_DEALLOC:
 		dbg("Entering handle_resource_dealloc()");
+		start = stats_now();
 		handle_resource_dealloc(event);
+		stats_stage(STATS_DEALLOC, start);
 		break;
 
 	    case RTAS_HDR_TYPE_EPOW:
 		dbg("Entering check_epow()");
-		if (check_epow(event) <= 0) {
+		start = stats_now();
+		rc = check_epow(event);
+		stats_stage(STATS_EPOW, start);
+		if (rc <= 0) {
 			dbg("Received EPOW 0 (all is normal) event");
 			return 0;
 		}
@@ -170,7 +200,9 @@ handle_rtas_event(struct event *event)
 	    case RTAS_HDR_TYPE_PLATFORM_ERROR:
 	    case RTAS_HDR_TYPE_PLATFORM_INFO:
 		dbg("Entering check_eeh()");
+		start = stats_now();
 		check_eeh(event);
+		stats_stage(STATS_EEH, start);
 		break;
 
 	    case RTAS_HDR_TYPE_DUMP_NOTIFICATION:
@@ -179,7 +211,9 @@ handle_rtas_event(struct event *event)
 
 	    case RTAS_HDR_TYPE_PRRN:
 		dbg("Entering PRRN handler");
+		start = stats_now();
 		handle_prrn_event(event);
+		stats_stage(STATS_PRRN, start);
 
 		/* Nothing left to do for PRRN Events, there is no exthdr
 		 * for these events and they are not a serviceable event
@@ -189,7 +223,9 @@ handle_rtas_event(struct event *event)
 
 	    case RTAS_HDR_TYPE_HOTPLUG:
 		dbg("Entering Hotplug handler");
+		start = stats_now();
 		handle_hotplug_event(event);
+		stats_stage(STATS_HOTPLUG, start);
 		break;
 
 	    default:
@@ -197,7 +233,7 @@ handle_rtas_event(struct event *event)
 		break;
 	}
 
-	exthdr = rtas_get_event_exthdr_scn(event->rtas_event);
+	exthdr = event_scn(event, RTAS_EVENT_EXT_HDR);
 	if (exthdr == NULL) {
 		log_msg(event, "Could not retrieve extended event data");
 		return 0;
@@ -212,13 +248,20 @@ handle_rtas_event(struct event *event)
 	if (exthdr->predictive)
 		event->flags |= RE_PREDICTIVE;
 
+	if (repeat)
+		return 0;
+
+	start = stats_now();
 	if (event->rtas_hdr->version == 6)
 		process_v6(event);
 	else
 		process_pre_v6(event);
+	stats_stage(STATS_ELA, start);
 
 	/* Log the event in the servicelog DB */
+	start = stats_now();
 	log_event(event);
+	stats_stage(STATS_LOG, start);
 
 #if 0
 	if (event->flags & RE_ALREADY_REPORTED) {
@@ -239,98 +282,285 @@ handle_rtas_event(struct event *event)
 	return 0;
 }
 
+/**
+ * handle_rtas_event
+ * @brief Main routine for processing RTAS events.
+ *
+ * @param event RTAS event structure to be handled
+ */
+int
+handle_rtas_event(struct event *event)
+{
+	uint64_t start;
+	int rc;
+
+	start = stats_now();
+	rc = dispatch_rtas_event(event);
+	stats_event(event->rtas_hdr->type, start, rc < 0);
+
+	return rc;
+}
+
+/**
+ * next_deadline
+ * @brief Retrieve the earliest time by which queued work must be done
+ *
+ * @param deadline buffer for the CLOCK_MONOTONIC deadline
+ * @return 1 if there is queued work, 0 otherwise
+ */
+static int
+next_deadline(struct timespec *deadline)
+{
+	struct timespec next;
+	int rc;
+
+	rc = hotplug_deadline(deadline);
+	if (log_event_deadline(&next)) {
+		if (!rc || next.tv_sec < deadline->tv_sec ||
+		    (next.tv_sec == deadline->tv_sec &&
+		     next.tv_nsec < deadline->tv_nsec))
+			*deadline = next;
+		rc = 1;
+	}
+	if (dedup_deadline(&next)) {
+		if (!rc || next.tv_sec < deadline->tv_sec ||
+		    (next.tv_sec == deadline->tv_sec &&
+		     next.tv_nsec < deadline->tv_nsec))
+			*deadline = next;
+		rc = 1;
+	}
+
+	return rc;
+}
+
+/**
+ * handle_queued_event
+ * @brief Parse and handle an event taken off the event queue
+ *
+ * @param event RTAS event read from the kernel
+ * @param len number of bytes read for the event
+ * @return 0 on success, -1 if the event could not be parsed, -2 if it
+ *	could not be written to the platform log
+ */
+static int
+handle_queued_event(struct event *event, int len)
+{
+	int rc;
+
+	/* Sections are only decoded once they are asked for */
+	if (event_scn_index(event, len)) {
+		stats_count(STATS_PARSE_ERRORS);
+		log_msg(event, "Could not parse RTAS event");
+		checkpoint_handled(event->seq_num);
+		return -1;
+	}
+
+	if (scanlog != NULL)
+		event->flags |= RE_SCANLOG_AVAIL;
+
+	dbg("Received RTAS event %d", event->seq_num);
+
+	rc = handle_rtas_event(event);
+	if (rc >= 0)
+		checkpoint_handled(event->seq_num);
+
+	if (event->scn_dir.parse_failed) {
+		stats_count(STATS_PARSE_ERRORS);
+		log_msg(event, "Could not parse RTAS event");
+	}
+
+	/* cleanup the RTAS event */
+	if (event->loc_codes != NULL)
+		free(event->loc_codes);
+	free_diag_vpd(event);
+	event_scn_cleanup(event);
+
+	return rc < 0 ? -2 : 0;
+}
+
+/**
+ * loop_timeout
+ * @brief Retrieve the epoll_wait() timeout for the next queued work
+ *
+ * @return timeout in msecs, rounded up, or -1 if nothing is queued
+ */
+static int
+loop_timeout(void)
+{
+	struct timespec deadline, now;
+	long msecs;
+
+	if (!next_deadline(&deadline))
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	msecs = (deadline.tv_sec - now.tv_sec) * 1000 +
+		(deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+
+	return msecs > 0 ? msecs : 0;
+}
+
+static int
+loop_add(int epfd, int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		log_msg(NULL, "Could not add fd %d to the event loop, %s",
+			fd, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
 /**
  * read_rtas_event
- * @brief Main routine to retrieve RTAS events from the kernel
+ * @brief Main event loop of rtas_errd
  * 
- * Responsible for reading RTAS events from the kernel (via /proc)
- * and calling handle_rtas_event() to process the event.
+ * Waits in epoll for any of
+ *  - RTAS events, read from the kernel (via /proc) by the reader thread
+ *    and taken off the event queue in the order they were read,
+ *  - the EPOW timer,
+ *  - SIGHUP, SIGCHLD, SIGTERM and SIGINT (see signal.c),
+ *  - the deadline of queued work: running drmgr for merged hotplug
+ *    events, committing queued servicelog entries and recording the
+ *    repeats of deduplicated events.
+ *
+ * Returns on SIGTERM or SIGINT, leaving the queued work for main() to
+ * flush.
  */
 int
 read_rtas_events()
 {
-	struct event event = {0};
-	ssize_t len;
-	int retries = 0;
+	struct epoll_event evs[3];
+	struct event *event;
+	int len, n, i, timeout;
+	int rc = 0, qrc = 0;
+	int more = 0, terminate = 0;
+	int epfd;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1) {
+		log_msg(NULL, "Could not create the event loop, %s",
+			strerror(errno));
+		return -1;
+	}
 
-	memset(&event, 0, sizeof(event));
+	if (event_queue_start()) {
+		close(epfd);
+		return -1;
+	}
 
-	while (1) {
-		/*
-		 * Passing a reference to re to the read routine is correct.
-		 * see rtas_errd.h for details.
-		 */
-		len = read_proc_error_log((char *)&event, RTAS_ERROR_LOG_MAX);
-		if (len <= 0) {
-			retries++;
-			if (retries >= 3) {
-				log_msg(NULL, "Could not read error log file");
-				return -1;
-			}
-			continue;
-		}
+	if (loop_add(epfd, event_queue_fd) || loop_add(epfd, signal_fd) ||
+	    loop_add(epfd, epow_timer_fd)) {
+		rc = -1;
+		goto out;
+	}
 
-		retries = 0;
+	while (!terminate) {
+		/* Don't wait if the last batch of events was cut short */
+		timeout = more ? 0 : loop_timeout();
 
-		event.rtas_event = parse_rtas_event(event.event_buf, len);
-		if (event.rtas_event == NULL) {
-			log_msg(&event, "Could not parse RTAS event");
-			return -1;
+		n = epoll_wait(epfd, evs, 3, timeout);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			log_msg(NULL, "Event loop failed, %s", strerror(errno));
+			rc = -1;
+			break;
 		}
 
-		event.rtas_hdr = rtas_get_event_hdr_scn(event.rtas_event);
-		if (event.rtas_hdr == NULL) {
-			log_msg(&event, "Could not retrieve event header");
-			cleanup_rtas_event(event.rtas_event);
-			return -1;
+		for (i = 0; i < n; i++) {
+			if (evs[i].data.fd == signal_fd)
+				terminate = handle_signals();
+			else if (evs[i].data.fd == epow_timer_fd)
+				epow_timer_expired();
 		}
 
-		event.length = event.rtas_event->event_length;
-
-		if (scanlog != NULL)
-			event.flags |= RE_SCANLOG_AVAIL;
-
-                dbg("Received RTAS event %d", event.seq_num);
+		if (n == 0 && !more) {
+			hotplug_flush();
+			log_event_flush();
+			dedup_flush(0);
+			checkpoint_flushed();
+			continue;
+		}
 
 		/*
-		 * Mark ourselves as not being able to handle SIGHUP
-		 * signals while handling the RTAS event
+		 * Handle at most a queue's worth of events before looking
+		 * at signals and timers again.
 		 */
-		d_cfg.flags &= ~RE_CFG_RECFG_SAFE;
-		handle_rtas_event(&event);
-		d_cfg.flags |= RE_CFG_RECFG_SAFE;
+		more = 0;
+		for (i = 0; i < RTAS_EVENT_QUEUE_SZ && !terminate; i++) {
+			qrc = event_queue_get(&event, &len);
+			if (qrc)
+				break;
 
-		if (d_cfg.flags & RE_CFG_RECEIVED_SIGHUP) {
-			diag_cfg(1, &cfg_log);
-			d_cfg.flags &= ~RE_CFG_RECEIVED_SIGHUP;
+#ifdef DEBUG
+			/* Leave the event to the next start, as a crash would */
+			if (spool_crash) {
+				event_queue_put(0);
+				continue;
+			}
+#endif
+			rc = handle_queued_event(event, len);
+
+			/*
+			 * Hand the slot back to the reader.  An event that
+			 * could not be logged stays in the spool, and
+			 * rtas_errd exits so that the next start logs it.
+			 * Handled events leave the spool once their queued
+			 * work is committed.
+			 */
+			event_queue_put(rc != -2);
+			checkpoint_flushed();
+
+			if (rc)
+				break;
 		}
 
-		/* cleanup the RTAS event */
-		if (event.loc_codes != NULL)
-			free(event.loc_codes);
-		free_diag_vpd(&event);
-		cleanup_rtas_event(event.rtas_event);
-		memset(&event, 0, sizeof(event));
-
-#ifdef DEBUG
-		/*
-		 * If we are reading a fake rtas event from a test file
-		 * we only want to read it once
-		 */
-		if (testing_finished)
+		if (rc || qrc == ENODATA)
 			break;
-#endif
+
+		if (i == RTAS_EVENT_QUEUE_SZ)
+			more = 1;
+
+		/* Deadlines may have passed while handling events */
+		if (loop_timeout() == 0) {
+			hotplug_flush();
+			log_event_flush();
+			dedup_flush(0);
+			checkpoint_flushed();
+		}
 	}
 
-	return 0;
+	/*
+	 * The reader only stops on its own after repeated read failures,
+	 * or in DEBUG builds once the last test event has been read.
+	 */
+	if (qrc == ENODATA && event_queue_error())
+		rc = -1;
+
+out:
+	event_queue_stop();
+	close(epfd);
+
+	return rc;
 }
 
 static void print_usage(char *argv0)
 {
 	fprintf(stderr, "Usage: %s [OPTION]\n\n", argv0);
 #ifdef DEBUG
+	fprintf(stderr, "  -C, --corpus=FILE         path to binary RTAS event corpus to replay\n");
 	fprintf(stderr, "  -c, --config=FILE         path to config file (default %s)\n",
 		config_file);
+	fprintf(stderr, "  -D, --drmgr=FILE          path to drmgr (default %s)\n",
+		drmgr_program);
 #endif
 	fprintf(stderr, "  -d, --debug               don't daemonize, increase librtas debug level\n");
 #ifdef DEBUG
@@ -340,13 +570,22 @@ static void print_usage(char *argv0)
 #endif
 	fprintf(stderr, "  -h, --help                help (this message)\n");
 #ifdef DEBUG
+	fprintf(stderr, "  -j, --journalfile=FILE    recover missed RTAS events from journal FILE\n");
+	fprintf(stderr, "  -k, --checkpointfile=FILE path to event checkpoint file (default %s)\n",
+		checkpoint_file);
 	fprintf(stderr, "  -l, --logfile=FILE        path to rtas_errd debug logfile (default %s)\n",
 		rtas_errd_log);
 	fprintf(stderr, "  -m, --msgsfile=FILE       path to syslog\n");
 	fprintf(stderr, "  -p, --platformfile=FILE   path to platform_log (default %s)\n",
 		platform_log);
+	fprintf(stderr, "  -r, --rate=N              replay the corpus at N events per second\n");
 	fprintf(stderr, "  -R, --nodrmgr             no drmgr\n");
+	fprintf(stderr, "  -S, --spoolfile=FILE      path to event spool file (default %s)\n",
+		spool_file);
 	fprintf(stderr, "  -s, --scenario=FILE       path to RTAS scenario file\n");
+	fprintf(stderr, "  -t, --statsfile=FILE      path to event statistics file (default %s)\n",
+		stats_file);
+	fprintf(stderr, "  -X, --crash               leave the events read in the spool, unhandled\n");
 #endif
 }
 
@@ -364,12 +603,30 @@ static struct option longopts[] = {
 	.val = 'h'
 },
 #ifdef DEBUG
+{
+	.name = "checkpointfile",
+	.has_arg = 1,
+	.flag = NULL,
+	.val = 'k'
+},
+{
+	.name = "corpus",
+	.has_arg = 1,
+	.flag = NULL,
+	.val = 'C'
+},
 {
 	.name = "config",
 	.has_arg = 1,
 	.flag = NULL,
 	.val = 'c'
 },
+{
+	.name = "drmgr",
+	.has_arg = 1,
+	.flag = NULL,
+	.val = 'D'
+},
 {
 	.name = "epowfile",
 	.has_arg = 1,
@@ -382,6 +639,12 @@ static struct option longopts[] = {
 	.flag = NULL,
 	.val = 'f'
 },
+{
+	.name = "journalfile",
+	.has_arg = 1,
+	.flag = NULL,
+	.val = 'j'
+},
 {
 	.name = "logfile",
 	.has_arg = 1,
@@ -406,12 +669,36 @@ static struct option longopts[] = {
 	.flag = NULL,
 	.val = 'p'
 },
+{
+	.name = "rate",
+	.has_arg = 1,
+	.flag = NULL,
+	.val = 'r'
+},
+{
+	.name = "spoolfile",
+	.has_arg = 1,
+	.flag = NULL,
+	.val = 'S'
+},
 {
 	.name = "scenario",
 	.has_arg = 1,
 	.flag = NULL,
 	.val = 's'
 },
+{
+	.name = "statsfile",
+	.has_arg = 1,
+	.flag = NULL,
+	.val = 't'
+},
+{
+	.name = "crash",
+	.has_arg = 0,
+	.flag = NULL,
+	.val = 'X'
+},
 #endif
 {
 	.name = NULL,
@@ -432,11 +719,10 @@ static struct option longopts[] = {
 int
 main(int argc, char *argv[])
 {
-	struct sigaction sigact;
 	int rc = 0;
 	int c;
 #ifdef DEBUG
-	int f_flag = 0, s_flag = 0;
+	int f_flag = 0, s_flag = 0, S_flag = 0;
 #endif
 	int platform = 0;
 
@@ -468,8 +754,8 @@ main(int argc, char *argv[])
 				break;
 
 			case 'f': /* RTAS test event */
-				if (s_flag) {
-					dbg("Only use the -f or -s flag");
+				if (s_flag || corpus_file) {
+					dbg("Only use one of the -f, -s or -C flags");
 					goto error_out;
 				}
 
@@ -484,6 +770,14 @@ main(int argc, char *argv[])
 				proc_error_log2 = NULL;
 				break;
 
+			case 'j': /* debug journal file */
+				journal_file = optarg;
+				break;
+
+			case 'k': /* debug checkpoint file */
+				checkpoint_file = optarg;
+				break;
+
 			case 'l': /* debug rtas_errd.log file */
 				rtas_errd_log = optarg;
 				break;
@@ -497,8 +791,8 @@ main(int argc, char *argv[])
 				break;
 
 			case 's': /* RTAS test scenario */
-				if (f_flag) {
-					dbg("Only use the -f or -s flag");
+				if (f_flag || corpus_file) {
+					dbg("Only use one of the -f, -s or -C flags");
 					goto error_out;
 				}
 
@@ -506,9 +800,44 @@ main(int argc, char *argv[])
 				scenario_file = optarg;
 				break;
 
+			case 'C': /* RTAS event corpus */
+				if (f_flag || s_flag) {
+					dbg("Only use one of the -f, -s or -C flags");
+					goto error_out;
+				}
+
+				corpus_file = optarg;
+				break;
+
+			case 'r': /* corpus replay rate */
+				corpus_rate = atoi(optarg);
+				if (corpus_rate < 0) {
+					fprintf(stderr, "Invalid replay rate %s\n",
+						optarg);
+					goto error_out;
+				}
+				break;
+
+			case 't': /* debug statistics file */
+				stats_file = optarg;
+				break;
+
+			case 'D': /* drmgr to run */
+				drmgr_program = optarg;
+				break;
+
 			case 'R': /* No drmgr */
 				no_drmgr = 1;
 				break;
+
+			case 'S': /* debug spool file */
+				S_flag++;
+				spool_file = optarg;
+				break;
+
+			case 'X': /* leave events in the spool */
+				spool_crash = 1;
+				break;
 #endif
 			default:
 				return -1;
@@ -532,42 +861,36 @@ main(int argc, char *argv[])
 	if (rc)
 		goto error_out;
 
-	/* Set up a signal handler for SIGALRM to handle EPOW events */
-	sigact.sa_handler = (void *)epow_timer_handler;
-	sigemptyset(&sigact.sa_mask);
-	sigact.sa_flags = SA_RESTART;
-	if (sigaction(SIGALRM, &sigact, NULL)) {
-		log_msg(NULL, "Could not initialize signal handler for "
-			"certain EPOW events (SIGALRM), %s", strerror(errno));
+	/*
+	 * SIGHUP (re-read the config file), SIGCHLD, SIGUSR1 (dump the
+	 * statistics) and SIGTERM are read from a signalfd in the event
+	 * loop, as are the EPOW timer expiries.  This must be done before
+	 * any thread is started.
+	 */
+	rc = signals_init();
+	if (rc)
 		goto error_out;
-	}
-
-	/* Set up a signal handler for SIGHUP to re-read the config file */
-	sigact.sa_handler = (void *)sighup_handler;
-	sigemptyset(&sigact.sa_mask);
-	sigact.sa_flags = SA_RESTART;
-	if (sigaction(SIGHUP, &sigact, NULL)) {
-		log_msg(NULL, "Could not initialize signal handler for "
-			"re-reading the ppc64-diag config file (SIGHUP), %s",
-			strerror(errno));
-	}
-
-	/* Ignore SIGPIPE */
-	sigact.sa_handler = SIG_IGN;
-	sigemptyset(&sigact.sa_mask);
-	sigact.sa_flags = SA_RESTART;
-	if (sigaction(SIGPIPE, &sigact, NULL)) {
-		log_msg(NULL, "Cannot ignore SIGPIPE, %s", strerror(errno));
-	}
 
-	/* Set up a signal handler for SIGCHLD to handle terminating children */
-	setup_sigchld_handler();
+	rc = epow_timer_init();
+	if (rc)
+		goto error_out;
 
 	/* Read any configuration options from the config file */
 	rc = diag_cfg(1, &cfg_log);
 	if (rc)
 		goto error_out;
 
+	/* Events are archived along with the platform log */
+	archive_open();
+
+#ifdef DEBUG
+	/* Test events are only spooled to a spool file of their own */
+	if ((f_flag || s_flag || corpus_file) && !S_flag)
+		spool_file = NULL;
+#endif
+	/* Events left in it by the last run are handled first, below */
+	spool_open();
+
 	/* Open the servicelog database */
 	rc = servicelog_open(&slog, 0);
 	if (rc) {
@@ -577,6 +900,15 @@ main(int argc, char *argv[])
 		slog = NULL;
 	}
 
+	/* Read the VPD used for callout part numbers */
+	vpd_cache_init();
+
+	/* Index the CPUs and LMBs that events may ask to deallocate */
+	topology_init();
+
+	/* Time the handling of events; SIGUSR1 dumps the statistics */
+	stats_start();
+
 	/* update RTAS events from syslog */
 	update_rtas_msgs();
 
@@ -604,13 +936,37 @@ main(int argc, char *argv[])
 
 	rc = read_rtas_events();
 
+#ifdef DEBUG
+	corpus_report();
+#endif
+
 error_out:
 	errno = 0;
 	log_msg(NULL, "The rtas_errd daemon is exiting");
+	hotplug_flush();
+	if (slog != NULL)
+		log_event_flush();
+	dedup_flush(1);
+	checkpoint_flushed();
+	/*
+	 * Let the drmgr runs that were asked for complete; after SIGTERM
+	 * only the ones already running, for a limited time.  The events
+	 * of the runs that did not complete stay in the spool.
+	 */
+	helper_drain();
+	checkpoint_flushed();
 	close_files();
+	archive_close();
+	spool_close();
 
 	if (slog != NULL)
 		servicelog_close(slog);
 
+	stats_stop();
+	vpd_cache_free();
+	topology_free();
+	epow_timer_close();
+	signals_close();
+
 	return rc;
 }
@@ -23,10 +23,12 @@
 #define _RTAS_ERRD_H
 
 #include <signal.h>
+#include <time.h>
 #include <librtasevent.h>
 #include <servicelog-1/servicelog.h>
 #include "fru_prev6.h"
 #include "config.h"
+#include "scn_dir.h"
 
 extern char *platform_log;
 extern char *messages_log;
@@ -34,17 +36,23 @@ extern char *proc_error_log1;
 extern char *proc_error_log2;
 extern char *rtas_errd_log;
 extern char *rtas_errd_log0;
+extern char *checkpoint_file;
+extern char *stats_file;
 extern char *test_file;
 
 #ifdef DEBUG
 extern char *scenario_file;
+extern char *journal_file;
+extern char *corpus_file;
+extern int corpus_rate;
 extern int testing_finished;
 extern int no_drmgr;
+extern int spool_crash;
 /**
  * @def RTAS_ERRD_ARGS 
  * @brief DEBUG args for rtas_errd
  */
-#define RTAS_ERRD_ARGS		"c:de:f:hl:m:p:Rs:"
+#define RTAS_ERRD_ARGS		"C:c:D:de:f:hj:k:l:m:p:r:RS:s:t:X"
 #else
 /**
  * @def RTAS_ERRD_ARGS
@@ -100,13 +108,16 @@ struct event {
 	int			length;    /**< RTAS event length (bytes) */
 	struct rtas_event_hdr	*rtas_hdr; /**< RTAS event header */
 					/**< data read in from proc_erro log */
+	struct rtas_event_hdr	hdr;	/**< rtas_hdr points here */
 	unsigned int		flags;	/**< rtas_Event flags */
 	char			*loc_codes;
 	char			addl_text[ADDL_TEXT_MAX];
 	struct errdata		errdata;
 	struct diag_vpd		diag_vpd;
-	struct rtas_event	*rtas_event;
+	struct rtas_event	*rtas_event; /**< NULL until event_rtas() */
+	struct scn_dir		scn_dir;
 	struct sl_event		*sl_entry;
+	uint64_t		read_time; /**< stats_now() when read */
 };
 
 /* flags for struct event */
@@ -131,7 +142,24 @@ void _dbg(const char *, ...);
 int print_rtas_event(struct event *);
 int platform_log_write(char *, ...);
 void update_epow_status_file(int);
+int wait_proc_error_log(int);
 int read_proc_error_log(char *, int);
+#ifdef DEBUG
+void corpus_report(void);
+#endif
+
+/* archive.c */
+void archive_open(void);
+void archive_close(void);
+int archive_last_seq(void);
+void archive_event(struct event *);
+
+/* scn_dir.c */
+int event_scn_index(struct event *, int);
+struct rtas_event *event_rtas(struct event *);
+int event_has_v6_scn(struct event *, const char *);
+void *event_scn(struct event *, int);
+void event_scn_cleanup(struct event *);
 
 /* dump.c */
 void check_scanlog_dump(void);
@@ -143,11 +171,27 @@ void check_eeh(struct event *);
 /* guard.c */
 void handle_resource_dealloc(struct event *);
 
+/* topology.c */
+void topology_init(void);
+void topology_invalidate(void);
+void topology_free(void);
+int topology_cpu_drc_name(uint32_t, char *, int);
+int topology_mem_drc_name(uint32_t, char *, int);
+int topology_online_lmbs(void);
+
 /* rtas_errd.c */
 int handle_rtas_event(struct event *);
 
 /* update.c */
 void update_rtas_msgs(void);
+void checkpoint_handled(int);
+void checkpoint_flushed(void);
+int read_checkpoint_cursor(char *, int);
+void update_checkpoint_cursor(const char *);
+int handle_recovered_event(struct event *);
+
+/* journal.c */
+int journal_update_rtas_msgs(int);
 
 /* ela.c */
 int process_pre_v6(struct event *);
@@ -160,12 +204,18 @@ int process_v6(struct event *);
 char *get_dt_status(char *);
 char *diag_get_fru_pn(struct event *, char *);
 void free_diag_vpd(struct event *);
+void vpd_cache_init(void);
+void vpd_cache_invalidate(void);
+void vpd_cache_free(void);
 
 /* menugoal.c */
 int menugoal(struct event *, char *);
 
 /* epow.c */
-void epow_timer_handler(int, siginfo_t, void *);
+extern int epow_timer_fd;
+int epow_timer_init(void);
+void epow_timer_expired(void);
+void epow_timer_close(void);
 int check_epow(struct event *);
 
 /* servicelog.c */
@@ -174,16 +224,140 @@ int servicelog_sev(int rtas_sev);
 void add_callout(struct event *event, char pri, int type, char *proc,
 		 char *loc, char *pn, char *sn, char *ccin);
 void log_event(struct event *);
+void log_event_flush(void);
+int log_event_deadline(struct timespec *);
+int log_event_pending(int *);
+void log_event_occurrences(uint64_t, const char *, int, int, int);
 
 /* signal.c */
-void sighup_handler(int, siginfo_t, void *);
-void restore_sigchld_default(void);
-void setup_sigchld_handler(void);
+extern int signal_fd;
+int signals_init(void);
+int handle_signals(void);
+void signals_close(void);
+
+/* helper.c */
+enum helper_type {
+	HELPER_DRMGR,
+	HELPER_POWERFAIL,
+	HELPER_TYPE_MAX
+};
+
+/* status is the waitpid() status of the helper, -1 if it did not run */
+typedef void (*helper_done_t)(int status, void *arg);
+
+extern char *drmgr_program;
+
+int helper_run(int, const char *, const char *, char *const [],
+	       helper_done_t, void *);
+void helper_reap(void);
+void helper_stop(void);
+int helper_stopped(void);
+void helper_drain(void);
 
 /* prrn.c */
 void handle_prrn_event(struct event *);
 
+/* dedup.c */
+#define DEDUP_MAX		64
+#define DEDUP_REFCODE_LEN	32
+
+int dedup_event(struct event *);
+void dedup_logged(int, uint64_t, const char *);
+int dedup_deadline(struct timespec *);
+int dedup_pending(int *);
+void dedup_restore(void);
+void dedup_flush(int);
+
 /* hotplug.c */
 void handle_hotplug_event(struct event *);
+void hotplug_flush(void);
+int hotplug_deadline(struct timespec *);
+int hotplug_pending(int *);
+
+/* stats.c */
+enum stats_stage {
+	STATS_DUMP,
+	STATS_PRINT,
+	STATS_DEALLOC,
+	STATS_EPOW,
+	STATS_EEH,
+	STATS_PRRN,
+	STATS_HOTPLUG,
+	STATS_ELA,
+	STATS_LOG,
+	STATS_SL_COMMIT,
+	STATS_EPOW_ACTION,
+	STATS_DRMGR,
+	STATS_STAGE_MAX
+};
+
+enum stats_counter {
+	STATS_EVENTS,
+	STATS_FAILURES,
+	STATS_PARSE_ERRORS,
+	STATS_READ_RETRIES,
+	STATS_SL_ERRORS,
+	STATS_DEDUP_REPEATS,
+	STATS_DRMGR_RUNS,
+	STATS_COUNTER_MAX
+};
+
+uint64_t stats_now(void);
+void stats_stage(int, uint64_t);
+void stats_event(int, uint64_t, int);
+void stats_count(int);
+void stats_log(void);
+void stats_dump(void);
+int stats_start(void);
+void stats_stop(void);
+
+/* queue.c */
+/**
+ * @def RTAS_EVENT_QUEUE_SZ
+ * @brief Number of RTAS events buffered between the reader and handler
+ */
+#define RTAS_EVENT_QUEUE_SZ	64
+
+struct event_queue_stats {
+	unsigned int	depth;		/**< events waiting to be handled */
+	unsigned int	high_water;	/**< largest depth seen */
+	unsigned long	enqueued;	/**< events read from the kernel */
+	unsigned long	dequeued;	/**< events handed to the handler */
+	unsigned long	full_waits;	/**< times the reader found it full */
+};
+
+extern int event_queue_fd;
+int event_queue_start(void);
+void event_queue_stop(void);
+int event_queue_get(struct event **, int *);
+void event_queue_put(int);
+int event_queue_error(void);
+void event_queue_get_stats(struct event_queue_stats *);
+
+/* spool.c */
+
+/**
+ * @struct spool_repeat
+ * @brief Repeats of an event within its dedup window, see dedup.c
+ */
+struct spool_repeat {
+	uint64_t	sig;		/**< event signature hash */
+	uint64_t	sl_key;		/**< servicelog key of first_seq */
+	int		first_seq;
+	int		last_seq;
+	int		count;		/**< occurrences, including the first */
+	char		refcode[DEDUP_REFCODE_LEN];
+};
+
+extern char *spool_file;
+int spool_open(void);
+int spool_replay(int);
+int spool_commit(struct event *, int);
+void spool_release(int);
+void spool_release_flushed(int);
+int spool_save_repeat(int, struct spool_repeat *);
+void spool_drop_repeat(int);
+int spool_next_repeat(int, struct spool_repeat *);
+void spool_close(void);
 
 #endif /* _RTAS_ERRD_H */
@@ -0,0 +1,441 @@
+/**
+ * @file scn_dir.c
+ * @brief Lazy, indexed access to the sections of an RTAS event
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <librtasevent.h>
+#include "rtas_errd.h"
+
+/*
+ * parse_rtas_event() decodes every section of an event up front, and
+ * each rtas_get_*_scn() call walks the list of decoded sections.  Many
+ * events, e.g. PRRN events or the ones whose handling only looks for a
+ * dump section they do not have, need none of that.
+ *
+ * event_scn_index() only decodes the event header itself and records
+ * where each section of a v6 event is.  event_scn() answers from that
+ * directory when the event does not have a section.  The extended
+ * header and the PH, UH and MT sections, which nearly every event is
+ * asked for, are decoded straight from event_buf.  For any other
+ * section the event is parsed on first use, and the section returned
+ * is cached.
+ */
+
+/*
+ * The v6 section holding each librtasevent section, if known.  Only
+ * the EPOW section is found in events of earlier versions as well.
+ */
+static const char *v6_scn_ids[RTAS_MAX_SCN_ID] = {
+	[RTAS_EPOW_SCN]		= "EP",
+	[RTAS_PRIV_HDR_SCN]	= "PH",
+	[RTAS_USR_HDR_SCN]	= "UH",
+	[RTAS_DUMP_SCN]		= "DH",
+	[RTAS_LRI_SCN]		= "LR",
+	[RTAS_MT_SCN]		= "MT",
+	[RTAS_PSRC_SCN]		= "PS",
+	[RTAS_SSRC_SCN]		= "SS",
+	[RTAS_HP_SCN]		= "HP",
+};
+
+static uint32_t
+get_be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint16_t
+get_be16(const unsigned char *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static void
+decode_date(struct rtas_date *date, const unsigned char *p)
+{
+	date->year = get_be16(p);
+	date->month = p[2];
+	date->day = p[3];
+}
+
+static void
+decode_time(struct rtas_time *time, const unsigned char *p)
+{
+	time->hour = p[0];
+	time->minutes = p[1];
+	time->seconds = p[2];
+	time->hundredths = p[3];
+}
+
+/**
+ * find_v6_scn
+ * @brief Find a v6 section in the section directory
+ *
+ * @return the section, NULL if the event does not have it
+ */
+static struct v6_scn *
+find_v6_scn(struct event *event, const char *id)
+{
+	struct scn_dir *dir = &event->scn_dir;
+	int i;
+
+	for (i = 0; i < dir->nscns; i++)
+		if (!memcmp(dir->scns[i].id, id, 2))
+			return &dir->scns[i];
+
+	return NULL;
+}
+
+/**
+ * scn_decode
+ * @brief Decode a section without having librtasevent parse the event
+ *
+ * Only the fields of the section that rtas_errd reads are filled in,
+ * the others are left zero.  Sections that are shorter than expected
+ * are left to librtasevent.
+ *
+ * @param event event indexed with event_scn_index()
+ * @param scn_id RTAS_*_SCN id of the section
+ * @param scn buffer for the section, NULL if the event does not have it
+ * @return 1 if the section was decoded, 0 if the event has to be parsed
+ */
+static int
+scn_decode(struct event *event, int scn_id, void **scn)
+{
+	struct scn_dir *dir = &event->scn_dir;
+	struct rtas_event_hdr *hdr = event->rtas_hdr;
+	unsigned char *buf = (unsigned char *)event->event_buf;
+	unsigned char *p;
+	struct v6_scn *v6;
+
+	*scn = NULL;
+
+	if (scn_id == RTAS_EVENT_EXT_HDR) {
+		struct rtas_event_exthdr *exthdr = &dir->exthdr;
+
+		if (!hdr->extended)
+			return 1;
+		if (event->length < (hdr->version < 6 ?
+				     EXTHDR_OFFSET + PRE_V6_EXTHDR_LEN :
+				     V6_SCN_START))
+			return 0;
+
+		p = buf + EXTHDR_OFFSET;
+		memset(exthdr, 0, sizeof(*exthdr));
+		exthdr->unrecoverable = (p[0] & 0x40) != 0;
+		exthdr->recoverable = (p[0] & 0x20) != 0;
+		exthdr->unrecoverable_bypassed = (p[0] & 0x10) != 0;
+		exthdr->predictive = (p[0] & 0x08) != 0;
+		exthdr->power_pc = (p[2] & 0x80) != 0;
+
+		/* v6 events keep the time in the PH section */
+		if (hdr->version < 6) {
+			decode_time(&exthdr->time, p + 4);
+			decode_date(&exthdr->date, p + 8);
+		}
+
+		*scn = exthdr;
+		return 1;
+	}
+
+	if (hdr->version != 6 || dir->nscns < 0)
+		return 0;
+
+	switch (scn_id) {
+	case RTAS_PRIV_HDR_SCN: {
+		struct rtas_priv_hdr_scn *privhdr = &dir->privhdr;
+
+		v6 = find_v6_scn(event, "PH");
+		if (v6 == NULL)
+			return 1;
+		if (v6->length < V6_PH_LEN)
+			return 0;
+
+		p = buf + v6->offset;
+		memset(privhdr, 0, sizeof(*privhdr));
+		decode_date(&privhdr->date, p + 8);
+		decode_time(&privhdr->time, p + 12);
+		privhdr->creator_id = p[24];
+		privhdr->plid = get_be32(p + 40);
+
+		*scn = privhdr;
+		return 1;
+	}
+
+	case RTAS_USR_HDR_SCN: {
+		struct rtas_usr_hdr_scn *usrhdr = &dir->usrhdr;
+
+		v6 = find_v6_scn(event, "UH");
+		if (v6 == NULL)
+			return 1;
+		if (v6->length < V6_UH_LEN)
+			return 0;
+
+		p = buf + v6->offset;
+		memset(usrhdr, 0, sizeof(*usrhdr));
+		usrhdr->subsystem_id = p[8];
+		usrhdr->event_severity = p[10];
+		usrhdr->event_type = p[11];
+		usrhdr->action = get_be16(p + 18);
+
+		*scn = usrhdr;
+		return 1;
+	}
+
+	case RTAS_MT_SCN: {
+		struct rtas_mt_scn *mt = &dir->mt;
+
+		v6 = find_v6_scn(event, "MT");
+		if (v6 == NULL)
+			return 1;
+		if (v6->length < V6_MT_LEN)
+			return 0;
+
+		p = buf + v6->offset;
+		memset(mt, 0, sizeof(*mt));
+		memcpy(mt->mtms.model, p + 8, 8);
+		memcpy(mt->mtms.serial_no, p + 16, 12);
+
+		*scn = mt;
+		return 1;
+	}
+	}
+
+	return 0;
+}
+
+/**
+ * index_v6_scns
+ * @brief Record the offset and length of each section of a v6 event
+ */
+static void
+index_v6_scns(struct event *event)
+{
+	struct scn_dir *dir = &event->scn_dir;
+	unsigned char *buf = (unsigned char *)event->event_buf;
+	int offset = V6_SCN_START, len;
+
+	dir->nscns = 0;
+	while (offset + V6_SCN_HDR_LEN <= event->length) {
+		len = buf[offset + 2] << 8 | buf[offset + 3];
+
+		/* Not something that can be trusted to leave sections out */
+		if (len < V6_SCN_HDR_LEN || offset + len > event->length ||
+		    dir->nscns == V6_SCN_MAX) {
+			dir->nscns = -1;
+			return;
+		}
+
+		memcpy(dir->scns[dir->nscns].id, buf + offset, 2);
+		dir->scns[dir->nscns].offset = offset;
+		dir->scns[dir->nscns].length = len;
+		dir->nscns++;
+
+		offset += len;
+	}
+}
+
+/**
+ * event_scn_index
+ * @brief Decode the header of an event and index its sections
+ *
+ * Sets event->rtas_hdr and event->length.  Nothing else is decoded
+ * until a section is asked for with event_scn().
+ *
+ * @param event event with seq_num and event_buf filled in
+ * @param buflen number of bytes read for the event
+ * @return 0 on success, -1 if the event is too short to have a header
+ */
+int
+event_scn_index(struct event *event, int buflen)
+{
+	struct scn_dir *dir = &event->scn_dir;
+	struct rtas_event_hdr *hdr = &event->hdr;
+	unsigned char *buf = (unsigned char *)event->event_buf;
+	uint32_t ext_len;
+
+	memset(dir, 0, sizeof(*dir));
+	dir->buflen = buflen;
+	dir->nscns = -1;
+	event->rtas_event = NULL;
+	event->rtas_hdr = NULL;
+
+	if (buflen < 8)
+		return -1;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->version = buf[0];
+	hdr->severity = buf[1] >> 5;
+	hdr->disposition = (buf[1] >> 3) & 0x3;
+	hdr->extended = (buf[1] >> 2) & 0x1;
+	hdr->initiator = buf[2] >> 4;
+	hdr->target = buf[2] & 0xf;
+	hdr->type = buf[3];
+	hdr->ext_log_length = ext_len = get_be32(buf + 4);
+
+	event->rtas_hdr = hdr;
+	event->length = ext_len > RTAS_ERROR_LOG_MAX - 8 ?
+					RTAS_ERROR_LOG_MAX : ext_len + 8;
+
+	if (hdr->version == 6 && hdr->extended)
+		index_v6_scns(event);
+
+	return 0;
+}
+
+/**
+ * event_rtas
+ * @brief Retrieve the event as parsed by librtasevent
+ *
+ * The event is parsed on the first call only.
+ *
+ * @param event event indexed with event_scn_index()
+ * @return the parsed event, NULL if it could not be parsed
+ */
+struct rtas_event *
+event_rtas(struct event *event)
+{
+	struct scn_dir *dir = &event->scn_dir;
+
+	if (!dir->parsed) {
+		dir->parsed = 1;
+		event->rtas_event = parse_rtas_event(event->event_buf,
+						     dir->buflen);
+		if (event->rtas_event == NULL)
+			dir->parse_failed = 1;
+	}
+
+	return event->rtas_event;
+}
+
+static void *
+scn_get(struct rtas_event *re, int scn_id)
+{
+	switch (scn_id) {
+	case RTAS_EVENT_EXT_HDR:
+		return rtas_get_event_exthdr_scn(re);
+	case RTAS_EPOW_SCN:
+		return rtas_get_epow_scn(re);
+	case RTAS_IO_SCN:
+		return rtas_get_io_scn(re);
+	case RTAS_CPU_SCN:
+		return rtas_get_cpu_scn(re);
+	case RTAS_MEM_SCN:
+		return rtas_get_mem_scn(re);
+	case RTAS_POST_SCN:
+		return rtas_get_post_scn(re);
+	case RTAS_IBM_SP_SCN:
+		return rtas_get_ibm_sp_scn(re);
+	case RTAS_PRIV_HDR_SCN:
+		return rtas_get_priv_hdr_scn(re);
+	case RTAS_USR_HDR_SCN:
+		return rtas_get_usr_hdr_scn(re);
+	case RTAS_DUMP_SCN:
+		return rtas_get_dump_scn(re);
+	case RTAS_LRI_SCN:
+		return rtas_get_lri_scn(re);
+	case RTAS_MT_SCN:
+		return rtas_get_mt_scn(re);
+	case RTAS_PSRC_SCN:
+		return rtas_get_src_scn(re);
+	case RTAS_HP_SCN:
+		return rtas_get_hotplug_scn(re);
+	}
+
+	return NULL;
+}
+
+/**
+ * event_has_v6_scn
+ * @brief Check the section directory for a v6 section
+ *
+ * @param event event indexed with event_scn_index()
+ * @param id two character section id
+ * @return 1 if the event has the section, 0 if it does not, -1 if the
+ *	directory cannot tell
+ */
+int
+event_has_v6_scn(struct event *event, const char *id)
+{
+	if (event->scn_dir.nscns < 0)
+		return -1;
+
+	return find_v6_scn(event, id) != NULL;
+}
+
+/**
+ * event_scn
+ * @brief Retrieve a section of an event
+ *
+ * Equivalent to the rtas_get_*_scn() call for scn_id on the parsed
+ * event, without parsing the event for a v6 section it does not have.
+ *
+ * @param event event indexed with event_scn_index()
+ * @param scn_id RTAS_*_SCN id of the section
+ * @return the section, NULL if the event does not have it
+ */
+void *
+event_scn(struct event *event, int scn_id)
+{
+	struct scn_dir *dir = &event->scn_dir;
+	struct rtas_event *re;
+
+	if (scn_id <= 0 || scn_id >= RTAS_MAX_SCN_ID)
+		return NULL;
+
+	if (dir->looked_up & (1 << scn_id))
+		return dir->cache[scn_id];
+
+	dir->looked_up |= 1 << scn_id;
+	dir->cache[scn_id] = NULL;
+
+	if (scn_decode(event, scn_id, &dir->cache[scn_id]))
+		return dir->cache[scn_id];
+
+	if (v6_scn_ids[scn_id] != NULL) {
+		if (event->rtas_hdr->version < 6 && scn_id != RTAS_EPOW_SCN)
+			return NULL;
+		if (event_has_v6_scn(event, v6_scn_ids[scn_id]) == 0)
+			return NULL;
+	}
+
+	re = event_rtas(event);
+	if (re != NULL)
+		dir->cache[scn_id] = scn_get(re, scn_id);
+
+	return dir->cache[scn_id];
+}
+
+/**
+ * event_scn_cleanup
+ * @brief Free the parsed event, if it was parsed
+ */
+void
+event_scn_cleanup(struct event *event)
+{
+	if (event->rtas_event != NULL)
+		cleanup_rtas_event(event->rtas_event);
+
+	event->rtas_event = NULL;
+	event->scn_dir.parsed = 0;
+	event->scn_dir.looked_up = 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file scn_dir.h
+ * @brief Section directory of an RTAS event
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _SCN_DIR_H
+#define _SCN_DIR_H
+
+#include <stdint.h>
+#include <librtasevent.h>
+
+/*
+ * The sections of a version 6 event follow the event header, the
+ * extended log header and the "IBM" company id, each starting with a
+ * two character id and a big endian length.
+ */
+#define V6_SCN_START		24
+#define V6_SCN_HDR_LEN		8
+#define V6_SCN_MAX		32
+
+/* Layout of the sections that scn_decode() decodes itself */
+#define EXTHDR_OFFSET		8
+#define PRE_V6_EXTHDR_LEN	12	/* flags, time and date */
+#define V6_PH_LEN		48
+#define V6_UH_LEN		20	/* up to the action flags */
+#define V6_MT_LEN		28
+
+struct v6_scn {
+	char		id[2];
+	uint16_t	offset;		/**< in event_buf */
+	uint16_t	length;
+};
+
+/**
+ * @struct scn_dir
+ * @brief Where the sections of an event are, and the ones decoded so far
+ *
+ * Built by event_scn_index() in one pass over event_buf.  The event is
+ * only parsed by librtasevent once a section that it has is asked for
+ * with event_scn(), and every section is looked up only once.
+ */
+struct scn_dir {
+	int			buflen;	/**< for parse_rtas_event() */
+	int			nscns;	/**< -1 if not a v6 event, or the
+					     sections could not be walked */
+	struct v6_scn		scns[V6_SCN_MAX];
+	int			parsed;	/**< parse_rtas_event() was called */
+	int			parse_failed;
+	uint32_t		looked_up; /**< bitmap of valid cache[] */
+	void			*cache[RTAS_MAX_SCN_ID];
+
+	/* Sections decoded straight from event_buf, see scn_decode() */
+	struct rtas_event_exthdr	exthdr;
+	struct rtas_priv_hdr_scn	privhdr;
+	struct rtas_usr_hdr_scn		usrhdr;
+	struct rtas_mt_scn		mt;
+};
+
+#endif /* _SCN_DIR_H */
@@ -52,7 +52,7 @@ get_event_date(struct event *event)
 
 	if (event->rtas_hdr->version == 6) {
 		struct rtas_priv_hdr_scn *privhdr;
-		privhdr = rtas_get_priv_hdr_scn(event->rtas_event);
+		privhdr = event_scn(event, RTAS_PRIV_HDR_SCN);
 
 		if (privhdr == NULL) {
 			log_msg(event, "Could not parse RTAS event to "
@@ -63,7 +63,7 @@ get_event_date(struct event *event)
 		}
 	} else {
 		struct rtas_event_exthdr *exthdr;
-		exthdr = rtas_get_event_exthdr_scn(event->rtas_event);
+		exthdr = event_scn(event, RTAS_EVENT_EXT_HDR);
 
 		if (exthdr == NULL) {
 			log_msg(event, "Could not parse RTAS event to "
@@ -206,6 +206,198 @@ mem_fail:
 	return;
 }
 
+/*
+ * Every servicelog_event_log() call is its own database transaction,
+ * and so its own fsync.  To keep the handling of a burst of low
+ * severity events from waiting on disk latency for each of them,
+ * log_event() queues the servicelog entries and they are logged after
+ * the burst: once ServicelogBatchSize entries are queued,
+ * ServicelogBatchTimeout milliseconds after the first one was queued,
+ * or as soon as an entry more severe than ServicelogFlushSeverity is
+ * queued.
+ */
+#define SL_BATCH_MAX	64
+
+static struct sl_event	*sl_batch[SL_BATCH_MAX];
+static int		sl_batch_seq[SL_BATCH_MAX];
+static int		sl_batch_count = 0;
+static struct timespec	sl_batch_deadline;
+
+/**
+ * sl_batch_size
+ * @brief Number of servicelog entries to collect before committing
+ */
+static int
+sl_batch_size(void)
+{
+	if (d_cfg.sl_batch_size > SL_BATCH_MAX)
+		return SL_BATCH_MAX;
+
+	return d_cfg.sl_batch_size;
+}
+
+/**
+ * sl_batch_log_one
+ * @brief Log a single queued entry in the servicelog DB
+ *
+ * @param i index of the entry in the batch
+ * @return 0 on success, !0 on failure
+ */
+static int
+sl_batch_log_one(int i)
+{
+	uint64_t key;
+	int rc;
+
+	rc = servicelog_event_log(slog, sl_batch[i], &key);
+	if (rc) {
+		stats_count(STATS_SL_ERRORS);
+		log_msg(NULL, "Could not log RTAS event %d to servicelog.\n"
+			"%s\n", sl_batch_seq[i], servicelog_error(slog));
+	} else {
+		log_msg(NULL, "RTAS event %d servicelog key %llu",
+			sl_batch_seq[i], key);
+		dedup_logged(sl_batch_seq[i], key, sl_batch[i]->refcode);
+	}
+
+	return rc;
+}
+
+/**
+ * log_event_flush
+ * @brief Commit any queued servicelog entries
+ */
+void
+log_event_flush(void)
+{
+	struct timespec start, end;
+	uint64_t commit_start;
+	long usecs;
+	int i;
+
+	if (sl_batch_count == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	commit_start = stats_now();
+
+	for (i = 0; i < sl_batch_count; i++)
+		sl_batch_log_one(i);
+
+	stats_stage(STATS_SL_COMMIT, commit_start);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usecs = (end.tv_sec - start.tv_sec) * 1000000 +
+		(end.tv_nsec - start.tv_nsec) / 1000;
+	dbg("Committed %d servicelog entries (RTAS events %d-%d) in "
+	    "%ld.%06ld seconds", sl_batch_count, sl_batch_seq[0],
+	    sl_batch_seq[sl_batch_count - 1], usecs / 1000000,
+	    usecs % 1000000);
+
+	for (i = 0; i < sl_batch_count; i++) {
+		servicelog_event_free(sl_batch[i]);
+		sl_batch[i] = NULL;
+	}
+	sl_batch_count = 0;
+}
+
+/**
+ * log_event_occurrences
+ * @brief Log how often an event occurred to servicelog
+ *
+ * libservicelog cannot update an event, so the count goes into an
+ * informational entry of its own, with the refcode of the first
+ * occurrence and naming its servicelog key.
+ *
+ * @param key servicelog key of the first occurrence
+ * @param refcode refcode of the first occurrence, may be empty
+ * @param count number of occurrences
+ * @param first_seq RTAS event number of the first occurrence
+ * @param last_seq RTAS event number of the last occurrence
+ */
+void
+log_event_occurrences(uint64_t key, const char *refcode, int count,
+		      int first_seq, int last_seq)
+{
+	struct sl_event *entry;
+	char desc[256];
+	uint64_t new_key;
+	int rc;
+
+	if (slog == NULL)
+		return;
+
+	snprintf(desc, sizeof(desc), "RTAS event %d (servicelog event %llu) "
+		 "occurred %d times, from RTAS event %d to RTAS event %d.  "
+		 "The repeats were not logged to servicelog.", first_seq,
+		 (unsigned long long)key, count, first_seq, last_seq);
+
+	entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		log_msg(NULL, "Memory allocation failed");
+		return;
+	}
+
+	entry->time_event = time(NULL);
+	entry->type = SL_TYPE_BASIC;
+	entry->severity = SL_SEV_INFO;
+	entry->disposition = SL_DISP_RECOVERABLE;
+	entry->call_home_status = SL_CALLHOME_NONE;
+	entry->refcode = strdup(refcode);
+	entry->description = strdup(desc);
+	if (entry->refcode == NULL || entry->description == NULL) {
+		log_msg(NULL, "Memory allocation failed");
+		servicelog_event_free(entry);
+		return;
+	}
+
+	rc = servicelog_event_log(slog, entry, &new_key);
+	if (rc) {
+		stats_count(STATS_SL_ERRORS);
+		log_msg(NULL, "Could not log the occurrences of RTAS event %d "
+			"to servicelog.\n%s\n", first_seq,
+			servicelog_error(slog));
+	} else {
+		log_msg(NULL, "Occurrences of RTAS event %d servicelog key "
+			"%llu", first_seq, new_key);
+	}
+
+	servicelog_event_free(entry);
+}
+
+/**
+ * log_event_deadline
+ * @brief Retrieve the time by which queued entries must be committed
+ *
+ * @param deadline buffer for the CLOCK_MONOTONIC deadline
+ * @return 1 if entries are queued, 0 otherwise
+ */
+int
+log_event_deadline(struct timespec *deadline)
+{
+	if (sl_batch_count == 0)
+		return 0;
+
+	*deadline = sl_batch_deadline;
+	return 1;
+}
+
+/**
+ * log_event_pending
+ * @brief Retrieve the first event whose entry is not committed yet
+ *
+ * @param seq_num buffer for the RTAS event number
+ * @return 1 if entries are queued, 0 otherwise
+ */
+int
+log_event_pending(int *seq_num)
+{
+	if (sl_batch_count == 0)
+		return 0;
+
+	*seq_num = sl_batch_seq[0];
+	return 1;
+}
+
 /**
  * log_event
  * @brief log the event in the servicelog DB
@@ -216,8 +408,7 @@ void
 log_event(struct event *event)
 {
 	struct rtas_dump_scn *scn_dump;
-	uint64_t key;
-	int rc, txtlen;
+	int txtlen;
 
 	/* If the DB isn't available, do nothing */
 	if (slog == NULL)
@@ -230,7 +421,7 @@ log_event(struct event *event)
 	}
 
 	if (event->flags & RE_PLATDUMP_AVAIL) {
-		if ((scn_dump = rtas_get_dump_scn(event->rtas_event)) != NULL) {
+		if ((scn_dump = event_scn(event, RTAS_DUMP_SCN)) != NULL) {
 			char filename[41];
 			uint64_t dump_size = 0;
 
@@ -276,13 +467,25 @@ log_event(struct event *event)
 		}
 	}
 
-	/* Log the event in the servicelog */
-	rc = servicelog_event_log(slog, event->sl_entry, &key);
-	servicelog_event_free(event->sl_entry);
+	/* Queue the event to be logged in the servicelog */
+	if (sl_batch_count == 0) {
+		long timeout = d_cfg.sl_batch_timeout;
 
-	if (rc)
-		log_msg(event, "Could not log event to servicelog.\n%s\n",
-			servicelog_error(slog));
-	else
-		log_msg(event, "servicelog key %llu", key);
+		clock_gettime(CLOCK_MONOTONIC, &sl_batch_deadline);
+		sl_batch_deadline.tv_sec += timeout / 1000;
+		sl_batch_deadline.tv_nsec += (timeout % 1000) * 1000000;
+		if (sl_batch_deadline.tv_nsec >= 1000000000) {
+			sl_batch_deadline.tv_sec++;
+			sl_batch_deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	sl_batch[sl_batch_count] = event->sl_entry;
+	sl_batch_seq[sl_batch_count] = event->seq_num;
+	sl_batch_count++;
+	event->sl_entry = NULL;
+
+	if ((sl_batch_count >= sl_batch_size()) ||
+	    (sl_batch[sl_batch_count - 1]->severity > d_cfg.sl_flush_severity))
+		log_event_flush();
 }
@@ -21,89 +21,152 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
 
 #include "rtas_errd.h"
 
+/*
+ * SIGHUP, SIGCHLD, SIGUSR1, SIGTERM and SIGINT are never delivered to a
+ * handler; they are blocked in every thread and read from signal_fd by
+ * the main event loop in read_rtas_events().  This means a config
+ * reload, a statistics dump or the reaping of children never
+ * interrupts the handling of an event, and
+ * there is no SIGCHLD handler to race with the waitpid() of spclose()
+ * and friends.
+ */
+
 /**
- * sighup_handler
- * @brief signal handler for SIGHUP
- *
- * The SIGHUP signal will cause the rtas_errd daemon to re-read
- * the configuration file.  If it is currently safe to re-configure
- * ourselves we do, otherwise we set a flag to indicate that a
- * re-configuration needs to occur at the next "safe" place
+ * @var signal_fd
+ * @brief signalfd the loop reads SIGHUP, SIGCHLD, SIGUSR1, SIGTERM and
+ * SIGINT from
  */
-void
-sighup_handler(int sig, siginfo_t siginfo, void *context)
+int signal_fd = -1;
+
+static void
+loop_sigset(sigset_t *set)
 {
-	if (d_cfg.flags & RE_CFG_RECFG_SAFE)
-		diag_cfg(1, &cfg_log);
-	else
-		d_cfg.flags |= RE_CFG_RECEIVED_SIGHUP;
+	sigemptyset(set);
+	sigaddset(set, SIGHUP);
+	sigaddset(set, SIGCHLD);
+	sigaddset(set, SIGUSR1);
+	sigaddset(set, SIGTERM);
+	sigaddset(set, SIGINT);
 }
 
 /**
- * sigchld_handler
- * @brief SIGCHLD handler.
+ * child_sigmask
+ * @brief Start forked children with no signals blocked
  *
- * Cleanup child process when it exited.
+ * The signal mask is inherited across fork() and exec(), and programs
+ * such as drmgr, lsvpd or extract_platdump must not start with SIGTERM,
+ * or any other signal a thread of ours happened to block when it
+ * forked, blocked.
  */
 static void
-sigchld_handler(int sig)
+child_sigmask(void)
 {
-	/* Wait for all dead processes.
-	 * We use a non-blocking call to be sure this signal handler will not
-	 * block if a child was cleaned up in another part of the program.
-	 */
-	while (waitpid(-1, NULL, WNOHANG) > 0) {
-	}
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigprocmask(SIG_SETMASK, &set, NULL);
 }
 
 /**
- * restore_sigchld_default
- * @brief restore child signal handler
+ * signals_init
+ * @brief Block the loop signals and set up signal_fd to read them
+ *
+ * Must be called before any other thread is started, so that all of
+ * them inherit the blocked signals.
  *
- * Restores child signal handler to default action.
+ * @return 0 on success, -1 on failure
  */
-void
-restore_sigchld_default(void)
+int
+signals_init(void)
 {
-	struct sigaction old_sigact;
 	struct sigaction sigact;
+	sigset_t set;
 
-	sigaction(SIGCHLD, NULL, &old_sigact);
-	if (old_sigact.sa_handler != SIG_DFL ) {
-		sigact.sa_handler = SIG_DFL;
-		sigemptyset(&sigact.sa_mask);
-		sigact.sa_flags = SA_RESTART;
-		if (sigaction(SIGCHLD, &sigact, NULL)) {
-			log_msg(NULL, "Could not restore SIGCHLD signal "
-				"handler to default action, %s",
-				strerror(errno));
-		}
+	/* Ignore SIGPIPE */
+	sigact.sa_handler = SIG_IGN;
+	sigemptyset(&sigact.sa_mask);
+	sigact.sa_flags = SA_RESTART;
+	if (sigaction(SIGPIPE, &sigact, NULL))
+		log_msg(NULL, "Cannot ignore SIGPIPE, %s", strerror(errno));
+
+	loop_sigset(&set);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	signal_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signal_fd == -1) {
+		log_msg(NULL, "Could not set up signal handling (signalfd), "
+			"%s", strerror(errno));
+		sigprocmask(SIG_UNBLOCK, &set, NULL);
+		return -1;
 	}
+
+	pthread_atfork(NULL, NULL, child_sigmask);
+
+	return 0;
 }
 
 /**
- * setup_sigchld_handler
- * @brief setup child signal handler
+ * handle_signals
+ * @brief Act on the signals queued on signal_fd
  *
- * Setup custom child signal handler to cleanup
- * child processes when it exited.
+ * SIGHUP re-reads the configuration file, SIGCHLD completes the
+ * helpers that exited (see helper.c), SIGUSR1 dumps the statistics.
+ *
+ * @return 1 if SIGTERM or SIGINT was received, 0 otherwise
  */
-void
-setup_sigchld_handler(void)
+int
+handle_signals(void)
 {
-	struct sigaction sigact;
-	sigact.sa_handler = (void *)sigchld_handler;
-	sigemptyset(&sigact.sa_mask);
-	sigact.sa_flags = SA_RESTART;
-	if (sigaction(SIGCHLD, &sigact, NULL)) {
-		log_msg(NULL, "Could not initialize signal handler for"
-			"cleaning up child processes, %s", strerror(errno));
+	struct signalfd_siginfo si;
+	int terminate = 0;
+
+	while (read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+		switch (si.ssi_signo) {
+		case SIGHUP:
+			log_msg(NULL, "Received SIGHUP, re-reading the "
+				"configuration file");
+			diag_cfg(1, &cfg_log);
+			break;
+
+		case SIGCHLD:
+			helper_reap();
+			break;
+
+		case SIGUSR1:
+			stats_dump();
+			break;
+
+		case SIGTERM:
+		case SIGINT:
+			log_msg(NULL, "Received %s, flushing queued events",
+				si.ssi_signo == SIGTERM ? "SIGTERM" : "SIGINT");
+			helper_stop();
+			terminate = 1;
+			break;
+		}
 	}
+
+	return terminate;
+}
+
+/**
+ * signals_close
+ * @brief Close signal_fd
+ */
+void
+signals_close(void)
+{
+	if (signal_fd != -1)
+		close(signal_fd);
+	signal_fd = -1;
 }
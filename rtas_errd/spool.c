@@ -0,0 +1,543 @@
+/**
+ * @file spool.c
+ * @brief Crash safe spool of RTAS events read but not yet handled
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rtas_errd.h"
+
+/*
+ * Once an event has been read from the kernel, the kernel no longer
+ * has it.  Before it is queued for handling, the reader thread copies
+ * it into a slot of spool_file, a memory mapped file, and syncs it to
+ * disk.  Once the event has been handled, its slot is only freed when
+ * the work queued for it is committed as well: its servicelog entry,
+ * a drmgr run it was merged into and the repeat record of an event it
+ * was deduplicated against (see checkpoint_flushed()).  The
+ * next start of rtas_errd replays the events left in the spool, e.g.
+ * by a crash, ahead of any it recovers from syslog.
+ *
+ * A slot is committed in two steps: the event and its generation
+ * number are written and synced first, and only then the state of the
+ * slot is set to SPOOL_COMMITTED and synced, so a slot is either
+ * complete or free after a crash.  Releasing a slot is not synced; an
+ * event that is found in the spool but was already handled is skipped
+ * on replay because of its event number.  The file is in host byte
+ * order, it never leaves the machine.
+ *
+ * Repeats of an event are only recorded when their dedup window closes,
+ * up to a minute later.  Rather than keep the slots of every event from
+ * the first repeat on until then, which a burst of events fills, the
+ * dedup table saves the repeats seen so far in a record of its own,
+ * after the slots, and the next start picks them up (see
+ * dedup_restore()).
+ *
+ * SPOOL_SLOTS is not tied to the event queue: besides the events
+ * queued, slots hold the handled events whose servicelog entry or
+ * drmgr run is still pending.
+ *
+ * Version 1 of the file had no repeat records; it is extended in place
+ * so that the events left in it are still replayed.
+ */
+#define SPOOL_MAGIC		"RTASSPOL"
+#define SPOOL_VERSION		2
+#define SPOOL_SLOTS		128
+#define SPOOL_REPEATS		DEDUP_MAX
+
+#define SPOOL_FREE		0
+#define SPOOL_FILLING		1
+#define SPOOL_COMMITTED		0x434d4954	/* "CMIT" */
+
+struct spool_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	slots;
+	uint32_t	slot_size;
+	uint32_t	reserved;
+};
+
+struct spool_slot {
+	uint32_t	state;		/**< SPOOL_* */
+	uint32_t	seq_num;
+	uint32_t	len;
+	uint32_t	reserved;
+	uint64_t	gen;		/**< order the events were read in */
+	char		data[RTAS_ERROR_LOG_MAX];
+};
+
+struct spool_repeat_rec {
+	uint32_t		state;	/**< SPOOL_* */
+	uint32_t		reserved;
+	struct spool_repeat	repeat;
+};
+
+/**
+ * @var spool_file
+ * @brief File events are spooled to, NULL to not spool them
+ */
+char *spool_file = "/var/log/rtas_errd.spool";
+
+static char *spool_map = NULL;
+static size_t spool_size;
+static size_t page_size;
+static uint64_t spool_gen;
+static int spool_full_logged = 0;
+/* Slots of handled events, owned by the main thread */
+static char spool_handled[SPOOL_SLOTS];
+
+static pthread_mutex_t spool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define SPOOL_DATA_OFFSET	4096	/* header gets a page to itself */
+
+#define SPOOL_V1_SIZE		(SPOOL_DATA_OFFSET + \
+				 SPOOL_SLOTS * sizeof(struct spool_slot))
+
+static struct spool_slot *
+spool_slot(int i)
+{
+	return (struct spool_slot *)(spool_map + SPOOL_DATA_OFFSET) + i;
+}
+
+/* Repeat records are owned by the main thread, they need no lock */
+static struct spool_repeat_rec *
+spool_repeat_rec(int i)
+{
+	return (struct spool_repeat_rec *)(spool_map + SPOOL_V1_SIZE) + i;
+}
+
+/**
+ * spool_sync
+ * @brief Sync part of the spool to disk
+ */
+static int
+spool_sync(void *addr, size_t len)
+{
+	uintptr_t start = (uintptr_t)addr & ~(page_size - 1);
+
+	return msync((void *)start, (uintptr_t)addr + len - start, MS_SYNC);
+}
+
+/**
+ * spool_open
+ * @brief Map spool_file, creating it if needed
+ *
+ * A spool that does not match the current format is started afresh.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int
+spool_open(void)
+{
+	struct spool_hdr *hdr;
+	struct stat sbuf;
+	int fd = -1, i, fresh = 0;
+
+	if (spool_file == NULL)
+		return 0;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	spool_size = SPOOL_V1_SIZE +
+		     SPOOL_REPEATS * sizeof(struct spool_repeat_rec);
+
+	fd = open(spool_file, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd < 0 || fstat(fd, &sbuf))
+		goto error;
+
+	if (sbuf.st_size == SPOOL_V1_SIZE) {
+		/* Add the repeat records, zeroed and so free */
+		if (ftruncate(fd, spool_size))
+			goto error;
+	} else if (sbuf.st_size != spool_size) {
+		if (ftruncate(fd, 0) || ftruncate(fd, spool_size))
+			goto error;
+		fresh = 1;
+	}
+
+	spool_map = mmap(NULL, spool_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 fd, 0);
+	if (spool_map == MAP_FAILED) {
+		spool_map = NULL;
+		goto error;
+	}
+	close(fd);
+	fd = -1;
+
+	hdr = (struct spool_hdr *)spool_map;
+	if (!fresh && (memcmp(hdr->magic, SPOOL_MAGIC, sizeof(hdr->magic)) ||
+		       (hdr->version != SPOOL_VERSION && hdr->version != 1) ||
+		       hdr->slots != SPOOL_SLOTS ||
+		       hdr->slot_size != sizeof(struct spool_slot))) {
+		log_msg(NULL, "Discarding %s, it is not a valid event spool",
+			spool_file);
+		memset(spool_map, 0, spool_size);
+		fresh = 1;
+	}
+
+	if (!fresh && hdr->version != SPOOL_VERSION) {
+		hdr->version = SPOOL_VERSION;
+		if (msync(spool_map, spool_size, MS_SYNC))
+			goto error;
+	}
+
+	if (fresh) {
+		memcpy(hdr->magic, SPOOL_MAGIC, sizeof(hdr->magic));
+		hdr->version = SPOOL_VERSION;
+		hdr->slots = SPOOL_SLOTS;
+		hdr->slot_size = sizeof(struct spool_slot);
+		if (msync(spool_map, spool_size, MS_SYNC))
+			goto error;
+	}
+
+	for (i = 0; i < SPOOL_SLOTS; i++) {
+		/* Slots that were being filled in hold nothing */
+		if (spool_slot(i)->state != SPOOL_COMMITTED)
+			spool_slot(i)->state = SPOOL_FREE;
+		else if (spool_slot(i)->gen > spool_gen)
+			spool_gen = spool_slot(i)->gen;
+	}
+
+	for (i = 0; i < SPOOL_REPEATS; i++)
+		if (spool_repeat_rec(i)->state != SPOOL_COMMITTED)
+			spool_repeat_rec(i)->state = SPOOL_FREE;
+
+	return 0;
+
+error:
+	log_msg(NULL, "Could not open the event spool %s, %s.  RTAS events "
+		"will not be spooled", spool_file, strerror(errno));
+	if (spool_map != NULL)
+		munmap(spool_map, spool_size);
+	spool_map = NULL;
+	if (fd >= 0)
+		close(fd);
+	return -1;
+}
+
+static int
+cmp_gen(const void *a, const void *b)
+{
+	uint64_t ga = spool_slot(*(const int *)a)->gen;
+	uint64_t gb = spool_slot(*(const int *)b)->gen;
+
+	return ga < gb ? -1 : ga > gb;
+}
+
+/**
+ * spool_free
+ * @brief Free a spool slot
+ *
+ * @param i spool slot returned by spool_commit()
+ */
+static void
+spool_free(int i)
+{
+	pthread_mutex_lock(&spool_lock);
+	spool_slot(i)->state = SPOOL_FREE;
+	spool_handled[i] = 0;
+	spool_full_logged = 0;
+	pthread_mutex_unlock(&spool_lock);
+}
+
+/**
+ * spool_replay
+ * @brief Handle the events left in the spool by the last run
+ *
+ * Events are handled in the order they were read from the kernel.
+ * Every spooled event is released afterwards, whether it could be
+ * handled or not, so that an event that cannot be handled does not
+ * stop rtas_errd from starting over and over again.  As for events
+ * read from the kernel, the slot of a handled event is only freed
+ * once its queued work is committed.
+ *
+ * @param last_seq number of the last event known to have been handled;
+ *	spooled events up to it are skipped
+ * @return number of the last event handled, or last_seq
+ */
+int
+spool_replay(int last_seq)
+{
+	struct spool_slot *slot;
+	struct event *event;
+	int order[SPOOL_SLOTS];
+	int i, n = 0;
+
+	if (spool_map == NULL)
+		return last_seq;
+
+	for (i = 0; i < SPOOL_SLOTS; i++)
+		if (spool_slot(i)->state == SPOOL_COMMITTED)
+			order[n++] = i;
+
+	if (n == 0)
+		return last_seq;
+
+	qsort(order, n, sizeof(order[0]), cmp_gen);
+	log_msg(NULL, "Replaying %d RTAS events from %s", n, spool_file);
+
+	event = malloc(sizeof(*event));
+	for (i = 0; i < n; i++) {
+		slot = spool_slot(order[i]);
+
+		if (event == NULL || (int)slot->seq_num <= last_seq ||
+		    slot->len > RTAS_ERROR_LOG_MAX) {
+			dbg("Skipping spooled RTAS event %u", slot->seq_num);
+		} else {
+			memset(event, 0, sizeof(*event));
+			event->seq_num = slot->seq_num;
+			memcpy(event->event_buf, slot->data, slot->len);
+			if (handle_recovered_event(event) == 0) {
+				last_seq = event->seq_num;
+				spool_release(order[i]);
+				continue;
+			}
+		}
+
+		spool_free(order[i]);
+	}
+	free(event);
+
+	return last_seq;
+}
+
+/**
+ * spool_commit
+ * @brief Durably save an event read from the kernel
+ *
+ * Called by the reader thread before the event is queued.
+ *
+ * @param event the event; only seq_num and event_buf are saved
+ * @param len number of bytes read for the event, including seq_num
+ * @return the spool slot holding the event, or -1 if it could not be
+ *	spooled
+ */
+int
+spool_commit(struct event *event, int len)
+{
+	struct spool_slot *slot = NULL;
+	int i;
+
+	if (spool_map == NULL)
+		return -1;
+
+	/* Test files return their size, which can be more than an event */
+	len -= sizeof(event->seq_num);
+	if (len <= 0)
+		return -1;
+	if (len > RTAS_ERROR_LOG_MAX)
+		len = RTAS_ERROR_LOG_MAX;
+
+	pthread_mutex_lock(&spool_lock);
+	for (i = 0; i < SPOOL_SLOTS; i++) {
+		if (spool_slot(i)->state == SPOOL_FREE) {
+			slot = spool_slot(i);
+			slot->state = SPOOL_FILLING;
+			break;
+		}
+	}
+	if (slot == NULL && !spool_full_logged) {
+		log_msg(NULL, "The event spool %s is full, RTAS events are "
+			"not spooled until handled ones are released",
+			spool_file);
+		spool_full_logged = 1;
+	}
+	pthread_mutex_unlock(&spool_lock);
+
+	if (slot == NULL)
+		return -1;
+
+	slot->seq_num = event->seq_num;
+	slot->len = len;
+	slot->gen = ++spool_gen;
+	memcpy(slot->data, event->event_buf, len);
+
+	if (spool_sync(slot, sizeof(*slot)))
+		goto error;
+
+	slot->state = SPOOL_COMMITTED;
+	if (spool_sync(&slot->state, sizeof(slot->state)))
+		goto error;
+
+	return i;
+
+error:
+	dbg("Could not sync RTAS event %d to %s, %s", event->seq_num,
+	    spool_file, strerror(errno));
+	spool_free(i);
+	return -1;
+}
+
+/**
+ * spool_release
+ * @brief Hand back the spool slot of a handled event
+ *
+ * The slot is freed by spool_release_flushed() once the work queued
+ * for the event is committed.
+ *
+ * @param i spool slot returned by spool_commit()
+ */
+void
+spool_release(int i)
+{
+	if (spool_map == NULL || i < 0)
+		return;
+
+	spool_handled[i] = 1;
+}
+
+/**
+ * spool_release_flushed
+ * @brief Free the spool slots of handled events up to an event number
+ *
+ * @param seq_num number of the last event whose queued work has been
+ *	committed
+ */
+void
+spool_release_flushed(int seq_num)
+{
+	int i;
+
+	if (spool_map == NULL)
+		return;
+
+	for (i = 0; i < SPOOL_SLOTS; i++)
+		if (spool_handled[i] &&
+		    (int)spool_slot(i)->seq_num <= seq_num)
+			spool_free(i);
+}
+
+/**
+ * spool_save_repeat
+ * @brief Durably save the repeats of an event
+ *
+ * A new record is committed in two steps, as spool slots are.  An
+ * existing one is updated in place.
+ *
+ * @param i record returned by an earlier call for the same event, or
+ *	-1 for a new record
+ * @param repeat the repeats
+ * @return the record holding the repeats, -1 if they could not be saved
+ */
+int
+spool_save_repeat(int i, struct spool_repeat *repeat)
+{
+	struct spool_repeat_rec *rec;
+
+	if (spool_map == NULL)
+		return -1;
+
+	if (i < 0) {
+		for (i = 0; i < SPOOL_REPEATS; i++)
+			if (spool_repeat_rec(i)->state == SPOOL_FREE)
+				break;
+		if (i == SPOOL_REPEATS)
+			return -1;
+	}
+
+	rec = spool_repeat_rec(i);
+	rec->repeat = *repeat;
+	if (spool_sync(rec, sizeof(*rec)))
+		goto error;
+
+	if (rec->state != SPOOL_COMMITTED) {
+		rec->state = SPOOL_COMMITTED;
+		if (spool_sync(&rec->state, sizeof(rec->state)))
+			goto error;
+	}
+
+	return i;
+
+error:
+	dbg("Could not sync the repeats of RTAS event %d to %s, %s",
+	    repeat->first_seq, spool_file, strerror(errno));
+	spool_drop_repeat(i);
+	return -1;
+}
+
+/**
+ * spool_drop_repeat
+ * @brief Free the record of the repeats of an event
+ *
+ * Synced, so that repeats already logged are not logged again by the
+ * next start.
+ *
+ * @param i record returned by spool_save_repeat()
+ */
+void
+spool_drop_repeat(int i)
+{
+	struct spool_repeat_rec *rec;
+
+	if (spool_map == NULL || i < 0)
+		return;
+
+	rec = spool_repeat_rec(i);
+	rec->state = SPOOL_FREE;
+	spool_sync(&rec->state, sizeof(rec->state));
+}
+
+/**
+ * spool_next_repeat
+ * @brief Retrieve the repeats saved by the last run
+ *
+ * @param i record to start looking from
+ * @param repeat buffer for the repeats
+ * @return the first record from i on holding repeats, -1 if there is
+ *	none
+ */
+int
+spool_next_repeat(int i, struct spool_repeat *repeat)
+{
+	if (spool_map == NULL)
+		return -1;
+
+	for (; i < SPOOL_REPEATS; i++) {
+		if (spool_repeat_rec(i)->state == SPOOL_COMMITTED) {
+			*repeat = spool_repeat_rec(i)->repeat;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * spool_close
+ * @brief Unmap the spool
+ *
+ * Events still in the spool are replayed by the next start.
+ */
+void
+spool_close(void)
+{
+	if (spool_map == NULL)
+		return;
+
+	msync(spool_map, spool_size, MS_SYNC);
+	munmap(spool_map, spool_size);
+	spool_map = NULL;
+}
@@ -0,0 +1,384 @@
+/**
+ * @file stats.c
+ * @brief Event handling statistics for rtas_errd
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "rtas_errd.h"
+
+/*
+ * Each stage of handle_rtas_event() is timed, as is the handling of
+ * every event as a whole per RTAS header type, into histograms of
+ * power of two microsecond buckets.  Together with a few counters they
+ * are written to stats_file every STATS_INTERVAL seconds by the stats
+ * thread, and to both stats_file and the rtas_errd log by stats_dump()
+ * when the event loop reads SIGUSR1 from signal_fd.  The epow_action stage
+ * is the time from an EPOW event being read from the kernel to
+ * rc.powerfail being started for it, drmgr_run the run time of drmgr.
+ *
+ * Only the event handling thread updates the statistics; the lock is
+ * there for the stats thread that writes them out.
+ */
+#define STATS_BUCKETS	32
+#define STATS_INTERVAL	10	/* secs */
+#define STATS_TYPES	256
+
+/**
+ * @var stats_file
+ * @brief File the statistics are written to
+ */
+char *stats_file = "/var/log/rtas_errd.stats";
+
+struct stats_hist {
+	uint64_t	count;
+	uint64_t	total;		/**< usecs */
+	uint64_t	max;		/**< usecs */
+	uint64_t	buckets[STATS_BUCKETS];
+};
+
+static const char *stage_names[STATS_STAGE_MAX] = {
+	[STATS_DUMP]	= "check_platform_dump",
+	[STATS_PRINT]	= "print_rtas_event",
+	[STATS_DEALLOC]	= "handle_resource_dealloc",
+	[STATS_EPOW]	= "check_epow",
+	[STATS_EEH]	= "check_eeh",
+	[STATS_PRRN]	= "handle_prrn_event",
+	[STATS_HOTPLUG]	= "handle_hotplug_event",
+	[STATS_ELA]	= "process_v6/pre_v6",
+	[STATS_LOG]	= "log_event",
+	[STATS_SL_COMMIT] = "servicelog_commit",
+	[STATS_EPOW_ACTION] = "epow_action",
+	[STATS_DRMGR]	= "drmgr_run",
+};
+
+static const char *counter_names[STATS_COUNTER_MAX] = {
+	[STATS_EVENTS]		= "events",
+	[STATS_FAILURES]	= "failures",
+	[STATS_PARSE_ERRORS]	= "parse_errors",
+	[STATS_READ_RETRIES]	= "read_retries",
+	[STATS_SL_ERRORS]	= "servicelog_errors",
+	[STATS_DEDUP_REPEATS]	= "dedup_repeats",
+	[STATS_DRMGR_RUNS]	= "drmgr_runs",
+};
+
+static struct stats_hist stage_hist[STATS_STAGE_MAX];
+static struct stats_hist type_hist[STATS_TYPES];
+static uint64_t counters[STATS_COUNTER_MAX];
+static struct timespec stats_started;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stats_file_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t stats_thread;
+static int stats_running = 0;
+
+/**
+ * stats_now
+ * @brief Retrieve a monotonic time stamp for stats_stage()
+ *
+ * @return CLOCK_MONOTONIC time in usecs
+ */
+uint64_t
+stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+hist_add(struct stats_hist *hist, uint64_t usecs)
+{
+	int bucket = 0;
+
+	/* bucket n holds latencies of less than 2^n usecs */
+	while (bucket < STATS_BUCKETS - 1 && (usecs >> bucket) != 0)
+		bucket++;
+
+	hist->count++;
+	hist->total += usecs;
+	if (usecs > hist->max)
+		hist->max = usecs;
+	hist->buckets[bucket]++;
+}
+
+/**
+ * stats_stage
+ * @brief Account the time spent in a stage of event handling
+ *
+ * @param stage STATS_* stage
+ * @param start stats_now() time stamp taken when the stage started
+ */
+void
+stats_stage(int stage, uint64_t start)
+{
+	uint64_t usecs = stats_now() - start;
+
+	pthread_mutex_lock(&stats_lock);
+	hist_add(&stage_hist[stage], usecs);
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * stats_event
+ * @brief Account the handling of an event as a whole
+ *
+ * @param type RTAS header type of the event
+ * @param start stats_now() time stamp taken when handling started
+ * @param rc return code of handle_rtas_event()
+ */
+void
+stats_event(int type, uint64_t start, int rc)
+{
+	uint64_t usecs = stats_now() - start;
+
+	pthread_mutex_lock(&stats_lock);
+	hist_add(&type_hist[type & (STATS_TYPES - 1)], usecs);
+	counters[STATS_EVENTS]++;
+	if (rc)
+		counters[STATS_FAILURES]++;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * stats_count
+ * @brief Increment one of the event handling counters
+ *
+ * @param counter STATS_* counter
+ */
+void
+stats_count(int counter)
+{
+	pthread_mutex_lock(&stats_lock);
+	counters[counter]++;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void
+print_hist(FILE *fp, const char *kind, const char *name,
+	   struct stats_hist *hist)
+{
+	int i, last;
+
+	for (last = STATS_BUCKETS - 1; last > 0; last--)
+		if (hist->buckets[last])
+			break;
+
+	fprintf(fp, "%s %s count %llu avg_usecs %llu max_usecs %llu "
+		"buckets", kind, name, (unsigned long long)hist->count,
+		(unsigned long long)(hist->total / hist->count),
+		(unsigned long long)hist->max);
+	for (i = 0; i <= last; i++)
+		fprintf(fp, " %llu", (unsigned long long)hist->buckets[i]);
+	fprintf(fp, "\n");
+}
+
+/**
+ * print_stats
+ * @brief Write out all of the statistics
+ *
+ * The histogram buckets are listed from the first one, which holds
+ * latencies of less than 1 usec, to the last one that is not empty;
+ * bucket n holds latencies from 2^(n-1) to 2^n usecs.
+ *
+ * @param fp stream to write to
+ */
+static void
+print_stats(FILE *fp)
+{
+	struct event_queue_stats qstats;
+	struct timespec now;
+	char name[16];
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	event_queue_get_stats(&qstats);
+
+	pthread_mutex_lock(&stats_lock);
+
+	fprintf(fp, "uptime_secs %ld\n", (long)(now.tv_sec -
+						stats_started.tv_sec));
+	for (i = 0; i < STATS_COUNTER_MAX; i++)
+		fprintf(fp, "%s %llu\n", counter_names[i],
+			(unsigned long long)counters[i]);
+
+	fprintf(fp, "queue_depth %u\nqueue_high_water %u\nqueue_enqueued %lu\n"
+		"queue_full_waits %lu\n", qstats.depth, qstats.high_water,
+		qstats.enqueued, qstats.full_waits);
+
+	for (i = 0; i < STATS_STAGE_MAX; i++)
+		if (stage_hist[i].count)
+			print_hist(fp, "stage", stage_names[i],
+				   &stage_hist[i]);
+
+	for (i = 0; i < STATS_TYPES; i++) {
+		if (type_hist[i].count == 0)
+			continue;
+
+		snprintf(name, sizeof(name), "0x%02x", i);
+		print_hist(fp, "type", name, &type_hist[i]);
+	}
+
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * write_stats_file
+ * @brief Replace stats_file with the current statistics
+ */
+static void
+write_stats_file(void)
+{
+	char tmp[PATH_MAX];
+	FILE *fp;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", stats_file);
+
+	pthread_mutex_lock(&stats_file_lock);
+
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		dbg("Could not open %s, %s", tmp, strerror(errno));
+		pthread_mutex_unlock(&stats_file_lock);
+		return;
+	}
+
+	print_stats(fp);
+
+	if (fclose(fp) || rename(tmp, stats_file)) {
+		dbg("Could not write %s, %s", stats_file, strerror(errno));
+		unlink(tmp);
+	}
+
+	pthread_mutex_unlock(&stats_file_lock);
+}
+
+/**
+ * stats_log
+ * @brief Dump the statistics to the rtas_errd log
+ */
+void
+stats_log(void)
+{
+	char *buf = NULL, *line, *next;
+	size_t len = 0;
+	FILE *fp;
+
+	fp = open_memstream(&buf, &len);
+	if (fp == NULL)
+		return;
+
+	print_stats(fp);
+	fclose(fp);
+
+	log_msg(NULL, "rtas_errd statistics:");
+	for (line = buf; line && *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		log_msg(NULL, "  %s", line);
+	}
+
+	free(buf);
+}
+
+/**
+ * stats_dump
+ * @brief Write the statistics to stats_file and the rtas_errd log
+ *
+ * Called by the event loop on SIGUSR1.
+ */
+void
+stats_dump(void)
+{
+	stats_log();
+	write_stats_file();
+}
+
+/**
+ * stats_thread_main
+ * @brief Write the statistics out periodically
+ */
+static void *
+stats_thread_main(void *arg)
+{
+	struct timespec interval = { STATS_INTERVAL, 0 };
+
+	/* Only allow stats_stop() to cancel us while we are waiting */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	while (1) {
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		nanosleep(&interval, NULL);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		write_stats_file();
+	}
+
+	return NULL;
+}
+
+/**
+ * stats_start
+ * @brief Start the thread that writes out the statistics
+ *
+ * @return 0 on success, !0 on failure
+ */
+int
+stats_start(void)
+{
+	int rc;
+
+	clock_gettime(CLOCK_MONOTONIC, &stats_started);
+
+	rc = pthread_create(&stats_thread, NULL, stats_thread_main, NULL);
+	if (rc) {
+		log_msg(NULL, "Could not start the statistics thread, %s",
+			strerror(rc));
+		return rc;
+	}
+
+	stats_running = 1;
+	return 0;
+}
+
+/**
+ * stats_stop
+ * @brief Stop the stats thread, writing the statistics one last time
+ */
+void
+stats_stop(void)
+{
+	if (!stats_running)
+		return;
+
+	pthread_cancel(stats_thread);
+	pthread_join(stats_thread, NULL);
+	stats_running = 0;
+
+	write_stats_file();
+}
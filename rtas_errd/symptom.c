@@ -0,0 +1,287 @@
+/**
+ * @file symptom.c
+ * @brief Sequence numbers of the symptom bits of version 3 to 5 RTAS events
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include "ela_msg.h"
+#include "symptom.h"
+
+#define NCPUSYMPTOMS	 9
+#define NMEMSYMPTOMS	17
+#define NIOSYMPTOMS	17
+#define NSPSYMPTOMS	33
+#define NSPSYMPTOMS_ADDITIONAL	9
+
+/* Look up tables for sequence number to reason code messages. */
+static const uint32_t cpu_log_sig[NCPUSYMPTOMS] = {
+	0x00, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+static const char * const cpu_log[NCPUSYMPTOMS][2] = {
+	{ MSGCPUALLZERO, DEFER_MSGALLZERO},
+	{ MSGCPUB12b0, DEFER_MSGCPUB12b0},
+	{ MSGCPUB12b1, DEFER_MSGCPUB12b1},
+	{ MSGCPUB12b2, DEFER_MSGCPUB12b2},
+	{ MSGCPUB12b3, DEFER_MSGCPUB12b3},
+	{ MSGCPUB12b4, DEFER_MSGCPUB12b4},
+	{ MSGCPUB12b5, DEFER_MSGCPUB12b5},
+	{ MSGCPUB12b6, DEFER_MSGCPUB12b6},
+	{ MSGCPUB12b7, DEFER_MSGCPUB12b7}
+};
+
+static const uint32_t mem_log_sig[NMEMSYMPTOMS] = {
+	0x0000, 0x8000, 0x4000, 0x2000, 0x1000,
+	0x0800, 0x0400, 0x0200, 0x0100,
+	0x0080, 0x0040, 0x0020, 0x0010,
+	0x0008, 0x0004, 0x0002, 0x0001};
+static const char * const mem_log[NMEMSYMPTOMS][2] = {
+	{ MSGMEMALLZERO, DEFER_MSGALLZERO},
+	{ MSGMEMB12b0, DEFER_MSGMEMB12b0},
+	{ MSGMEMB12b1, DEFER_MSGMEMB12b1},
+	{ MSGMEMB12b2, DEFER_MSGMEMB12b2},
+	{ MSGMEMB12b3, DEFER_MSGMEMB12b3},
+	{ MSGMEMB12b4, DEFER_MSGMEMB12b4},
+	{ MSGMEMB12b5, DEFER_MSGMEMB12b5},
+	{ MSGMEMB12b6, DEFER_MSGMEMB12b6},
+	{ MSGMEMB12b7, DEFER_MSGMEMB12b7},
+	{ MSGMEMB13b0, DEFER_MSGMEMB13b0},
+	{ MSGMEMB13b1, DEFER_MSGMEMB13b1},
+	{ MSGMEMB13b2, DEFER_MSGMEMB13b2},
+	{ MSGMEMB13b3, DEFER_MSGMEMB13b3},
+	{ MSGMEMB13b4, DEFER_MSGMEMB13b4},
+	{ MSGRESERVED, DEFER_MSGRESERVED},
+	{ MSGMEMB13b6, DEFER_MSGMEMB13b6},
+	{ MSGMEMB13b7, DEFER_MSGMEMB13b7},
+};
+
+/*
+ * I/O Byte 13, bits 0-2 are describtions that are masked off the
+ * symptom bits.
+ */
+static const uint32_t io_log_sig[NIOSYMPTOMS] = {
+	0x0000, 0x8000, 0x4000, 0x2000, 0x1000,
+	0x0800, 0x0400, 0x0410, 0x0200, 0x0210,
+	0x0100, 0x0110, 0x0010,
+	0x0008, 0x0004, 0x0002, 0x0001};
+static const char * const io_log[NIOSYMPTOMS][2] = {
+	{ MSGIOALLZERO, DEFER_MSGALLZERO},
+	{ MSGIOB12b0, DEFER_MSGIOB12b0},
+	{ MSGIOB12b1, DEFER_MSGIOB12b1},
+	{ MSGIOB12b2, DEFER_MSGIOB12b2},
+	{ MSGIOB12b3, DEFER_MSGIOB12b3},
+	{ MSGIOB12b4, DEFER_MSGIOB12b4},
+	{ MSGIOB12b5, DEFER_MSGIOB12b5},
+	{ MSGIOB12b5B13b3, DEFER_MSGIOB12b5B13b3},
+	{ MSGIOB12b6, DEFER_MSGIOB12b6},
+	{ MSGIOB12b6B13b3, DEFER_MSGIOB12b6B13b3},
+	{ MSGIOB12b7, DEFER_MSGIOB12b7},
+	{ MSGIOB12b7B13b3, DEFER_MSGIOB12b7B13b3},
+	{ MSGIOB13b3, DEFER_MSGIOB13b3},
+	{ MSGIOB13b4, DEFER_MSGIOB13b4},
+	{ MSGIOB13b5, DEFER_MSGIOB13b5},
+	{ MSGIOB13b6, DEFER_MSGIOB13b6},
+	{ MSGIOB13b7, DEFER_MSGIOB13b7},
+};
+
+static const uint32_t sp_log_sig[NSPSYMPTOMS] = {
+	0x00000000,
+	0x80000000, 0x40000000, 0x20000000, 0x10000000,
+	0x08000000, 0x04000000, 0x02000000, 0x01000000,
+	0x00800000, 0x00400000, 0x00200000, 0x00100000,
+	0x00080000, 0x00040000, 0x00020000, 0x00010000,
+	0x00008000, 0x00004000, 0x00002000, 0x00001000,
+	0x00000800, 0x00000400, 0x00000200, 0x00000100,
+	0x00000080, 0x00000040, 0x00000020, 0x00000010,
+	0x00000008, 0x00000004, 0x00000002, 0x00000001};
+static const char * const sp_log[NSPSYMPTOMS][2] = {
+	{ MSGSPALLZERO, DEFER_MSGALLZERO},
+	{ MSGSPB16b0, DEFER_MSGSPB16b0},
+	{ MSGSPB16b1, DEFER_MSGSPB16b1},
+	{ MSGSPB16b2, DEFER_MSGSPB16b2},
+	{ MSGSPB16b3, DEFER_MSGSPB16b3},
+	{ MSGSPB16b4, DEFER_MSGSPB16b4},
+	{ MSGSPB16b5, DEFER_MSGSPB16b5},
+	{ MSGSPB16b6, DEFER_MSGSPB16b6},
+	{ MSGSPB16b7, DEFER_MSGSPB16b7},
+	{ MSGSPB17b0, DEFER_MSGSPB17b0},
+	{ MSGSPB17b1, DEFER_MSGSPB17b1},
+	{ MSGSPB17b2, DEFER_MSGSPB17b2},
+	{ MSGSPB17b3, DEFER_MSGSPB17b3},
+	{ MSGSPB17b4, DEFER_MSGSPB17b4},
+	{ MSGSPB17b5, DEFER_MSGSPB17b5},
+	{ MSGRESERVED,DEFER_MSGRESERVED},
+	{ MSGRESERVED,DEFER_MSGRESERVED},
+	{ MSGSPB18b0, DEFER_MSGSPB18b0},
+	{ MSGSPB18b1, DEFER_MSGSPB18b1},
+	{ MSGSPB18b2, DEFER_MSGSPB18b2},
+	{ MSGSPB18b3, DEFER_MSGSPB18b3},
+	{ MSGSPB18b4, DEFER_MSGSPB18b4},
+	{ MSGRESERVED,DEFER_MSGRESERVED},
+	{ MSGSPB18b6, DEFER_MSGSPB18b6},
+	{ MSGSPB18b7, DEFER_MSGSPB18b7},
+	{ MSGSPB19b0, DEFER_MSGSPB19b0},
+	{ MSGSPB19b1, DEFER_MSGSPB19b1},
+	{ MSGRESERVED, DEFER_MSGRESERVED},
+	{ MSGRESERVED, DEFER_MSGRESERVED},
+	{ MSGSPB19b4, DEFER_MSGSPB19b4},
+	{ MSGSPB19b5, DEFER_MSGSPB19b5},
+	{ MSGSPB19b6, DEFER_MSGSPB19b6},
+	{ MSGRESERVED, DEFER_MSGRESERVED},
+};
+
+static const uint32_t sp_log_additional_sig[NSPSYMPTOMS_ADDITIONAL] = {
+	0x00, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+static const char * const sp_log_additional[NSPSYMPTOMS_ADDITIONAL][2] = {
+	{ MSGSPALLZERO, DEFER_MSGALLZERO},
+	{ MSGSPB28b0, DEFER_MSGSPB28b0},
+	{ MSGSPB28b1, DEFER_MSGSPB28b1},
+	{ MSGSPB28b2, DEFER_MSGSPB28b2},
+	{ MSGSPB28b3, DEFER_MSGSPB28b3},
+	{ MSGSPB28b4, DEFER_MSGSPB28b4},
+	{ MSGSPB28b5, DEFER_MSGSPB28b5},
+	{ MSGSPB28b6, DEFER_MSGSPB28b6},
+	{ MSGSPB28b7, DEFER_MSGSPB28b7},
+};
+
+#define TABLE(sigs, msgs, width) \
+	{ sizeof(sigs) / sizeof(sigs[0]), width, sigs, msgs }
+
+const struct symptom_table symptom_tables[SYMPTOM_TABLES] = {
+	[SYMPTOM_CPU]		= TABLE(cpu_log_sig, cpu_log, 1),
+	[SYMPTOM_MEM]		= TABLE(mem_log_sig, mem_log, 2),
+	[SYMPTOM_IO]		= TABLE(io_log_sig, io_log, 2),
+	[SYMPTOM_SP]		= TABLE(sp_log_sig, sp_log, 4),
+	[SYMPTOM_SP_ADDITIONAL]	= TABLE(sp_log_additional_sig,
+					sp_log_additional, 1),
+};
+
+/*
+ * Finding the sequence number used to take a walk over the signatures
+ * of a table, which were themselves set up on the stack on every call.
+ * Since almost every signature has its bits in one byte of the symptom
+ * bits, each table is turned into a per byte index on first use:
+ * byte_seqn[b][v] is the first signature held in byte b (counting from
+ * the least significant one) that byte value v has all the bits of.
+ * The sequence number is the smallest one found for the bytes of the
+ * symptom bits, unless one of the few signatures spanning several bytes
+ * (kept in multi[], in table order) comes first.
+ */
+#define SYMPTOM_MAX_WIDTH	4
+#define SYMPTOM_MAX_MULTI	8
+
+struct symptom_index {
+	uint8_t		byte_seqn[SYMPTOM_MAX_WIDTH][256];
+	int		nmulti;
+	uint8_t		multi[SYMPTOM_MAX_MULTI];
+};
+
+static struct symptom_index symptom_index[SYMPTOM_TABLES];
+static int symptom_index_built = 0;
+
+/**
+ * sig_byte
+ * @brief Find the only byte of the symptom bits a signature has bits in
+ *
+ * @return the byte, -1 if the signature has bits in several bytes, or
+ *	none
+ */
+static int
+sig_byte(uint32_t sig)
+{
+	int b;
+
+	for (b = 0; b < SYMPTOM_MAX_WIDTH; b++)
+		if (sig && !(sig & ~(0xffU << (8 * b))))
+			return b;
+
+	return -1;
+}
+
+static void
+build_symptom_index(void)
+{
+	const struct symptom_table *t;
+	struct symptom_index *idx;
+	int i, b, v, seqn;
+
+	for (i = 0; i < SYMPTOM_TABLES; i++) {
+		t = &symptom_tables[i];
+		idx = &symptom_index[i];
+
+		for (b = 0; b < t->width; b++)
+			for (v = 0; v < 256; v++)
+				idx->byte_seqn[b][v] = t->nsigs;
+
+		/* Walk backwards so that the first match is the one kept */
+		for (seqn = t->nsigs - 1; seqn > 0; seqn--) {
+			b = sig_byte(t->sigs[seqn]);
+			if (b < 0)
+				continue;
+
+			for (v = 0; v < 256; v++)
+				if (((uint32_t)v << (8 * b) & t->sigs[seqn]) ==
+				    t->sigs[seqn])
+					idx->byte_seqn[b][v] = seqn;
+		}
+
+		idx->nmulti = 0;
+		for (seqn = 1; seqn < t->nsigs; seqn++)
+			if (sig_byte(t->sigs[seqn]) < 0 &&
+			    idx->nmulti < SYMPTOM_MAX_MULTI)
+				idx->multi[idx->nmulti++] = seqn;
+	}
+
+	symptom_index_built = 1;
+}
+
+/**
+ * symptom_seqn
+ * @brief Convert symptom bits to the sequence number of their signature
+ *
+ * @param table the symptom table of the error log format
+ * @param sbits the symptom bits
+ * @return the index in the table of the first signature that sbits has
+ *	all the bits of, 0 if there is none
+ */
+int
+symptom_seqn(enum symptom_table_id table, uint32_t sbits)
+{
+	const struct symptom_table *t = &symptom_tables[table];
+	struct symptom_index *idx = &symptom_index[table];
+	int b, i, seqn, best;
+
+	/* ELA only ever runs on the main thread */
+	if (!symptom_index_built)
+		build_symptom_index();
+
+	best = t->nsigs;
+	for (b = 0; b < t->width; b++) {
+		seqn = idx->byte_seqn[b][(sbits >> (8 * b)) & 0xff];
+		if (seqn < best)
+			best = seqn;
+	}
+
+	for (i = 0; i < idx->nmulti && idx->multi[i] < best; i++) {
+		if ((sbits & t->sigs[idx->multi[i]]) == t->sigs[idx->multi[i]]) {
+			best = idx->multi[i];
+			break;
+		}
+	}
+
+	return best == t->nsigs ? 0 : best;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file symptom.h
+ * @brief Symptom bit tables of version 3 to 5 RTAS events
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _SYMPTOM_H
+#define _SYMPTOM_H
+
+#include <stdint.h>
+
+/* Symptom bit tables, one per error log format */
+enum symptom_table_id {
+	SYMPTOM_CPU,
+	SYMPTOM_MEM,
+	SYMPTOM_IO,
+	SYMPTOM_SP,
+	SYMPTOM_SP_ADDITIONAL,	/* byte 28 of SP logs without bytes 16-19 */
+	SYMPTOM_TABLES,
+};
+
+/**
+ * @struct symptom_table
+ * @brief Signatures of the symptom bits, and the reason code messages
+ *
+ * The sequence number of a set of symptom bits is the index of the
+ * first signature, after the all zero one at index 0, whose bits are
+ * all set; 0 if there is none.  msgs[seqn][1] is the message for a
+ * predictive error, msgs[seqn][0] the one otherwise.
+ */
+struct symptom_table {
+	int			nsigs;
+	int			width;	/**< bytes of symptom bits */
+	const uint32_t		*sigs;
+	const char * const	(*msgs)[2];
+};
+
+extern const struct symptom_table symptom_tables[SYMPTOM_TABLES];
+
+int symptom_seqn(enum symptom_table_id, uint32_t);
+
+#endif /* _SYMPTOM_H */
@@ -0,0 +1,272 @@
+/**
+ * @file build_corpus.c
+ * @brief Build a binary RTAS event corpus for rtas_errd -C
+ *
+ * Extracts every RTAS event from platform log format text, such as
+ * /var/log/platform, syslog or the rtas_errd/tests/events files, and
+ * writes them to a corpus file (see rtas_errd/corpus.h) that rtas_errd
+ * can replay without parsing any text.
+ *
+ * Usage: build_corpus [-n first_seq] [-r repeat] -o corpus file ...
+ *
+ * Events keep their RTAS event numbers unless -n is given, in which case
+ * they are renumbered from first_seq on.  -r writes the events of all
+ * the files repeat times over, to build large corpora out of a few
+ * sample events.
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <endian.h>
+
+#include "corpus.h"
+
+#define RTAS_ERROR_LOG_MAX	4096
+
+struct corpus_event {
+	int		seq_num;
+	int		len;
+	char		buf[RTAS_ERROR_LOG_MAX];
+};
+
+static struct corpus_event *events;
+static int event_count;
+static int event_max;
+
+static int
+hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * parse_dump_line
+ * @brief Add the bytes of an "RTAS <line>: <hex>" line to an event
+ *
+ * Each line holds 16 bytes of the event, at offset line * 16.
+ *
+ * @return 0 on success, -1 if the line is not part of a hexdump
+ */
+static int
+parse_dump_line(struct corpus_event *event, char *p)
+{
+	char *end;
+	long line;
+	int offset, hi, lo;
+
+	line = strtol(p, &end, 10);
+	if (end == p || *end != ':' || line < 0 ||
+	    line >= RTAS_ERROR_LOG_MAX / 16)
+		return -1;
+
+	offset = line * 16;
+	for (p = end + 1; *p != '\0' && *p != '\n'; p++) {
+		if (isspace(*p))
+			continue;
+
+		hi = hexval(p[0]);
+		lo = hexval(p[1]);
+		if (hi < 0 || lo < 0 || offset >= RTAS_ERROR_LOG_MAX)
+			return -1;
+
+		event->buf[offset++] = hi << 4 | lo;
+		p++;
+	}
+
+	if (offset > event->len)
+		event->len = offset;
+
+	return 0;
+}
+
+static struct corpus_event *
+new_event(int seq_num)
+{
+	if (event_count == event_max) {
+		event_max = event_max ? event_max * 2 : 64;
+		events = realloc(events, event_max * sizeof(*events));
+		if (events == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	memset(&events[event_count], 0, sizeof(*events));
+	events[event_count].seq_num = seq_num;
+
+	return &events[event_count];
+}
+
+/**
+ * read_events
+ * @brief Extract all of the RTAS events in a platform log format file
+ *
+ * @return number of events found, -1 on error
+ */
+static int
+read_events(const char *path)
+{
+	struct corpus_event *event = NULL;
+	char *line = NULL, *p;
+	size_t size = 0;
+	int found = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	while (getline(&line, &size, fp) > 0) {
+		/* There may be a syslog prefix ahead of the RTAS tag */
+		p = strstr(line, "RTAS");
+		if (p == NULL)
+			continue;
+		p += 4;
+
+		if (*p == ':') {
+			if (strstr(p, "RTAS event begin")) {
+				event = new_event(strtol(p + 1, NULL, 10));
+			} else if (strstr(p, "RTAS event end") && event) {
+				if (event->len > 0) {
+					event_count++;
+					found++;
+				}
+				event = NULL;
+			}
+		} else if (*p == ' ' && event) {
+			if (parse_dump_line(event, p + 1)) {
+				fprintf(stderr, "%s: dropping malformed event "
+					"%d\n", path, event->seq_num);
+				event = NULL;
+			}
+		}
+	}
+
+	free(line);
+	fclose(fp);
+
+	return found;
+}
+
+static int
+write_all(FILE *fp, const void *buf, size_t len)
+{
+	return fwrite(buf, 1, len, fp) != len;
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-n first_seq] [-r repeat] -o corpus "
+		"file ...\n", argv0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct rtas_corpus_hdr hdr;
+	struct rtas_corpus_rec rec;
+	char *output = NULL;
+	int first_seq = -1, repeat = 1;
+	int c, i, r, seq;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "n:o:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			first_seq = atoi(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (output == NULL || optind == argc || repeat < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = optind; i < argc; i++) {
+		if (read_events(argv[i]) < 0)
+			return 1;
+	}
+
+	if (event_count == 0) {
+		fprintf(stderr, "No RTAS events found\n");
+		return 1;
+	}
+
+	fp = fopen(output, "w");
+	if (fp == NULL) {
+		perror(output);
+		return 1;
+	}
+
+	memcpy(hdr.magic, RTAS_CORPUS_MAGIC, sizeof(hdr.magic));
+	hdr.version = htobe32(RTAS_CORPUS_VERSION);
+	hdr.count = htobe32(event_count * repeat);
+	if (write_all(fp, &hdr, sizeof(hdr)))
+		goto write_error;
+
+	seq = first_seq;
+	for (r = 0; r < repeat; r++) {
+		for (i = 0; i < event_count; i++) {
+			rec.seq_num = htobe32(first_seq < 0 ?
+					      events[i].seq_num : seq++);
+			rec.len = htobe32(events[i].len);
+			if (write_all(fp, &rec, sizeof(rec)) ||
+			    write_all(fp, events[i].buf, events[i].len))
+				goto write_error;
+		}
+	}
+
+	if (fclose(fp)) {
+		perror(output);
+		return 1;
+	}
+
+	printf("%d RTAS events written to %s\n", event_count * repeat,
+	       output);
+	free(events);
+	return 0;
+
+write_error:
+	perror(output);
+	fclose(fp);
+	return 1;
+}
@@ -0,0 +1,426 @@
+/**
+ * @file dt_props_bench.c
+ * @brief Compare and time single and batch convert_dt_node_props queries
+ *
+ * Builds a fake device tree with the given number of CPUs and LMBs: CPU
+ * nodes with their interrupt servers, ibm,drc-indexes and ibm,drc-names
+ * for the CPUs and an ibm,drc-info for the memory.  Then asks
+ * convert_dt_node_props, with --dt-root pointing at it, every one of
+ * these queries:
+ *
+ *   cpu: interrupt-server to drc-name, drc-index to interrupt-server,
+ *        drc-name to drc-index
+ *   mem: drc-index to drc-name
+ *
+ * once as a run of the program per query, as scripts do today, and once
+ * as a single --batch run.  The answers have to be identical.
+ *
+ * Usage: dt_props_bench [-c cpus] [-l lmbs] [-s servers per cpu] [-k]
+ *		path/to/convert_dt_node_props
+ *
+ * -k keeps the fake device tree and the query file, and prints where.
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <endian.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define CPU_DRC_START	0x10000000
+#define MEM_DRC_START	0x80000000
+
+struct query {
+	char	*context;
+	char	*from;
+	char	*to;
+	char	value[32];
+	char	*single;	/* answer of the single run, lines joined */
+	char	*batch;
+};
+
+static char root[] = "/tmp/dt_props_bench.XXXXXX";
+
+static int
+write_file(const char *path, const void *buf, size_t len)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (fp == NULL || fwrite(buf, 1, len, fp) != len) {
+		perror(path);
+		if (fp)
+			fclose(fp);
+		return -1;
+	}
+
+	return fclose(fp);
+}
+
+static char *
+put_be32(char *p, uint32_t val)
+{
+	val = htobe32(val);
+	memcpy(p, &val, 4);
+	return p + 4;
+}
+
+/**
+ * build_tree
+ * @brief Write the fake device tree under root
+ */
+static int
+build_tree(int ncpus, int nlmbs, int nservers)
+{
+	char path[PATH_MAX], *buf, *p;
+	int i, j;
+
+	/* big enough for any of the properties */
+	buf = malloc(16 + (ncpus + 1) * 16 + nservers * 4);
+	if (buf == NULL)
+		return -1;
+
+	snprintf(path, sizeof(path), "%s/cpus", root);
+	if (mkdir(path, 0755))
+		goto error;
+
+	for (i = 0; i < ncpus; i++) {
+		snprintf(path, sizeof(path), "%s/cpus/PowerPC,POWER9@%x",
+			 root, i * nservers);
+		if (mkdir(path, 0755))
+			goto error;
+
+		put_be32(buf, CPU_DRC_START + i);
+		strcat(path, "/ibm,my-drc-index");
+		if (write_file(path, buf, 4))
+			goto error;
+
+		for (j = 0, p = buf; j < nservers; j++)
+			p = put_be32(p, i * nservers + j);
+		snprintf(path, sizeof(path), "%s/cpus/PowerPC,POWER9@%x/"
+			 "ibm,ppc-interrupt-server#s", root, i * nservers);
+		if (write_file(path, buf, p - buf))
+			goto error;
+	}
+
+	p = put_be32(buf, ncpus);
+	for (i = 0; i < ncpus; i++)
+		p = put_be32(p, CPU_DRC_START + i);
+	snprintf(path, sizeof(path), "%s/cpus/ibm,drc-indexes", root);
+	if (write_file(path, buf, p - buf))
+		goto error;
+
+	p = put_be32(buf, ncpus);
+	for (i = 0; i < ncpus; i++)
+		p += sprintf(p, "CPU %d", i) + 1;
+	snprintf(path, sizeof(path), "%s/cpus/ibm,drc-names", root);
+	if (write_file(path, buf, p - buf))
+		goto error;
+
+	/* One drc-info entry for all the LMBs, behind one for something else */
+	p = put_be32(buf, 2);
+	p += sprintf(p, "PHB") + 1;
+	p += sprintf(p, "PHB ") + 1;
+	p = put_be32(p, 0x20000000);
+	p = put_be32(p, 0);
+	p = put_be32(p, 16);
+	p = put_be32(p, 1);
+	p = put_be32(p, 0xffffffff);
+	p += sprintf(p, "MEM") + 1;
+	p += sprintf(p, "LMB ") + 1;
+	p = put_be32(p, MEM_DRC_START);
+	p = put_be32(p, 0);
+	p = put_be32(p, nlmbs);
+	p = put_be32(p, 1);
+	p = put_be32(p, 0xffffffff);
+	snprintf(path, sizeof(path), "%s/ibm,drc-info", root);
+	if (write_file(path, buf, p - buf))
+		goto error;
+
+	free(buf);
+	return 0;
+
+error:
+	perror(path);
+	free(buf);
+	return -1;
+}
+
+static void
+add_query(struct query *q, char *context, char *from, char *to,
+	  const char *fmt, unsigned int val)
+{
+	q->context = context;
+	q->from = from;
+	q->to = to;
+	snprintf(q->value, sizeof(q->value), fmt, val);
+}
+
+/* Run prog with stdin and stdout redirected, wait for it */
+static int
+run(char *prog, char **argv, const char *in, const char *out)
+{
+	pid_t pid;
+	int status, fd;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		if (in) {
+			fd = open(in, O_RDONLY);
+			if (fd < 0 || dup2(fd, 0) < 0)
+				_exit(127);
+		}
+		fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || dup2(fd, 1) < 0)
+			_exit(127);
+		fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0)
+			dup2(fd, 2);
+		execv(prog, argv);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) == 127)
+		return -1;
+
+	return WEXITSTATUS(status);
+}
+
+/* Read an answer file back, lines joined with a space */
+static char *
+read_answer(FILE *fp)
+{
+	char line[1024], *answer = NULL;
+	size_t len = 0;
+
+	while (fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\n")] = '\0';
+		answer = realloc(answer, len + strlen(line) + 2);
+		if (answer == NULL)
+			return NULL;
+		sprintf(answer + len, "%s%s", len ? " " : "", line);
+		len = strlen(answer);
+	}
+
+	return answer ? answer : strdup("");
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+rm_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct query *queries;
+	char *prog, in[PATH_MAX], out[PATH_MAX];
+	char *args[12];
+	int ncpus = 256, nlmbs = 1024, nservers = 8, keep = 0;
+	int nqueries, i, c, rc = 1;
+	double t_single, t_batch;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "c:l:s:kh")) != EOF) {
+		switch (c) {
+		case 'c':
+			ncpus = atoi(optarg);
+			break;
+		case 'l':
+			nlmbs = atoi(optarg);
+			break;
+		case 's':
+			nservers = atoi(optarg);
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-c cpus] [-l lmbs] "
+				"[-s servers per cpu] [-k] "
+				"convert_dt_node_props\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1 || ncpus <= 0 || nlmbs <= 0 || nservers <= 0) {
+		fprintf(stderr, "Usage: %s [-c cpus] [-l lmbs] "
+			"[-s servers per cpu] [-k] convert_dt_node_props\n",
+			argv[0]);
+		return 1;
+	}
+	prog = argv[optind];
+
+	if (mkdtemp(root) == NULL) {
+		perror(root);
+		return 1;
+	}
+	if (build_tree(ncpus, nlmbs, nservers))
+		goto out;
+
+	nqueries = 3 * ncpus + nlmbs;
+	queries = calloc(nqueries, sizeof(*queries));
+	if (queries == NULL)
+		goto out;
+
+	for (i = 0; i < ncpus; i++) {
+		add_query(&queries[3 * i], "cpu", "interrupt-server",
+			  "drc-name", "%u", i * nservers + nservers - 1);
+		add_query(&queries[3 * i + 1], "cpu", "drc-index",
+			  "interrupt-server", "0x%08x", CPU_DRC_START + i);
+		add_query(&queries[3 * i + 2], "cpu", "drc-name",
+			  "drc-index", "CPU %u", i);
+	}
+	for (i = 0; i < nlmbs; i++)
+		add_query(&queries[3 * ncpus + i], "mem", "drc-index",
+			  "drc-name", "0x%08x", MEM_DRC_START + i);
+
+	snprintf(in, sizeof(in), "%s/queries", root);
+	snprintf(out, sizeof(out), "%s/answers", root);
+
+	/* One run per query */
+	t_single = now();
+	for (i = 0; i < nqueries; i++) {
+		args[0] = prog;
+		args[1] = "--dt-root";
+		args[2] = root;
+		args[3] = "--context";
+		args[4] = queries[i].context;
+		args[5] = "--from";
+		args[6] = queries[i].from;
+		args[7] = "--to";
+		args[8] = queries[i].to;
+		args[9] = queries[i].value;
+		args[10] = NULL;
+
+		if (run(prog, args, NULL, out) < 0) {
+			fprintf(stderr, "Could not run %s\n", prog);
+			goto out;
+		}
+
+		fp = fopen(out, "r");
+		if (fp == NULL) {
+			perror(out);
+			goto out;
+		}
+		queries[i].single = read_answer(fp);
+		fclose(fp);
+	}
+	t_single = now() - t_single;
+
+	/* One run for all of them */
+	fp = fopen(in, "w");
+	if (fp == NULL) {
+		perror(in);
+		goto out;
+	}
+	for (i = 0; i < nqueries; i++)
+		fprintf(fp, "--context %s --from %s --to %s \"%s\"\n",
+			queries[i].context, queries[i].from, queries[i].to,
+			queries[i].value);
+	fclose(fp);
+
+	args[0] = prog;
+	args[1] = "--dt-root";
+	args[2] = root;
+	args[3] = "--batch";
+	args[4] = NULL;
+
+	t_batch = now();
+	if (run(prog, args, in, out) < 0) {
+		fprintf(stderr, "Could not run %s\n", prog);
+		goto out;
+	}
+	t_batch = now() - t_batch;
+
+	fp = fopen(out, "r");
+	if (fp == NULL) {
+		perror(out);
+		goto out;
+	}
+
+	/* Batch answers are one line per query */
+	rc = 0;
+	for (i = 0; i < nqueries; i++) {
+		char line[1024];
+
+		if (!fgets(line, sizeof(line), fp))
+			line[0] = '\0';
+		line[strcspn(line, "\n")] = '\0';
+		queries[i].batch = strdup(line);
+
+		if (queries[i].single == NULL || queries[i].batch == NULL ||
+		    strcmp(queries[i].single, queries[i].batch)) {
+			fprintf(stderr, "FAIL: %s %s to %s of %s: single "
+				"\"%s\", batch \"%s\"\n", queries[i].context,
+				queries[i].from, queries[i].to,
+				queries[i].value, queries[i].single,
+				queries[i].batch);
+			rc = 1;
+		} else if (queries[i].single[0] == '\0') {
+			fprintf(stderr, "FAIL: %s %s to %s of %s: no answer\n",
+				queries[i].context, queries[i].from,
+				queries[i].to, queries[i].value);
+			rc = 1;
+		}
+	}
+	fclose(fp);
+
+	if (rc == 0) {
+		printf("%d cpus, %d lmbs, %d queries: answers identical\n",
+		       ncpus, nlmbs, nqueries);
+		printf("single: %8.3f secs, %8.1f usecs/query\n", t_single,
+		       t_single * 1e6 / nqueries);
+		printf("batch:  %8.3f secs, %8.1f usecs/query, %5.1fx\n",
+		       t_batch, t_batch * 1e6 / nqueries,
+		       t_batch > 0 ? t_single / t_batch : 0);
+	}
+
+out:
+	if (keep)
+		printf("Device tree and queries kept in %s\n", root);
+	else
+		nftw(root, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	return rc;
+}
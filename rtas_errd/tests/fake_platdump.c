@@ -0,0 +1,135 @@
+/**
+ * @file fake_platdump.c
+ * @brief Stand-in for rtas_platform_dump() to benchmark extract_platdump
+ *
+ * Linked into extract_platdump_fake instead of librtas, so that dump
+ * extraction can be timed and checked on any machine, including ones
+ * without librtas.  The fake dump is controlled from the environment:
+ *
+ *	FAKE_PLATDUMP_SIZE	dump size in kbytes (default 65536)
+ *	FAKE_PLATDUMP_MBPS	firmware transfer rate in MB/s to simulate,
+ *				0 for no delay (default 0)
+ *	FAKE_PLATDUMP_MAX_CHUNK	largest buffer in kbytes that is accepted,
+ *				larger ones fail with RTAS_NO_LOWMEM like
+ *				the librtas RMO buffer does (default 64)
+ *
+ * Byte n of the dump is (n * 7 + n / 4096) & 0xff, apart from the dump
+ * header that holds the prefix size and the suggested file name
+ * "FAKEDUMP.0000000001".
+ *
+ * Copyright (C) 2007 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <endian.h>
+#include <librtas.h>
+
+#define DUMP_HDR_PREFIX_OFFSET	0x16
+#define DUMP_HDR_FNAME_OFFSET	0x18
+#define FAKE_DUMP_NAME		"FAKEDUMP.0000000001"
+#define FAKE_DUMP_PREFIX	8	/* strlen("FAKEDUMP") */
+
+static uint64_t
+env_kbytes(const char *name, uint64_t def)
+{
+	char *val = getenv(name);
+
+	return val ? strtoull(val, NULL, 10) : def;
+}
+
+static void
+fake_fill(char *buf, uint64_t offset, uint64_t len)
+{
+	char hdr[DUMP_HDR_FNAME_OFFSET + 40];
+	uint16_t prefix = htobe16(FAKE_DUMP_PREFIX);
+	uint64_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = ((offset + i) * 7 + (offset + i) / 4096) & 0xff;
+
+	if (offset >= sizeof(hdr))
+		return;
+
+	/* Overlay the part of the header that falls in this chunk */
+	for (i = 0; i < sizeof(hdr); i++)
+		hdr[i] = (i * 7) & 0xff;
+	memcpy(hdr + DUMP_HDR_PREFIX_OFFSET, &prefix, sizeof(prefix));
+	memset(hdr + DUMP_HDR_FNAME_OFFSET, 0, 40);
+	strcpy(hdr + DUMP_HDR_FNAME_OFFSET, FAKE_DUMP_NAME);
+
+	for (i = offset; i < sizeof(hdr) && i < offset + len; i++)
+		buf[i - offset] = hdr[i];
+}
+
+/**
+ * rtas_platform_dump
+ * @brief Return the next chunk of the fake dump
+ *
+ * The sequence number is simply the offset of the next chunk.
+ *
+ * @return 1 if there is more of the dump, 0 at its end, or a librtas
+ *	   error code
+ */
+int
+rtas_platform_dump(uint64_t dump_tag, uint64_t sequence, char *buffer,
+		   uint64_t length, uint64_t *seq_next, uint64_t *bytes_ret)
+{
+	uint64_t size = env_kbytes("FAKE_PLATDUMP_SIZE", 65536) * 1024;
+	uint64_t mbps = env_kbytes("FAKE_PLATDUMP_MBPS", 0);
+	uint64_t max_chunk = env_kbytes("FAKE_PLATDUMP_MAX_CHUNK", 64) * 1024;
+	uint64_t len, nsecs;
+	struct timespec delay;
+
+	/* The final call, telling firmware the dump has been saved */
+	if (buffer == NULL) {
+		*seq_next = sequence;
+		*bytes_ret = 0;
+		return 0;
+	}
+
+	if (length > max_chunk)
+		return RTAS_NO_LOWMEM;
+
+	len = size - sequence < length ? size - sequence : length;
+	fake_fill(buffer, sequence, len);
+
+	if (mbps) {
+		nsecs = len * 1000000000 / (mbps * 1024 * 1024);
+		delay.tv_sec = nsecs / 1000000000;
+		delay.tv_nsec = nsecs % 1000000000;
+		nanosleep(&delay, NULL);
+	}
+
+	*seq_next = sequence + len;
+	*bytes_ret = len;
+
+	return *seq_next < size;
+}
+
+/**
+ * rtas_set_sysparm
+ * @brief Not needed by extract_platdump, only there for config.c
+ */
+int
+rtas_set_sysparm(unsigned int parameter, char *data)
+{
+	return RTAS_UNKNOWN_OP;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file hexdump_bench.c
+ * @brief Compare and time the platform log hexdump encoders
+ *
+ * Checks that rtas_hexdump() produces exactly the text of the previous
+ * one sprintf("%02x") per byte implementation of print_rtas_event(),
+ * and reports how long each takes per event.
+ *
+ * Usage: hexdump_bench [-i iterations] [event file ...]
+ *
+ * Event files are in the rtas_errd/tests/events format (the platform
+ * log text).  Without any, random events of every length up to
+ * RTAS_ERROR_LOG_MAX are used.
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "hexdump.h"
+
+#define RTAS_ERROR_LOG_MAX	4096
+
+struct bench_event {
+	char	buf[RTAS_ERROR_LOG_MAX];
+	int	len;
+};
+
+/*
+ * The encoder print_rtas_event() used to use.  The byte is printed as
+ * unsigned, which is what "%02x" of a plain char did on ppc64.
+ */
+static int
+old_hexdump(char *out, const char *data, int len)
+{
+	int i, offset = 0;
+
+	for (i = 0; i < len; i++) {
+		if ((i % 16) == 0)
+			offset += sprintf(out + offset, "RTAS %d:", i/16);
+
+		if ((i % 4) == 0)
+			offset += sprintf(out + offset, " ");
+
+		offset += sprintf(out + offset, "%02x",
+				  (unsigned char)data[i]);
+
+		if ((i % 16) == 15)
+			offset += sprintf(out + offset, "\n");
+	}
+	if ((i % 16) != 0)
+		offset += sprintf(out + offset, "\n");
+
+	return offset;
+}
+
+/* Read the binary event back out of a platform log style text file */
+static int
+read_event_file(const char *path, struct bench_event *ev)
+{
+	FILE	*fp;
+	char	line[256], *p;
+	unsigned int byte;
+	int	n;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	ev->len = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, "RTAS ", 5) != 0)
+			continue;
+
+		p = strchr(line, ':');
+		if (p == NULL)
+			continue;
+		p++;
+
+		while (*p != '\0' && *p != '\n') {
+			if (*p == ' ') {
+				p++;
+				continue;
+			}
+			if (sscanf(p, "%2x%n", &byte, &n) != 1)
+				break;
+			if (ev->len >= RTAS_ERROR_LOG_MAX)
+				break;
+			ev->buf[ev->len++] = byte;
+			p += n;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_event *events;
+	char	*old_buf, *new_buf;
+	int	nevents, iterations = 1;
+	int	i, j, c, old_len, new_len;
+	double	start, t_old, t_new;
+	long	bytes = 0;
+
+	while ((c = getopt(argc, argv, "i:h")) != EOF) {
+		switch (c) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-i iterations] "
+				"[event file ...]\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	nevents = argc - optind;
+	if (nevents == 0)
+		nevents = RTAS_ERROR_LOG_MAX;
+
+	events = calloc(nevents, sizeof(*events));
+	old_buf = malloc(RTAS_HEXDUMP_SIZE(RTAS_ERROR_LOG_MAX) + 1);
+	new_buf = malloc(RTAS_HEXDUMP_SIZE(RTAS_ERROR_LOG_MAX));
+	if (events == NULL || old_buf == NULL || new_buf == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	if (optind < argc) {
+		for (i = 0; i < nevents; i++)
+			if (read_event_file(argv[optind + i], &events[i]))
+				return 1;
+	} else {
+		srand(1);
+		for (i = 0; i < nevents; i++) {
+			events[i].len = i + 1;
+			for (j = 0; j < events[i].len; j++)
+				events[i].buf[j] = rand();
+		}
+	}
+
+	/* First make sure the output is identical */
+	for (i = 0; i < nevents; i++) {
+		old_len = old_hexdump(old_buf, events[i].buf, events[i].len);
+		new_len = rtas_hexdump(new_buf, events[i].buf, events[i].len);
+
+		if (old_len != new_len ||
+		    memcmp(old_buf, new_buf, old_len) != 0) {
+			fprintf(stderr, "FAIL: output differs for event %d "
+				"(%s, %d bytes)\n", i,
+				optind < argc ? argv[optind + i] : "random",
+				events[i].len);
+			return 1;
+		}
+		bytes += events[i].len;
+	}
+
+	if (iterations <= 0)
+		return 0;
+
+	start = now();
+	for (j = 0; j < iterations; j++)
+		for (i = 0; i < nevents; i++)
+			old_hexdump(old_buf, events[i].buf, events[i].len);
+	t_old = now() - start;
+
+	start = now();
+	for (j = 0; j < iterations; j++)
+		for (i = 0; i < nevents; i++)
+			rtas_hexdump(new_buf, events[i].buf, events[i].len);
+	t_new = now() - start;
+
+	printf("%d events, %ld bytes, %d iterations: output identical\n",
+	       nevents, bytes, iterations);
+	printf("sprintf encoder: %10.3f usecs/event\n",
+	       t_old * 1e6 / ((double)nevents * iterations));
+	printf("table encoder:   %10.3f usecs/event\n",
+	       t_new * 1e6 / ((double)nevents * iterations));
+	if (t_new > 0)
+		printf("speedup:         %10.1fx\n", t_old / t_new);
+
+	free(old_buf);
+	free(new_buf);
+	free(events);
+	return 0;
+}
@@ -0,0 +1,479 @@
+/**
+ * @file scn_bench.c
+ * @brief Compare and time eager and lazy RTAS event section access
+ *
+ * For every event, checks that event_scn() finds exactly the sections
+ * the librtasevent getters find on the fully parsed event, that the
+ * header decoded by event_scn_index() matches librtasevent's, and that
+ * the fields rtas_errd reads from the sections event_scn() decodes
+ * itself match as well.  Then times the section lookups that
+ * dispatch_rtas_event() makes for each event both ways.
+ *
+ * "eager" is parse_rtas_event() followed by the rtas_get_*_scn() calls,
+ * as rtas_errd used to do; "lazy" is event_scn_index() followed by the
+ * same lookups through event_scn().  The number of events that still
+ * had to be parsed by the lazy lookups is reported along with the
+ * times.
+ *
+ * Usage: scn_bench [-i iterations] event file ...
+ *
+ * Event files are in the rtas_errd/tests/events format (the platform
+ * log text), e.g. every file in rtas_errd/tests/events.
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <librtasevent.h>
+
+#include "rtas_errd.h"
+
+/* Every section checked against librtasevent */
+static const int all_scns[] = {
+	RTAS_EVENT_EXT_HDR, RTAS_EPOW_SCN, RTAS_IO_SCN, RTAS_CPU_SCN,
+	RTAS_MEM_SCN, RTAS_POST_SCN, RTAS_IBM_SP_SCN, RTAS_PRIV_HDR_SCN,
+	RTAS_USR_HDR_SCN, RTAS_DUMP_SCN, RTAS_LRI_SCN, RTAS_MT_SCN,
+	RTAS_PSRC_SCN, RTAS_HP_SCN,
+};
+#define N_ALL	(sizeof(all_scns) / sizeof(all_scns[0]))
+
+static void *
+eager_get(struct rtas_event *re, int scn_id)
+{
+	switch (scn_id) {
+	case RTAS_EVENT_EXT_HDR:
+		return rtas_get_event_exthdr_scn(re);
+	case RTAS_EPOW_SCN:
+		return rtas_get_epow_scn(re);
+	case RTAS_IO_SCN:
+		return rtas_get_io_scn(re);
+	case RTAS_CPU_SCN:
+		return rtas_get_cpu_scn(re);
+	case RTAS_MEM_SCN:
+		return rtas_get_mem_scn(re);
+	case RTAS_POST_SCN:
+		return rtas_get_post_scn(re);
+	case RTAS_IBM_SP_SCN:
+		return rtas_get_ibm_sp_scn(re);
+	case RTAS_PRIV_HDR_SCN:
+		return rtas_get_priv_hdr_scn(re);
+	case RTAS_USR_HDR_SCN:
+		return rtas_get_usr_hdr_scn(re);
+	case RTAS_DUMP_SCN:
+		return rtas_get_dump_scn(re);
+	case RTAS_LRI_SCN:
+		return rtas_get_lri_scn(re);
+	case RTAS_MT_SCN:
+		return rtas_get_mt_scn(re);
+	case RTAS_PSRC_SCN:
+		return rtas_get_src_scn(re);
+	case RTAS_HP_SCN:
+		return rtas_get_hotplug_scn(re);
+	}
+
+	return NULL;
+}
+
+static void *
+lookup(struct event *ev, struct rtas_event *re, int scn_id)
+{
+	return re != NULL ? eager_get(re, scn_id) : event_scn(ev, scn_id);
+}
+
+/**
+ * dispatch_lookups
+ * @brief Make the section lookups dispatch_rtas_event() makes
+ *
+ * Follows the handling of an event through check_platform_dump(),
+ * dedup_event(), the handler for its type, process_v6() or
+ * process_pre_v6() and log_event().
+ *
+ * @param ev the event
+ * @param re the parsed event for the eager lookups, NULL for event_scn()
+ */
+static void
+dispatch_lookups(struct event *ev, struct rtas_event *re)
+{
+	unsigned char *buf = (unsigned char *)ev->event_buf;
+	struct rtas_event_exthdr *exthdr;
+	int version = buf[0], type = buf[3];
+
+	lookup(ev, re, RTAS_DUMP_SCN);
+
+	switch (type) {
+	case RTAS_HDR_TYPE_EPOW:
+	case RTAS_HDR_TYPE_DUMP_NOTIFICATION:
+	case RTAS_HDR_TYPE_PRRN:
+	case RTAS_HDR_TYPE_HOTPLUG:
+		break;
+	default:
+		exthdr = lookup(ev, re, RTAS_EVENT_EXT_HDR);
+		if (exthdr != NULL && version == 6 &&
+		    (exthdr->recoverable || exthdr->predictive))
+			lookup(ev, re, RTAS_PSRC_SCN);
+	}
+
+	switch (type) {
+	case RTAS_HDR_TYPE_CACHE_PARITY:
+		if (version < 6) {
+			lookup(ev, re, RTAS_EVENT_EXT_HDR);
+			lookup(ev, re, RTAS_CPU_SCN);
+		}
+		break;
+	case RTAS_HDR_TYPE_RESOURCE_DEALLOC:
+		if (version >= 6)
+			lookup(ev, re, RTAS_LRI_SCN);
+		break;
+	case RTAS_HDR_TYPE_EPOW:
+		lookup(ev, re, RTAS_EPOW_SCN);
+		break;
+	case RTAS_HDR_TYPE_PLATFORM_ERROR:
+	case RTAS_HDR_TYPE_PLATFORM_INFO:
+		if (version == 6)
+			lookup(ev, re, RTAS_PSRC_SCN);
+		break;
+	case RTAS_HDR_TYPE_PRRN:
+		return;
+	case RTAS_HDR_TYPE_HOTPLUG:
+		if (version >= 6)
+			lookup(ev, re, RTAS_HP_SCN);
+		break;
+	}
+
+	if (lookup(ev, re, RTAS_EVENT_EXT_HDR) == NULL)
+		return;
+
+	if (version == 6) {
+		lookup(ev, re, RTAS_PRIV_HDR_SCN);	/* get_event_date() */
+		lookup(ev, re, RTAS_MT_SCN);
+		lookup(ev, re, RTAS_EVENT_EXT_HDR);
+		lookup(ev, re, RTAS_PRIV_HDR_SCN);
+		if (lookup(ev, re, RTAS_USR_HDR_SCN) == NULL)
+			return;
+		if (lookup(ev, re, RTAS_PSRC_SCN) != NULL)
+			lookup(ev, re, RTAS_PSRC_SCN);	/* report_src() */
+	} else {
+		lookup(ev, re, RTAS_EVENT_EXT_HDR);	/* get_event_date() */
+		lookup(ev, re, RTAS_EVENT_EXT_HDR);
+	}
+}
+
+/* Read the binary event back out of a platform log style text file */
+static int
+read_event_file(const char *path, struct event *ev, int *len)
+{
+	FILE	*fp;
+	char	line[256], *p;
+	unsigned int byte;
+	int	n;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	*len = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, "RTAS ", 5) != 0)
+			continue;
+
+		p = strchr(line, ':');
+		if (p == NULL)
+			continue;
+		p++;
+
+		while (*p != '\0' && *p != '\n') {
+			if (*p == ' ') {
+				p++;
+				continue;
+			}
+			if (sscanf(p, "%2x%n", &byte, &n) != 1)
+				break;
+			if (*len >= RTAS_ERROR_LOG_MAX)
+				break;
+			ev->event_buf[(*len)++] = byte;
+			p += n;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * check_decoded
+ * @brief Compare the fields rtas_errd reads from a decoded section
+ *
+ * @return 0 if they match
+ */
+static int
+check_decoded(const char *path, struct event *ev, struct rtas_event *re,
+	      int scn_id)
+{
+	const char *name;
+	int differs;
+
+	switch (scn_id) {
+	case RTAS_EVENT_EXT_HDR: {
+		struct rtas_event_exthdr *a = eager_get(re, scn_id);
+		struct rtas_event_exthdr *b = event_scn(ev, scn_id);
+
+		if (a == NULL || b == NULL)
+			return 0;
+		name = "extended header";
+		differs = a->unrecoverable != b->unrecoverable ||
+			  a->recoverable != b->recoverable ||
+			  a->unrecoverable_bypassed !=
+				b->unrecoverable_bypassed ||
+			  a->predictive != b->predictive ||
+			  a->power_pc != b->power_pc;
+		if (ev->rtas_hdr->version < 6)
+			differs |= memcmp(&a->time, &b->time,
+					  sizeof(a->time)) ||
+				   memcmp(&a->date, &b->date,
+					  sizeof(a->date));
+		break;
+	}
+	case RTAS_PRIV_HDR_SCN: {
+		struct rtas_priv_hdr_scn *a = eager_get(re, scn_id);
+		struct rtas_priv_hdr_scn *b = event_scn(ev, scn_id);
+
+		if (a == NULL || b == NULL)
+			return 0;
+		name = "PH section";
+		differs = memcmp(&a->date, &b->date, sizeof(a->date)) ||
+			  memcmp(&a->time, &b->time, sizeof(a->time)) ||
+			  a->creator_id != b->creator_id ||
+			  a->plid != b->plid;
+		break;
+	}
+	case RTAS_USR_HDR_SCN: {
+		struct rtas_usr_hdr_scn *a = eager_get(re, scn_id);
+		struct rtas_usr_hdr_scn *b = event_scn(ev, scn_id);
+
+		if (a == NULL || b == NULL)
+			return 0;
+		name = "UH section";
+		differs = a->subsystem_id != b->subsystem_id ||
+			  a->event_severity != b->event_severity ||
+			  a->event_type != b->event_type ||
+			  a->action != b->action;
+		break;
+	}
+	case RTAS_MT_SCN: {
+		struct rtas_mt_scn *a = eager_get(re, scn_id);
+		struct rtas_mt_scn *b = event_scn(ev, scn_id);
+
+		if (a == NULL || b == NULL)
+			return 0;
+		name = "MT section";
+		differs = strcmp(a->mtms.model, b->mtms.model) ||
+			  strcmp(a->mtms.serial_no, b->mtms.serial_no);
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	if (differs) {
+		fprintf(stderr, "FAIL: %s: %s differs\n", path, name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * check_event
+ * @brief Compare the lazy lookups of an event with librtasevent's
+ *
+ * @return 0 if they match
+ */
+static int
+check_event(const char *path, struct event *ev, int len)
+{
+	struct rtas_event *re;
+	struct rtas_event_hdr *hdr;
+	int i, rc = 0;
+
+	re = parse_rtas_event(ev->event_buf, len);
+	if (re == NULL) {
+		fprintf(stderr, "%s: librtasevent could not parse the event\n",
+			path);
+		return -1;
+	}
+	hdr = rtas_get_event_hdr_scn(re);
+
+	if (event_scn_index(ev, len) || hdr == NULL ||
+	    ev->rtas_hdr->version != hdr->version ||
+	    ev->rtas_hdr->severity != hdr->severity ||
+	    ev->rtas_hdr->disposition != hdr->disposition ||
+	    ev->rtas_hdr->extended != hdr->extended ||
+	    ev->rtas_hdr->initiator != hdr->initiator ||
+	    ev->rtas_hdr->target != hdr->target ||
+	    ev->rtas_hdr->type != hdr->type ||
+	    ev->length != re->event_length) {
+		fprintf(stderr, "FAIL: %s: event header differs\n", path);
+		rc = -1;
+	}
+
+	for (i = 0; i < N_ALL; i++) {
+		if ((eager_get(re, all_scns[i]) == NULL) !=
+		    (event_scn(ev, all_scns[i]) == NULL)) {
+			fprintf(stderr, "FAIL: %s: section %d is %sfound\n",
+				path, all_scns[i],
+				event_scn(ev, all_scns[i]) ? "" : "not ");
+			rc = -1;
+		}
+		if (check_decoded(path, ev, re, all_scns[i]))
+			rc = -1;
+	}
+
+	event_scn_cleanup(ev);
+	cleanup_rtas_event(re);
+	return rc;
+}
+
+static double
+run_eager(struct event *events, int *lens, int nevents, int iterations)
+{
+	struct rtas_event *re;
+	double start = now();
+	int i, j;
+
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < nevents; i++) {
+			re = parse_rtas_event(events[i].event_buf, lens[i]);
+			if (re == NULL)
+				continue;
+			rtas_get_event_hdr_scn(re);
+			dispatch_lookups(&events[i], re);
+			cleanup_rtas_event(re);
+		}
+	}
+
+	return now() - start;
+}
+
+static double
+run_lazy(struct event *events, int *lens, int nevents, int iterations,
+	 int *parsed)
+{
+	double start = now();
+	int i, j;
+
+	*parsed = 0;
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < nevents; i++) {
+			if (event_scn_index(&events[i], lens[i]))
+				continue;
+			dispatch_lookups(&events[i], NULL);
+			if (j == 0 && events[i].scn_dir.parsed)
+				(*parsed)++;
+			event_scn_cleanup(&events[i]);
+		}
+	}
+
+	return now() - start;
+}
+
+static void
+report(const char *name, double t_eager, double t_lazy, int nevents,
+       int iterations, int parsed)
+{
+	double n = (double)nevents * iterations;
+
+	printf("%s: eager %8.3f usecs/event, lazy %8.3f usecs/event",
+	       name, t_eager * 1e6 / n, t_lazy * 1e6 / n);
+	if (t_lazy > 0)
+		printf(", %5.1fx", t_eager / t_lazy);
+	printf(", %d of %d events parsed\n", parsed, nevents);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct event *events;
+	int	*lens;
+	int	nevents, iterations = 10000;
+	int	i, c, parsed, rc = 0;
+	double	t_eager, t_lazy;
+
+	while ((c = getopt(argc, argv, "i:h")) != EOF) {
+		switch (c) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-i iterations] "
+				"event file ...\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	nevents = argc - optind;
+	if (nevents == 0) {
+		fprintf(stderr, "Usage: %s [-i iterations] event file ...\n",
+			argv[0]);
+		return 1;
+	}
+
+	events = calloc(nevents, sizeof(*events));
+	lens = calloc(nevents, sizeof(*lens));
+	if (events == NULL || lens == NULL) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < nevents; i++) {
+		if (read_event_file(argv[optind + i], &events[i], &lens[i]))
+			return 1;
+		events[i].seq_num = i + 1;
+	}
+
+	/* First make sure the lookups agree */
+	for (i = 0; i < nevents; i++)
+		if (check_event(argv[optind + i], &events[i], lens[i]))
+			rc = 1;
+	if (rc || iterations <= 0)
+		return rc;
+
+	printf("%d events, %d iterations: lookups identical\n", nevents,
+	       iterations);
+
+	t_eager = run_eager(events, lens, nevents, iterations);
+	t_lazy = run_lazy(events, lens, nevents, iterations, &parsed);
+	report("dispatch", t_eager, t_lazy, nevents, iterations, parsed);
+
+	free(lens);
+	free(events);
+	return 0;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file symptom_test.c
+ * @brief Check the symptom bit index against the signature walk
+ *
+ * symptom_seqn() must find the same sequence number, and so the same
+ * SRN and reason code message, as the walk over the signatures that
+ * convert_symptom() used to make:
+ *
+ *   - for every possible value of the 8 and 16 bit symptom bits
+ *     (CPU, memory, I/O and additional SP formats),
+ *   - for every SP symptom bits value with up to two bits set, plus
+ *     pseudo random ones,
+ *   - for the symptom bits of every version 3 to 5 event given, or by
+ *     default of the ones in $srcdir/rtas_errd/tests/events.
+ *
+ * Usage: symptom_test [event file ...]
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <limits.h>
+#include <librtasevent.h>
+
+#include "fru_prev6.h"
+#include "dchrp.h"
+#include "symptom.h"
+
+#define RTAS_ERROR_LOG_MAX	4096
+
+static const char *table_names[SYMPTOM_TABLES] = {
+	[SYMPTOM_CPU]		= "cpu",
+	[SYMPTOM_MEM]		= "memory",
+	[SYMPTOM_IO]		= "io",
+	[SYMPTOM_SP]		= "sp",
+	[SYMPTOM_SP_ADDITIONAL]	= "sp additional",
+};
+
+/* The signature walk of the previous convert_symptom() */
+static int
+walk_seqn(enum symptom_table_id table, uint32_t sbits)
+{
+	const struct symptom_table *t = &symptom_tables[table];
+	int seqn = 1;
+
+	while (seqn < t->nsigs) {
+		if ((sbits & t->sigs[seqn]) == t->sigs[seqn])
+			break;
+		seqn++;
+	}
+	if (seqn >= t->nsigs)
+		seqn = 0;
+
+	return seqn;
+}
+
+static int failures;
+
+static void
+check(enum symptom_table_id table, uint32_t sbits, const char *what)
+{
+	const struct symptom_table *t = &symptom_tables[table];
+	int want = walk_seqn(table, sbits);
+	int got = symptom_seqn(table, sbits);
+
+	if (got == want && t->msgs[got][0] == t->msgs[want][0] &&
+	    t->msgs[got][1] == t->msgs[want][1])
+		return;
+
+	if (failures++ < 20)
+		fprintf(stderr, "FAIL: %s%s%s symptom bits 0x%x: sequence "
+			"number %d, expected %d\n", what ? what : "",
+			what ? ": " : "", table_names[table], sbits, got, want);
+}
+
+/* Read the binary event back out of a platform log style text file */
+static int
+read_event_file(const char *path, unsigned char *buf, int *len)
+{
+	FILE	*fp;
+	char	line[256], *p;
+	unsigned int byte;
+	int	n;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	*len = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, "RTAS ", 5) != 0)
+			continue;
+
+		p = strchr(line, ':');
+		if (p == NULL)
+			continue;
+		p++;
+
+		while (*p != '\0' && *p != '\n') {
+			if (*p == ' ') {
+				p++;
+				continue;
+			}
+			if (sscanf(p, "%2x%n", &byte, &n) != 1)
+				break;
+			if (*len >= RTAS_ERROR_LOG_MAX)
+				break;
+			buf[(*len)++] = byte;
+			p += n;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/**
+ * check_event
+ * @brief Check the symptom bits of an event as convert_symptom() has them
+ *
+ * @return 1 if the event was checked, 0 if it is not a version 3 to 5
+ *	event with symptom bits, -1 if it could not be read
+ */
+static int
+check_event(const char *path)
+{
+	unsigned char buf[RTAS_ERROR_LOG_MAX];
+	uint32_t sbits;
+	int len;
+
+	memset(buf, 0, sizeof(buf));
+	if (read_event_file(path, buf, &len))
+		return -1;
+
+	if (len <= I_BYTE28 || buf[0] < 3 || buf[0] >= 6)
+		return 0;
+
+	switch (buf[I_FORMAT] & 0x0F) {
+	case RTAS_EXTHDR_FMT_CPU:
+		check(SYMPTOM_CPU, buf[I_BYTE12], path);
+		break;
+	case RTAS_EXTHDR_FMT_MEMORY:
+		check(SYMPTOM_MEM, buf[I_BYTE12] << 8 | buf[I_BYTE13], path);
+		break;
+	case RTAS_EXTHDR_FMT_IO:
+		check(SYMPTOM_IO, (buf[I_BYTE12] << 8 | buf[I_BYTE13]) &
+		      0x0FF1F, path);
+		break;
+	case RTAS_EXTHDR_FMT_IBM_SP:
+		sbits = (uint32_t)buf[I_BYTE16] << 24 | buf[I_BYTE17] << 16 |
+			buf[I_BYTE18] << 8 | buf[I_BYTE19];
+		if (sbits)
+			check(SYMPTOM_SP, sbits, path);
+		else
+			check(SYMPTOM_SP_ADDITIONAL, buf[I_BYTE28], path);
+		break;
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+check_event_dir(const char *dir)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *d;
+	int n = 0;
+
+	d = opendir(dir);
+	if (d == NULL)
+		return 0;
+
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", dir,
+			     de->d_name) >= sizeof(path))
+			continue;
+		if (check_event(path) > 0)
+			n++;
+	}
+
+	closedir(d);
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	char dir[PATH_MAX];
+	uint32_t sbits, seed = 1;
+	int i, j, nevents = 0;
+
+	for (sbits = 0; sbits < 0x100; sbits++) {
+		check(SYMPTOM_CPU, sbits, NULL);
+		check(SYMPTOM_SP_ADDITIONAL, sbits, NULL);
+	}
+
+	for (sbits = 0; sbits < 0x10000; sbits++) {
+		check(SYMPTOM_MEM, sbits, NULL);
+		check(SYMPTOM_IO, sbits, NULL);
+	}
+
+	check(SYMPTOM_SP, 0, NULL);
+	for (i = 0; i < 32; i++)
+		for (j = i; j < 32; j++)
+			check(SYMPTOM_SP, 1U << i | 1U << j, NULL);
+	for (i = 0; i < 1000000; i++) {
+		seed = seed * 1103515245 + 12345;
+		check(SYMPTOM_SP, seed, NULL);
+	}
+
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			if (check_event(argv[i]) > 0)
+				nevents++;
+	} else {
+		snprintf(dir, sizeof(dir), "%s/rtas_errd/tests/events",
+			 getenv("srcdir") ? getenv("srcdir") : ".");
+		nevents = check_event_dir(dir);
+	}
+
+	if (failures) {
+		fprintf(stderr, "%d symptom bits lookups differ\n", failures);
+		return 1;
+	}
+
+	printf("symptom bits lookups identical, %d pre-v6 events checked\n",
+	       nevents);
+	return 0;
+}
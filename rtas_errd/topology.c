@@ -0,0 +1,567 @@
+/**
+ * @file topology.c
+ * @brief In memory index of the CPUs and LMBs of the partition
+ *
+ * Copyright (C) 2004 IBM Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <endian.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "rtas_errd.h"
+
+/*
+ * Guarding a CPU or an LMB needs the drc-name of the resource.  Rather
+ * than scanning the device tree (or running convert_dt_node_props) for
+ * each request, it is looked up in an index of:
+ *
+ *   - every CPU node: its interrupt servers and drc-index,
+ *   - the CPU and memory drc-index to drc-name tables, from the
+ *     ibm,drc-info property or the older ibm,drc-indexes and
+ *     ibm,drc-names pair (see convert_dt_node_props.c).
+ *
+ * The number of LMBs online is still counted from sysfs each time.
+ *
+ * Like the VPD cache, the index is built at startup and rebuilt by the
+ * next lookup once hotplug, PRRN or a drmgr run of rtas_errd's own has
+ * marked it out of date.  A CPU that is not in the index, e.g. one
+ * added by DLPAR from the HMC, also has the index rebuilt once.
+ */
+
+#define DT_CPUS			"/proc/device-tree/cpus"
+#define SYSFS_MEMORY		"/sys/devices/system/memory"
+
+struct drc_table {
+	const char	*drc_type;	/**< in ibm,drc-info */
+	const char	*v1_indexes;
+	const char	*v1_names;
+	const char	*v2_info;
+};
+
+static const struct drc_table cpu_drcs = {
+	"CPU",
+	DT_CPUS "/ibm,drc-indexes",
+	DT_CPUS "/ibm,drc-names",
+	DT_CPUS "/ibm,drc-info",
+};
+
+static const struct drc_table mem_drcs = {
+	"MEM",
+	"/proc/device-tree/ibm,drc-indexes",
+	"/proc/device-tree/ibm,drc-names",
+	"/proc/device-tree/ibm,drc-info",
+};
+
+/**
+ * @struct drc_range
+ * @brief drc-indexes with names of the form <prefix><suffix>
+ *
+ * An ibm,drc-info entry; an ibm,drc-names entry is a range of one
+ * whose name is the prefix alone.
+ */
+struct drc_range {
+	uint32_t	start;		/**< first drc-index */
+	uint32_t	count;
+	uint32_t	incr;
+	uint32_t	suffix;		/**< of the name of start, -1 if none */
+	char		*prefix;
+};
+
+struct drc_ranges {
+	struct drc_range	*ranges;
+	int			n;
+};
+
+struct topo_cpu {
+	uint32_t	drc_index;
+	uint32_t	*servers;	/**< interrupt servers, host order */
+	int		nservers;
+};
+
+static struct topo_cpu		*cpus;
+static int			ncpus;
+static struct drc_ranges	cpu_names;
+static struct drc_ranges	mem_names;
+static int			topology_valid;
+
+/**
+ * read_prop
+ * @brief Read a whole device tree property
+ *
+ * @param path property file
+ * @param len set to the length of the property
+ * @return malloc'ed property value, NULL on failure
+ */
+static char *
+read_prop(const char *path, int *len)
+{
+	struct stat sbuf;
+	char *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &sbuf) || sbuf.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+
+	buf = malloc(sbuf.st_size + 1);
+	if (buf == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	*len = read(fd, buf, sbuf.st_size);
+	close(fd);
+	if (*len <= 0) {
+		free(buf);
+		return NULL;
+	}
+	buf[*len] = '\0';
+
+	return buf;
+}
+
+static uint32_t
+prop_u32(const char *p)
+{
+	uint32_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return be32toh(val);
+}
+
+static void
+free_ranges(struct drc_ranges *r)
+{
+	int i;
+
+	for (i = 0; i < r->n; i++)
+		free(r->ranges[i].prefix);
+	free(r->ranges);
+	r->ranges = NULL;
+	r->n = 0;
+}
+
+static int
+add_range(struct drc_ranges *r, uint32_t start, uint32_t count,
+	  uint32_t incr, uint32_t suffix, const char *prefix)
+{
+	struct drc_range *ranges;
+
+	ranges = realloc(r->ranges, (r->n + 1) * sizeof(*ranges));
+	if (ranges == NULL)
+		return -1;
+	r->ranges = ranges;
+
+	ranges[r->n].prefix = strdup(prefix);
+	if (ranges[r->n].prefix == NULL)
+		return -1;
+
+	ranges[r->n].start = start;
+	ranges[r->n].count = count;
+	ranges[r->n].incr = incr;
+	ranges[r->n].suffix = suffix;
+	r->n++;
+	return 0;
+}
+
+/**
+ * load_drc_info
+ * @brief Load the ranges of a drc type from an ibm,drc-info property
+ *
+ * @return 0 on success, -1 if the property is malformed or out of memory
+ */
+static int
+load_drc_info(const struct drc_table *t, char *buf, int len,
+	      struct drc_ranges *r)
+{
+	char *p = buf + 4, *end = buf + len, *type, *prefix;
+	uint32_t i, num;
+
+	if (len < 4)
+		return -1;
+	num = prop_u32(buf);
+
+	for (i = 0; i < num; i++) {
+		type = p;
+		p += strnlen(p, end - p) + 1;
+		prefix = p;
+		p += strnlen(p, end - p) + 1;
+
+		/* drc-index-start, suffix-start, count, increment, domain */
+		if (p + 5 * 4 > end)
+			return -1;
+
+		if (!strcmp(type, t->drc_type) &&
+		    add_range(r, prop_u32(p), prop_u32(p + 8),
+			      prop_u32(p + 12), prop_u32(p + 4), prefix))
+			return -1;
+
+		p += 5 * 4;
+	}
+
+	return 0;
+}
+
+/**
+ * load_drc_names
+ * @brief Load drc-index to drc-name pairs from ibm,drc-indexes and names
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+static int
+load_drc_names(const struct drc_table *t, struct drc_ranges *r)
+{
+	char *indexes, *names, *p, *end;
+	int ilen, nlen, rc = -1;
+	uint32_t i, num;
+
+	/* No such resources is not a failure */
+	indexes = read_prop(t->v1_indexes, &ilen);
+	names = read_prop(t->v1_names, &nlen);
+	if (indexes == NULL || names == NULL || ilen < 4 || nlen < 4) {
+		rc = 0;
+		goto out;
+	}
+
+	num = prop_u32(indexes);
+	p = names + 4;
+	end = names + nlen;
+	for (i = 0; i < num && 4 + (i + 1) * 4 <= ilen && p < end; i++) {
+		if (add_range(r, prop_u32(indexes + 4 + i * 4), 1, 1,
+			      (uint32_t)-1, p))
+			goto out;
+		p += strnlen(p, end - p) + 1;
+	}
+	rc = 0;
+
+out:
+	free(indexes);
+	free(names);
+	return rc;
+}
+
+static int
+load_drc_table(const struct drc_table *t, struct drc_ranges *r)
+{
+	char *info;
+	int len, rc;
+
+	info = read_prop(t->v2_info, &len);
+	if (info == NULL)
+		return load_drc_names(t, r);
+
+	rc = load_drc_info(t, info, len, r);
+	free(info);
+	return rc;
+}
+
+/**
+ * load_cpus
+ * @brief Index the interrupt servers and drc-index of every CPU node
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+static int
+load_cpus(void)
+{
+	struct topo_cpu *cpu;
+	struct dirent *de;
+	char path[PATH_MAX], *servers, *drc;
+	int slen, dlen, i;
+	DIR *dir;
+
+	dir = opendir(DT_CPUS);
+	if (dir == NULL)
+		return 0;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp(de->d_name, "PowerPC,POWER", 13))
+			continue;
+
+		snprintf(path, sizeof(path), DT_CPUS "/%s/"
+			 "ibm,ppc-interrupt-server#s", de->d_name);
+		servers = read_prop(path, &slen);
+		snprintf(path, sizeof(path), DT_CPUS "/%s/ibm,my-drc-index",
+			 de->d_name);
+		drc = read_prop(path, &dlen);
+
+		if (servers == NULL || drc == NULL || slen < 4 || dlen < 4) {
+			free(servers);
+			free(drc);
+			continue;
+		}
+
+		cpu = realloc(cpus, (ncpus + 1) * sizeof(*cpus));
+		if (cpu == NULL) {
+			free(servers);
+			free(drc);
+			closedir(dir);
+			return -1;
+		}
+		cpus = cpu;
+		cpu = &cpus[ncpus++];
+
+		cpu->drc_index = prop_u32(drc);
+		cpu->nservers = slen / 4;
+		cpu->servers = (uint32_t *)servers;
+		for (i = 0; i < cpu->nservers; i++)
+			cpu->servers[i] = prop_u32(servers + i * 4);
+
+		free(drc);
+	}
+
+	closedir(dir);
+	return 0;
+}
+
+/**
+ * count_online_lmbs
+ * @brief Count the memory blocks that are online
+ */
+static int
+count_online_lmbs(void)
+{
+	struct dirent *de;
+	char path[PATH_MAX], state[7];
+	int fd, n = 0;
+	DIR *dir;
+
+	dir = opendir(SYSFS_MEMORY);
+	if (dir == NULL)
+		return 0;
+
+	while ((de = readdir(dir)) != NULL) {
+		/* ignore memory@0 situation */
+		if (!strncmp(de->d_name, "memory@0", 8) ||
+		    strncmp(de->d_name, "memory", 6))
+			continue;
+
+		snprintf(path, sizeof(path), SYSFS_MEMORY "/%s/state",
+			 de->d_name);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			continue;
+
+		if (read(fd, state, 6) == 6 && !strncmp(state, "online", 6))
+			n++;
+		close(fd);
+	}
+
+	closedir(dir);
+	return n;
+}
+
+/**
+ * topology_free
+ * @brief Free the topology index
+ */
+void
+topology_free(void)
+{
+	int i;
+
+	for (i = 0; i < ncpus; i++)
+		free(cpus[i].servers);
+	free(cpus);
+	cpus = NULL;
+	ncpus = 0;
+
+	free_ranges(&cpu_names);
+	free_ranges(&mem_names);
+	topology_valid = 0;
+}
+
+/**
+ * topology_build
+ * @brief (Re)build the topology index
+ *
+ * @return 0 on success, !0 on failure
+ */
+static int
+topology_build(void)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	topology_free();
+
+	if (load_cpus() || load_drc_table(&cpu_drcs, &cpu_names) ||
+	    load_drc_table(&mem_drcs, &mem_names)) {
+		topology_free();
+		dbg("Could not build the topology index");
+		return 1;
+	}
+
+	topology_valid = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dbg("Topology index: %d CPUs, %d CPU and %d memory drc ranges, "
+	    "built in %ld msecs", ncpus, cpu_names.n, mem_names.n,
+	    (end.tv_sec - start.tv_sec) * 1000 +
+	    (end.tv_nsec - start.tv_nsec) / 1000000);
+
+	return 0;
+}
+
+/**
+ * topology_init
+ * @brief Build the topology index at startup
+ */
+void
+topology_init(void)
+{
+	if (topology_build())
+		dbg("Could not build the topology index, lookups will retry");
+}
+
+/**
+ * topology_invalidate
+ * @brief Mark the topology index out of date
+ *
+ * Called once CPUs or memory may have been added, removed or renamed.
+ * The index is rebuilt by the next lookup.
+ */
+void
+topology_invalidate(void)
+{
+	if (topology_valid)
+		dbg("Topology index invalidated");
+
+	topology_valid = 0;
+}
+
+/**
+ * drc_name
+ * @brief Look up the drc-name of a drc-index
+ *
+ * @return length of the full drc-name, which is truncated if it is
+ *	bufsize or more, -1 if the drc-index is not known
+ */
+static int
+drc_name(struct drc_ranges *r, uint32_t drc_index, char *buf, int bufsize)
+{
+	struct drc_range *range;
+	int i;
+
+	for (i = 0; i < r->n; i++) {
+		range = &r->ranges[i];
+
+		if (range->count == 0 || drc_index < range->start ||
+		    drc_index > range->start +
+		    (uint64_t)(range->count - 1) * range->incr)
+			continue;
+
+		/* As convert_dt_node_props names them */
+		if (range->suffix == (uint32_t)-1)
+			return snprintf(buf, bufsize, "%s", range->prefix);
+
+		return snprintf(buf, bufsize, "%s%u", range->prefix,
+				range->suffix + drc_index - range->start);
+	}
+
+	return -1;
+}
+
+static struct topo_cpu *
+find_cpu(uint32_t server)
+{
+	int i, j;
+
+	for (i = 0; i < ncpus; i++)
+		for (j = 0; j < cpus[i].nservers; j++)
+			if (cpus[i].servers[j] == server)
+				return &cpus[i];
+
+	return NULL;
+}
+
+/**
+ * topology_cpu_drc_name
+ * @brief Look up the drc-name of a CPU
+ *
+ * @param server interrupt server number (logical ID) of the CPU
+ * @param buf buffer for the drc-name
+ * @param bufsize size of buf
+ * @return length of the drc-name as for drc_name(), -1 if the CPU or its
+ *	drc-name is not known
+ */
+int
+topology_cpu_drc_name(uint32_t server, char *buf, int bufsize)
+{
+	struct topo_cpu *cpu;
+
+	if (!topology_valid && topology_build())
+		return -1;
+
+	cpu = find_cpu(server);
+	if (cpu == NULL) {
+		/* Added since the index was built? */
+		if (topology_build())
+			return -1;
+		cpu = find_cpu(server);
+		if (cpu == NULL)
+			return -1;
+	}
+
+	return drc_name(&cpu_names, cpu->drc_index, buf, bufsize);
+}
+
+/**
+ * topology_mem_drc_name
+ * @brief Look up the drc-name of an LMB
+ *
+ * @param drc_index drc-index of the LMB
+ * @param buf buffer for the drc-name
+ * @param bufsize size of buf
+ * @return length of the drc-name as for drc_name(), -1 if it is not known
+ */
+int
+topology_mem_drc_name(uint32_t drc_index, char *buf, int bufsize)
+{
+	if (!topology_valid && topology_build())
+		return -1;
+
+	return drc_name(&mem_names, drc_index, buf, bufsize);
+}
+
+/**
+ * topology_online_lmbs
+ * @brief Retrieve the number of memory blocks online
+ *
+ * Not cached with the rest of the index: memory may be taken offline
+ * by DLPAR operations rtas_errd does not see, or by its own drmgr
+ * runs still queued to the helper, without a hotplug event.
+ */
+int
+topology_online_lmbs(void)
+{
+	return count_online_lmbs();
+}
@@ -73,6 +73,58 @@ char *messages_log = NULL;
  */
 static int msgs_log_fd = -1;
 
+/**
+ * @var checkpoint_file
+ * @brief Records the last RTAS event handled and how far into syslog
+ * it was, see update_checkpoint().
+ */
+/**
+ * @var ckpt_fd
+ * @brief File descriptor for checkpoint_file
+ */
+char *checkpoint_file = "/var/log/rtas_errd.checkpoint";
+static int ckpt_fd = -1;
+
+/* Last event handled, and last one whose queued work was committed */
+static int handled_seq = -1;
+static int flushed_seq = -1;
+
+#ifdef DEBUG
+/**
+ * @var journal_file
+ * @brief journal file to recover RTAS events from, instead of the
+ * system journal
+ */
+char *journal_file = NULL;
+#endif
+
+/**
+ * @def CKPT_LEN
+ * @brief Length of the checkpoint record
+ */
+#define CKPT_LEN	(10 + 1 + 20 + 1 + 20 + 1)
+
+/**
+ * @def CKPT_CURSOR_MAX
+ * @brief Maximum length of the journal cursor stored after the record
+ */
+#define CKPT_CURSOR_MAX	512
+
+/**
+ * @def CKPT_REWIND
+ * @brief How far before the checkpoint offset to start searching
+ * syslog.  This covers events that were read from the kernel, and so
+ * already in syslog, but not yet handled when the checkpoint was
+ * written.
+ */
+#define CKPT_REWIND	(4 * 1024 * 1024)
+
+struct rtas_checkpoint {
+	int			seq_num;
+	unsigned long long	offset;
+	unsigned long long	inode;
+};
+
 /**
  * setup_bc
  * @brief Initalize the bad character array for a Boyer-Moore search
@@ -196,32 +248,350 @@ get_rtas_no(char *ptr)
 	return strtoul(ptr, NULL, 10);
 }
 
+/**
+ * find_rtas_start_rev
+ * @brief Find the beginning of the last RTAS event before a point.
+ *
+ * @param textstart pointer to the start of the text
+ * @param textend pointer to where to search backwards from
+ * @return pointer to RTAS event start on success, NULL on failure.
+ */
+static char *
+find_rtas_start_rev(char *textstart, char *textend)
+{
+	int	len = strlen(RTAS_START);
+	char	*p;
+
+	if (textstart == NULL)
+		return NULL;
+
+	for (p = textend - len; p >= textstart; p--) {
+		if (*p == 'R' && memcmp(p, RTAS_START, len) == 0)
+			return p;
+	}
+
+	return NULL;
+}
+
+/**
+ * read_checkpoint
+ * @brief Read the last checkpoint written by update_checkpoint()
+ *
+ * @param ckpt buffer to read the checkpoint in to
+ * @return 0 on success, !0 if there is no valid checkpoint
+ */
+static int
+read_checkpoint(struct rtas_checkpoint *ckpt)
+{
+	char	buf[CKPT_LEN + 1];
+	int	len;
+
+	if (ckpt_fd < 0)
+		return -1;
+
+	len = pread(ckpt_fd, buf, CKPT_LEN, 0);
+	if (len != CKPT_LEN)
+		return -1;
+	buf[len] = '\0';
+
+	if (sscanf(buf, "%d %llu %llu", &ckpt->seq_num, &ckpt->offset,
+		   &ckpt->inode) != 3)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * read_checkpoint_cursor
+ * @brief Read the journal cursor saved after the checkpoint record
+ *
+ * @param buf buffer to read the cursor in to
+ * @param buflen size of buf
+ * @return 0 on success, !0 if no cursor has been saved
+ */
+int
+read_checkpoint_cursor(char *buf, int buflen)
+{
+	char	*nl;
+	int	len;
+
+	if (ckpt_fd < 0)
+		return -1;
+
+	len = pread(ckpt_fd, buf, buflen - 1, CKPT_LEN);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	nl = strchr(buf, '\n');
+	if (nl == NULL)
+		return -1;
+	*nl = '\0';
+
+	return 0;
+}
+
+/**
+ * update_checkpoint_cursor
+ * @brief Save a journal cursor after the checkpoint record
+ *
+ * @param cursor journal cursor of the last entry searched
+ */
+void
+update_checkpoint_cursor(const char *cursor)
+{
+	char	buf[CKPT_CURSOR_MAX];
+	int	len;
+
+	if (ckpt_fd < 0)
+		return;
+
+	len = snprintf(buf, sizeof(buf), "%s\n", cursor);
+	if (len >= sizeof(buf))
+		return;
+
+	if (pwrite(ckpt_fd, buf, len, CKPT_LEN) != len ||
+	    ftruncate(ckpt_fd, CKPT_LEN + len))
+		dbg("Could not save journal cursor to %s, %s",
+		    checkpoint_file, strerror(errno));
+}
+
+/**
+ * update_checkpoint
+ * @brief Record the last RTAS event handled by rtas_errd
+ *
+ * Saves the sequence number of the last handled event along with the
+ * current size and inode of syslog, so the next start of rtas_errd only
+ * has to look at the part of syslog written after this point to find
+ * events it missed.  The record is fixed length and always rewritten
+ * in place.  It is not synced; a stale checkpoint only means looking
+ * at more of syslog than necessary.
+ *
+ * @param seq_num sequence number of the event just handled
+ */
+static void
+update_checkpoint(int seq_num)
+{
+	struct stat	sbuf;
+	char		buf[CKPT_LEN + 1];
+	unsigned long long offset = 0, inode = 0;
+
+	if (ckpt_fd < 0)
+		return;
+
+	if (messages_log != NULL && stat(messages_log, &sbuf) == 0) {
+		offset = sbuf.st_size;
+		inode = sbuf.st_ino;
+	}
+
+	snprintf(buf, sizeof(buf), "%-10d %-20llu %-20llu\n",
+		 seq_num, offset, inode);
+	if (pwrite(ckpt_fd, buf, CKPT_LEN, 0) != CKPT_LEN)
+		dbg("Could not update %s, %s", checkpoint_file,
+		    strerror(errno));
+}
+
+/**
+ * checkpoint_handled
+ * @brief Note that an RTAS event has been handled
+ *
+ * The event only counts as handled in full, and the checkpoint moves
+ * past it, once checkpoint_flushed() finds its queued work committed.
+ *
+ * @param seq_num sequence number of the event just handled
+ */
+void
+checkpoint_handled(int seq_num)
+{
+	handled_seq = seq_num;
+}
+
+/**
+ * checkpoint_flushed
+ * @brief Move the checkpoint past the events handled in full
+ *
+ * An event is handled in full once its servicelog entry is committed,
+ * its drmgr run has completed and, if it is the repeat of an earlier
+ * event, the repeat has been saved to the spool or recorded.
+ * Until then its spool slot is kept, so a crash does not lose the work
+ * queued for it.  Called whenever queued work may have been committed.
+ */
+void
+checkpoint_flushed(void)
+{
+	int seq_num = handled_seq, pending;
+
+	if (hotplug_pending(&pending) && pending <= seq_num)
+		seq_num = pending - 1;
+	if (log_event_pending(&pending) && pending <= seq_num)
+		seq_num = pending - 1;
+	if (dedup_pending(&pending) && pending <= seq_num)
+		seq_num = pending - 1;
+
+	if (seq_num <= flushed_seq)
+		return;
+
+	spool_release_flushed(seq_num);
+	update_checkpoint(seq_num);
+	flushed_seq = seq_num;
+}
+
+/**
+ * handle_recovered_event
+ * @brief Handle an RTAS event recovered from the system log or spool
+ *
+ * @param event event with the seq_num and event_buf filled in
+ * @return 0 if the event was handled, !0 otherwise
+ */
+int
+handle_recovered_event(struct event *event)
+{
+	if (event_scn_index(event, RTAS_ERROR_LOG_MAX) ||
+	    event_rtas(event) == NULL) {
+		log_msg(NULL, "Could not update RTAS Event %d to %s",
+			event->seq_num, platform_log);
+		event_scn_cleanup(event);
+		return -1;
+	}
+
+	log_msg(NULL, "Updating RTAS event %d to %s",
+		event->seq_num, platform_log);
+
+	handle_rtas_event(event);
+	checkpoint_handled(event->seq_num);
+
+	if (event->loc_codes != NULL)
+		free(event->loc_codes);
+	free_diag_vpd(event);
+	event_scn_cleanup(event);
+
+	return 0;
+}
+
+/**
+ * last_platform_log_no
+ * @brief Find the number of the last RTAS event in the platform log
+ *
+ * @return event number, 0 if the log contains no events
+ */
+static int
+last_platform_log_no(void)
+{
+	struct stat	log_sbuf;
+	char		*log_mmap, *last_p;
+	int		last_rtas_log_no = 0;
+
+	if ((fstat(platform_log_fd, &log_sbuf)) < 0) {
+		log_msg(NULL, "Cannot get status of %s to update RTAS events",
+			platform_log);
+		return 0;
+	}
+
+	if (log_sbuf.st_size == 0)
+		return 0;
+
+	if ((log_mmap = mmap(0, log_sbuf.st_size, PROT_READ, MAP_PRIVATE,
+			     platform_log_fd, 0)) == (char *)-1) {
+		log_msg(NULL, "Cannot map %s to update RTAS events, %s",
+			platform_log, strerror(errno));
+		return 0;
+	}
+
+	/* The last event is at the end, search backwards for it */
+	last_p = find_rtas_start_rev(log_mmap, log_mmap + log_sbuf.st_size);
+	if (last_p != NULL)
+		last_rtas_log_no = get_rtas_no(last_p);
+
+	munmap(log_mmap, log_sbuf.st_size);
+
+	return last_rtas_log_no;
+}
+
 /**
  * update_rtas_msgs
  * @brief Update RTAS messages in the platform log
  *
  * Update the file /var/log/platform with any RTAS events
  * found in syslog that have not been handled by rtas_errd.
+ *
+ * The last handled event is the later of the last event in the
+ * platform log and the one recorded in the checkpoint file.  If the
+ * checkpoint is for the current syslog file, only syslog written
+ * since the checkpoint (plus CKPT_REWIND bytes, for events that were
+ * read but not yet handled when it was written) is searched.
+ * Otherwise syslog is searched backwards from the end until an event
+ * that has already been handled is found.
  */
 void
 update_rtas_msgs(void)
 {
-	struct stat	log_sbuf, msgs_sbuf;
-	char		*log_mmap = NULL, *log_mmap_end;
+	struct stat	msgs_sbuf;
+	struct rtas_checkpoint ckpt;
 	char		*msgs_mmap = NULL, *msgs_mmap_end;
-	char		*rtas_msgs_end, *rtas_msgs_start, *msgs_p;
-	char		*log_p;
-	char		*last_p;
-	int		last_rtas_log_no, last_rtas_msgs_no, cur_rtas_no;
-
-	messages_log = "/var/log/messages";
-	if (access(messages_log, R_OK)) {
-		/* try /var/log/syslog */
-		if (!access("/var/log/syslog", R_OK)) {
-			messages_log = "/var/log/syslog";
+	char		*rtas_msgs_end, *rtas_msgs_start;
+	char		*p;
+	int		last_rtas_log_no, cur_rtas_no, replay_seq, platform_seq;
+	int		have_ckpt;
+	off_t		scan_start = 0;
+
+	if (messages_log == NULL) {
+		messages_log = "/var/log/messages";
+		if (access(messages_log, R_OK)) {
+			/* try /var/log/syslog */
+			if (!access("/var/log/syslog", R_OK)) {
+				messages_log = "/var/log/syslog";
+			}
 		}
 	}
 
+	ckpt_fd = open(checkpoint_file, O_RDWR | O_CREAT,
+		       S_IRUSR | S_IWUSR | S_IRGRP /*0640*/);
+	if (ckpt_fd < 0)
+		log_msg(NULL, "Could not open checkpoint file %s, %s",
+			checkpoint_file, strerror(errno));
+
+	have_ckpt = !read_checkpoint(&ckpt);
+
+	/*
+	 * The archive may be behind the platform log, e.g. when it was
+	 * turned off for a while or could not be written; take the later
+	 */
+	last_rtas_log_no = archive_last_seq();
+	platform_seq = last_platform_log_no();
+	if (platform_seq > last_rtas_log_no)
+		last_rtas_log_no = platform_seq;
+
+	/*
+	 * Events the last run read from the kernel but did not handle
+	 * in full are in the spool; syslog is only needed for events that
+	 * were never read, e.g. because the kernel dropped them.  The
+	 * checkpoint only moves past an event once its queued work is
+	 * committed, so the spooled events after it are handled again
+	 * even if they already made it to the platform log.  The repeats
+	 * of events the last run saved are restored first, so they are
+	 * not counted again.
+	 */
+	dedup_restore();
+	replay_seq = spool_replay(have_ckpt ? ckpt.seq_num : last_rtas_log_no);
+	if (replay_seq > last_rtas_log_no)
+		last_rtas_log_no = replay_seq;
+	if (have_ckpt && ckpt.seq_num > last_rtas_log_no)
+		last_rtas_log_no = ckpt.seq_num;
+
+	if (d_cfg.recovery_source == RE_CFG_RECOVER_JOURNAL
+#ifdef DEBUG
+	    || journal_file != NULL
+#endif
+	   ) {
+#ifdef WITH_JOURNAL
+		last_rtas_log_no = journal_update_rtas_msgs(last_rtas_log_no);
+#else
+		log_msg(NULL, "rtas_errd was built without journal support, "
+			"missed RTAS events will not be recovered");
+#endif
+		goto cleanup;
+	}
+
 	if ((msgs_log_fd = open(messages_log, O_RDONLY)) < 0) {
 		log_msg(NULL, "Could not open %s to update RTAS events, %s",
 			messages_log, strerror(errno));
@@ -239,6 +609,16 @@ update_rtas_msgs(void)
 		goto cleanup;
 	}
 
+	/* Without any record of a handled event there is nothing to
+	 * catch up with.
+	 */
+	if (last_rtas_log_no == 0)
+		goto cleanup;
+
+	/*
+	 * Pages of syslog are only touched where we search, so mapping
+	 * all of it is cheap even for a very large file.
+	 */
 	if ((msgs_mmap = mmap(0, msgs_sbuf.st_size, PROT_READ, MAP_PRIVATE,
 			      msgs_log_fd, 0)) == (char *)-1) {
 		log_msg(NULL, "Cannot map %s to update RTAS events",
@@ -247,69 +627,33 @@ update_rtas_msgs(void)
 		goto cleanup;
 	}
 
-        msgs_p = msgs_mmap;
 	msgs_mmap_end = msgs_mmap + msgs_sbuf.st_size;
 
-	if ((fstat(platform_log_fd, &log_sbuf)) < 0) {
-		log_msg(NULL, "Cannot get status of %s to update RTAS events",
-			platform_log);
-		goto cleanup;
-	}
-
-	/* nothing to do if file size is zero */
-	if (log_sbuf.st_size == 0)
-		goto cleanup;
-
-	if ((log_mmap = mmap(0, log_sbuf.st_size, PROT_READ, MAP_PRIVATE,
-			     platform_log_fd, 0)) == (char *)-1) {
-		log_msg(NULL, "Cannot map %s to update RTAS events, %s",
-			platform_log, strerror(errno));
-		log_mmap = NULL;
-		goto cleanup;
-	}
-
-	log_p = log_mmap;
-	log_mmap_end = log_mmap + log_sbuf.st_size;
-
-	/* find the last RTAS event in /var/log/platform */
-	last_p = NULL;
-	log_p = find_rtas_start(log_p, log_mmap_end);
-	while (log_p != NULL) {
-		last_p = log_p;
-		log_p = find_rtas_start(log_p + sizeof(RTAS_START),
-					log_mmap_end);
-	}
-
-	if (last_p == NULL)
-		last_rtas_log_no = 0;
-	else
-		last_rtas_log_no = get_rtas_no(last_p);
-
-	/* We're finished with /var/log/platform; unamp it */
-	munmap(log_mmap, log_sbuf.st_size);
-	log_mmap = NULL;
-
-	/* find the last RTAS event in syslog */
-	last_p = NULL;
-	msgs_p = find_rtas_start(msgs_p, msgs_mmap_end);
-	while (msgs_p != NULL) {
-		last_p = msgs_p;
-		msgs_p = find_rtas_start(msgs_p + strlen(RTAS_START),
-					 msgs_mmap_end);
-	}
-
-	if (last_p == NULL) {
-		dbg("%s does not contain any RTAS events", messages_log);
-		goto cleanup;
+	if (have_ckpt && ckpt.inode == msgs_sbuf.st_ino &&
+	    ckpt.offset <= msgs_sbuf.st_size) {
+		if (ckpt.offset > CKPT_REWIND)
+			scan_start = ckpt.offset - CKPT_REWIND;
+
+		dbg("Resuming search of %s at offset %lld", messages_log,
+		    (long long)scan_start);
+		rtas_msgs_start = find_rtas_start(msgs_mmap + scan_start,
+						  msgs_mmap_end);
+	} else {
+		/* syslog was rotated (or there is no usable checkpoint),
+		 * go backwards from the end until we reach events that
+		 * have already been handled.
+		 */
+		dbg("Searching %s backwards from the end", messages_log);
+		rtas_msgs_start = NULL;
+		p = find_rtas_start_rev(msgs_mmap, msgs_mmap_end);
+		while (p != NULL && get_rtas_no(p) > last_rtas_log_no) {
+			rtas_msgs_start = p;
+			p = find_rtas_start_rev(msgs_mmap, p);
+		}
 	}
 
-	last_rtas_msgs_no = get_rtas_no(last_p);
-
-	if (last_rtas_log_no >= last_rtas_msgs_no)
-		goto cleanup;
-
 	/*
-	 *  If we get here we know there are some events that have not
+	 *  If we find events after the last handled one, they have not
 	 *  been processed by rtas_errd, process them now.  NOTE:  There
 	 *  are scenarios in which we will process events that have 
 	 *  already been processed.  There is not much we can do about
@@ -319,19 +663,25 @@ update_rtas_msgs(void)
 	/* Move to the first event that has not been handled so we
 	 * can process them in order.
 	 */
-	cur_rtas_no = 0;
-	rtas_msgs_start = msgs_mmap;
-	while (cur_rtas_no <= last_rtas_log_no) {
+	while (rtas_msgs_start != NULL) {
+		cur_rtas_no = get_rtas_no(rtas_msgs_start);
+		if (cur_rtas_no > last_rtas_log_no)
+			break;
 		rtas_msgs_start =
 			find_rtas_start(rtas_msgs_start + strlen(RTAS_START),
 					msgs_mmap_end);
-		cur_rtas_no = get_rtas_no(rtas_msgs_start);
+	}
+
+	if (rtas_msgs_start == NULL) {
+		dbg("%s does not contain any unhandled RTAS events",
+		    messages_log);
+		goto cleanup;
 	}
 
 	rtas_msgs_end = find_rtas_end(rtas_msgs_start, msgs_mmap_end);
 
 	/* Retrieve RTAS events from syslog */
-	while (rtas_msgs_start != NULL) {
+	while (rtas_msgs_start != NULL && rtas_msgs_end != NULL) {
 		struct event event;
 		unsigned long	*out_buf;
 		char		*tmp = rtas_msgs_start;
@@ -372,21 +722,8 @@ update_rtas_msgs(void)
 		/* Initializethe fields of the rtas event */
 		event.seq_num = cur_rtas_no;
 
-		event.rtas_event = parse_rtas_event(event.event_buf,
-						    RTAS_ERROR_LOG_MAX);
-		if (event.rtas_event == NULL) {
-			log_msg(NULL, "Could not update RTAS Event %d to %s",
-				cur_rtas_no, platform_log);
-		} else {
-			log_msg(NULL, "Updating RTAS event %d to %s",
-				cur_rtas_no, platform_log);
-
-			event.rtas_hdr =
-				rtas_get_event_hdr_scn(event.rtas_event);
-			event.length = event.rtas_hdr->ext_log_length + 8;
-
-			handle_rtas_event(&event);
-		}
+		if (handle_recovered_event(&event) == 0)
+			last_rtas_log_no = cur_rtas_no;
 
 		rtas_msgs_start = find_rtas_start(rtas_msgs_end, msgs_mmap_end);
 		rtas_msgs_end = find_rtas_end(rtas_msgs_start, msgs_mmap_end);
@@ -398,5 +735,10 @@ cleanup:
 	if (msgs_log_fd != -1)
 		close(msgs_log_fd);
 
+	/* Start the checkpoint at the current end of syslog */
+	if (!have_ckpt)
+		checkpoint_handled(last_rtas_log_no);
+	checkpoint_flushed();
+
 	return;
 }
@@ -222,7 +222,7 @@ report_src(struct event *event, struct rtas_priv_hdr_scn *privhdr,
 	int rc = 0;
 	char *msg;
 
-	src = rtas_get_src_scn(event->rtas_event);
+	src = event_scn(event, RTAS_PSRC_SCN);
 	if (src == NULL) {
 		log_msg(event, "Could not retrieve SRC section to handle "
 			"event, skipping");
@@ -333,7 +333,7 @@ report_menugoal(struct event *event, struct rtas_priv_hdr_scn *privhdr,
 		struct rtas_epow_scn *epow;
 		struct rtas_src_scn *src;
 
-		epow = rtas_get_epow_scn(event->rtas_event);
+		epow = event_scn(event, RTAS_EPOW_SCN);
 
 		/* This menu goal is a result of V6 log marked as an error, */
 		/* and the action is customer notifiy only. Include any/all */
@@ -392,7 +392,7 @@ report_menugoal(struct event *event, struct rtas_priv_hdr_scn *privhdr,
 					  MSGMENUGPEL_ERROR, msg);
 		}
 
-		src = rtas_get_src_scn(event->rtas_event);
+		src = event_scn(event, RTAS_PSRC_SCN);
 
 		if (src != NULL && strlen(src->primary_refcode)) {
 			struct rtas_fru_scn *fru;
@@ -552,7 +552,7 @@ process_v6(struct event *event)
 	event->sl_entry->type = SL_TYPE_RTAS;
 	event->sl_entry->severity = servicelog_sev(event->rtas_hdr->severity);
 
-	mt = rtas_get_mt_scn(event->rtas_event);
+	mt = event_scn(event, RTAS_MT_SCN);
 	if (mt != NULL) {
 		event->sl_entry->machine_model =
 				malloc(strlen(mt->mtms.model)+1);
@@ -575,7 +575,7 @@ process_v6(struct event *event)
 	 * set in either report_src or report_menugoal later
 	 */
 
-	exthdr = rtas_get_event_exthdr_scn(event->rtas_event);
+	exthdr = event_scn(event, RTAS_EVENT_EXT_HDR);
 	if (exthdr == NULL) {
 		log_msg(event, "Could not retrieve RTAS extended header "
 			"section.");
@@ -600,7 +600,7 @@ process_v6(struct event *event)
 	/* populate the "additional data" section of the servicelog entry */
 	rtas_data->event_type = event->rtas_hdr->type;
 
-	privhdr = rtas_get_priv_hdr_scn(event->rtas_event);
+	privhdr = event_scn(event, RTAS_PRIV_HDR_SCN);
 	if (privhdr == NULL) {
 		log_msg(event, "No PH (private header) section in this v6 "
 			"RTAS event; strange, but not an error.");
@@ -609,7 +609,7 @@ process_v6(struct event *event)
 		rtas_data->creator_id = privhdr->creator_id;
 	}
 
-	usrhdr = rtas_get_usr_hdr_scn(event->rtas_event);
+	usrhdr = event_scn(event, RTAS_USR_HDR_SCN);
 	if (usrhdr == NULL) {
 		log_msg(event, "No UH (user header) section in this v6 "
 			"RTAS event; strange, but not an error.");
@@ -629,7 +629,7 @@ process_v6(struct event *event)
 	 * if a "primary SRC" section exists, this is an SRC; otherwise, it
 	 * is a menugoal
 	 */
-	srchdr = rtas_get_src_scn(event->rtas_event);
+	srchdr = event_scn(event, RTAS_PSRC_SCN);
 	if (srchdr != NULL)
 		report_src(event, privhdr, usrhdr);
 	else